@@ -0,0 +1,330 @@
+/*
+ * Replay a trace.c access log against set-associative LRU cache and TLB
+ * models to predict miss rates for a given geometry and page size.
+ *
+ *   gcc -O3 -mavx2 -pthread -DDAGGER_TRACE -o dataset_stream dataset_stream.c
+ *   DAGGER_TRACE_FILE=items.trace DAGGER_TRACE_SAMPLE=1 ./dataset_stream dataset ...
+ *   gcc -O2 -o access_sim access_sim.c
+ *   ./access_sim items.trace --cache 48K:12 --cache 2M:16 --cache 32M:16 --page-size 4K --page-size 2M
+ *
+ * Each region (cache, dataset, shard) is mapped at its own 1 TB aligned
+ * virtual base and addresses are used as physical ones, i.e. page colouring
+ * and the physical-index hash of real LLCs are not modelled.  Blocks of
+ * different threads are replayed one after another in file order, which
+ * models one core's private caches seeing all threads' misses; for a shared
+ * LLC that is the right picture, for L1/L2 run with one thread.  With
+ * DAGGER_TRACE_SAMPLE > 1 the accesses between sampled units are missing, so
+ * rates are pessimistic for caches that would have kept them.
+ */
+
+#include <getopt.h>
+
+#include "trace.c"
+
+#define SIM_MAX_LEVELS 8
+#define SIM_MAX_PAGE_SIZES 8
+#define SIM_REGION_SHIFT 40
+
+static const char *sim_region_names[TRACE_MARKER] = {"cache", "dataset", "shard"};
+static const char *sim_unit_names[TRACE_UNITS] = {"item", "mask", "hash"};
+
+// One set-associative LRU level; each set is kept in MRU-first order.
+struct sim_level {
+    uint64_t size;
+    uint64_t ways;
+    uint64_t block; // line or page size
+    uint64_t sets;
+    uint64_t *tags; // key + 1, 0 is empty
+    uint64_t accesses;
+    uint64_t misses;
+    uint64_t region_misses[TRACE_MARKER];
+};
+
+static int sim_level_init(struct sim_level *l, uint64_t entries, uint64_t ways, uint64_t block) {
+    if (ways == 0 || entries < ways || entries % ways != 0) {
+        return (-1);
+    }
+    l->ways = ways;
+    l->block = block;
+    l->sets = entries / ways;
+    l->size = entries * block;
+    l->tags = (uint64_t *)calloc(entries, sizeof(uint64_t));
+    return (l->tags == NULL ? -1 : 0);
+}
+
+// Returns 1 on a hit.  A miss inserts key as the MRU entry of its set.
+static int sim_level_access(struct sim_level *l, uint64_t key, unsigned region) {
+    uint64_t *set = l->tags + (key % l->sets) * l->ways;
+    uint64_t tag = key + 1;
+    uint64_t w = 0;
+    l->accesses++;
+    while (w < l->ways && set[w] != tag) {
+        w++;
+    }
+    int hit = w < l->ways;
+    if (!hit) {
+        l->misses++;
+        l->region_misses[region]++;
+        w = l->ways - 1;
+    }
+    memmove(set + 1, set, w * sizeof(uint64_t));
+    set[0] = tag;
+    return (hit);
+}
+
+// An access walks down the levels until one hits; every level that missed keeps the key.
+static void sim_hierarchy_access(struct sim_level *levels, int n, uint64_t addr, unsigned region) {
+    for (int k = 0; k < n; k++) {
+        if (sim_level_access(&levels[k], addr / levels[k].block, region)) {
+            return;
+        }
+    }
+}
+
+struct sim_config {
+    struct sim_level caches[SIM_MAX_LEVELS];
+    int ncaches;
+    uint64_t tlb_entries[SIM_MAX_LEVELS];
+    uint64_t tlb_ways[SIM_MAX_LEVELS];
+    int ntlbs;
+    uint64_t page_sizes[SIM_MAX_PAGE_SIZES];
+    int npage_sizes;
+    struct sim_level tlbs[SIM_MAX_PAGE_SIZES][SIM_MAX_LEVELS];
+};
+
+struct sim_stats {
+    uint64_t units[TRACE_UNITS];
+    uint64_t accesses[TRACE_MARKER];
+    uint64_t blocks;
+};
+
+static void sim_access(struct sim_config *c, const struct trace_header *h, unsigned region, uint64_t row) {
+    uint64_t bytes = h->row_bytes[region];
+    uint64_t addr = ((uint64_t)(region + 1) << SIM_REGION_SHIFT) + row * bytes;
+    uint64_t line = c->caches[0].block;
+    for (uint64_t a = addr / line * line; a < addr + bytes; a += line) {
+        sim_hierarchy_access(c->caches, c->ncaches, a, region);
+    }
+    for (int p = 0; p < c->npage_sizes; p++) {
+        uint64_t page = c->page_sizes[p];
+        for (uint64_t a = addr / page * page; a < addr + bytes; a += page) {
+            sim_hierarchy_access(c->tlbs[p], c->ntlbs, a, region);
+        }
+    }
+}
+
+static int sim_replay(struct sim_config *c, FILE *f, struct trace_header *h, struct sim_stats *st) {
+    unsigned char *data = (unsigned char *)malloc(TRACE_BUFFER_BYTES);
+    struct trace_block b;
+    int ret = 0;
+    while (fread(&b, sizeof(b), 1, f) == 1) {
+        if (b.bytes > TRACE_BUFFER_BYTES || fread(data, 1, b.bytes, f) != b.bytes) {
+            fprintf(stderr, "truncated trace block %llu\n", (unsigned long long)st->blocks);
+            ret = -1;
+            break;
+        }
+        st->blocks++;
+        int64_t last[TRACE_MARKER] = {0};
+        uint64_t pos = 0;
+        for (uint64_t e = 0; e < b.events; e++) {
+            uint64_t v = 0;
+            for (unsigned shift = 0; pos < b.bytes; shift += 7) {
+                unsigned char byte = data[pos++];
+                v |= (uint64_t)(byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                    break;
+                }
+            }
+            unsigned region = v & 3;
+            v >>= 2;
+            if (region == TRACE_MARKER) {
+                if (v < TRACE_UNITS) {
+                    st->units[v]++;
+                }
+                continue;
+            }
+            int64_t delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            last[region] += delta;
+            st->accesses[region]++;
+            sim_access(c, h, region, (uint64_t)last[region]);
+        }
+    }
+    free(data);
+    return (ret);
+}
+
+static const char *sim_format_size(uint64_t v, char *buf, size_t len) {
+    static const char units[] = "KMGT";
+    int u = -1;
+    while (u < 3 && v >= 1024 && v % 1024 == 0) {
+        v /= 1024;
+        u++;
+    }
+    snprintf(buf, len, u < 0 ? "%lluB" : "%llu%c", (unsigned long long)v, u < 0 ? 0 : units[u]);
+    return (buf);
+}
+
+static void sim_print_level(const char *label, const struct sim_level *l, uint64_t units) {
+    char size[32];
+    printf("  %s %s %llu-way: %llu accesses, %llu misses (%0.2f%%)", label, sim_format_size(l->size, size, sizeof(size)),
+           (unsigned long long)l->ways, (unsigned long long)l->accesses, (unsigned long long)l->misses,
+           l->accesses ? 100.0 * l->misses / l->accesses : 0);
+    if (units > 0) {
+        printf(", %0.2f per unit", (double)l->misses / units);
+    }
+    for (int r = 0; r < TRACE_MARKER; r++) {
+        if (l->region_misses[r] > 0 && l->region_misses[r] != l->misses) {
+            printf(", %s %llu", sim_region_names[r], (unsigned long long)l->region_misses[r]);
+        }
+    }
+    printf("\n");
+}
+
+static uint64_t parse_size(const char *s, char **end) {
+    uint64_t v = strtoull(s, end, 0);
+    switch (**end) {
+    case 'K': case 'k': v <<= 10; (*end)++; break;
+    case 'M': case 'm': v <<= 20; (*end)++; break;
+    case 'G': case 'g': v <<= 30; (*end)++; break;
+    }
+    return (v);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s TRACE [options]\n"
+            "  --cache SIZE:WAYS[:LINE]  cache level, outermost last (default 48K:12 2M:16 32M:16, 64B lines)\n"
+            "  --tlb ENTRIES:WAYS        TLB level, outermost last (default 64:4 2048:16)\n"
+            "  --page-size SIZE          page size to model, repeatable (default 4K 2M 1G)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"cache", required_argument, 0, 'c'},
+        {"tlb", required_argument, 0, 't'},
+        {"page-size", required_argument, 0, 'p'},
+        {0, 0, 0, 0},
+    };
+    struct sim_config c;
+    memset(&c, 0, sizeof(c));
+
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return (1);
+    }
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        char *end;
+        uint64_t a, b, line = 64;
+        switch (opt) {
+        case 'c':
+            a = parse_size(optarg, &end);
+            b = *end == ':' ? strtoull(end + 1, &end, 0) : 0;
+            if (*end == ':') {
+                line = parse_size(end + 1, &end);
+            }
+            if (c.ncaches == SIM_MAX_LEVELS || line == 0 || a % line != 0 ||
+                sim_level_init(&c.caches[c.ncaches], a / line, b, line) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            c.ncaches++;
+            break;
+        case 't':
+            a = strtoull(optarg, &end, 0);
+            b = *end == ':' ? strtoull(end + 1, &end, 0) : 0;
+            if (c.ntlbs == SIM_MAX_LEVELS || b == 0 || a < b || a % b != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            c.tlb_entries[c.ntlbs] = a;
+            c.tlb_ways[c.ntlbs++] = b;
+            break;
+        case 'p':
+            a = parse_size(optarg, &end);
+            if (c.npage_sizes == SIM_MAX_PAGE_SIZES || a == 0 || (a & (a - 1)) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            c.page_sizes[c.npage_sizes++] = a;
+            break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (c.ncaches == 0) {
+        sim_level_init(&c.caches[0], 48 << 10 >> 6, 12, 64);
+        sim_level_init(&c.caches[1], 2 << 20 >> 6, 16, 64);
+        sim_level_init(&c.caches[2], 32 << 20 >> 6, 16, 64);
+        c.ncaches = 3;
+    }
+    for (int k = 1; k < c.ncaches; k++) {
+        if (c.caches[k].block != c.caches[0].block) {
+            fprintf(stderr, "all cache levels must use the same line size\n");
+            return (1);
+        }
+    }
+    if (c.ntlbs == 0) {
+        c.tlb_entries[0] = 64;
+        c.tlb_ways[0] = 4;
+        c.tlb_entries[1] = 2048;
+        c.tlb_ways[1] = 16;
+        c.ntlbs = 2;
+    }
+    if (c.npage_sizes == 0) {
+        c.page_sizes[0] = 4 << 10;
+        c.page_sizes[1] = 2 << 20;
+        c.page_sizes[2] = 1 << 30;
+        c.npage_sizes = 3;
+    }
+    for (int p = 0; p < c.npage_sizes; p++) {
+        for (int k = 0; k < c.ntlbs; k++) {
+            sim_level_init(&c.tlbs[p][k], c.tlb_entries[k], c.tlb_ways[k], c.page_sizes[p]);
+        }
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    struct trace_header h;
+    if (f == NULL || fread(&h, sizeof(h), 1, f) != 1 || h.magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s is not a dagger trace\n", argv[1]);
+        return (1);
+    }
+    struct sim_stats st;
+    memset(&st, 0, sizeof(st));
+    int ret = sim_replay(&c, f, &h, &st);
+    fclose(f);
+
+    uint64_t units = 0;
+    printf("%s: %llu blocks, 1 in %u units sampled\n", argv[1], (unsigned long long)st.blocks, h.sample);
+    for (int u = 0; u < TRACE_UNITS; u++) {
+        if (st.units[u] > 0) {
+            printf("  %llu %s units\n", (unsigned long long)st.units[u], sim_unit_names[u]);
+            units += st.units[u];
+        }
+    }
+    for (int r = 0; r < TRACE_MARKER; r++) {
+        if (st.accesses[r] > 0) {
+            printf("  %llu %s row accesses of %u bytes\n", (unsigned long long)st.accesses[r], sim_region_names[r],
+                   h.row_bytes[r]);
+        }
+    }
+    char label[64];
+    printf("caches, %lluB lines:\n", (unsigned long long)c.caches[0].block);
+    for (int k = 0; k < c.ncaches; k++) {
+        snprintf(label, sizeof(label), "L%d", k + 1);
+        sim_print_level(label, &c.caches[k], units);
+    }
+    const struct sim_level *llc = &c.caches[c.ncaches - 1];
+    printf("  memory traffic %0.2f MB, %0.0f bytes per unit\n", llc->misses * llc->block / 1e6,
+           units ? (double)llc->misses * llc->block / units : 0);
+    for (int p = 0; p < c.npage_sizes; p++) {
+        char page[32];
+        printf("TLBs, %s pages (size is reach):\n", sim_format_size(c.page_sizes[p], page, sizeof(page)));
+        for (int k = 0; k < c.ntlbs; k++) {
+            snprintf(label, sizeof(label), "TLB%d %llu entries", k + 1, (unsigned long long)c.tlb_entries[k]);
+            sim_print_level(label, &c.tlbs[p][k], units);
+        }
+    }
+    return (ret == 0 ? 0 : 1);
+}
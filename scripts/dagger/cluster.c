@@ -0,0 +1,1063 @@
+/*
+ * Mine with several processes on one host: a coordinator and its workers.
+ *
+ *   gcc -O3 -march=native -pthread cluster.c -o cluster
+ *   ./cluster verify
+ *   ./cluster run --shards 8 --shard-size 1073741824 --hold 0-3@0-15 --hold 4-7@16-31 --seconds 600
+ *   ./cluster run ... --no-spawn      # then start each worker yourself, e.g.
+ *   numactl --cpunodebind=1 --membind=1 ./cluster worker --shm /dagger-cluster-1234 --id 1
+ *
+ * Each worker is a process of its own, typically one per NUMA node or per
+ * disk, and holds a range of shards (--hold FIRST-LAST[@CPUS], one per
+ * worker): it pins itself to CPUS and maps only those shards, either its
+ * slice of --data (the whole dataset as `dataset_stream dataset` writes it,
+ * shard s at byte s * shard_size) or, without --data, by building the slice
+ * from its own cache, which first-touch places on the worker's node.  A
+ * candidate of shard s is SHA512 of the 16 bytes {s, nonce}, hashed against
+ * that shard alone; nonces whose digest's first 8 bytes, read as a
+ * little-endian word, are below 2^64 / --diff are printed.
+ *
+ * Everything between the processes goes through one shared memory object
+ * (shm_open) holding two bounded lock-free rings per worker: commands from
+ * the coordinator (ASSIGN a shard range, WORK on a nonce range of a shard,
+ * STOP) and results from the worker's threads (READY, DONE with the time
+ * spent, FOUND, FAILED).  The rings are the multi-producer, multi-consumer
+ * queue of sequence-numbered cells, so a worker's threads take work straight
+ * from the ring without a dispatcher, and nothing ever blocks in the kernel
+ * except an idle side backing off.
+ *
+ * The coordinator owns the nonce space of every shard and hands it out in
+ * disjoint batches.  Each batch is sized to about --slice seconds of one
+ * thread of the receiving worker, from the rate its DONE reports measured,
+ * and every worker is kept --depth batches per thread ahead, so a slow node
+ * is never handed more than it can finish and a fast one never runs dry.  A
+ * worker's next batch goes to the shard it holds that has received the
+ * fewest nonces so far, so shards held by several workers shift to whichever
+ * has the capacity.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+
+#define CLUSTER_MAGIC 0x3152545355474144ULL // "DAGUSTR1"
+#define CLUSTER_RING 1024                   // cells per ring, a power of two
+#define CLUSTER_MAX_WORKERS 64
+
+enum cluster_msg_type {
+    CLUSTER_ASSIGN, // coordinator: map shards [shard, shard + count)
+    CLUSTER_WORK,   // coordinator: hash nonces [nonce, nonce + count) of shard
+    CLUSTER_STOP,   // coordinator: one thread exits
+    CLUSTER_READY,  // worker: shards [shard, shard + count) are mapped
+    CLUSTER_DONE,   // worker: a WORK batch is hashed, in ns
+    CLUSTER_FOUND,  // worker: nonce of shard meets the target
+    CLUSTER_FAILED, // worker: an ASSIGN or WORK could not be carried out
+};
+
+struct cluster_msg {
+    uint32_t type;
+    uint32_t worker;
+    uint64_t shard;
+    uint64_t count;
+    uint64_t nonce;
+    uint64_t ns;
+    unsigned char digest[32];
+};
+
+struct cluster_cell {
+    _Atomic uint64_t seq;
+    struct cluster_msg msg;
+};
+
+struct cluster_ring {
+    _Atomic uint64_t head __attribute__((aligned(64))); // next cell to pop
+    _Atomic uint64_t tail __attribute__((aligned(64))); // next cell to push
+    struct cluster_cell cells[CLUSTER_RING] __attribute__((aligned(64)));
+};
+
+struct cluster_slot {
+    _Atomic uint64_t pid; // set by the worker once attached
+    _Atomic uint64_t threads;
+    struct cluster_ring cmd; // coordinator -> worker threads
+    struct cluster_ring res; // worker threads -> coordinator
+};
+
+// The shared memory object: parameters, then one slot per worker.
+struct cluster_header {
+    uint64_t magic;
+    uint64_t size;
+    uint64_t workers;
+    uint64_t shards;
+    uint64_t shard_size;
+    uint64_t cache_size;
+    uint64_t target; // first digest word must be below this
+    uint64_t coordinator;
+    char seed[64];
+    char data[256]; // dataset file, empty to build shards from the cache
+    _Atomic uint64_t stop;
+    struct cluster_slot slot[] __attribute__((aligned(64)));
+};
+
+void cluster_ring_init(struct cluster_ring *r) {
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    for (uint64_t i = 0; i < CLUSTER_RING; i++) {
+        atomic_init(&r->cells[i].seq, i);
+    }
+}
+
+// 0 if pushed, -1 if the ring is full.  Any number of threads and processes may push.
+int cluster_push(struct cluster_ring *r, const struct cluster_msg *msg) {
+    uint64_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    struct cluster_cell *cell;
+    for (;;) {
+        cell = &r->cells[pos % CLUSTER_RING];
+        int64_t dif = (int64_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return (-1);
+        } else {
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+    cell->msg = *msg;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return (0);
+}
+
+// 0 if a message was popped, -1 if the ring is empty.  Any number of threads and processes may pop.
+int cluster_pop(struct cluster_ring *r, struct cluster_msg *msg) {
+    uint64_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct cluster_cell *cell;
+    for (;;) {
+        cell = &r->cells[pos % CLUSTER_RING];
+        int64_t dif = (int64_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + 1));
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return (-1);
+        } else {
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+    *msg = cell->msg;
+    atomic_store_explicit(&cell->seq, pos + CLUSTER_RING, memory_order_release);
+    return (0);
+}
+
+// Spin briefly, then sleep: an idle side costs nothing, a busy one no syscalls.
+static void cluster_backoff(unsigned *idle) {
+    if (++*idle < 64) {
+        __builtin_ia32_pause();
+    } else if (*idle < 128) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static uint64_t cluster_shm_size(uint64_t workers) {
+    return (sizeof(struct cluster_header) + workers * sizeof(struct cluster_slot));
+}
+
+// Create (create != 0) or attach to the shared memory object name.
+struct cluster_header *cluster_map(const char *name, uint64_t workers, int create) {
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open shared memory %s: %s\n", name, strerror(errno));
+        return (NULL);
+    }
+    uint64_t size = cluster_shm_size(workers);
+    if (!create) {
+        struct stat st;
+        size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    } else if (ftruncate(fd, size) != 0) {
+        fprintf(stderr, "cannot size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return (NULL);
+    }
+    struct cluster_header *hdr = size >= sizeof(*hdr) ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        fprintf(stderr, "cannot map shared memory %s\n", name);
+        return (NULL);
+    }
+    if (create) {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->size = size;
+        hdr->workers = workers;
+        for (uint64_t w = 0; w < workers; w++) {
+            atomic_init(&hdr->slot[w].pid, 0);
+            atomic_init(&hdr->slot[w].threads, 0);
+            cluster_ring_init(&hdr->slot[w].cmd);
+            cluster_ring_init(&hdr->slot[w].res);
+        }
+    } else if (hdr->magic != CLUSTER_MAGIC || hdr->size != size || cluster_shm_size(hdr->workers) != size) {
+        fprintf(stderr, "%s is not a cluster shared memory object\n", name);
+        munmap(hdr, size);
+        return (NULL);
+    }
+    return (hdr);
+}
+
+// Parse a CPU list such as "0-3,8,10-11".
+int cluster_parse_cpus(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        unsigned long a = strtoul(s, &end, 10), b = a;
+        if (end == s) {
+            return (-1);
+        }
+        if (*end == '-') {
+            s = end + 1;
+            b = strtoul(s, &end, 10);
+            if (end == s || b < a) {
+                return (-1);
+            }
+        }
+        for (unsigned long c = a; c <= b && c < CPU_SETSIZE; c++) {
+            CPU_SET(c, set);
+        }
+        s = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != 0) {
+            return (-1);
+        }
+    }
+    return (CPU_COUNT(set) > 0 ? 0 : -1);
+}
+
+/*
+ * Worker side.
+ */
+
+struct cluster_node {
+    struct cluster_header *hdr;
+    struct cluster_slot *slot;
+    uint32_t id;
+    const struct dagger_profile *profile;
+    unsigned char *cache;
+    unsigned char **shard; // data of every held shard, NULL elsewhere
+    void **maps;           // mapping starting at each assigned range, to unmap
+    uint64_t *map_len;
+    pthread_mutex_t lock;  // ASSIGN
+};
+
+static int cluster_coordinator_gone(struct cluster_header *hdr) {
+    return (atomic_load_explicit(&hdr->stop, memory_order_acquire) ||
+            (kill((pid_t)hdr->coordinator, 0) != 0 && errno == ESRCH));
+}
+
+// Results must not be lost: wait for room while the coordinator is there to drain.
+static int cluster_report(struct cluster_node *n, struct cluster_msg *msg) {
+    unsigned idle = 0;
+    msg->worker = n->id;
+    while (cluster_push(&n->slot->res, msg) != 0) {
+        if (idle > 1024 && cluster_coordinator_gone(n->hdr)) {
+            return (-1);
+        }
+        cluster_backoff(&idle);
+    }
+    return (0);
+}
+
+int cluster_assign(struct cluster_node *n, uint64_t first, uint64_t count) {
+    struct cluster_header *hdr = n->hdr;
+    if (count == 0 || first >= hdr->shards || count > hdr->shards - first) {
+        return (-1);
+    }
+    uint64_t len = count * hdr->shard_size;
+    unsigned char *base;
+    pthread_mutex_lock(&n->lock);
+    if (n->maps[first] != NULL) {
+        pthread_mutex_unlock(&n->lock);
+        return (0);
+    }
+    if (hdr->data[0] != 0) {
+        int fd = open(hdr->data, O_RDONLY);
+        base = fd < 0 ? MAP_FAILED : mmap(NULL, len, PROT_READ, MAP_SHARED, fd, first * hdr->shard_size);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "worker %u: cannot map shards %llu-%llu of %s: %s\n", n->id, (unsigned long long)first,
+                    (unsigned long long)(first + count - 1), hdr->data, strerror(errno));
+            pthread_mutex_unlock(&n->lock);
+            return (-1);
+        }
+        madvise(base, len, MADV_RANDOM);
+    } else {
+        // built here, so the pages are local to the CPUs this worker runs on
+        if (n->cache == NULL) {
+            n->cache = generate_cache(hdr->cache_size, (unsigned char *)hdr->seed, strlen(hdr->seed));
+        }
+        base = n->cache != NULL ? alloc_dataset(len, n->profile->huge_pages) : NULL;
+        if (base == NULL) {
+            fprintf(stderr, "worker %u: cannot allocate %llu bytes of shards\n", n->id, (unsigned long long)len);
+            pthread_mutex_unlock(&n->lock);
+            return (-1);
+        }
+        uint64_t first_item = first * hdr->shard_size / HASH_BYTES;
+        for (uint64_t k = 0; k < len / HASH_BYTES; k++) {
+            calculate_dataset_item_opt(n->cache, hdr->cache_size, first_item + k, base + k * HASH_BYTES);
+        }
+    }
+    n->maps[first] = base;
+    n->map_len[first] = len;
+    for (uint64_t s = 0; s < count; s++) {
+        n->shard[first + s] = base + s * hdr->shard_size;
+    }
+    pthread_mutex_unlock(&n->lock);
+    return (0);
+}
+
+// Hash nonces [nonce, nonce + count) of a held shard, reporting what meets the target.
+int cluster_mine(struct cluster_node *n, uint64_t shard, uint64_t nonce, uint64_t count) {
+    struct cluster_header *hdr = n->hdr;
+    unsigned char *data = shard < hdr->shards ? n->shard[shard] : NULL;
+    if (data == NULL) {
+        return (-1);
+    }
+    uint64_t batch = n->profile->hashimoto_batch < HASHIMOTO_MAX_BATCH ? n->profile->hashimoto_batch : HASHIMOTO_MAX_BATCH;
+    unsigned char hashes[HASH_BYTES * HASHIMOTO_MAX_BATCH];
+    uint32_t mixes[MIX_BYTES / 4 * HASHIMOTO_MAX_BATCH] __attribute__((aligned(32)));
+    for (uint64_t done = 0; done < count; done += batch) {
+        uint64_t m = count - done < batch ? count - done : batch;
+        for (uint64_t l = 0; l < m; l++) {
+            uint64_t in[2] = {shard, nonce + done + l};
+            SHA512((unsigned char *)in, sizeof(in), hashes + l * HASH_BYTES);
+        }
+        hashimoto_interleaved(hashes, m, hdr->shard_size, data, mixes, n->profile->prefetch);
+        for (uint64_t l = 0; l < m; l++) {
+            uint64_t head;
+            memcpy(&head, mixes + l * MIX_BYTES / 4, 8);
+            if (head >= hdr->target) {
+                continue;
+            }
+            struct cluster_msg found = {.type = CLUSTER_FOUND, .shard = shard, .nonce = nonce + done + l};
+            memcpy(found.digest, mixes + l * MIX_BYTES / 4, sizeof(found.digest));
+            if (cluster_report(n, &found) != 0) {
+                return (-1);
+            }
+        }
+    }
+    return (0);
+}
+
+static void *cluster_node_thread(void *arg) {
+    struct cluster_node *n = arg;
+    struct cluster_msg msg;
+    unsigned idle = 0;
+    for (;;) {
+        if (cluster_pop(&n->slot->cmd, &msg) != 0) {
+            if (idle % 1024 == 1023 && cluster_coordinator_gone(n->hdr)) {
+                break;
+            }
+            cluster_backoff(&idle);
+            continue;
+        }
+        idle = 0;
+        if (msg.type == CLUSTER_STOP) {
+            break;
+        }
+        struct cluster_msg reply = msg;
+        uint64_t t0 = metrics_now();
+        int ret = -1;
+        if (msg.type == CLUSTER_ASSIGN) {
+            ret = cluster_assign(n, msg.shard, msg.count);
+            reply.type = CLUSTER_READY;
+        } else if (msg.type == CLUSTER_WORK) {
+            ret = cluster_mine(n, msg.shard, msg.nonce, msg.count);
+            reply.type = CLUSTER_DONE;
+        }
+        reply.ns = metrics_now() - t0;
+        if (ret != 0) {
+            reply.type = CLUSTER_FAILED;
+            reply.nonce = msg.type;
+        }
+        if (cluster_report(n, &reply) != 0) {
+            break;
+        }
+    }
+    return (NULL);
+}
+
+// Run worker id of the cluster at name with threads threads (0: one per CPU it may use) until stopped.
+int cluster_worker(const char *name, uint32_t id, int threads, const char *cpus) {
+    struct cluster_header *hdr = cluster_map(name, 0, 0);
+    if (hdr == NULL) {
+        return (-1);
+    }
+    if (id >= hdr->workers) {
+        fprintf(stderr, "worker %u: the cluster has %llu workers\n", id, (unsigned long long)hdr->workers);
+        return (-1);
+    }
+    cpu_set_t set;
+    if (cpus != NULL && cpus[0] != 0) {
+        if (cluster_parse_cpus(cpus, &set) != 0 || sched_setaffinity(0, sizeof(set), &set) != 0) {
+            fprintf(stderr, "worker %u: cannot run on CPUs %s\n", id, cpus);
+            return (-1);
+        }
+    }
+    if (threads <= 0) {
+        threads = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : 1;
+    }
+
+    struct dagger_profile profile;
+    dagger_profile_load(&profile);
+    struct cluster_node n;
+    memset(&n, 0, sizeof(n));
+    n.hdr = hdr;
+    n.slot = &hdr->slot[id];
+    n.id = id;
+    n.profile = &profile;
+    n.shard = calloc(hdr->shards, sizeof(*n.shard));
+    n.maps = calloc(hdr->shards, sizeof(*n.maps));
+    n.map_len = calloc(hdr->shards, sizeof(*n.map_len));
+    pthread_mutex_init(&n.lock, NULL);
+    if (n.shard == NULL || n.maps == NULL || n.map_len == NULL) {
+        return (-1);
+    }
+    atomic_store(&n.slot->threads, threads);
+    atomic_store(&n.slot->pid, getpid());
+
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    if (tids == NULL) {
+        fprintf(stderr, "worker %u: out of memory\n", id);
+    }
+    for (int t = 0; tids != NULL && t < threads; t++) {
+        int err = pthread_create(&tids[started], NULL, cluster_node_thread, &n);
+        if (err != 0) {
+            fprintf(stderr, "worker %u: cannot start thread %d: %s\n", id, t, strerror(err));
+            break;
+        }
+        started++;
+    }
+    if (started < threads) {
+        // the coordinator sizes the work by this; with no thread the worker just exits
+        atomic_store(&n.slot->threads, started);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    for (uint64_t s = 0; s < hdr->shards; s++) {
+        if (n.maps[s] != NULL) {
+            munmap(n.maps[s], n.map_len[s]);
+        }
+    }
+    free(n.shard);
+    free(n.maps);
+    free(n.map_len);
+    free(n.cache);
+    munmap(hdr, hdr->size);
+    return (started > 0 ? 0 : -1);
+}
+
+/*
+ * Coordinator side.
+ */
+
+struct cluster_member {
+    uint64_t first;     // shards held
+    uint64_t count;
+    char cpus[64];
+    pid_t pid;          // 0 if started by hand, -1 if fork() failed
+    int ready;
+    int dead;
+    uint64_t threads;
+    double rate;        // hashes per second of one thread, averaged over DONE reports
+    uint64_t inflight;  // WORK batches not yet DONE
+    uint64_t hashes;
+    uint64_t found;
+};
+
+struct cluster_found {
+    uint64_t shard;
+    uint64_t nonce;
+    unsigned char digest[32];
+};
+
+struct cluster {
+    struct cluster_header *hdr;
+    struct cluster_member *members;
+    uint64_t nmembers;
+    uint64_t *issued;      // per shard: nonces handed out, also the next nonce
+    uint64_t *hashed;      // per shard: nonces reported done
+    uint64_t nonce_limit;  // per shard, 0 for none
+    double slice;          // seconds of one thread per batch
+    uint64_t depth;        // batches per thread queued ahead
+    uint64_t found;
+    struct cluster_found *record; // every FOUND, if record_cap > 0
+    uint64_t nrecord, record_cap;
+    int quiet;
+    double seconds; // spent mining, once every worker was ready
+};
+
+// Handle what the workers reported; returns the number of messages.
+uint64_t cluster_drain(struct cluster *c) {
+    uint64_t handled = 0;
+    struct cluster_msg msg;
+    for (uint64_t w = 0; w < c->nmembers; w++) {
+        struct cluster_member *m = &c->members[w];
+        while (cluster_pop(&c->hdr->slot[w].res, &msg) == 0) {
+            handled++;
+            if (msg.type == CLUSTER_READY) {
+                m->ready = 1;
+                m->threads = atomic_load(&c->hdr->slot[w].threads);
+                if (!c->quiet) {
+                    printf("worker %llu ready: shards %llu-%llu, %llu threads (%0.2fs)\n", (unsigned long long)w,
+                           (unsigned long long)msg.shard, (unsigned long long)(msg.shard + msg.count - 1),
+                           (unsigned long long)m->threads, msg.ns / 1e9);
+                }
+            } else if (msg.type == CLUSTER_DONE) {
+                double rate = msg.count / (msg.ns > 0 ? msg.ns / 1e9 : 1e-9);
+                m->rate = m->rate == 0 ? rate : 0.75 * m->rate + 0.25 * rate;
+                m->inflight -= m->inflight > 0;
+                m->hashes += msg.count;
+                c->hashed[msg.shard] += msg.count;
+                metrics_add(METRIC_HASHES, msg.count);
+                metrics_observe(METRIC_HASH_LATENCY, msg.ns / msg.count);
+            } else if (msg.type == CLUSTER_FOUND) {
+                m->found++;
+                c->found++;
+                if (c->nrecord < c->record_cap) {
+                    struct cluster_found *f = &c->record[c->nrecord++];
+                    f->shard = msg.shard;
+                    f->nonce = msg.nonce;
+                    memcpy(f->digest, msg.digest, sizeof(f->digest));
+                }
+                if (!c->quiet) {
+                    printf("shard %llu nonce %llu digest ", (unsigned long long)msg.shard, (unsigned long long)msg.nonce);
+                    for (int k = 0; k < 32; k++) {
+                        printf("%02x", msg.digest[k]);
+                    }
+                    printf(" (worker %llu)\n", (unsigned long long)w);
+                }
+            } else if (msg.type == CLUSTER_FAILED) {
+                // a worker that cannot map its shards or hash them is of no further use
+                fprintf(stderr, "worker %llu failed a %s, dropping it\n", (unsigned long long)w,
+                        msg.nonce == CLUSTER_ASSIGN ? "shard assignment" : "work batch");
+                metrics_add(METRIC_ERRORS, 1);
+                m->inflight -= msg.nonce == CLUSTER_WORK && m->inflight > 0;
+                m->dead = 1;
+            }
+        }
+    }
+    return (handled);
+}
+
+// Shard of m with the fewest nonces handed out that still has some left, or UINT64_MAX.
+static uint64_t cluster_pick_shard(struct cluster *c, const struct cluster_member *m) {
+    uint64_t best = UINT64_MAX;
+    for (uint64_t s = m->first; s < m->first + m->count; s++) {
+        if (c->nonce_limit != 0 && c->issued[s] >= c->nonce_limit) {
+            continue;
+        }
+        if (best == UINT64_MAX || c->issued[s] < c->issued[best]) {
+            best = s;
+        }
+    }
+    return (best);
+}
+
+// Keep every ready worker depth batches per thread ahead; returns the number of batches sent.
+uint64_t cluster_refill(struct cluster *c) {
+    uint64_t sent = 0;
+    for (uint64_t w = 0; w < c->nmembers; w++) {
+        struct cluster_member *m = &c->members[w];
+        if (!m->ready || m->dead) {
+            continue;
+        }
+        while (m->inflight < m->threads * c->depth) {
+            uint64_t s = cluster_pick_shard(c, m);
+            if (s == UINT64_MAX) {
+                break;
+            }
+            // until a rate is measured, small batches that report back soon
+            uint64_t count = m->rate > 0 ? (uint64_t)(m->rate * c->slice) : HASHIMOTO_MAX_BATCH;
+            count = count < 1 ? 1 : count;
+            if (c->nonce_limit != 0 && count > c->nonce_limit - c->issued[s]) {
+                count = c->nonce_limit - c->issued[s];
+            }
+            struct cluster_msg msg = {.type = CLUSTER_WORK, .worker = w, .shard = s, .nonce = c->issued[s], .count = count};
+            if (cluster_push(&c->hdr->slot[w].cmd, &msg) != 0) {
+                break;
+            }
+            c->issued[s] += count;
+            m->inflight++;
+            sent++;
+        }
+    }
+    return (sent);
+}
+
+// Notice workers that exited; returns how many are still alive.
+uint64_t cluster_reap(struct cluster *c) {
+    uint64_t alive = 0;
+    for (uint64_t w = 0; w < c->nmembers; w++) {
+        struct cluster_member *m = &c->members[w];
+        pid_t pid = m->pid != 0 ? m->pid : (pid_t)atomic_load(&c->hdr->slot[w].pid);
+        int status;
+        if (!m->dead && m->pid < 0) {
+            // fork() failed, the worker never ran
+            m->dead = 1;
+        } else if (!m->dead && m->pid > 0 && waitpid(m->pid, &status, WNOHANG) == m->pid) {
+            m->pid = 0;
+            m->dead = 1;
+        } else if (!m->dead && m->pid == 0 && pid != 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            m->dead = 1;
+        }
+        if (m->dead && m->inflight > 0) {
+            // what it reported before exiting is still in its ring
+            cluster_drain(c);
+        }
+        if (m->dead && m->inflight > 0) {
+            // its batches are lost; the nonces stay skipped
+            if (!atomic_load(&c->hdr->stop)) {
+                fprintf(stderr, "worker %llu exited with %llu batches in flight\n", (unsigned long long)w,
+                        (unsigned long long)m->inflight);
+            }
+            m->inflight = 0;
+        }
+        alive += !m->dead;
+    }
+    return (alive);
+}
+
+static double cluster_elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Assign every worker its shards, then hand out work for seconds (or until nonce_limit is reached everywhere).
+int cluster_coordinate(struct cluster *c, double seconds, double interval) {
+    for (uint64_t w = 0; w < c->nmembers; w++) {
+        struct cluster_msg msg = {.type = CLUSTER_ASSIGN, .worker = w, .shard = c->members[w].first,
+                                  .count = c->members[w].count};
+        cluster_push(&c->hdr->slot[w].cmd, &msg);
+    }
+    uint64_t alive = c->nmembers, ready = 0;
+    unsigned idle = 0;
+    while (alive > 0 && ready < alive) {
+        if (cluster_drain(c) == 0) {
+            cluster_backoff(&idle);
+        }
+        alive = cluster_reap(c);
+        ready = 0;
+        for (uint64_t w = 0; w < c->nmembers; w++) {
+            ready += c->members[w].ready && !c->members[w].dead;
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double last = 0;
+    uint64_t last_hashes = 0;
+    idle = 0;
+    while (alive > 0) {
+        uint64_t busy = cluster_drain(c);
+        alive = cluster_reap(c);
+        double now = cluster_elapsed(&start);
+        if (now >= seconds) {
+            break;
+        }
+        busy += cluster_refill(c);
+        uint64_t inflight = 0;
+        for (uint64_t w = 0; w < c->nmembers; w++) {
+            inflight += c->members[w].inflight;
+        }
+        if (busy == 0 && inflight == 0) {
+            break; // every held shard reached nonce_limit
+        }
+        if (!c->quiet && now - last >= interval) {
+            uint64_t hashes = 0;
+            printf("%7.1fs", now);
+            for (uint64_t w = 0; w < c->nmembers; w++) {
+                const struct cluster_member *m = &c->members[w];
+                hashes += m->hashes;
+                printf(m->dead ? " | w%llu dead" : " | w%llu %0.2f H/s", (unsigned long long)w, m->rate * m->threads);
+            }
+            printf(" | rate %0.2f H/s, %llu found\n", (hashes - last_hashes) / (now - last), (unsigned long long)c->found);
+            last_hashes = hashes;
+            last = now;
+        }
+        if (busy == 0) {
+            cluster_backoff(&idle);
+        } else {
+            idle = 0;
+        }
+    }
+
+    c->seconds = cluster_elapsed(&start);
+
+    // let the workers finish their batches and exit, draining as they go
+    atomic_store_explicit(&c->hdr->stop, 1, memory_order_release);
+    for (uint64_t w = 0; w < c->nmembers; w++) {
+        struct cluster_msg msg = {.type = CLUSTER_STOP, .worker = w};
+        for (uint64_t t = 0; t < c->members[w].threads; t++) {
+            cluster_push(&c->hdr->slot[w].cmd, &msg);
+        }
+    }
+    while (cluster_reap(c) > 0) {
+        if (cluster_drain(c) == 0) {
+            cluster_backoff(&idle);
+        }
+    }
+    cluster_drain(c);
+    return (0);
+}
+
+// Start worker id as a process of its own (this binary, `worker` mode).
+static pid_t cluster_spawn(const char *name, uint64_t id, int threads, const char *cpus) {
+    char id_arg[32], threads_arg[32];
+    snprintf(id_arg, sizeof(id_arg), "%llu", (unsigned long long)id);
+    snprintf(threads_arg, sizeof(threads_arg), "%d", threads);
+    char *args[] = {"cluster", "worker", "--shm", (char *)name, "--id", id_arg, "--threads", threads_arg,
+                    cpus[0] ? "--cpus" : NULL, (char *)cpus, NULL};
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv("/proc/self/exe", args);
+        fprintf(stderr, "cannot start worker %llu: %s\n", (unsigned long long)id, strerror(errno));
+        _exit(127);
+    }
+    if (pid < 0) {
+        fprintf(stderr, "cannot fork worker %llu: %s\n", (unsigned long long)id, strerror(errno));
+    }
+    return (pid);
+}
+
+int cluster_parse_hold(const char *s, struct cluster_member *m) {
+    char *end;
+    memset(m, 0, sizeof(*m));
+    m->first = strtoull(s, &end, 10);
+    uint64_t last = m->first;
+    if (end == s) {
+        return (-1);
+    }
+    if (*end == '-') {
+        s = end + 1;
+        last = strtoull(s, &end, 10);
+        if (end == s || last < m->first) {
+            return (-1);
+        }
+    }
+    m->count = last - m->first + 1;
+    if (*end == '@') {
+        cpu_set_t set;
+        if (strlen(end + 1) >= sizeof(m->cpus) || cluster_parse_cpus(end + 1, &set) != 0) {
+            return (-1);
+        }
+        strcpy(m->cpus, end + 1);
+    } else if (*end != 0) {
+        return (-1);
+    }
+    return (0);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+// Two forked workers with overlapping shards against hashimoto() over the whole dataset.
+int cluster_self_verify() {
+    int ok = 1;
+
+    // the rings: full, empty and in order across the wrap
+    struct cluster_ring *r = malloc(sizeof(*r));
+    cluster_ring_init(r);
+    struct cluster_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    for (uint64_t round = 0; round < 3; round++) {
+        uint64_t n = 0;
+        for (msg.nonce = 0; cluster_push(r, &msg) == 0; msg.nonce++) {
+            n++;
+        }
+        ok &= check("ring capacity", n == CLUSTER_RING);
+        for (uint64_t i = 0; cluster_pop(r, &msg) == 0; i++) {
+            ok &= check("ring order", msg.nonce == i);
+            n--;
+        }
+        ok &= check("ring drained", n == 0);
+    }
+    free(r);
+
+    const uint64_t shards = 4, shard_size = 1 << 14, cache_size = 4096, limit = 300;
+    char name[64];
+    snprintf(name, sizeof(name), "/dagger-cluster-verify-%d", (int)getpid());
+    struct cluster_header *hdr = cluster_map(name, 2, 1);
+    if (!check("shared memory", hdr != NULL)) {
+        return (1);
+    }
+    hdr->magic = CLUSTER_MAGIC;
+    hdr->shards = shards;
+    hdr->shard_size = shard_size;
+    hdr->cache_size = cache_size;
+    hdr->target = UINT64_MAX / 16;
+    hdr->coordinator = getpid();
+    strcpy(hdr->seed, "123");
+
+    struct cluster_member members[2];
+    cluster_parse_hold("0-2", &members[0]);
+    cluster_parse_hold("1-3", &members[1]);
+    for (int w = 0; w < 2; w++) {
+        members[w].pid = fork();
+        if (members[w].pid == 0) {
+            _exit(cluster_worker(name, w, 2, NULL) == 0 ? 0 : 1);
+        }
+    }
+    struct cluster c;
+    memset(&c, 0, sizeof(c));
+    c.hdr = hdr;
+    c.members = members;
+    c.nmembers = 2;
+    c.issued = calloc(shards, sizeof(uint64_t));
+    c.hashed = calloc(shards, sizeof(uint64_t));
+    c.nonce_limit = limit;
+    c.slice = 0.001;
+    c.depth = 2;
+    c.record_cap = shards * limit;
+    c.record = malloc(sizeof(struct cluster_found) * c.record_cap);
+    c.quiet = 1;
+    cluster_coordinate(&c, 60, 1);
+    shm_unlink(name);
+
+    for (uint64_t s = 0; s < shards; s++) {
+        ok &= check("every nonce hashed once", c.issued[s] == limit && c.hashed[s] == limit);
+    }
+    ok &= check("both workers hashed", members[0].hashes > 0 && members[1].hashes > 0);
+
+    // every nonce meeting the target, found directly
+    unsigned char *cache = generate_cache(cache_size, (unsigned char *)"123", 3);
+    unsigned char *dataset = malloc(shards * shard_size);
+    for (uint64_t i = 0; i < shards * shard_size / HASH_BYTES; i++) {
+        calculate_dataset_item_opt(cache, cache_size, i, dataset + i * HASH_BYTES);
+    }
+    uint64_t want = 0;
+    for (uint64_t s = 0; s < shards; s++) {
+        for (uint64_t nonce = 0; nonce < limit; nonce++) {
+            uint64_t in[2] = {s, nonce}, head;
+            unsigned char hash[HASH_BYTES];
+            uint32_t mix[MIX_BYTES / 4] __attribute__((aligned(32)));
+            SHA512((unsigned char *)in, sizeof(in), hash);
+            hashimoto(hash, shard_size, dataset + s * shard_size, mix);
+            memcpy(&head, mix, 8);
+            if (head >= hdr->target) {
+                continue;
+            }
+            want++;
+            int seen = 0;
+            for (uint64_t f = 0; f < c.nrecord; f++) {
+                seen |= c.record[f].shard == s && c.record[f].nonce == nonce && memcmp(c.record[f].digest, mix, 32) == 0;
+            }
+            ok &= check("found with the right digest", seen);
+        }
+    }
+    ok &= check("nothing else found", want > 0 && c.nrecord == want && c.found == want);
+
+    munmap(hdr, hdr->size);
+    free(dataset);
+    free(cache);
+    free(c.issued);
+    free(c.hashed);
+    free(c.record);
+    printf(ok ? "cluster_self_verify() passed\n" : "cluster_self_verify() failed!\n");
+    return (!ok);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s run [options]\n"
+            "       %s worker --shm NAME --id N [--threads N] [--cpus LIST]\n"
+            "  --hold FIRST-LAST[@CPUS]  shards of one worker and the CPUs it runs on (repeat per worker)\n"
+            "  --shards N                shards in the dataset (default: the highest held + 1)\n"
+            "  --shard-size BYTES        bytes per shard, multiple of 4096 (default 1073741824)\n"
+            "  --data PATH               dataset file to map (default: workers build their shards)\n"
+            "  --cache-size BYTES        cache size (default 16777216)\n"
+            "  --seed STR                cache seed (default 123)\n"
+            "  --worker-threads N        threads per worker (default: one per CPU it may use)\n"
+            "  --seconds S               how long to mine (default 60)\n"
+            "  --nonces N                stop once N nonces of every shard are hashed\n"
+            "  --diff N                  print nonces meeting 2^64 / N on the first digest word (default 2^32)\n"
+            "  --slice S                 seconds of one thread per work batch (default 0.05)\n"
+            "  --depth N                 batches per thread queued ahead (default 2)\n"
+            "  --shm NAME                shared memory object (default /dagger-cluster-PID)\n"
+            "  --no-spawn                wait for workers started by hand\n"
+            "  --interval S              progress line every S seconds (default 1)\n"
+            "  --metrics TARGET          export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"hold", required_argument, 0, 'H'},       {"shards", required_argument, 0, 'n'},
+        {"shard-size", required_argument, 0, 's'}, {"data", required_argument, 0, 'D'},
+        {"cache-size", required_argument, 0, 'c'}, {"seed", required_argument, 0, 'e'},
+        {"worker-threads", required_argument, 0, 'T'}, {"threads", required_argument, 0, 't'},
+        {"cpus", required_argument, 0, 'C'},       {"id", required_argument, 0, 'I'},
+        {"seconds", required_argument, 0, 'S'},    {"nonces", required_argument, 0, 'N'},
+        {"diff", required_argument, 0, 'd'},       {"slice", required_argument, 0, 'l'},
+        {"depth", required_argument, 0, 'p'},      {"shm", required_argument, 0, 'm'},
+        {"no-spawn", no_argument, 0, 'W'},         {"interval", required_argument, 0, 'i'},
+        {"metrics", required_argument, 0, 'X'},    {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (cluster_self_verify());
+    }
+    if (argc < 2 || (strcmp(argv[1], "run") != 0 && strcmp(argv[1], "worker") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    static struct cluster_member members[CLUSTER_MAX_WORKERS];
+    uint64_t nmembers = 0, shards = 0, shard_size = 1073741824, cache_size = 16777216, diff = 1ULL << 32;
+    uint64_t nonces = 0, depth = 2, id = UINT64_MAX;
+    const char *data = "", *seed = "123", *cpus = NULL;
+    char name[64] = "";
+    int threads = 0, spawn = 1;
+    double seconds = 60, slice = 0.05, interval = 1;
+    const char *metrics_target = getenv("DAGGER_METRICS");
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'H':
+            if (nmembers == CLUSTER_MAX_WORKERS || cluster_parse_hold(optarg, &members[nmembers]) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            nmembers++;
+            break;
+        case 'n': shards = strtoull(optarg, NULL, 0); break;
+        case 's': shard_size = strtoull(optarg, NULL, 0); break;
+        case 'D': data = optarg; break;
+        case 'c': cache_size = strtoull(optarg, NULL, 0); break;
+        case 'e': seed = optarg; break;
+        case 'T':
+        case 't': threads = atoi(optarg); break;
+        case 'C': cpus = optarg; break;
+        case 'I': id = strtoull(optarg, NULL, 0); break;
+        case 'S': seconds = atof(optarg); break;
+        case 'N': nonces = strtoull(optarg, NULL, 0); break;
+        case 'd': diff = strtoull(optarg, NULL, 0); break;
+        case 'l': slice = atof(optarg); break;
+        case 'p': depth = strtoull(optarg, NULL, 0); break;
+        case 'm': snprintf(name, sizeof(name), "%s", optarg); break;
+        case 'W': spawn = 0; break;
+        case 'i': interval = atof(optarg); break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+
+    if (strcmp(argv[1], "worker") == 0) {
+        if (name[0] == 0 || id == UINT64_MAX) {
+            usage(argv[0]);
+            return (1);
+        }
+        return (cluster_worker(name, id, threads, cpus) == 0 ? 0 : 1);
+    }
+
+    uint64_t held = 0;
+    for (uint64_t w = 0; w < nmembers; w++) {
+        held = members[w].first + members[w].count > held ? members[w].first + members[w].count : held;
+    }
+    shards = shards == 0 ? held : shards;
+    if (nmembers == 0 || held > shards || shard_size < MIX_BYTES || shard_size % 4096 != 0 || cache_size < HASH_BYTES ||
+        strlen(seed) >= sizeof(((struct cluster_header *)0)->seed) ||
+        strlen(data) >= sizeof(((struct cluster_header *)0)->data) || diff == 0 || seconds <= 0 || slice <= 0 ||
+        depth == 0 || interval <= 0 || threads < 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    if (name[0] == 0) {
+        snprintf(name, sizeof(name), "/dagger-cluster-%d", (int)getpid());
+    }
+    struct cluster_header *hdr = cluster_map(name, nmembers, 1);
+    if (hdr == NULL) {
+        return (1);
+    }
+    hdr->shards = shards;
+    hdr->shard_size = shard_size;
+    hdr->cache_size = cache_size;
+    hdr->target = diff == 1 ? UINT64_MAX : UINT64_MAX / diff;
+    hdr->coordinator = getpid();
+    strcpy(hdr->seed, seed);
+    strcpy(hdr->data, data);
+    // workers check the magic, so it goes last
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = CLUSTER_MAGIC;
+
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        shm_unlink(name);
+        return (1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (uint64_t w = 0; w < nmembers; w++) {
+        if (spawn) {
+            members[w].pid = cluster_spawn(name, w, threads, members[w].cpus);
+        } else {
+            printf("start worker %llu: %s worker --shm %s --id %llu%s%s\n", (unsigned long long)w, argv[0], name,
+                   (unsigned long long)w, members[w].cpus[0] ? " --cpus " : "", members[w].cpus);
+        }
+    }
+    printf("Mining %llu shards of %llu bytes with %llu workers for %0.0fs (%s)\n", (unsigned long long)shards,
+           (unsigned long long)shard_size, (unsigned long long)nmembers, seconds,
+           data[0] ? data : "shards built by the workers");
+    fflush(stdout);
+
+    struct cluster c;
+    memset(&c, 0, sizeof(c));
+    c.hdr = hdr;
+    c.members = members;
+    c.nmembers = nmembers;
+    c.issued = calloc(shards, sizeof(uint64_t));
+    c.hashed = calloc(shards, sizeof(uint64_t));
+    c.nonce_limit = nonces;
+    c.slice = slice;
+    c.depth = depth;
+    cluster_coordinate(&c, seconds, interval);
+    shm_unlink(name);
+
+    uint64_t hashes = 0;
+    for (uint64_t w = 0; w < nmembers; w++) {
+        const struct cluster_member *m = &members[w];
+        printf("worker %llu: shards %llu-%llu, %llu hashes (%0.2f H/s per thread), %llu found\n", (unsigned long long)w,
+               (unsigned long long)m->first, (unsigned long long)(m->first + m->count - 1),
+               (unsigned long long)m->hashes, m->rate, (unsigned long long)m->found);
+        hashes += m->hashes;
+    }
+    for (uint64_t s = 0; s < shards; s++) {
+        printf("shard %llu: %llu hashes\n", (unsigned long long)s, (unsigned long long)c.hashed[s]);
+    }
+    printf("Done! Mined %0.2fs, %llu hashes (%0.2f H/s), %llu found\n", c.seconds, (unsigned long long)hashes,
+           hashes / c.seconds, (unsigned long long)c.found);
+    metrics_stop();
+    munmap(hdr, hdr->size);
+    free(c.issued);
+    free(c.hashed);
+    return (0);
+}
@@ -1,7 +1,14 @@
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #include "sha512.c"
+#include "sha512_mb.c"
 
 #define HASH_BYTES 64
 #define WORD_BYTES 8
@@ -9,6 +16,8 @@
 #define CACHE_ROUND 3
 #define CACHE_ITEM(cache, idx) ((cache) + (idx) * HASH_BYTES)
 #define DATASET_PARENTS 256
+#define LOOP_ACCESSES 64
+#define MIX_BYTES 128
 
 unsigned char *generate_cache(uint64_t cache_size, unsigned char *seed, uint64_t seed_size) {
     unsigned char *cache = malloc(cache_size);
@@ -42,6 +51,8 @@ unsigned char *generate_cache(uint64_t cache_size, unsigned char *seed, uint64_t
     return (cache);
 }
 
+#include "generate_caches.c"
+
 __attribute__((always_inline))
 uint64_t fnv64(uint64_t a, uint64_t b) {
     return ((a * 0x00000100000001B3)) ^ b;
@@ -103,6 +114,204 @@ void calculate_dataset_item_opt(unsigned char *cache, uint64_t cache_size, uint6
     return;
 }
 
+void hashimoto(unsigned char* hash, uint64_t size, unsigned char* dataset, uint64_t* mix) {
+    uint64_t *dataset_u64 = (uint64_t *)dataset;
+    uint64_t *hash_u64 = (uint64_t *)hash;
+
+    // replicate hash
+    for (uint64_t i = 0; i < HASH_BYTES / WORD_BYTES; i++) {
+        mix[i] = hash_u64[i];
+        mix[i + HASH_BYTES / WORD_BYTES] = hash_u64[i];
+    }
+
+    uint64_t seedHead = mix[0];
+    uint64_t mix_len = MIX_BYTES / WORD_BYTES;
+    uint64_t rows = size / MIX_BYTES;
+
+    // Mix in random dataset nodes
+    for (uint64_t i = 0; i < LOOP_ACCESSES; i++) {
+        uint64_t parent = fnv64(i ^ seedHead, mix[i % mix_len]) % rows;
+        for (uint64_t j = 0; j < mix_len; j++) {
+            mix[j] = fnv64(mix[j], dataset_u64[parent * mix_len + j]);
+        }
+    }
+
+    for (uint64_t i = 0; i < mix_len; i += 4) {
+        mix[i / 4] = fnv64(fnv64(fnv64(mix[i], mix[i+1]), mix[i+2]), mix[i+3]);
+    }
+
+    return;
+}
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+// AVX-512DQ has a native 64-bit mullo.
+__attribute__((always_inline))
+static inline __m512i fnv64_avx512(__m512i a, __m512i b) {
+    return _mm512_xor_si512(_mm512_mullo_epi64(a, _mm512_set1_epi64(0x00000100000001B3)), b);
+}
+
+void calculate_dataset_item_avx512(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char* dataset) {
+    uint64_t rows = cache_size / HASH_BYTES;
+
+    uint64_t *cache_u64 = (uint64_t *)cache;
+    uint64_t *mix = (uint64_t *)dataset;
+    mix[0] = cache_u64[(i % rows) * WORDS_PER_HASH] ^ i;
+    for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
+        mix[j] = cache_u64[(i % rows) * WORDS_PER_HASH + j];
+    }
+
+    // TODO: big order casting
+    SHA512(dataset, HASH_BYTES, dataset);
+
+    // the whole 64-byte mix is one register
+    __m512i m = _mm512_loadu_si512(mix);
+    for (uint64_t j = 0; j < DATASET_PARENTS; j++) {
+        __m512i w = _mm512_permutexvar_epi64(_mm512_set1_epi64(j % WORDS_PER_HASH), m);
+        uint64_t cache_idx = fnv64(i ^ j, _mm_cvtsi128_si64(_mm512_castsi512_si128(w))) % rows;
+        m = fnv64_avx512(m, _mm512_loadu_si512(&cache_u64[cache_idx * WORDS_PER_HASH]));
+    }
+    _mm512_storeu_si512(mix, m);
+
+    // TODO: big order casting
+    SHA512(dataset, HASH_BYTES, dataset);
+    return;
+}
+
+void hashimoto_avx512(unsigned char* hash, uint64_t size, unsigned char* dataset, uint64_t* mix) {
+    uint64_t *dataset_u64 = (uint64_t *)dataset;
+    __m512i h = _mm512_loadu_si512(hash);
+
+    // replicate hash
+    __m512i mix0 = h;
+    __m512i mix1 = h;
+
+    uint64_t seedHead = ((uint64_t *)hash)[0];
+    uint64_t mix_len = MIX_BYTES / WORD_BYTES;
+    uint64_t rows = size / MIX_BYTES;
+
+    // Mix in random dataset nodes
+    for (uint64_t i = 0; i < LOOP_ACCESSES; i++) {
+        uint64_t p = i % mix_len;
+        __m512i src = p < 8 ? mix0 : mix1;
+        __m512i w = _mm512_permutexvar_epi64(_mm512_set1_epi64(p % 8), src);
+        uint64_t parent = fnv64(i ^ seedHead, _mm_cvtsi128_si64(_mm512_castsi512_si128(w))) % rows;
+        uint64_t *row = &dataset_u64[parent * mix_len];
+        mix0 = fnv64_avx512(mix0, _mm512_loadu_si512(row));
+        mix1 = fnv64_avx512(mix1, _mm512_loadu_si512(row + 8));
+    }
+
+    _mm512_storeu_si512(mix, mix0);
+    _mm512_storeu_si512(mix + 8, mix1);
+
+    for (uint64_t i = 0; i < mix_len; i += 4) {
+        mix[i / 4] = fnv64(fnv64(fnv64(mix[i], mix[i+1]), mix[i+2]), mix[i+3]);
+    }
+
+    return;
+}
+#endif
+
+#ifdef __AVX2__
+// AVX2 has no 64-bit mullo.  The prime is 2^40 + 0x1B3, so a * prime is
+// (a << 40) + a * 0x1B3, and a * 0x1B3 only needs two 32x32->64 multiplies.
+__attribute__((always_inline))
+static inline __m256i fnv64_avx2(__m256i a, __m256i b) {
+    __m256i k = _mm256_set1_epi64x(0x1B3);
+    __m256i lo = _mm256_mul_epu32(a, k);
+    __m256i hi = _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), k), 32);
+    __m256i prod = _mm256_add_epi64(_mm256_slli_epi64(a, 40), _mm256_add_epi64(lo, hi));
+    return _mm256_xor_si256(prod, b);
+}
+
+void calculate_dataset_item_avx2(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char* dataset) {
+    uint64_t rows = cache_size / HASH_BYTES;
+
+    uint64_t *cache_u64 = (uint64_t *)cache;
+    uint64_t *mix = (uint64_t *)dataset;
+    mix[0] = cache_u64[(i % rows) * WORDS_PER_HASH] ^ i;
+    for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
+        mix[j] = cache_u64[(i % rows) * WORDS_PER_HASH + j];
+    }
+
+    // TODO: big order casting
+    SHA512(dataset, HASH_BYTES, dataset);
+
+    __m256i m0 = _mm256_loadu_si256((__m256i *)mix);
+    __m256i m1 = _mm256_loadu_si256((__m256i *)(mix + 4));
+    for (uint64_t j = 0; j < DATASET_PARENTS; j++) {
+        uint64_t p = j % WORDS_PER_HASH;
+        // only spill the half that holds the word we need
+        if (p < 4) {
+            _mm256_storeu_si256((__m256i *)mix, m0);
+        } else {
+            _mm256_storeu_si256((__m256i *)(mix + 4), m1);
+        }
+        uint64_t cache_idx = fnv64(i ^ j, mix[p]) % rows;
+        uint64_t *cache_u64_ptr = &cache_u64[cache_idx * WORDS_PER_HASH];
+        m0 = fnv64_avx2(m0, _mm256_loadu_si256((__m256i *)cache_u64_ptr));
+        m1 = fnv64_avx2(m1, _mm256_loadu_si256((__m256i *)(cache_u64_ptr + 4)));
+    }
+    _mm256_storeu_si256((__m256i *)mix, m0);
+    _mm256_storeu_si256((__m256i *)(mix + 4), m1);
+
+    // TODO: big order casting
+    SHA512(dataset, HASH_BYTES, dataset);
+    return;
+}
+
+void hashimoto_avx2(unsigned char* hash, uint64_t size, unsigned char* dataset, uint64_t* mix) {
+    uint64_t *dataset_u64 = (uint64_t *)dataset;
+    uint64_t *hash_u64 = (uint64_t *)hash;
+
+    // replicate hash
+    for (uint64_t i = 0; i < HASH_BYTES / WORD_BYTES; i++) {
+        mix[i] = hash_u64[i];
+        mix[i + HASH_BYTES / WORD_BYTES] = hash_u64[i];
+    }
+
+    __m256i mix0 = _mm256_loadu_si256((__m256i *)mix);
+    __m256i mix1 = _mm256_loadu_si256((__m256i *)(mix + 4));
+    __m256i mix2 = _mm256_loadu_si256((__m256i *)(mix + 8));
+    __m256i mix3 = _mm256_loadu_si256((__m256i *)(mix + 12));
+
+    uint64_t seedHead = mix[0];
+    uint64_t mix_len = MIX_BYTES / WORD_BYTES;
+    uint64_t rows = size / MIX_BYTES;
+
+    // Mix in random dataset nodes
+    for (uint64_t i = 0; i < LOOP_ACCESSES; i++) {
+        uint64_t p = i % mix_len;
+        if (p < 4) {
+            _mm256_storeu_si256((__m256i *)mix, mix0);
+        } else if (p < 8) {
+            _mm256_storeu_si256((__m256i *)(mix + 4), mix1);
+        } else if (p < 12) {
+            _mm256_storeu_si256((__m256i *)(mix + 8), mix2);
+        } else {
+            _mm256_storeu_si256((__m256i *)(mix + 12), mix3);
+        }
+
+        uint64_t parent = fnv64(i ^ seedHead, mix[p]) % rows;
+        uint64_t *row = &dataset_u64[parent * mix_len];
+        mix0 = fnv64_avx2(mix0, _mm256_loadu_si256((__m256i *)row));
+        mix1 = fnv64_avx2(mix1, _mm256_loadu_si256((__m256i *)(row + 4)));
+        mix2 = fnv64_avx2(mix2, _mm256_loadu_si256((__m256i *)(row + 8)));
+        mix3 = fnv64_avx2(mix3, _mm256_loadu_si256((__m256i *)(row + 12)));
+    }
+
+    _mm256_storeu_si256((__m256i *)mix, mix0);
+    _mm256_storeu_si256((__m256i *)(mix + 4), mix1);
+    _mm256_storeu_si256((__m256i *)(mix + 8), mix2);
+    _mm256_storeu_si256((__m256i *)(mix + 12), mix3);
+
+    for (uint64_t i = 0; i < mix_len; i += 4) {
+        mix[i / 4] = fnv64(fnv64(fnv64(mix[i], mix[i+1]), mix[i+2]), mix[i+3]);
+    }
+
+    return;
+}
+#endif
+
 void simple_verify() {
     unsigned char seed[] = "123";
 
@@ -151,6 +360,60 @@ void self_verify() {
     return;
 }
 
+void simd_verify() {
+    unsigned char seed[] = "123";
+
+    unsigned char *cache = generate_cache(1024, seed, sizeof(seed) - 1);
+    unsigned char *data0 = malloc(HASH_BYTES);
+    unsigned char *data1 = malloc(HASH_BYTES);
+    int failed = 0;
+
+    calculate_dataset_item(cache, 1024, 123, data0);
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    calculate_dataset_item_avx512(cache, 1024, 123, data1);
+    failed |= memcmp(data0, data1, HASH_BYTES) != 0;
+#endif
+#ifdef __AVX2__
+    calculate_dataset_item_avx2(cache, 1024, 123, data1);
+    failed |= memcmp(data0, data1, HASH_BYTES) != 0;
+#endif
+
+    unsigned char *init_hash = malloc(HASH_BYTES);
+    uint64_t *mix0 = aligned_alloc(64, MIX_BYTES);
+    uint64_t *mix1 = aligned_alloc(64, MIX_BYTES);
+    SHA512(seed, sizeof(seed) - 1, init_hash);
+
+    hashimoto(init_hash, 1024, cache, mix0);
+    printf("expect: ffc56b74d98f47982fb15292772bd4042b8960507b0c1e750fc56a7ffe991c6b\n");
+    printf("actual: ");
+    for (int i = 0; i < 32; i++) {
+        printf("%02x", ((unsigned char *)mix0)[i]);
+    }
+    printf("\n");
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    hashimoto_avx512(init_hash, 1024, cache, mix1);
+    failed |= memcmp(mix0, mix1, 32) != 0;
+#endif
+#ifdef __AVX2__
+    hashimoto_avx2(init_hash, 1024, cache, mix1);
+    failed |= memcmp(mix0, mix1, 32) != 0;
+#endif
+
+    free(cache);
+    free(data0);
+    free(data1);
+    free(init_hash);
+    free(mix0);
+    free(mix1);
+
+    if (failed) {
+        printf("simd_verify() failed!\n");
+        return;
+    }
+    printf("simd_verify() passed\n");
+    return;
+}
+
 void hash_empty_verify() {
     unsigned char *digest = malloc(64);
     SHA512(0, 0, digest);
@@ -200,10 +463,131 @@ void benchmark() {
     return;
 }
 
+void benchmark_item_kernel(const char *name, void (*kernel)(unsigned char*, uint64_t, uint64_t, unsigned char*),
+                           unsigned char *cache, uint64_t cache_size, uint64_t items) {
+    struct timespec start, end;
+    unsigned char *data = malloc(HASH_BYTES);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t idx = 0; idx < items; idx ++) {
+        kernel(cache, cache_size, idx, data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: took %0.2fs, rate %0.2f H/s\n", name, used_time, items / used_time);
+
+    free(data);
+    return;
+}
+
+// Dataset item generation of the scalar and SIMD kernels over the same cache.
+void benchmark_items() {
+    unsigned char seed[] = "123";
+    struct timespec start, end;
+
+    uint64_t cache_size = 83886080; // 80 MB
+    printf("Generating cache with size %llu\n", cache_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned char *cache = generate_cache(cache_size, seed, sizeof(seed) - 1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (cache == NULL) {
+        fprintf(stderr, "cannot allocate %llu bytes of cache\n", (unsigned long long)cache_size);
+        return;
+    }
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    uint64_t items = 200000;
+    benchmark_item_kernel("calculate_dataset_item", calculate_dataset_item, cache, cache_size, items);
+    benchmark_item_kernel("calculate_dataset_item_opt", calculate_dataset_item_opt, cache, cache_size, items);
+#ifdef __AVX2__
+    benchmark_item_kernel("calculate_dataset_item_avx2", calculate_dataset_item_avx2, cache, cache_size, items);
+#endif
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    benchmark_item_kernel("calculate_dataset_item_avx512", calculate_dataset_item_avx512, cache, cache_size, items);
+#endif
+
+    free(cache);
+    return;
+}
+
+void benchmark_hashimoto_kernel(const char *name, void (*kernel)(unsigned char*, uint64_t, unsigned char*, uint64_t*),
+                                unsigned char *dataset, uint64_t dataset_size) {
+    struct timespec start, end;
+    unsigned char *init_hash = malloc(HASH_BYTES);
+    uint64_t *mix = aligned_alloc(64, MIX_BYTES);
+
+    uint64_t items = 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t idx = 0; idx < items; idx ++) {
+        SHA512(&idx, 8, init_hash);
+        kernel(init_hash, dataset_size, dataset, mix);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: took %0.2fs, rate %0.2f H/s\n", name, used_time, items / used_time);
+
+    free(init_hash);
+    free(mix);
+    return;
+}
+
+void benchmark_hashimoto() {
+    unsigned char seed[] = "123";
+    struct timespec start, end;
+
+    uint64_t cache_size = 83886080; // 80 MB
+    printf("Generating cache with size %llu\n", cache_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned char *cache = generate_cache(cache_size, seed, sizeof(seed) - 1);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (cache == NULL) {
+        fprintf(stderr, "cannot allocate %llu bytes of cache\n", (unsigned long long)cache_size);
+        return;
+    }
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    // the cache stands in for the dataset, as in dagger_32.c
+    benchmark_hashimoto_kernel("hashimoto", hashimoto, cache, cache_size);
+#ifdef __AVX2__
+    benchmark_hashimoto_kernel("hashimoto_avx2", hashimoto_avx2, cache, cache_size);
+#endif
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    benchmark_hashimoto_kernel("hashimoto_avx512", hashimoto_avx512, cache, cache_size);
+#endif
+
+    free(cache);
+    return;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [verify|items|hashimoto|caches]\n"
+            "  verify      check the kernels against the reference vectors\n"
+            "  items       compare dataset item generation of the scalar, AVX2 and AVX-512 kernels\n"
+            "  hashimoto   compare the scalar, AVX2 and AVX-512 hashimoto kernels\n"
+            "  caches      benchmark generate_caches()\n"
+            "with no command, verify and stream dataset items\n",
+            prog);
+}
+
 int main(int argc, char *argv[]) {
+    const char *cmd = argc >= 2 ? argv[1] : NULL;
+    if (argc > 2 || (cmd != NULL && strcmp(cmd, "verify") != 0 && strcmp(cmd, "items") != 0 &&
+                     strcmp(cmd, "hashimoto") != 0 && strcmp(cmd, "caches") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
     self_verify();
-    benchmark();
+    self_caches_verify();
+    simd_verify();
+    if (cmd == NULL) {
+        benchmark();
+    } else if (strcmp(cmd, "items") == 0) {
+        benchmark_items();
+    } else if (strcmp(cmd, "hashimoto") == 0) {
+        benchmark_hashimoto();
+    } else if (strcmp(cmd, "caches") == 0) {
+        benchmark_generate_caches();
+    }
     return (0);
 }
-
-
@@ -1,9 +1,18 @@
+#include <getopt.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <immintrin.h>
 
 #include "sha512.c"
+#include "sha512_mb.c"
+#include "metrics.c"
+#include "timeline.c"
+#include "trace.c"
+#include "dagger_profile.c"
 
 #define HASH_BYTES 64
 #define WORD_BYTES 4
@@ -14,16 +23,10 @@
 #define LOOP_ACCESSES 64
 #define MIX_BYTES 128
 
-unsigned char *generate_cache(uint64_t cache_size, unsigned char *seed, uint64_t seed_size) {
-    unsigned char *cache = malloc(cache_size);
-    if (cache == NULL) {
-        return (NULL);
-    }
-    unsigned char *hash = malloc(HASH_BYTES);
-    if (hash == NULL) {
-        free(hash);
-        return (NULL);
-    }
+// Fill cache_size bytes at cache, for callers that own the memory (e.g. the cgo package).
+void generate_cache_into(unsigned char *cache, uint64_t cache_size, unsigned char *seed, uint64_t seed_size) {
+    unsigned char hash[HASH_BYTES];
+    uint64_t t0 = timeline_begin();
 
     SHA512(seed, seed_size, cache);
     uint64_t rows = cache_size / HASH_BYTES;
@@ -42,11 +45,23 @@ unsigned char *generate_cache(uint64_t cache_size, unsigned char *seed, uint64_t
             SHA512(hash, HASH_BYTES, CACHE_ITEM(cache, i));
         }
     }
-    free(hash);
+    timeline_end("cache", t0);
+}
+
+unsigned char *generate_cache(uint64_t cache_size, unsigned char *seed, uint64_t seed_size) {
+    unsigned char *cache = malloc(cache_size);
+    if (cache == NULL) {
+        return (NULL);
+    }
+    generate_cache_into(cache, cache_size, seed, seed_size);
     return (cache);
 }
 
-__attribute__((always_inline))
+#define CACHE_GROUP_BEGIN() timeline_begin()
+#define CACHE_GROUP_END(t0) timeline_end("cache group", (t0))
+#include "generate_caches.c"
+
+static inline __attribute__((always_inline))
 uint64_t fnv32(uint32_t a, uint32_t b) {
     return ((a * 0x01000193)) ^ b;
 }
@@ -56,6 +71,8 @@ void calculate_dataset_item(unsigned char *cache, uint64_t cache_size, uint64_t
 
     uint32_t *cache_u32 = (uint32_t *)cache;
     uint32_t *mix = (uint32_t *)dataset;
+    TRACE_MARK(TRACE_ITEM);
+    TRACE_ACCESS(TRACE_CACHE, i % rows);
     mix[0] = cache_u32[(i % rows) * WORDS_PER_HASH] ^ i;
     for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
         mix[j] = cache_u32[(i % rows) * WORDS_PER_HASH + j];
@@ -66,6 +83,7 @@ void calculate_dataset_item(unsigned char *cache, uint64_t cache_size, uint64_t
 
     for (uint64_t j = 0; j < DATASET_PARENTS; j++) {
         uint64_t cache_idx = fnv32(i ^ j, mix[j % WORDS_PER_HASH]) % rows;
+        TRACE_ACCESS(TRACE_CACHE, cache_idx);
         for (uint64_t k = 0; k < WORDS_PER_HASH; k++) {
             mix[k] = fnv32(mix[k], cache_u32[cache_idx * WORDS_PER_HASH + k]);
         }
@@ -76,21 +94,19 @@ void calculate_dataset_item(unsigned char *cache, uint64_t cache_size, uint64_t
     return;
 }
 
-void calculate_dataset_item_opt(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char* dataset) {
-    uint32_t rows = cache_size / HASH_BYTES;
-
-    uint32_t *cache_u32 = (uint32_t *)cache;
+// The part of an item shared by calculate_dataset_item_opt() and
+// calculate_mask_data(): hash the seeded mix in dataset, fold in DATASET_PARENTS
+// pseudo-randomly selected cache rows, and hash it again.
+static inline __attribute__((always_inline))
+void mix_parents(uint32_t *cache_u32, uint32_t rows, uint64_t i, unsigned char *dataset) {
     uint32_t *mix = (uint32_t *)dataset;
-    mix[0] = cache_u32[(i % rows) * WORDS_PER_HASH] ^ i;
-    for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
-        mix[j] = cache_u32[(i % rows) * WORDS_PER_HASH + j];
-    }
 
     // TODO: big order casting
     SHA512(dataset, HASH_BYTES, dataset);
 
     for (uint32_t j = 0; j < DATASET_PARENTS; j++) {
         uint32_t cache_idx = fnv32(i ^ j, mix[j % WORDS_PER_HASH]) % rows;
+        TRACE_ACCESS(TRACE_CACHE, cache_idx);
         uint32_t *cache_u32_ptr = &cache_u32[cache_idx * WORDS_PER_HASH];
         for (uint64_t k = 0; k < WORDS_PER_HASH; k++) {
             mix[k] = fnv32(mix[k], cache_u32_ptr[k]);
@@ -102,35 +118,49 @@ void calculate_dataset_item_opt(unsigned char *cache, uint64_t cache_size, uint6
     return;
 }
 
+void calculate_dataset_item_opt(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char* dataset) {
+    uint32_t rows = cache_size / HASH_BYTES;
+
+    uint32_t *cache_u32 = (uint32_t *)cache;
+    uint32_t *mix = (uint32_t *)dataset;
+    TRACE_MARK(TRACE_ITEM);
+    TRACE_ACCESS(TRACE_CACHE, i % rows);
+    mix[0] = cache_u32[(i % rows) * WORDS_PER_HASH] ^ i;
+    for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
+        mix[j] = cache_u32[(i % rows) * WORDS_PER_HASH + j];
+    }
+    mix_parents(cache_u32, rows, i, dataset);
+    return;
+}
+
 void calculate_mask_data(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char* dataset) {
     uint32_t rows = cache_size / HASH_BYTES;
 
     uint32_t *cache_u32 = (uint32_t *)cache;
     uint32_t *mix = (uint32_t *)dataset;
+    TRACE_MARK(TRACE_MASK);
+    TRACE_ACCESS(TRACE_CACHE, i % rows);
     mix[0] = mix[0] ^ cache_u32[(i % rows) * WORDS_PER_HASH] ^ i;
     for (uint64_t j = 1; j < WORDS_PER_HASH; j++) {
         mix[j] = mix[j] ^ cache_u32[(i % rows) * WORDS_PER_HASH + j];
     }
+    mix_parents(cache_u32, rows, i, dataset);
+    return;
+}
 
-    // TODO: big order casting
-    SHA512(dataset, HASH_BYTES, dataset);
-
-    for (uint32_t j = 0; j < DATASET_PARENTS; j++) {
-        uint32_t cache_idx = fnv32(i ^ j, mix[j % WORDS_PER_HASH]) % rows;
-        uint32_t *cache_u32_ptr = &cache_u32[cache_idx * WORDS_PER_HASH];
-        for (uint64_t k = 0; k < WORDS_PER_HASH; k++) {
-            mix[k] = fnv32(mix[k], cache_u32_ptr[k]);
-        }
+// Mask a blob in place.  Every HASH_BYTES piece is masked as item first_item + k,
+// so a shard laid out as consecutive blobs is masked as one flat item array.
+void calculate_mask_blob(unsigned char *cache, uint64_t cache_size, uint64_t first_item, unsigned char *blob, uint64_t size) {
+    for (uint64_t k = 0; k < size / HASH_BYTES; k++) {
+        calculate_mask_data(cache, cache_size, first_item + k, blob + k * HASH_BYTES);
     }
-
-    // TODO: big order casting
-    SHA512(dataset, HASH_BYTES, dataset);
     return;
 }
 
 void hashimoto(unsigned char* hash, uint64_t size, unsigned char* dataset, uint32_t* mix) {
     uint32_t *dataset_u32 = (uint32_t *)dataset;
     uint32_t *hash_u32 = (uint32_t *)hash;
+    TRACE_MARK(TRACE_HASH);
 
     // replicate hash
     for (uint64_t i = 0; i < HASH_BYTES / 4; i++) {
@@ -145,6 +175,7 @@ void hashimoto(unsigned char* hash, uint64_t size, unsigned char* dataset, uint3
     // Mix in random dataset nodes
 	for (uint32_t i = 0; i < LOOP_ACCESSES; i++) {
 		uint64_t parent = fnv32(i^seedHead, mix[i%mix_len]) % rows;
+        TRACE_ACCESS(TRACE_DATASET, parent);
         for (uint32_t j = 0; j < mix_len; j ++) {
             mix[j] = fnv32(mix[j], dataset_u32[parent * mix_len + j]);
         }
@@ -160,6 +191,7 @@ void hashimoto(unsigned char* hash, uint64_t size, unsigned char* dataset, uint3
 void hashimoto_avx(unsigned char* hash, uint64_t size, unsigned char* dataset, uint32_t* mix) {
     uint32_t *dataset_u32 = (uint32_t *)dataset;
     uint32_t *hash_u32 = (uint32_t *)hash;
+    TRACE_MARK(TRACE_HASH);
 
     // replicate hash
     for (uint64_t i = 0; i < HASH_BYTES / 4; i++) {
@@ -168,15 +200,15 @@ void hashimoto_avx(unsigned char* hash, uint64_t size, unsigned char* dataset, u
     }
 
     __m256i m = _mm256_set1_epi32(0x01000193);
-    __m256i mix0 = _mm256_load_si256(mix);
-    __m256i mix1 = _mm256_load_si256(mix+8);
-    __m256i mix2 = _mm256_load_si256(mix+16);
-    __m256i mix3 = _mm256_load_si256(mix+24);
+    __m256i *mix_vec0 = (__m256i *)mix;
+    __m256i *mix_vec1 = (__m256i *)(mix+8);
+    __m256i *mix_vec2 = (__m256i *)(mix+16);
+    __m256i *mix_vec3 = (__m256i *)(mix+24);
 
-    unsigned char *mix_bytes0 = mix;
-    unsigned char *mix_bytes1 = mix+8;
-    unsigned char *mix_bytes2 = mix+16;
-    unsigned char *mix_bytes3 = mix+24;
+    __m256i mix0 = _mm256_load_si256(mix_vec0);
+    __m256i mix1 = _mm256_load_si256(mix_vec1);
+    __m256i mix2 = _mm256_load_si256(mix_vec2);
+    __m256i mix3 = _mm256_load_si256(mix_vec3);
 
     uint32_t seedHead = mix[0];
     uint32_t mix_len = MIX_BYTES / 4;
@@ -186,23 +218,24 @@ void hashimoto_avx(unsigned char* hash, uint64_t size, unsigned char* dataset, u
 	for (uint32_t i = 0; i < LOOP_ACCESSES; i++) {
         uint32_t p = i % 32;
         if (p < 8) {
-            _mm256_store_si256(mix_bytes0, mix0);
+            _mm256_store_si256(mix_vec0, mix0);
         } else if (p < 16) {
-            _mm256_store_si256(mix_bytes1, mix1);
+            _mm256_store_si256(mix_vec1, mix1);
         } else if (p < 24) {
-            _mm256_store_si256(mix_bytes2, mix2);
+            _mm256_store_si256(mix_vec2, mix2);
         } else {
-            _mm256_store_si256(mix_bytes3, mix3);
+            _mm256_store_si256(mix_vec3, mix3);
         }
 
         uint64_t parent = fnv32(i^seedHead, mix[i%mix_len]) % rows;
+        TRACE_ACCESS(TRACE_DATASET, parent);
         uint32_t *dataset_u32_ptr = &dataset_u32[parent * mix_len];
         // printf("%u\n", dataset_u32_ptr[0]);
-        unsigned char *dataset_bytes = dataset_u32_ptr;
-        __m256i c0 = _mm256_load_si256(dataset_bytes);
-        __m256i c1 = _mm256_load_si256(dataset_bytes+32);
-        __m256i c2 = _mm256_load_si256(dataset_bytes+64);
-        __m256i c3 = _mm256_load_si256(dataset_bytes+96);
+        const __m256i *dataset_vec = (const __m256i *)dataset_u32_ptr;
+        __m256i c0 = _mm256_load_si256(dataset_vec);
+        __m256i c1 = _mm256_load_si256(dataset_vec+1);
+        __m256i c2 = _mm256_load_si256(dataset_vec+2);
+        __m256i c3 = _mm256_load_si256(dataset_vec+3);
 
         mix0 = _mm256_mullo_epi32(mix0, m);
         mix0 = _mm256_xor_si256(mix0, c0);
@@ -217,10 +250,10 @@ void hashimoto_avx(unsigned char* hash, uint64_t size, unsigned char* dataset, u
         mix3 = _mm256_xor_si256(mix3, c3);
     }
 
-    _mm256_store_si256(mix_bytes0, mix0);
-    _mm256_store_si256(mix_bytes1, mix1);
-    _mm256_store_si256(mix_bytes2, mix2);
-    _mm256_store_si256(mix_bytes3, mix3);
+    _mm256_store_si256(mix_vec0, mix0);
+    _mm256_store_si256(mix_vec1, mix1);
+    _mm256_store_si256(mix_vec2, mix2);
+    _mm256_store_si256(mix_vec3, mix3);
 
     for (uint32_t i = 0; i < mix_len; i += 4) {
         mix[i / 4] = fnv32(fnv32(fnv32(mix[i], mix[i+1]), mix[i+2]), mix[i+3]);
@@ -229,6 +262,75 @@ void hashimoto_avx(unsigned char* hash, uint64_t size, unsigned char* dataset, u
     return;
 }
 
+#define HASHIMOTO_MAX_BATCH 64
+
+/*
+ * hashimoto() of n candidates in lockstep.  Every access of a candidate
+ * depends on its previous one, so a single candidate leaves the core waiting
+ * on DRAM for each of its LOOP_ACCESSES rows; interleaving n of them keeps up
+ * to n misses in flight.  The candidates are mixed round robin, and before one
+ * is mixed the row of the candidate `prefetch` places later in that order is
+ * prefetched (0: no software prefetch, at most n - 1).  hashes holds n
+ * HASH_BYTES hashes and mixes n MIX_BYTES mixes; every digest ends up where
+ * hashimoto() leaves it.  n is at most HASHIMOTO_MAX_BATCH.
+ */
+void hashimoto_interleaved(unsigned char *hashes, uint64_t n, uint64_t size, unsigned char *dataset, uint32_t *mixes,
+                           unsigned prefetch) {
+    uint32_t *dataset_u32 = (uint32_t *)dataset;
+    uint32_t mix_len = MIX_BYTES / 4;
+    uint32_t rows = size / MIX_BYTES;
+    uint32_t seed_head[HASHIMOTO_MAX_BATCH];
+    uint64_t parent[HASHIMOTO_MAX_BATCH]; // next row of every candidate
+    if (prefetch >= n) {
+        prefetch = n - 1;
+    }
+
+    for (uint64_t l = 0; l < n; l++) {
+        uint32_t *hash_u32 = (uint32_t *)(hashes + l * HASH_BYTES);
+        uint32_t *mix = mixes + l * mix_len;
+        TRACE_MARK(TRACE_HASH);
+        for (uint64_t i = 0; i < HASH_BYTES / 4; i++) {
+            mix[i] = hash_u32[i];
+            mix[i + HASH_BYTES / 4] = hash_u32[i];
+        }
+        seed_head[l] = mix[0];
+        parent[l] = fnv32(seed_head[l], mix[0]) % rows;
+    }
+    for (uint64_t l = 0; l < prefetch; l++) {
+        __builtin_prefetch(&dataset_u32[parent[l] * mix_len]);
+        __builtin_prefetch(&dataset_u32[parent[l] * mix_len + 16]);
+    }
+
+    for (uint32_t i = 0; i < LOOP_ACCESSES; i++) {
+        for (uint64_t l = 0; l < n; l++) {
+            if (prefetch != 0) {
+                // the candidate prefetch places ahead; past the end of the round it is one access later
+                uint64_t ahead = l + prefetch;
+                if (ahead < n || i + 1 < LOOP_ACCESSES) {
+                    const uint32_t *row = &dataset_u32[parent[ahead % n] * mix_len];
+                    __builtin_prefetch(row);
+                    __builtin_prefetch(row + 16);
+                }
+            }
+            uint32_t *mix = mixes + l * mix_len;
+            TRACE_ACCESS(TRACE_DATASET, parent[l]);
+            const uint32_t *row = &dataset_u32[parent[l] * mix_len];
+            for (uint32_t j = 0; j < mix_len; j++) {
+                mix[j] = fnv32(mix[j], row[j]);
+            }
+            parent[l] = fnv32((i + 1) ^ seed_head[l], mix[(i + 1) % mix_len]) % rows;
+        }
+    }
+
+    for (uint64_t l = 0; l < n; l++) {
+        uint32_t *mix = mixes + l * mix_len;
+        for (uint32_t i = 0; i < mix_len; i += 4) {
+            mix[i / 4] = fnv32(fnv32(fnv32(mix[i], mix[i+1]), mix[i+2]), mix[i+3]);
+        }
+    }
+    return;
+}
+
 void simple_verify() {
     unsigned char seed[] = "123";
 
@@ -299,13 +401,17 @@ void benchmark_generate_data_item() {
     unsigned char *cache = generate_cache(cache_size, seed, sizeof(seed) - 1);
     clock_gettime(CLOCK_MONOTONIC, &end);
     printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    metrics_set(METRIC_CACHE_BYTES, cache_size);
 
     clock_gettime(CLOCK_MONOTONIC, &start);
     clock_gettime(CLOCK_MONOTONIC, &startb);
     unsigned char *data = malloc(HASH_BYTES);
     uint64_t items = 1000000;
     for (uint64_t idx = 0; idx < items; idx ++) {
+        uint64_t t0 = metrics_now();
         calculate_dataset_item_opt(cache, cache_size, idx, data);
+        metrics_observe_since(METRIC_ITEM_LATENCY, t0);
+        metrics_add(METRIC_DATASET_ITEMS, 1);
 
         if (idx % 10000 != 0) {
             continue;
@@ -337,7 +443,7 @@ void simple_hashimoto_verify() {
 
     unsigned char *cache = generate_cache(1024, seed, sizeof(seed) - 1);
 
-    hashimoto(init_hash, 1024, cache, mix);
+    hashimoto(init_hash, 1024, cache, (uint32_t *)mix);
 
     printf("expect: a35905961116a162bd58f9bf83ea40198b7cb2469ddb6844df1cbc9109f194aa\n");
     printf("actual: ");
@@ -346,7 +452,7 @@ void simple_hashimoto_verify() {
     }
     printf("\n");
 
-    hashimoto_avx(init_hash, 1024, cache, mix);
+    hashimoto_avx(init_hash, 1024, cache, (uint32_t *)mix);
     printf("actual: ");
     for (int i = 0; i < 32; i++) {
         printf("%02x", mix[i]);
@@ -359,29 +465,106 @@ void simple_hashimoto_verify() {
     return;
 }
 
-void benchmark_hashimoto() {
+// hashimoto_interleaved() against hashimoto() for every batch width and prefetch distance.
+void self_interleaved_verify() {
+    unsigned char seed[] = "123";
+    uint64_t size = 1 << 16;
+    unsigned char *cache = generate_cache(size, seed, sizeof(seed) - 1);
+    unsigned char hashes[HASH_BYTES * 13];
+    uint32_t mixes[MIX_BYTES / 4 * 13] __attribute__((aligned(32)));
+    uint32_t mix[MIX_BYTES / 4] __attribute__((aligned(32)));
+
+    for (uint64_t l = 0; l < 13; l++) {
+        SHA512(&l, 8, hashes + l * HASH_BYTES);
+    }
+    for (uint64_t n = 1; n <= 13; n += 4) {
+        for (unsigned prefetch = 0; prefetch < 16; prefetch += 3) {
+            hashimoto_interleaved(hashes, n, size, cache, mixes, prefetch);
+            for (uint64_t l = 0; l < n; l++) {
+                hashimoto(hashes + l * HASH_BYTES, size, cache, mix);
+                if (memcmp(mix, mixes + l * MIX_BYTES / 4, MIX_BYTES / 4) != 0) {
+                    printf("self_interleaved_verify() failed at batch %llu prefetch %u!\n", (unsigned long long)n, prefetch);
+                    free(cache);
+                    return;
+                }
+            }
+        }
+    }
+    free(cache);
+
+    printf("self_interleaved_verify() passed\n");
+    return;
+}
+
+// Anonymous memory for a benchmark dataset, on transparent huge pages if asked; release with munmap().
+unsigned char *alloc_dataset(uint64_t size, int huge_pages) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return (NULL);
+    }
+    if (huge_pages) {
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+    return (p);
+}
+
+// Hashimoto over a cache_size dataset with the batch, prefetch and page size of the profile.
+void benchmark_hashimoto(const struct dagger_profile *profile, uint64_t cache_size, uint64_t items) {
     unsigned char seed[] = "123";
     struct timespec start, end;
     struct timespec startb, endb;
 
-    uint64_t cache_size = 83886080; // 80 MB
+    uint64_t batch = profile->hashimoto_batch < HASHIMOTO_MAX_BATCH ? profile->hashimoto_batch : HASHIMOTO_MAX_BATCH;
     printf("Generating cache with size %llu\n", cache_size);
     clock_gettime(CLOCK_MONOTONIC, &start);
-    unsigned char *cache = generate_cache(cache_size, seed, sizeof(seed) - 1);
+    unsigned char *cache = alloc_dataset(cache_size, profile->huge_pages);
+    if (cache == NULL) {
+        fprintf(stderr, "cannot allocate %llu bytes of cache\n", (unsigned long long)cache_size);
+        return;
+    }
+    generate_cache_into(cache, cache_size, seed, sizeof(seed) - 1);
     clock_gettime(CLOCK_MONOTONIC, &end);
     printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    metrics_set(METRIC_CACHE_BYTES, cache_size);
+    printf("Hashimoto with %llu interleaved, prefetch %d%s\n", (unsigned long long)batch, profile->prefetch,
+           profile->huge_pages ? ", huge pages" : "");
 
     clock_gettime(CLOCK_MONOTONIC, &start);
     clock_gettime(CLOCK_MONOTONIC, &startb);
-    unsigned char *init_hash = malloc(HASH_BYTES);
-    unsigned char *mix = aligned_alloc(32, HASH_BYTES * 2);
+    unsigned char *init_hash = malloc(HASH_BYTES * batch);
+    unsigned char *mix = aligned_alloc(32, MIX_BYTES * batch);
+    if (init_hash == NULL || mix == NULL) {
+        fprintf(stderr, "cannot allocate hashimoto buffers\n");
+        free(init_hash);
+        free(mix);
+        munmap(cache, cache_size);
+        return;
+    }
 
-    uint64_t items = 1000000;
-    for (uint64_t idx = 0; idx < items; idx ++) {
-        SHA512(&idx, 8, init_hash);
-        hashimoto_avx(init_hash, cache_size, cache, mix);
+    uint64_t report = 0;
+    for (uint64_t idx = 0; idx < items; idx += batch) {
+        uint64_t n = items - idx < batch ? items - idx : batch;
+        uint64_t t0 = metrics_now();
+        uint64_t tl = timeline_begin();
+        for (uint64_t l = 0; l < n; l++) {
+            uint64_t nonce = idx + l;
+            SHA512(&nonce, 8, init_hash + l * HASH_BYTES);
+        }
+        tl = timeline_end("seed hashes", tl);
+        if (n == 1) {
+            hashimoto_avx(init_hash, cache_size, cache, (uint32_t *)mix);
+        } else {
+            hashimoto_interleaved(init_hash, n, cache_size, cache, (uint32_t *)mix, profile->prefetch);
+        }
+        timeline_end("hashimoto", tl);
+        // the batch finishes together; each hash gets its share of the batch time
+        uint64_t per_hash = (metrics_now() - t0) / n;
+        for (uint64_t l = 0; l < n; l++) {
+            metrics_observe(METRIC_HASH_LATENCY, per_hash);
+        }
+        metrics_add(METRIC_HASHES, n);
 
-        if (idx % 10000 != 0) {
+        if (report >= idx + n) {
             continue;
         }
 
@@ -389,11 +572,12 @@ void benchmark_hashimoto() {
         double used_time = (endb.tv_sec - startb.tv_sec) + (endb.tv_nsec - startb.tv_nsec) / 1e9;
         startb = endb;
 
-        printf("rate %0.2f H/s, item %llu, ", 10000 / used_time, idx);
+        printf("rate %0.2f H/s, item %llu, ", 10000 / used_time, report);
         for (int i = 0; i < 32; i++) {
-            printf("%02x", mix[i]);
+            printf("%02x", mix[(report - idx) * MIX_BYTES + i]);
         }
         printf("\n");
+        report += 10000;
     }
     clock_gettime(CLOCK_MONOTONIC, &end);
     double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
@@ -401,17 +585,292 @@ void benchmark_hashimoto() {
 
     free(init_hash);
     free(mix);
+    munmap(cache, cache_size);
 
     return;
 }
 
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Nanoseconds per dependent load, chasing a random cycle through the cache lines of size bytes.
+double measure_latency(uint64_t size, double seconds) {
+    uint64_t lines = size / 64;
+    uint64_t *buf = (uint64_t *)alloc_dataset(size, 0);
+    uint32_t *order = malloc(sizeof(uint32_t) * lines);
+    if (buf == NULL || order == NULL) {
+        free(order);
+        return (0);
+    }
+    // Sattolo's shuffle: one cycle through every line
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t i = 0; i < lines; i++) {
+        order[i] = i;
+    }
+    for (uint64_t i = lines - 1; i > 0; i--) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t j = (rng >> 33) % i;
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (uint64_t i = 0; i < lines; i++) {
+        buf[order[i] * 8] = order[(i + 1) % lines] * 8;
+    }
+    free(order);
+
+    struct timespec start;
+    uint64_t p = 0, steps = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double t;
+    do {
+        for (int k = 0; k < 100000; k++) {
+            p = buf[p];
+        }
+        steps += 100000;
+    } while ((t = seconds_since(&start)) < seconds);
+    munmap(buf, size);
+    return (p == UINT64_MAX ? 0 : t / steps * 1e9); // p keeps the chase alive
+}
+
+struct calibrate_worker {
+    unsigned char *data;
+    uint64_t size;
+    uint64_t batch;
+    unsigned prefetch;
+    double seconds;
+    uint64_t done; // bytes read or hashes computed
+    uint64_t sum;
+};
+
+static void *bandwidth_worker(void *arg) {
+    struct calibrate_worker *w = arg;
+    const uint64_t *p = (const uint64_t *)w->data;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (uint64_t i = 0; i < w->size / 8; i += 4) {
+            s0 += p[i];
+            s1 += p[i + 1];
+            s2 += p[i + 2];
+            s3 += p[i + 3];
+        }
+        w->sum += s0 + s1 + s2 + s3;
+        w->done += w->size;
+    } while (seconds_since(&start) < w->seconds);
+    return (NULL);
+}
+
+static void *hashimoto_worker(void *arg) {
+    struct calibrate_worker *w = arg;
+    unsigned char hashes[HASH_BYTES * HASHIMOTO_MAX_BATCH];
+    uint32_t mixes[MIX_BYTES / 4 * HASHIMOTO_MAX_BATCH] __attribute__((aligned(32)));
+    uint64_t nonce = (uint64_t)w->sum << 32;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (int rep = 0; rep < 16; rep++) {
+            for (uint64_t l = 0; l < w->batch; l++, nonce++) {
+                SHA512(&nonce, 8, hashes + l * HASH_BYTES);
+            }
+            if (w->batch == 1) {
+                hashimoto_avx(hashes, w->size, w->data, mixes);
+            } else {
+                hashimoto_interleaved(hashes, w->batch, w->size, w->data, mixes, w->prefetch);
+            }
+            w->done += w->batch;
+        }
+    } while (seconds_since(&start) < w->seconds);
+    return (NULL);
+}
+
+// Run worker on threads threads over data for seconds; returns the total of their done counters per second,
+// or 0 when the threads cannot all be started, so that setting is never picked.
+static double calibrate_run(void *(*worker)(void *), unsigned char *data, uint64_t size, uint64_t batch,
+                            unsigned prefetch, int threads, double seconds) {
+    struct calibrate_worker *w = calloc(threads, sizeof(*w));
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    uint64_t slice = size / threads / 64 * 64;
+    int started = 0;
+    if (w == NULL || tids == NULL) {
+        fprintf(stderr, "out of memory\n");
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; w != NULL && tids != NULL && t < threads; t++) {
+        w[t].data = worker == bandwidth_worker ? data + t * slice : data;
+        w[t].size = worker == bandwidth_worker ? slice : size;
+        w[t].batch = batch;
+        w[t].prefetch = prefetch;
+        w[t].seconds = seconds;
+        w[t].sum = t;
+        int err = pthread_create(&tids[t], NULL, worker, &w[t]);
+        if (err != 0) {
+            fprintf(stderr, "cannot start thread %d: %s\n", t, strerror(err));
+            break;
+        }
+        started++;
+    }
+    double total = 0;
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        total += w[t].done;
+    }
+    total = started == threads ? total / seconds_since(&start) : 0;
+    free(tids);
+    free(w);
+    return (total);
+}
+
+/*
+ * Measure this host and pick the hashimoto tunables: memory latency and
+ * bandwidth for the record, then batch width and prefetch distance on one
+ * thread, huge pages, and the thread count, each kept only if it is faster.
+ */
+int calibrate(uint64_t cache_size, uint64_t latency_size, double seconds, const char *output) {
+    struct dagger_profile p;
+    unsigned char seed[] = "123";
+    dagger_profile_defaults(&p);
+    printf("Calibrating %s (%d cores)\n", p.host, p.cores);
+
+    p.latency_ns = measure_latency(latency_size, seconds);
+    printf("latency   %8.1f ns (random loads over %llu bytes)\n", p.latency_ns,
+           (unsigned long long)latency_size);
+
+    unsigned char *data = alloc_dataset(cache_size, 0);
+    if (data == NULL) {
+        fprintf(stderr, "cannot allocate %llu bytes\n", (unsigned long long)cache_size);
+        return (1);
+    }
+    generate_cache_into(data, cache_size, seed, sizeof(seed) - 1);
+    p.bandwidth_mbs = calibrate_run(bandwidth_worker, data, cache_size, 0, 0, p.cores, seconds) / 1e6;
+    printf("bandwidth %8.0f MB/s (%d threads)\n", p.bandwidth_mbs, p.cores);
+
+    double best = 0;
+    for (uint64_t batch = 1; batch <= HASHIMOTO_MAX_BATCH; batch *= 2) {
+        for (unsigned prefetch = 0; prefetch == 0 || prefetch < batch; prefetch = prefetch ? prefetch * 2 : 1) {
+            double rate = calibrate_run(hashimoto_worker, data, cache_size, batch, prefetch, 1, seconds);
+            printf("batch %2llu prefetch %2u: %10.0f H/s\n", (unsigned long long)batch, prefetch, rate);
+            if (rate > best) {
+                best = rate;
+                p.hashimoto_batch = batch;
+                p.prefetch = prefetch;
+            }
+            if (batch == 1) {
+                break;
+            }
+        }
+    }
+
+    unsigned char *huge = alloc_dataset(cache_size, 1);
+    if (huge != NULL) {
+        memcpy(huge, data, cache_size);
+        double rate = calibrate_run(hashimoto_worker, huge, cache_size, p.hashimoto_batch, p.prefetch, 1, seconds);
+        printf("huge pages:             %10.0f H/s\n", rate);
+        if (rate > best * 1.02) {
+            best = rate;
+            p.huge_pages = 1;
+            munmap(data, cache_size);
+            data = huge;
+        } else {
+            munmap(huge, cache_size);
+        }
+    }
+
+    best = 0;
+    for (int threads = 1;; threads = threads * 2 < p.cores ? threads * 2 : p.cores) {
+        double rate = calibrate_run(hashimoto_worker, data, cache_size, p.hashimoto_batch, p.prefetch, threads, seconds);
+        printf("threads %3d:            %10.0f H/s\n", threads, rate);
+        if (rate > best * 1.02) {
+            best = rate;
+            p.threads = threads;
+        }
+        if (threads == p.cores) {
+            break;
+        }
+    }
+    p.hashimoto_hps = best;
+    munmap(data, cache_size);
+    if (best == 0) {
+        fprintf(stderr, "no hashimoto run completed, profile not written\n");
+        return (1);
+    }
+
+    printf("Chose batch %d, prefetch %d, %s, %d threads: %0.0f H/s\n", p.hashimoto_batch, p.prefetch,
+           p.huge_pages ? "huge pages" : "4K pages", p.threads, p.hashimoto_hps);
+    return (dagger_profile_save(&p, output) == 0 ? 0 : 1);
+}
+
+#ifndef DAGGER_NO_MAIN
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--cache-size N] [--items N]\n"
+            "       %s calibrate [--cache-size N] [--latency-size N] [--seconds S] [--output PATH]\n"
+            "  --cache-size N       dataset bytes hashimoto reads (default 83886080)\n"
+            "  --items N            hashes of the benchmark (default 1000000)\n"
+            "  --latency-size N     bytes the latency probe walks (default 268435456)\n"
+            "  --seconds S          time per calibration measurement (default 0.25)\n"
+            "  --output PATH        profile to write (default $DAGGER_PROFILE or ~/.dagger/HOST.profile)\n",
+            prog, prog);
+}
+
 int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"cache-size", required_argument, 0, 'c'},   {"items", required_argument, 0, 'n'},
+        {"latency-size", required_argument, 0, 'l'}, {"seconds", required_argument, 0, 's'},
+        {"output", required_argument, 0, 'o'},       {0, 0, 0, 0},
+    };
+    int cal = argc >= 2 && strcmp(argv[1], "calibrate") == 0;
+    uint64_t cache_size = 83886080; // 80 MB
+    uint64_t items = 1000000;
+    uint64_t latency_size = 268435456;
+    double seconds = 0.25;
+    const char *output = NULL;
+    int opt;
+    optind = cal ? 2 : 1;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'c': cache_size = strtoull(optarg, NULL, 0); break;
+        case 'n': items = strtoull(optarg, NULL, 0); break;
+        case 'l': latency_size = strtoull(optarg, NULL, 0); break;
+        case 's': seconds = atof(optarg); break;
+        case 'o': output = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (optind != argc || cache_size < MIX_BYTES || latency_size < 4096 || seconds <= 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    if (cal) {
+        return (calibrate(cache_size, latency_size, seconds, output));
+    }
+
+    // DAGGER_METRICS=file:PATH or unix:PATH exports live rates and latencies
+    metrics_start_env();
+    // DAGGER_TRACE_FILE=PATH records row accesses in -DDAGGER_TRACE builds
+    uint32_t trace_rows[TRACE_MARKER] = {HASH_BYTES, MIX_BYTES, 0};
+    trace_start_env(trace_rows);
+    // DAGGER_TIMELINE=PATH records a Chrome trace of the stages, SIGUSR2 pauses it
+    timeline_start_env();
+    // DAGGER_PROFILE (or ~/.dagger/HOST.profile) from `calibrate` picks the hashimoto tunables
+    struct dagger_profile profile;
+    dagger_profile_load(&profile);
     simple_verify();
     self_verify();
     simple_hashimoto_verify();
+    self_interleaved_verify();
+    self_caches_verify();
+    // benchmark_generate_caches();
     // benchmark_generate_data_item();
-    benchmark_hashimoto();
+    benchmark_hashimoto(&profile, cache_size, items);
+    timeline_stop();
+    trace_stop();
+    metrics_stop();
     return (0);
 }
-
-
+#endif
@@ -0,0 +1,256 @@
+// Explicit instantiations and runtime registry of the templated dagger kernels.
+//
+//   g++ -std=c++17 -O3 -march=native dagger_kernels.cpp -o dagger_kernels
+//
+// Define DAGGER_NO_MAIN to link the kernels into another program.
+//
+// To benchmark the instantiations against the hand-unrolled C kernels of
+// dagger_32.c for the same parameters:
+//
+//   gcc -O3 -march=native -DDAGGER_NO_MAIN -c dagger_32.c -o /tmp/dagger_32.o
+//   g++ -std=c++17 -O3 -march=native -DDAGGER_KERNELS_VS_C dagger_kernels.cpp /tmp/dagger_32.o -pthread -o dagger_kernels
+
+#include <stdio.h>
+#include <time.h>
+
+#include "sha512.c"
+
+#include "dagger_kernels.h"
+#include "dagger_kernels.hpp"
+
+template struct DaggerKernel<uint32_t, 16, 256, 128, 64, Sha512Hash>;
+template struct DaggerKernel<uint64_t, 8, 256, 128, 64, Sha512Hash>;
+
+static const DaggerKernelEntry kernel_registry[] = {
+    make_dagger_kernel_entry<Dagger32Kernel>("dagger32-sha512"),
+    make_dagger_kernel_entry<Dagger64Kernel>("dagger64-sha512"),
+};
+
+const DaggerKernelEntry *dagger_kernels(size_t *n) {
+    *n = sizeof(kernel_registry) / sizeof(kernel_registry[0]);
+    return kernel_registry;
+}
+
+const DaggerKernelEntry *find_dagger_kernel(unsigned word_bytes, unsigned dataset_parents, unsigned mix_bytes,
+                                            unsigned loop_accesses, const char *hash_name) {
+    for (const DaggerKernelEntry &e : kernel_registry) {
+        if (e.word_bytes == word_bytes && e.dataset_parents == dataset_parents && e.mix_bytes == mix_bytes &&
+            e.loop_accesses == loop_accesses && strcmp(e.hash_name, hash_name) == 0) {
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+void dagger32_kernel_generate_cache(unsigned char *cache, uint64_t cache_size, const unsigned char *seed,
+                                    uint64_t seed_size) {
+    Dagger32Kernel::generate_cache_into(cache, cache_size, seed, seed_size);
+}
+
+void dagger32_kernel_dataset_item(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *item) {
+    Dagger32Kernel::calculate_dataset_item(cache, cache_size, i, item);
+}
+
+void dagger32_kernel_mask_data(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *data) {
+    Dagger32Kernel::calculate_mask_data(cache, cache_size, i, data);
+}
+
+void dagger32_kernel_hashimoto(const unsigned char *hash, uint64_t size, const unsigned char *dataset,
+                               unsigned char *digest) {
+    Dagger32Kernel::hashimoto(hash, size, dataset, digest);
+}
+
+void dagger32_kernel_hashimoto_light(const unsigned char *hash, uint64_t size, const unsigned char *cache,
+                                     uint64_t cache_size, unsigned char *digest) {
+    Dagger32Kernel::hashimoto_light(hash, size, cache, cache_size, digest);
+}
+
+void dagger32_kernel_hashimoto_rows(const unsigned char *hash, uint64_t rows, dagger32_row_fn row, void *ctx,
+                                    unsigned char *digest) {
+    Dagger32Kernel::hashimoto_rows(
+        hash, rows, [&](uint64_t parent, uint32_t *scratch) { return row(ctx, parent, scratch); }, digest);
+}
+
+#ifndef DAGGER_NO_MAIN
+
+static int check_hex(const char *name, const unsigned char *data, int len, const char *expect) {
+    char actual[2 * 64 + 1];
+    for (int i = 0; i < len; i++) {
+        sprintf(actual + 2 * i, "%02x", data[i]);
+    }
+    if (strcmp(actual, expect) != 0) {
+        printf("%s failed!\n", name);
+        printf("expect: %s\n", expect);
+        printf("actual: %s\n", actual);
+        return (0);
+    }
+    return (1);
+}
+
+// Vectors produced by dagger_32.c (simple_verify, simple_hashimoto_verify) and dagger.c.
+void self_verify() {
+    unsigned char seed[] = "123";
+    unsigned char data[64];
+    unsigned char digest[32];
+    int ok = 1;
+
+    const DaggerKernelEntry *k32 = find_dagger_kernel(4, 256, 128, 64, "sha512");
+    unsigned char *cache = k32->generate_cache(1024, seed, sizeof(seed) - 1);
+    k32->calculate_dataset_item(cache, 1024, 123, data);
+    ok &= check_hex("dagger32 dataset item", data, 64,
+                    "c098aa298730026b820035f4587d37737e3f5733010a61e5f833ee4e7535955f"
+                    "6f3cbc75a65881d3957ec972b4fae8226804a78a09bb450d5d0b5303fb836fc1");
+    k32->calculate_mask_data(cache, 1024, 123, data);
+    ok &= check_hex("dagger32 mask data", data, 64,
+                    "46df553f850fc96736a154a247c7e511a70d5f8c3f8bdd1fc098c64dad77bd73"
+                    "41be534f0538e525cf79cede6c9ecf45b1c1418aba2cfbc5021b78517d87372a");
+    SHA512(seed, sizeof(seed) - 1, data);
+    k32->hashimoto(data, 1024, cache, digest);
+    ok &= check_hex("dagger32 hashimoto", digest, 32,
+                    "a35905961116a162bd58f9bf83ea40198b7cb2469ddb6844df1cbc9109f194aa");
+
+    // hashimoto_light must match hashimoto over the dataset it computes rows of
+    unsigned char dataset[1024];
+    unsigned char light[32];
+    for (uint64_t i = 0; i < sizeof(dataset) / 64; i++) {
+        k32->calculate_dataset_item(cache, 1024, i, dataset + i * 64);
+    }
+    k32->hashimoto(data, sizeof(dataset), dataset, digest);
+    k32->hashimoto_light(data, sizeof(dataset), cache, 1024, light);
+    if (memcmp(digest, light, sizeof(light)) != 0) {
+        printf("dagger32 hashimoto_light failed!\n");
+        ok = 0;
+    }
+    free(cache);
+
+    const DaggerKernelEntry *k64 = find_dagger_kernel(8, 256, 128, 64, "sha512");
+    cache = k64->generate_cache(1024, seed, sizeof(seed) - 1);
+    k64->calculate_dataset_item(cache, 1024, 123, data);
+    ok &= check_hex("dagger64 dataset item", data, 64,
+                    "4fd90864df58aea10c0b72913e901714c35bb3b1b198263a210e0883a35f85a3"
+                    "2dd820c3f1af7d8728e1555ae4a9128f7ae64844a76ac7e65c6075519a699ebc");
+    free(cache);
+
+    if (ok) {
+        printf("self_verify() passed\n");
+    }
+    return;
+}
+
+void benchmark_generate_data_item(const DaggerKernelEntry *k) {
+    unsigned char seed[] = "123";
+    struct timespec start, end;
+
+    uint64_t cache_size = 16777216; // 16 MB
+    unsigned char *cache = k->generate_cache(cache_size, seed, sizeof(seed) - 1);
+
+    unsigned char data[64];
+    uint64_t items = 200000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t idx = 0; idx < items; idx++) {
+        k->calculate_dataset_item(cache, cache_size, idx, data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %llu items took %0.2fs, rate %0.2f H/s\n", k->name, (unsigned long long)items, used_time,
+           items / used_time);
+
+    free(cache);
+    return;
+}
+
+#ifdef DAGGER_KERNELS_VS_C
+// The hand-unrolled kernels of dagger_32.c (WORD_BYTES 4, DATASET_PARENTS 256,
+// MIX_BYTES 128, LOOP_ACCESSES 64), i.e. Dagger32Kernel.  dagger.c has no
+// DAGGER_NO_MAIN and clashes with dagger_32.c symbol for symbol, so only the
+// 32-bit configuration is compared.
+extern "C" {
+void calculate_dataset_item_opt(unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *dataset);
+void hashimoto(unsigned char *hash, uint64_t size, unsigned char *dataset, uint32_t *mix);
+void hashimoto_avx(unsigned char *hash, uint64_t size, unsigned char *dataset, uint32_t *mix);
+}
+
+// Time f(0) .. f(n - 1); f returns one byte of its output so the calls cannot be
+// dropped, and the folded bytes let the caller check both sides agree.
+template <typename F>
+static unsigned char benchmark_loop(const char *name, uint64_t n, F &&f) {
+    struct timespec start, end;
+    unsigned char sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t idx = 0; idx < n; idx++) {
+        sink = (unsigned char)((sink << 1 | sink >> 7) ^ f(idx));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-32s %llu in %0.2fs, rate %0.2f H/s\n", name, (unsigned long long)n, used_time, n / used_time);
+    return (sink);
+}
+
+void benchmark_vs_c() {
+    unsigned char seed[] = "123";
+    uint64_t cache_size = 16777216; // 16 MB, also the dataset hashimoto reads
+    unsigned char *cache = Dagger32Kernel::generate_cache(cache_size, seed, sizeof(seed) - 1);
+    if (cache == NULL) {
+        printf("benchmark_vs_c() failed: out of memory!\n");
+        return;
+    }
+    int ok = 1;
+
+    uint64_t items = 200000;
+    unsigned char data[64] __attribute__((aligned(64)));
+    unsigned char t = benchmark_loop("dataset item (template)", items, [&](uint64_t idx) {
+        Dagger32Kernel::calculate_dataset_item(cache, cache_size, idx, data);
+        return data[idx % 64];
+    });
+    unsigned char c = benchmark_loop("dataset item (dagger_32.c opt)", items, [&](uint64_t idx) {
+        calculate_dataset_item_opt(cache, cache_size, idx, data);
+        return data[idx % 64];
+    });
+    ok &= t == c;
+
+    uint64_t hashes = 200000;
+    unsigned char hash[64] __attribute__((aligned(64)));
+    uint32_t mix[Dagger32Kernel::mix_words] __attribute__((aligned(64)));
+    unsigned char digest[Dagger32Kernel::digest_bytes];
+    SHA512(seed, sizeof(seed) - 1, hash);
+    t = benchmark_loop("hashimoto (template)", hashes, [&](uint64_t idx) {
+        memcpy(hash, &idx, sizeof(idx));
+        Dagger32Kernel::hashimoto(hash, cache_size, cache, digest);
+        return digest[idx % sizeof(digest)];
+    });
+    c = benchmark_loop("hashimoto (dagger_32.c)", hashes, [&](uint64_t idx) {
+        memcpy(hash, &idx, sizeof(idx));
+        ::hashimoto(hash, cache_size, cache, mix);
+        return ((unsigned char *)mix)[idx % sizeof(digest)];
+    });
+    ok &= t == c;
+    c = benchmark_loop("hashimoto (dagger_32.c avx)", hashes, [&](uint64_t idx) {
+        memcpy(hash, &idx, sizeof(idx));
+        hashimoto_avx(hash, cache_size, cache, mix);
+        return ((unsigned char *)mix)[idx % sizeof(digest)];
+    });
+    ok &= t == c;
+
+    if (!ok) {
+        printf("benchmark_vs_c() failed: template and C kernels disagree!\n");
+    }
+    free(cache);
+    return;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    self_verify();
+
+    size_t n;
+    const DaggerKernelEntry *kernels = dagger_kernels(&n);
+    for (size_t i = 0; i < n; i++) {
+        benchmark_generate_data_item(&kernels[i]);
+    }
+#ifdef DAGGER_KERNELS_VS_C
+    benchmark_vs_c();
+#endif
+    return (0);
+}
+
+#endif
@@ -0,0 +1,37 @@
+// C entry points of the Dagger32Kernel instantiation (the dagger_32.c
+// parameters) in dagger_kernels.cpp, for C programs that link it:
+//
+//   g++ -std=c++17 -O3 -march=native -DDAGGER_NO_MAIN -c dagger_kernels.cpp -o dagger_kernels.o
+//
+// dagger_kernels.cpp compiles its own sha512.c as C++, so the object links next
+// to dagger_32.c without symbol clashes.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dagger32_kernel_generate_cache(unsigned char *cache, uint64_t cache_size, const unsigned char *seed,
+                                    uint64_t seed_size);
+void dagger32_kernel_dataset_item(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *item);
+// data holds the 64 bytes to mask on input and the masked bytes on output.
+void dagger32_kernel_mask_data(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *data);
+// digest receives the 32-byte compressed mix.
+void dagger32_kernel_hashimoto(const unsigned char *hash, uint64_t size, const unsigned char *dataset,
+                               unsigned char *digest);
+void dagger32_kernel_hashimoto_light(const unsigned char *hash, uint64_t size, const unsigned char *cache,
+                                     uint64_t cache_size, unsigned char *digest);
+
+// Returns the 32 words of dataset row parent, either in place or built into scratch.
+typedef const uint32_t *(*dagger32_row_fn)(void *ctx, uint64_t parent, uint32_t *scratch);
+
+// hashimoto over rows dataset rows supplied by row(ctx, parent, scratch).
+void dagger32_kernel_hashimoto_rows(const unsigned char *hash, uint64_t rows, dagger32_row_fn row, void *ctx,
+                                    unsigned char *digest);
+
+#ifdef __cplusplus
+}
+#endif
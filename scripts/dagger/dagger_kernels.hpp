@@ -0,0 +1,252 @@
+// Compile-time specialized dagger kernels.
+//
+// dagger.c (64-bit words, fnv64) and dagger_32.c (32-bit words, fnv32) are the
+// same algorithm with different #defines.  DaggerKernel<> carries those
+// parameters as template arguments so every configuration gets fully unrolled
+// word loops without keeping a separate copy of the code.  The configurations
+// we run are explicitly instantiated in dagger_kernels.cpp and can be picked at
+// runtime through find_dagger_kernel().
+//
+// The C++ tools use the templates directly.  C callers (the cgo package,
+// hybrid_miner.c) go through the extern "C" Dagger32Kernel wrappers declared in
+// dagger_kernels.h, including hashimoto_rows() for callers that supply dataset
+// rows their own way.  dagger.c and dagger_32.c keep their hand-written AVX and
+// interleaved kernels for the single-file tools; build dagger_kernels.cpp with
+// DAGGER_KERNELS_VS_C to check that they still match the instantiations.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <type_traits>
+#include <utility>
+
+unsigned char *SHA512(void *data, unsigned int data_len, unsigned char *digest);
+
+struct Sha512Hash {
+    static constexpr unsigned bytes = 64;
+    static constexpr const char *name = "sha512";
+    static inline void hash(const void *data, uint64_t len, unsigned char *digest) {
+        SHA512((void *)data, len, digest);
+    }
+};
+
+template <typename Word>
+struct FnvPrime;
+
+template <>
+struct FnvPrime<uint32_t> {
+    static constexpr uint32_t value = 0x01000193;
+};
+
+template <>
+struct FnvPrime<uint64_t> {
+    static constexpr uint64_t value = 0x00000100000001B3ULL;
+};
+
+template <typename Word>
+__attribute__((always_inline)) inline Word fnv(Word a, Word b) {
+    return (a * FnvPrime<Word>::value) ^ b;
+}
+
+template <typename F, size_t... K>
+__attribute__((always_inline)) inline void unroll_impl(F &&f, std::index_sequence<K...>) {
+    (f(std::integral_constant<size_t, K>{}), ...);
+}
+
+// Call f(0), f(1), ..., f(N - 1) with compile-time indices.
+template <size_t N, typename F>
+__attribute__((always_inline)) inline void unroll(F &&f) {
+    unroll_impl(f, std::make_index_sequence<N>{});
+}
+
+template <typename Word, unsigned WordsPerHash, unsigned DatasetParents, unsigned MixBytes, unsigned LoopAccesses,
+          typename Hash = Sha512Hash, unsigned CacheRounds = 3>
+struct DaggerKernel {
+    static constexpr unsigned word_bytes = sizeof(Word);
+    static constexpr unsigned hash_bytes = WordsPerHash * sizeof(Word);
+    static constexpr unsigned mix_words = MixBytes / sizeof(Word);
+    static constexpr unsigned digest_bytes = MixBytes / 4;
+    static constexpr unsigned row_items = MixBytes / hash_bytes;
+    static constexpr unsigned dataset_parents = DatasetParents;
+    static constexpr unsigned loop_accesses = LoopAccesses;
+    static constexpr unsigned cache_rounds = CacheRounds;
+    static constexpr const char *hash_name = Hash::name;
+
+    static_assert(std::is_unsigned<Word>::value, "word must be unsigned");
+    static_assert(hash_bytes == Hash::bytes, "a cache row must be exactly one hash");
+    static_assert(MixBytes % hash_bytes == 0, "mix must be a whole number of rows");
+    static_assert(mix_words % 4 == 0, "mix compression folds 4 words at a time");
+
+    static void generate_cache_into(unsigned char *cache, uint64_t cache_size, const unsigned char *seed,
+                                    uint64_t seed_size) {
+        unsigned char hash[hash_bytes];
+
+        Hash::hash(seed, seed_size, cache);
+        uint64_t rows = cache_size / hash_bytes;
+        for (uint64_t i = 1; i < rows; i++) {
+            Hash::hash(cache + (i - 1) * hash_bytes, hash_bytes, cache + i * hash_bytes);
+        }
+        for (unsigned r = 0; r < CacheRounds; r++) {
+            for (uint64_t i = 0; i < rows; i++) {
+                uint32_t v;
+                memcpy(&v, cache + i * hash_bytes, sizeof(v));
+                const unsigned char *p0 = cache + (v % rows) * hash_bytes;
+                const unsigned char *p1 = cache + ((i - 1 + rows) % rows) * hash_bytes;
+                unroll<hash_bytes>([&](auto k) { hash[k] = p0[k] ^ p1[k]; });
+                Hash::hash(hash, hash_bytes, cache + i * hash_bytes);
+            }
+        }
+    }
+
+    static unsigned char *generate_cache(uint64_t cache_size, const unsigned char *seed, uint64_t seed_size) {
+        unsigned char *cache = (unsigned char *)malloc(cache_size);
+        if (cache == NULL) {
+            return (NULL);
+        }
+        generate_cache_into(cache, cache_size, seed, seed_size);
+        return (cache);
+    }
+
+    // Mix DatasetParents pseudo-randomly selected cache rows into mix and hash it.
+    static __attribute__((always_inline)) inline void mix_parents(const Word *cache_w, uint64_t rows, uint64_t i,
+                                                                  Word *mix, unsigned char *out) {
+        // SHA512() stores 64-bit words; go through bytes so the Word view of mix
+        // is not reordered around it under strict aliasing.
+        unsigned char buf[hash_bytes] __attribute__((aligned(64)));
+        memcpy(buf, mix, hash_bytes);
+        Hash::hash(buf, hash_bytes, buf);
+        memcpy(mix, buf, hash_bytes);
+        for (uint64_t j = 0; j < DatasetParents; j++) {
+            uint64_t cache_idx = (uint64_t)fnv<Word>((Word)(i ^ j), mix[j % WordsPerHash]) % rows;
+            const Word *parent = &cache_w[cache_idx * WordsPerHash];
+            unroll<WordsPerHash>([&](auto k) { mix[k] = fnv<Word>(mix[k], parent[k]); });
+        }
+        Hash::hash(mix, hash_bytes, out);
+    }
+
+    static void calculate_dataset_item(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *item) {
+        uint64_t rows = cache_size / hash_bytes;
+        const Word *cache_w = (const Word *)cache;
+        const Word *row = &cache_w[(i % rows) * WordsPerHash];
+        Word mix[WordsPerHash] __attribute__((aligned(64)));
+
+        unroll<WordsPerHash>([&](auto k) { mix[k] = row[k]; });
+        mix[0] ^= (Word)i;
+        mix_parents(cache_w, rows, i, mix, item);
+    }
+
+    // data holds the 64 bytes to mask on input and the masked bytes on output.
+    static void calculate_mask_data(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *data) {
+        uint64_t rows = cache_size / hash_bytes;
+        const Word *cache_w = (const Word *)cache;
+        const Word *row = &cache_w[(i % rows) * WordsPerHash];
+        Word mix[WordsPerHash] __attribute__((aligned(64)));
+
+        memcpy(mix, data, hash_bytes);
+        unroll<WordsPerHash>([&](auto k) { mix[k] ^= row[k]; });
+        mix[0] ^= (Word)i;
+        mix_parents(cache_w, rows, i, mix, data);
+    }
+
+    // The hashimoto loop over any row source: row(parent, scratch) returns the
+    // mix_words words of dataset row parent, either in place or built into
+    // scratch.  digest receives digest_bytes (the compressed mix).
+    template <typename Row>
+    static __attribute__((always_inline)) inline void hashimoto_rows(const unsigned char *hash, uint64_t rows,
+                                                                     Row &&row, unsigned char *digest) {
+        const Word *hash_w = (const Word *)hash;
+        Word mix[mix_words] __attribute__((aligned(64)));
+        Word scratch[mix_words] __attribute__((aligned(64)));
+
+        // replicate hash
+        unroll<mix_words>([&](auto k) { mix[k] = hash_w[k % WordsPerHash]; });
+
+        Word seed_head = mix[0];
+
+        // Mix in random dataset nodes
+        for (unsigned i = 0; i < LoopAccesses; i++) {
+            uint64_t parent = (uint64_t)fnv<Word>((Word)i ^ seed_head, mix[i % mix_words]) % rows;
+            const Word *r = row(parent, scratch);
+            unroll<mix_words>([&](auto k) { mix[k] = fnv<Word>(mix[k], r[k]); });
+        }
+
+        unroll<mix_words / 4>([&](auto k) {
+            mix[k] = fnv<Word>(fnv<Word>(fnv<Word>(mix[4 * k], mix[4 * k + 1]), mix[4 * k + 2]), mix[4 * k + 3]);
+        });
+        memcpy(digest, mix, digest_bytes);
+    }
+
+    static void hashimoto(const unsigned char *hash, uint64_t size, const unsigned char *dataset, unsigned char *digest) {
+        const Word *dataset_w = (const Word *)dataset;
+        hashimoto_rows(
+            hash, size / MixBytes, [&](uint64_t parent, Word *) { return &dataset_w[parent * mix_words]; }, digest);
+    }
+
+    // hashimoto() without the dataset: each row is computed from the cache as it is read.
+    static void hashimoto_light(const unsigned char *hash, uint64_t size, const unsigned char *cache,
+                                uint64_t cache_size, unsigned char *digest) {
+        hashimoto_rows(
+            hash, size / MixBytes,
+            [&](uint64_t parent, Word *scratch) {
+                for (unsigned r = 0; r < row_items; r++) {
+                    calculate_dataset_item(cache, cache_size, parent * row_items + r,
+                                           (unsigned char *)scratch + r * hash_bytes);
+                }
+                return (const Word *)scratch;
+            },
+            digest);
+    }
+};
+
+struct DaggerKernelEntry {
+    const char *name;
+    unsigned word_bytes;
+    unsigned words_per_hash;
+    unsigned dataset_parents;
+    unsigned mix_bytes;
+    unsigned loop_accesses;
+    unsigned cache_rounds;
+    const char *hash_name;
+    unsigned char *(*generate_cache)(uint64_t cache_size, const unsigned char *seed, uint64_t seed_size);
+    void (*calculate_dataset_item)(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *item);
+    void (*calculate_mask_data)(const unsigned char *cache, uint64_t cache_size, uint64_t i, unsigned char *data);
+    void (*hashimoto)(const unsigned char *hash, uint64_t size, const unsigned char *dataset, unsigned char *digest);
+    void (*hashimoto_light)(const unsigned char *hash, uint64_t size, const unsigned char *cache, uint64_t cache_size,
+                            unsigned char *digest);
+};
+
+template <typename Kernel>
+constexpr DaggerKernelEntry make_dagger_kernel_entry(const char *name) {
+    return DaggerKernelEntry{name,
+                             Kernel::word_bytes,
+                             Kernel::hash_bytes / Kernel::word_bytes,
+                             Kernel::dataset_parents,
+                             Kernel::mix_words * Kernel::word_bytes,
+                             Kernel::loop_accesses,
+                             Kernel::cache_rounds,
+                             Kernel::hash_name,
+                             Kernel::generate_cache,
+                             Kernel::calculate_dataset_item,
+                             Kernel::calculate_mask_data,
+                             Kernel::hashimoto,
+                             Kernel::hashimoto_light};
+}
+
+// dagger_32.c: 32-bit words, fnv32
+typedef DaggerKernel<uint32_t, 16, 256, 128, 64, Sha512Hash> Dagger32Kernel;
+// dagger.c: 64-bit words, fnv64
+typedef DaggerKernel<uint64_t, 8, 256, 128, 64, Sha512Hash> Dagger64Kernel;
+
+extern template struct DaggerKernel<uint32_t, 16, 256, 128, 64, Sha512Hash>;
+extern template struct DaggerKernel<uint64_t, 8, 256, 128, 64, Sha512Hash>;
+
+// All explicitly instantiated kernels; *n receives the count.
+const DaggerKernelEntry *dagger_kernels(size_t *n);
+
+// Look up an instantiated kernel by its parameters, or NULL if none matches.
+const DaggerKernelEntry *find_dagger_kernel(unsigned word_bytes, unsigned dataset_parents, unsigned mix_bytes,
+                                            unsigned loop_accesses, const char *hash_name);
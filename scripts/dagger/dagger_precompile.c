@@ -0,0 +1,494 @@
+/*
+ * Reference implementation of the IDaggerHash precompile.
+ *
+ *   gcc -O3 -march=native -pthread dagger_precompile.c -o dagger_precompile
+ *   ./dagger_precompile verify
+ *   ./dagger_precompile bench --kv-size 131072 --chunk-size 4096 --checks 16 --submissions 256
+ *
+ * checkDaggerData(kvIdx, kvHash, maskedData) and checkDaggerDataWithProof(
+ * chunkIdx, kvHash, proofs, maskedData) follow TestSystemContractDaggerHashimoto:
+ * the keccak256 of the masked data is folded with the Merkle proof
+ * (MerkleLib.calculateRootWithProof; no proof for checkDaggerData) and the
+ * first 24 bytes of the root must equal the first 24 bytes of kvHash, the part
+ * a PhyAddr keeps.  Neither call unmasks the data yet, so kvIdx is unused.
+ * dagger_precompile_call() is the raw precompile of TestDaggerHashPrecompile:
+ * input paddr || maskedData, output an ABI encoded bool.
+ *
+ * A mine() makes randomChecks such calls.  check_dagger_batch() verifies the
+ * checks of one or many submissions together: checks with the same data and
+ * proof length are hashed KECCAK_MB_LANES at a time with KECCAK256_MB(), their
+ * proofs are folded level by level the same way, and groups are spread over
+ * threads.  `bench` reports the latency of single calls and of one submission,
+ * and batch throughput, which is what the gas schedule of the precompile has
+ * to pay for.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "keccak.c"
+#include "keccak_mb.c"
+#include "merkle.c"
+
+#define KV_HASH_BYTES 24 // PhyAddr.hash is a bytes24
+
+enum check_result { CHECK_REVERT = -1, CHECK_FAIL = 0, CHECK_OK = 1 };
+
+struct dagger_check {
+    uint64_t idx;                 // chunk index, for checkDaggerDataWithProof
+    const unsigned char *kv_hash; // 32 bytes, only the first KV_HASH_BYTES count
+    const unsigned char *proofs;  // nproofs * 32 bytes, bottom up
+    unsigned nproofs;
+    const unsigned char *data;
+    uint64_t len;
+};
+
+// checkDaggerDataWithProof(); CHECK_REVERT where the contract reverts ("chunkId overflows").
+int check_dagger_data_with_proof(uint64_t idx, const unsigned char *kv_hash, const unsigned char *proofs,
+                                 unsigned nproofs, const unsigned char *data, uint64_t len) {
+    unsigned char hash[32];
+    if (nproofs < 64 && idx >= (1ULL << nproofs)) {
+        return (CHECK_REVERT);
+    }
+    keccak256(data, len, hash);
+    merkle_root_with_proof(hash, idx, proofs, nproofs, hash);
+    return (memcmp(hash, kv_hash, KV_HASH_BYTES) == 0 ? CHECK_OK : CHECK_FAIL);
+}
+
+// checkDaggerData(): the whole blob is one chunk.
+int check_dagger_data(uint64_t kv_idx, const unsigned char *kv_hash, const unsigned char *data, uint64_t len) {
+    return (check_dagger_data_with_proof(0, kv_hash, NULL, 0, data, len));
+}
+
+// TestDaggerHashPrecompile's fallback: input is paddr || maskedData with
+// exactly max_kv_size bytes of data; out receives abi.encode(bool).
+int dagger_precompile_call(const unsigned char *input, uint64_t input_len, uint64_t max_kv_size,
+                           unsigned char out[32]) {
+    if (input_len != max_kv_size + 32) {
+        return (CHECK_REVERT); // "incorrect data size"
+    }
+    int ok = check_dagger_data(0, input, input + 32, max_kv_size);
+    memset(out, 0, 32);
+    out[31] = ok == CHECK_OK;
+    return (ok);
+}
+
+struct check_batch {
+    const struct dagger_check *checks;
+    const uint64_t *order; // check indices sorted so that groups share len and nproofs
+    uint64_t ngroups;
+    uint64_t *group_start; // ngroups + 1 offsets into order
+    int *results;
+    uint64_t next_group;
+};
+
+// Verify up to KECCAK_MB_LANES checks with equal len and nproofs.
+static void check_group(const struct dagger_check *checks, const uint64_t *idx, uint64_t n, int *results) {
+    unsigned char hash[KECCAK_MB_LANES][32];
+    unsigned char pair[KECCAK_MB_LANES][64];
+    const unsigned char *in[KECCAK_MB_LANES];
+    unsigned char *out[KECCAK_MB_LANES];
+    uint64_t chunk[KECCAK_MB_LANES];
+    const struct dagger_check *c0 = &checks[idx[0]];
+
+    // spare lanes repeat the first check
+    for (uint64_t l = 0; l < KECCAK_MB_LANES; l++) {
+        const struct dagger_check *c = &checks[idx[l < n ? l : 0]];
+        in[l] = c->data;
+        out[l] = hash[l];
+        chunk[l] = c->idx;
+    }
+    KECCAK256_MB(in, c0->len, out);
+
+    for (unsigned level = 0; level < c0->nproofs; level++) {
+        for (uint64_t l = 0; l < KECCAK_MB_LANES; l++) {
+            const unsigned char *sibling = checks[idx[l < n ? l : 0]].proofs + 32 * level;
+            int right = chunk[l] & 1;
+            memcpy(pair[l] + (right ? 32 : 0), hash[l], 32);
+            memcpy(pair[l] + (right ? 0 : 32), sibling, 32);
+            in[l] = pair[l];
+            chunk[l] >>= 1;
+        }
+        KECCAK256_MB(in, 64, out);
+    }
+    for (uint64_t l = 0; l < n; l++) {
+        results[idx[l]] = memcmp(hash[l], checks[idx[l]].kv_hash, KV_HASH_BYTES) == 0 ? CHECK_OK : CHECK_FAIL;
+    }
+}
+
+static void *check_batch_worker(void *arg) {
+    struct check_batch *b = arg;
+    for (;;) {
+        uint64_t g = __atomic_fetch_add(&b->next_group, 1, __ATOMIC_RELAXED);
+        if (g >= b->ngroups) {
+            break;
+        }
+        uint64_t first = b->group_start[g];
+        check_group(b->checks, b->order + first, b->group_start[g + 1] - first, b->results);
+    }
+    return (NULL);
+}
+
+// qsort_r() order of check indices by shape; arg is the checks array.
+static int check_shape_cmp(const void *a, const void *b, void *arg) {
+    const struct dagger_check *checks = arg;
+    const struct dagger_check *x = &checks[*(const uint64_t *)a];
+    const struct dagger_check *y = &checks[*(const uint64_t *)b];
+    if (x->len != y->len) {
+        return (x->len < y->len ? -1 : 1);
+    }
+    if (x->nproofs != y->nproofs) {
+        return (x->nproofs < y->nproofs ? -1 : 1);
+    }
+    return (*(const uint64_t *)a < *(const uint64_t *)b ? -1 : 1);
+}
+
+/*
+ * results[i] = check_dagger_data_with_proof() of checks[i], for the randomChecks
+ * checks of any number of submissions.  Returns -1 if out of memory.
+ */
+int check_dagger_batch(const struct dagger_check *checks, uint64_t n, int *results, int threads) {
+    uint64_t *order = malloc(sizeof(uint64_t) * (n + 1));
+    uint64_t *group_start = malloc(sizeof(uint64_t) * (n + 1));
+    if (order == NULL || group_start == NULL) {
+        free(order);
+        free(group_start);
+        return (-1);
+    }
+
+    // overflowing chunk indices revert without hashing anything
+    uint64_t m = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (checks[i].nproofs < 64 && checks[i].idx >= (1ULL << checks[i].nproofs)) {
+            results[i] = CHECK_REVERT;
+        } else {
+            order[m++] = i;
+        }
+    }
+    qsort_r(order, m, sizeof(uint64_t), check_shape_cmp, (void *)checks);
+
+    struct check_batch b = {checks, order, 0, group_start, results, 0};
+    for (uint64_t i = 0; i < m;) {
+        uint64_t j = i + 1;
+        while (j < m && j - i < KECCAK_MB_LANES && checks[order[j]].len == checks[order[i]].len &&
+               checks[order[j]].nproofs == checks[order[i]].nproofs) {
+            j++;
+        }
+        group_start[b.ngroups++] = i;
+        i = j;
+    }
+    group_start[b.ngroups] = m;
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > b.ngroups) {
+        threads = b.ngroups > 0 ? b.ngroups : 1;
+    }
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (int t = 1; tids != NULL && t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, check_batch_worker, &b) == 0) {
+            started++;
+        }
+    }
+    check_batch_worker(&b);
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    free(order);
+    free(group_start);
+    return (0);
+}
+
+#ifndef DAGGER_NO_MAIN
+
+static uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+    return ((end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Blobs, their MerkleLib roots as kvHash, and one check per (blob, chunk) drawn at random.
+struct check_set {
+    uint64_t kv_size, chunk_size;
+    unsigned bits;
+    uint64_t nblobs, nchecks;
+    unsigned char *blobs, *roots, *proofs;
+    struct dagger_check *checks;
+};
+
+static int make_check_set(struct check_set *s, uint64_t nblobs, uint64_t nchecks, uint64_t rng) {
+    s->nblobs = nblobs;
+    s->nchecks = nchecks;
+    s->bits = merkle_min_bits(s->kv_size, s->chunk_size);
+    s->blobs = malloc(nblobs * s->kv_size);
+    s->roots = malloc(nblobs * 32);
+    s->proofs = malloc(nchecks * 32 * (s->bits + 1));
+    s->checks = calloc(nchecks, sizeof(struct dagger_check));
+    if (s->blobs == NULL || s->roots == NULL || s->proofs == NULL || s->checks == NULL) {
+        return (-1);
+    }
+    for (uint64_t k = 0; k < nblobs * s->kv_size / 8; k++) {
+        uint64_t v = splitmix64(&rng);
+        memcpy(s->blobs + 8 * k, &v, 8);
+    }
+    struct merkle_tree *trees = calloc(nblobs, sizeof(struct merkle_tree));
+    if (trees == NULL) {
+        return (-1);
+    }
+    for (uint64_t b = 0; b < nblobs; b++) {
+        if (merkle_tree_build(&trees[b], s->blobs + b * s->kv_size, s->kv_size, s->chunk_size, s->bits) != 0) {
+            return (-1);
+        }
+        memcpy(s->roots + 32 * b, merkle_tree_root(&trees[b]), 32);
+    }
+    for (uint64_t i = 0; i < nchecks; i++) {
+        uint64_t b = splitmix64(&rng) % nblobs;
+        uint64_t chunk = splitmix64(&rng) % ((s->kv_size + s->chunk_size - 1) / s->chunk_size);
+        struct dagger_check *c = &s->checks[i];
+        c->idx = chunk;
+        c->kv_hash = s->roots + 32 * b;
+        c->proofs = s->proofs + 32 * s->bits * i;
+        c->nproofs = s->bits;
+        c->data = s->blobs + b * s->kv_size + chunk * s->chunk_size;
+        // the last chunk may be short
+        c->len = s->kv_size - chunk * s->chunk_size < s->chunk_size ? s->kv_size - chunk * s->chunk_size : s->chunk_size;
+        merkle_tree_proof(&trees[b], chunk, (unsigned char *)c->proofs);
+    }
+    for (uint64_t b = 0; b < nblobs; b++) {
+        merkle_tree_free(&trees[b]);
+    }
+    free(trees);
+    return (0);
+}
+
+static void free_check_set(struct check_set *s) {
+    free(s->blobs);
+    free(s->roots);
+    free(s->proofs);
+    free(s->checks);
+}
+
+// Batch, single-call and raw precompile results agree, and damage is caught.
+static int self_verify(int threads) {
+    int failed = 0;
+    uint64_t rng = 1;
+
+    // KECCAK256_MB() lanes against keccak256() around the rate boundaries
+    uint64_t lens[] = {0, 1, 64, 135, 136, 137, 271, 272, 4096};
+    unsigned char msg[KECCAK_MB_LANES][4096], mb[KECCAK_MB_LANES][32], want[32];
+    const unsigned char *in[KECCAK_MB_LANES];
+    unsigned char *out[KECCAK_MB_LANES];
+    for (int l = 0; l < KECCAK_MB_LANES; l++) {
+        for (int k = 0; k < 4096; k++) {
+            msg[l][k] = splitmix64(&rng);
+        }
+        in[l] = msg[l];
+        out[l] = mb[l];
+    }
+    for (unsigned k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+        KECCAK256_MB(in, lens[k], out);
+        for (int l = 0; l < KECCAK_MB_LANES; l++) {
+            keccak256(msg[l], lens[k], want);
+            if (memcmp(mb[l], want, 32) != 0) {
+                printf("KECCAK256_MB() lane %d differs on %llu bytes\n", l, (unsigned long long)lens[k]);
+                failed = 1;
+            }
+        }
+    }
+
+    uint64_t shapes[][2] = {{4096, 4096}, {32768, 4096}, {131072, 4096}, {1000, 64}, {4096, 100}};
+    for (unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        struct check_set set = {shapes[s][0], shapes[s][1]};
+        if (make_check_set(&set, 5, 37, rng++) != 0) {
+            fprintf(stderr, "out of memory\n");
+            return (1);
+        }
+        // damage every third check, alternating data, proof and kvHash
+        unsigned char *bad = malloc(set.nchecks * set.chunk_size);
+        unsigned char *bad_hash = malloc(set.nchecks * 32);
+        for (uint64_t i = 0; i < set.nchecks; i += 3) {
+            struct dagger_check *c = &set.checks[i];
+            switch (i / 3 % 3) {
+            case 0:
+                memcpy(bad + i * set.chunk_size, c->data, c->len);
+                bad[i * set.chunk_size + i % c->len] ^= 1;
+                c->data = bad + i * set.chunk_size;
+                break;
+            case 1:
+                if (c->nproofs > 0) {
+                    ((unsigned char *)c->proofs)[i % (32 * c->nproofs)] ^= 0x80;
+                    break;
+                }
+                // fall through
+            default:
+                memcpy(bad_hash + 32 * i, c->kv_hash, 32);
+                bad_hash[32 * i + i % KV_HASH_BYTES] ^= 1;
+                c->kv_hash = bad_hash + 32 * i;
+            }
+        }
+        // bytes beyond the first 24 of kvHash are ignored
+        memcpy(bad_hash + 32 * 1, set.checks[1].kv_hash, 32);
+        bad_hash[32 * 1 + 31] ^= 0xff;
+        set.checks[1].kv_hash = bad_hash + 32;
+        // and an overflowing chunk index reverts
+        set.checks[2].idx = 1ULL << set.bits;
+
+        int *results = malloc(sizeof(int) * set.nchecks);
+        check_dagger_batch(set.checks, set.nchecks, results, threads);
+        for (uint64_t i = 0; i < set.nchecks; i++) {
+            const struct dagger_check *c = &set.checks[i];
+            int want = i == 2 ? CHECK_REVERT : i % 3 == 0 ? CHECK_FAIL : CHECK_OK;
+            int single = check_dagger_data_with_proof(c->idx, c->kv_hash, c->proofs, c->nproofs, c->data, c->len);
+            if (results[i] != want || single != want) {
+                printf("kv %llu chunk %llu check %llu: batch %d single %d, expected %d\n",
+                       (unsigned long long)shapes[s][0], (unsigned long long)shapes[s][1], (unsigned long long)i,
+                       results[i], single, want);
+                failed = 1;
+            }
+        }
+        free(results);
+        free(bad);
+        free(bad_hash);
+
+        // the raw precompile on whole blobs
+        if (set.bits == 0) {
+            unsigned char *input = malloc(32 + set.kv_size), out[32];
+            for (int tamper = 0; tamper < 2; tamper++) {
+                memcpy(input, set.roots, 32);
+                memcpy(input + 32, set.blobs, set.kv_size);
+                input[32 + set.kv_size - 1] ^= tamper;
+                int r = dagger_precompile_call(input, 32 + set.kv_size, set.kv_size, out);
+                if (r != (tamper ? CHECK_FAIL : CHECK_OK) || out[31] != !tamper ||
+                    dagger_precompile_call(input, 31 + set.kv_size, set.kv_size, out) != CHECK_REVERT) {
+                    printf("precompile call on %llu bytes failed\n", (unsigned long long)set.kv_size);
+                    failed = 1;
+                }
+            }
+            free(input);
+        }
+        free_check_set(&set);
+    }
+    printf(failed ? "self_verify() failed!\n" : "self_verify() passed\n");
+    return (failed);
+}
+
+static void bench(uint64_t kv_size, uint64_t chunk_size, uint64_t checks, uint64_t submissions, int threads,
+                  double seconds) {
+    struct check_set set = {kv_size, chunk_size};
+    if (make_check_set(&set, 64, checks * submissions, 7) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return;
+    }
+    int *results = malloc(sizeof(int) * set.nchecks);
+    struct timespec start, end;
+    uint64_t iters;
+    double t;
+    printf("kv size %llu, chunk size %llu (%u proof levels), %llu checks per submission, %d lanes\n",
+           (unsigned long long)kv_size, (unsigned long long)chunk_size, set.bits, (unsigned long long)checks,
+           KECCAK_MB_LANES);
+
+    // one call at a time, as the EVM issues them
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (iters = 0;; iters++) {
+        const struct dagger_check *c = &set.checks[iters % set.nchecks];
+        check_dagger_data_with_proof(c->idx, c->kv_hash, c->proofs, c->nproofs, c->data, c->len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if ((t = elapsed(&start, &end)) >= seconds) {
+            break;
+        }
+    }
+    printf("single check:      %8.2f us, %8.1f MB/s\n", t / iters * 1e6, iters * chunk_size / t / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (iters = 0;; iters++) {
+        check_dagger_batch(set.checks + checks * (iters % submissions), checks, results, threads);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if ((t = elapsed(&start, &end)) >= seconds) {
+            break;
+        }
+    }
+    printf("one submission:    %8.2f us (%llu checks)\n", t / iters * 1e6, (unsigned long long)checks);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (iters = 0;; iters++) {
+        check_dagger_batch(set.checks, set.nchecks, results, threads);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if ((t = elapsed(&start, &end)) >= seconds) {
+            break;
+        }
+    }
+    double per_check = t / iters / set.nchecks;
+    printf("batch of %llu:  %8.2f us/check, %8.1f MB/s, %8.0f submissions/s\n", (unsigned long long)set.nchecks, per_check * 1e6,
+           chunk_size / per_check / 1e6, 1 / (per_check * checks));
+    free(results);
+    free_check_set(&set);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify|bench [options]\n"
+            "  --kv-size N          maxKvSize in bytes (default 4096)\n"
+            "  --chunk-size N       chunk proven by checkDaggerDataWithProof (default kv size)\n"
+            "  --checks N           randomChecks per submission (default 16)\n"
+            "  --submissions N      submissions per batch (default 64)\n"
+            "  --threads N          batch threads (default 1)\n"
+            "  --seconds S          time per measurement (default 1)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"kv-size", required_argument, 0, 'k'},  {"chunk-size", required_argument, 0, 'c'},
+        {"checks", required_argument, 0, 'n'},   {"submissions", required_argument, 0, 's'},
+        {"threads", required_argument, 0, 't'},  {"seconds", required_argument, 0, 'S'},
+        {0, 0, 0, 0},
+    };
+    if (argc < 2 || (strcmp(argv[1], "verify") != 0 && strcmp(argv[1], "bench") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+    uint64_t kv_size = 4096, chunk_size = 0, checks = 16, submissions = 64;
+    int threads = 1;
+    double seconds = 1;
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'k': kv_size = strtoull(optarg, NULL, 0); break;
+        case 'c': chunk_size = strtoull(optarg, NULL, 0); break;
+        case 'n': checks = strtoull(optarg, NULL, 0); break;
+        case 's': submissions = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        case 'S': seconds = atof(optarg); break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (chunk_size == 0) {
+        chunk_size = kv_size;
+    }
+    if (kv_size == 0 || kv_size % chunk_size != 0 || checks == 0 || submissions == 0 || threads < 1) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    if (strcmp(argv[1], "verify") == 0) {
+        return (self_verify(threads));
+    }
+    bench(kv_size, chunk_size, checks, submissions, threads, seconds);
+    return (0);
+}
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Per-host tuning profile of the dagger kernels, written by `dagger_32 calibrate`.
+ *
+ * A text file of "name value" lines, # starts a comment:
+ *
+ *   host node17              cores 32                 latency_ns 94.2
+ *   bandwidth_mbs 18230      threads 32               hashimoto_batch 16
+ *   prefetch 4               huge_pages 1             hashimoto_hps 61234
+ *
+ * dagger_profile_load() reads $DAGGER_PROFILE, or else
+ * $HOME/.dagger/<hostname>.profile, so a home directory shared by many hosts
+ * keeps one profile per host.  Engines take their defaults from it and
+ * command line options still win; without a profile (or with one calibrated
+ * on another host) they keep their built-in defaults.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct dagger_profile {
+    char host[64];
+    int cores;
+    double latency_ns;    // one dependent random load from DRAM
+    double bandwidth_mbs; // sequential reads on all cores
+    int threads;          // hashimoto threads
+    int hashimoto_batch;  // candidates interleaved per thread (hashimoto_interleaved)
+    int prefetch;         // how many candidates ahead a row is prefetched, 0 for none
+    int huge_pages;       // madvise(MADV_HUGEPAGE) the dataset
+    double hashimoto_hps; // what the chosen settings measured
+};
+
+// Built-in defaults: one candidate at a time on every core.
+void dagger_profile_defaults(struct dagger_profile *p) {
+    memset(p, 0, sizeof(*p));
+    if (gethostname(p->host, sizeof(p->host) - 1) != 0) {
+        strcpy(p->host, "localhost");
+    }
+    p->cores = sysconf(_SC_NPROCESSORS_ONLN);
+    p->threads = p->cores;
+    p->hashimoto_batch = 1;
+}
+
+// Default thread count for dataset generation and masking.  The profile's
+// threads are tuned for hashimoto, which is bound by DRAM; items are computed
+// out of the cache and keep scaling with every online core.
+int dagger_gen_threads() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0 ? (int)n : 1);
+}
+
+// $DAGGER_PROFILE, or $HOME/.dagger/<hostname>.profile; -1 if neither can be formed.
+int dagger_profile_path(char *buf, size_t len) {
+    const char *env = getenv("DAGGER_PROFILE");
+    const char *home = getenv("HOME");
+    char host[64] = {0};
+    if (env != NULL && env[0] != 0) {
+        return (snprintf(buf, len, "%s", env) < (int)len ? 0 : -1);
+    }
+    if (home == NULL || gethostname(host, sizeof(host) - 1) != 0) {
+        return (-1);
+    }
+    return (snprintf(buf, len, "%s/.dagger/%s.profile", home, host) < (int)len ? 0 : -1);
+}
+
+/*
+ * Defaults, overridden by the profile of this host if there is one.
+ * Returns 0 if a profile was applied, 1 if there was none, -1 if it is
+ * malformed (p keeps the defaults).
+ */
+int dagger_profile_load(struct dagger_profile *p) {
+    char path[4096];
+    dagger_profile_defaults(p);
+    FILE *f = dagger_profile_path(path, sizeof(path)) == 0 ? fopen(path, "r") : NULL;
+    if (f == NULL) {
+        return (1);
+    }
+    struct dagger_profile q = *p;
+    char line[256], name[64], value[128];
+    int err = 0;
+    for (unsigned lineno = 1; !err && fgets(line, sizeof(line), f) != NULL; lineno++) {
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = 0;
+        }
+        int n = sscanf(line, "%63s %127s", name, value);
+        if (n <= 0) {
+            continue;
+        }
+        if (n != 2) {
+            err = lineno;
+        } else if (strcmp(name, "host") == 0) {
+            snprintf(q.host, sizeof(q.host), "%.63s", value);
+        } else if (strcmp(name, "cores") == 0) {
+            q.cores = atoi(value);
+        } else if (strcmp(name, "latency_ns") == 0) {
+            q.latency_ns = atof(value);
+        } else if (strcmp(name, "bandwidth_mbs") == 0) {
+            q.bandwidth_mbs = atof(value);
+        } else if (strcmp(name, "threads") == 0) {
+            q.threads = atoi(value);
+        } else if (strcmp(name, "hashimoto_batch") == 0) {
+            q.hashimoto_batch = atoi(value);
+        } else if (strcmp(name, "prefetch") == 0) {
+            q.prefetch = atoi(value);
+        } else if (strcmp(name, "huge_pages") == 0) {
+            q.huge_pages = atoi(value);
+        } else if (strcmp(name, "hashimoto_hps") == 0) {
+            q.hashimoto_hps = atof(value);
+        } // unknown names are left for newer tools
+    }
+    fclose(f);
+    if (err || q.threads < 1 || q.hashimoto_batch < 1 || q.prefetch < 0) {
+        fprintf(stderr, "%s:%d: cannot parse, using defaults\n", path, err);
+        return (-1);
+    }
+    if (strcmp(q.host, p->host) != 0) {
+        fprintf(stderr, "%s was calibrated on %s, not %s; using defaults\n", path, q.host, p->host);
+        return (1);
+    }
+    *p = q;
+    return (0);
+}
+
+// Write p to path (dagger_profile_path() if NULL) through a rename, creating ~/.dagger if needed.
+int dagger_profile_save(const struct dagger_profile *p, const char *path) {
+    char def[4096], tmp[4200];
+    if (path == NULL) {
+        if (dagger_profile_path(def, sizeof(def)) != 0) {
+            fprintf(stderr, "set DAGGER_PROFILE or HOME to save the profile\n");
+            return (-1);
+        }
+        path = def;
+        char *slash = strrchr(def, '/');
+        if (getenv("DAGGER_PROFILE") == NULL && slash != NULL) {
+            *slash = 0;
+            mkdir(def, 0755);
+            *slash = '/';
+        }
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s: %s\n", tmp, strerror(errno));
+        return (-1);
+    }
+    fprintf(f,
+            "# written by dagger_32 calibrate\n"
+            "host %s\ncores %d\nlatency_ns %.1f\nbandwidth_mbs %.0f\n"
+            "threads %d\nhashimoto_batch %d\nprefetch %d\nhuge_pages %d\nhashimoto_hps %.0f\n",
+            p->host, p->cores, p->latency_ns, p->bandwidth_mbs, p->threads, p->hashimoto_batch, p->prefetch,
+            p->huge_pages, p->hashimoto_hps);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return (-1);
+    }
+    printf("Profile written to %s\n", path);
+    return (0);
+}
@@ -0,0 +1,796 @@
+/*
+ * Stream dataset (or masked shard) generation straight to disk.
+ *
+ *   gcc -O3 -mavx2 -pthread dataset_stream.c -o dataset_stream
+ *   ./dataset_stream dataset --output dataset.bin --size 1073741824
+ *   ./dataset_stream mask --input shard.bin --output shard.masked
+ *
+ * Worker threads fill fixed-size, page-aligned chunks of a bounded ring and a
+ * single writer flushes finished chunks with O_DIRECT writes through io_uring
+ * while the next chunks are computed.  Only the ring (--mem-cap) and the cache
+ * are resident, so datasets larger than spare RAM can be produced, and the
+ * output bypasses the page cache so it does not evict the shards being served.
+ *
+ * Progress is recorded in a journal (--journal, default OUTPUT.journal): once a
+ * chunk is durable on disk its index and checksum are appended and synced.  A
+ * restarted run checks the completed chunks against their checksums and only
+ * regenerates the missing or damaged ones.  In mask mode the journal also
+ * records the identity of the input (size, mtime, inode) and a checksum of every
+ * raw input chunk, so a journal left by a different or rewritten input is
+ * rejected instead of resuming on top of stale output.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+#include "uring.c"
+
+#define STREAM_ALIGN 4096
+#define JOURNAL_MAGIC 0x324c4e524a474144ULL // "DAGJRNL2"
+
+enum stream_mode { STREAM_DATASET, STREAM_MASK };
+
+enum slot_state { SLOT_FREE, SLOT_BUSY, SLOT_READY, SLOT_WRITING };
+
+struct slot {
+    unsigned char *buf;
+    uint64_t chunk;
+    uint64_t len;
+    uint64_t checksum;
+    uint64_t input_checksum; // of the raw input chunk, mask mode only
+    uint64_t write_start; // metrics_now() when the write was issued
+    int state;
+};
+
+// Parameters a journal belongs to; a journal for anything else is rejected.
+struct journal_header {
+    uint64_t magic;
+    uint64_t mode;
+    uint64_t cache_size;
+    uint64_t total_size;
+    uint64_t chunk_size;
+    unsigned char seed_hash[HASH_BYTES];
+    // mask mode: the input the output was computed from, zero otherwise
+    uint64_t input_size;
+    uint64_t input_mtime_ns;
+    uint64_t input_ino;
+};
+
+struct journal_entry {
+    uint64_t chunk;
+    uint64_t checksum;
+    uint64_t input_checksum;
+    uint64_t check;
+};
+
+static uint64_t journal_check(const struct journal_entry *e) {
+    return (e->chunk ^ e->checksum ^ e->input_checksum ^ JOURNAL_MAGIC);
+}
+
+struct stream {
+    int mode;
+    unsigned char *cache;
+    uint64_t cache_size;
+    uint64_t total_size;
+    uint64_t chunk_size;
+    int in_fd;
+    int out_fd;
+    int direct;
+
+    struct slot *slots;
+    uint64_t nslots;
+    uint64_t nchunks;
+    uint64_t next_chunk;
+    int error;
+
+    int journal_fd;
+    unsigned char *done;
+    uint64_t todo;
+    struct journal_entry *pending;
+    uint64_t npending;
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+};
+
+uint64_t chunk_checksum(unsigned char *buf, uint64_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    uint64_t k = 0;
+    for (; k + 8 <= len; k += 8) {
+        uint64_t w;
+        memcpy(&w, buf + k, 8);
+        h = (h ^ w) * 0x00000100000001B3ULL;
+    }
+    for (; k < len; k++) {
+        h = (h ^ buf[k]) * 0x00000100000001B3ULL;
+    }
+    return (h);
+}
+
+// Record a failure and wake every thread waiting on the ring so it can exit.
+void stream_fail(struct stream *s) {
+    pthread_mutex_lock(&s->lock);
+    s->error = 1;
+    pthread_cond_broadcast(&s->slot_free);
+    pthread_cond_broadcast(&s->slot_ready);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void stream_compute_chunk(struct stream *s, struct slot *sl) {
+    uint64_t off = sl->chunk * s->chunk_size;
+    uint64_t first_item = off / HASH_BYTES;
+    uint64_t items = (sl->len + HASH_BYTES - 1) / HASH_BYTES;
+
+    if (s->mode == STREAM_DATASET) {
+        uint64_t start = metrics_now();
+        uint64_t t0 = timeline_begin();
+        for (uint64_t k = 0; k < items; k++) {
+            calculate_dataset_item_opt(s->cache, s->cache_size, first_item + k, sl->buf + k * HASH_BYTES);
+        }
+        timeline_end("dataset chunk", t0);
+        metrics_observe_since(METRIC_ITEM_LATENCY, start);
+        metrics_add(METRIC_DATASET_ITEMS, items);
+        sl->checksum = chunk_checksum(sl->buf, sl->len);
+        return;
+    }
+
+    // a trailing partial item is masked as if zero padded
+    memset(sl->buf + sl->len, 0, items * HASH_BYTES - sl->len);
+    uint64_t done = 0;
+    uint64_t start = metrics_now();
+    uint64_t t0 = timeline_begin();
+    while (done < sl->len) {
+        ssize_t n = pread(s->in_fd, sl->buf + done, sl->len - done, off + done);
+        if (n <= 0) {
+            fprintf(stderr, "read input at %llu failed: %s\n", off + done, n < 0 ? strerror(errno) : "EOF");
+            stream_fail(s);
+            return;
+        }
+        done += n;
+    }
+    start = metrics_observe_since(METRIC_IO_LATENCY, start);
+    t0 = timeline_end("read input", t0);
+    metrics_add(METRIC_IO_READ_BYTES, sl->len);
+    sl->input_checksum = chunk_checksum(sl->buf, sl->len);
+    calculate_mask_blob(s->cache, s->cache_size, first_item, sl->buf, items * HASH_BYTES);
+    timeline_end("mask chunk", t0);
+    metrics_observe_since(METRIC_MASK_LATENCY, start);
+    metrics_add(METRIC_MASK_ITEMS, items);
+    sl->checksum = chunk_checksum(sl->buf, sl->len);
+}
+
+void *stream_worker(void *arg) {
+    struct stream *s = arg;
+
+    timeline_thread_name("generator");
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (s->next_chunk < s->nchunks && s->done[s->next_chunk]) {
+            s->next_chunk++;
+        }
+        if (s->next_chunk >= s->nchunks || s->error) {
+            break;
+        }
+        struct slot *sl = NULL;
+        for (uint64_t i = 0; i < s->nslots; i++) {
+            if (s->slots[i].state == SLOT_FREE) {
+                sl = &s->slots[i];
+                break;
+            }
+        }
+        if (sl == NULL) {
+            // all buffers are waiting for the writer
+            uint64_t t0 = timeline_begin();
+            pthread_cond_wait(&s->slot_free, &s->lock);
+            timeline_end("wait free slot", t0);
+            continue;
+        }
+        sl->state = SLOT_BUSY;
+        sl->chunk = s->next_chunk++;
+        sl->len = s->total_size - sl->chunk * s->chunk_size;
+        if (sl->len > s->chunk_size) {
+            sl->len = s->chunk_size;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        stream_compute_chunk(s, sl);
+
+        pthread_mutex_lock(&s->lock);
+        sl->state = SLOT_READY;
+        pthread_cond_signal(&s->slot_ready);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return (NULL);
+}
+
+// O_DIRECT needs aligned lengths; the file is truncated to its real size at the end.
+uint64_t stream_write_len(struct stream *s, struct slot *sl) {
+    if (!s->direct) {
+        return (sl->len);
+    }
+    return ((sl->len + STREAM_ALIGN - 1) / STREAM_ALIGN * STREAM_ALIGN);
+}
+
+void stream_release(struct stream *s, struct slot *sl) {
+    timeline_span("write chunk", sl->write_start, metrics_observe_since(METRIC_IO_LATENCY, sl->write_start));
+    metrics_add(METRIC_IO_WRITE_BYTES, sl->len);
+    metrics_add(METRIC_EPOCH_CHUNKS_DONE, 1);
+    struct journal_entry *e = &s->pending[s->npending++];
+    e->chunk = sl->chunk;
+    e->checksum = sl->checksum;
+    e->input_checksum = s->mode == STREAM_MASK ? sl->input_checksum : 0;
+    e->check = journal_check(e);
+    if (!s->direct) {
+        // keep buffered output out of the page cache as well
+        uint64_t off = sl->chunk * s->chunk_size;
+        sync_file_range(s->out_fd, off, sl->len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(s->out_fd, off, sl->len, POSIX_FADV_DONTNEED);
+    }
+    pthread_mutex_lock(&s->lock);
+    sl->state = SLOT_FREE;
+    pthread_cond_signal(&s->slot_free);
+    pthread_mutex_unlock(&s->lock);
+}
+
+int stream_write_sync(struct stream *s, struct slot *sl) {
+    uint64_t len = stream_write_len(s, sl);
+    uint64_t off = sl->chunk * s->chunk_size;
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(s->out_fd, sl->buf + done, len - done, off + done);
+        if (n < 0) {
+            fprintf(stderr, "write at %llu failed: %s\n", off + done, strerror(errno));
+            return (-1);
+        }
+        done += n;
+    }
+    return (0);
+}
+
+// Make the chunks released since the last commit durable, then record them.
+int journal_commit(struct stream *s) {
+    if (s->npending == 0) {
+        return (0);
+    }
+    if (fdatasync(s->out_fd) != 0) {
+        fprintf(stderr, "fdatasync output failed: %s\n", strerror(errno));
+        return (-1);
+    }
+    ssize_t len = sizeof(struct journal_entry) * s->npending;
+    if (write(s->journal_fd, s->pending, len) != len || fdatasync(s->journal_fd) != 0) {
+        fprintf(stderr, "journal append failed: %s\n", strerror(errno));
+        return (-1);
+    }
+    for (uint64_t i = 0; i < s->npending; i++) {
+        s->done[s->pending[i].chunk] = 1;
+    }
+    s->npending = 0;
+    return (0);
+}
+
+// Load the journal and keep the chunks whose on-disk bytes still match their
+// checksum.  A journal for other parameters or another input is rejected, and
+// so is one whose raw input chunks no longer match.  Returns the number of
+// chunks already complete, or -1.
+int64_t journal_open(struct stream *s, const char *path, const char *output, struct journal_header *expect, int verify) {
+    s->journal_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (s->journal_fd < 0) {
+        fprintf(stderr, "cannot open journal %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    struct journal_header h;
+    ssize_t n = pread(s->journal_fd, &h, sizeof(h), 0);
+    if (n == 0) {
+        // fresh journal
+        if (pwrite(s->journal_fd, expect, sizeof(*expect), 0) != sizeof(*expect) || fdatasync(s->journal_fd) != 0) {
+            fprintf(stderr, "cannot write journal %s: %s\n", path, strerror(errno));
+            return (-1);
+        }
+        lseek(s->journal_fd, sizeof(*expect), SEEK_SET);
+        return (0);
+    }
+    if (n != sizeof(h) || memcmp(&h, expect, sizeof(h)) != 0) {
+        fprintf(stderr, "journal %s belongs to a different generation or input, remove it to start over\n", path);
+        return (-1);
+    }
+
+    struct stat st;
+    if (fstat(s->journal_fd, &st) != 0) {
+        fprintf(stderr, "cannot stat journal %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    uint64_t nentries = (st.st_size - sizeof(h)) / sizeof(struct journal_entry);
+    struct journal_entry *entries = malloc(sizeof(struct journal_entry) * (nentries + 1));
+    uint64_t *checksums = calloc(s->nchunks, sizeof(uint64_t));
+    uint64_t *input_checksums = calloc(s->nchunks, sizeof(uint64_t));
+    unsigned char *buf = malloc(s->chunk_size);
+    if (entries == NULL || checksums == NULL || input_checksums == NULL || buf == NULL) {
+        fprintf(stderr, "cannot load journal %s: out of memory\n", path);
+        free(entries);
+        free(checksums);
+        free(input_checksums);
+        free(buf);
+        return (-1);
+    }
+    if (pread(s->journal_fd, entries, sizeof(struct journal_entry) * nentries, sizeof(h)) !=
+        (ssize_t)(sizeof(struct journal_entry) * nentries)) {
+        fprintf(stderr, "cannot read journal %s\n", path);
+        free(entries);
+        free(checksums);
+        free(input_checksums);
+        free(buf);
+        return (-1);
+    }
+    for (uint64_t i = 0; i < nentries; i++) {
+        struct journal_entry *e = &entries[i];
+        // a torn append leaves an entry that fails its check word
+        if (e->chunk >= s->nchunks || journal_check(e) != e->check) {
+            continue;
+        }
+        s->done[e->chunk] = 1;
+        checksums[e->chunk] = e->checksum;
+        input_checksums[e->chunk] = e->input_checksum;
+    }
+
+    int fd = verify ? open(output, O_RDONLY) : -1;
+    uint64_t kept = 0;
+    int stale = 0;
+    for (uint64_t c = 0; c < s->nchunks; c++) {
+        if (!s->done[c]) {
+            continue;
+        }
+        if (verify) {
+            uint64_t off = c * s->chunk_size;
+            uint64_t len = s->total_size - off < s->chunk_size ? s->total_size - off : s->chunk_size;
+            if (s->mode == STREAM_MASK &&
+                (pread(s->in_fd, buf, len, off) != (ssize_t)len || chunk_checksum(buf, len) != input_checksums[c])) {
+                fprintf(stderr, "journal %s was written for different input at chunk %llu, remove it to start over\n",
+                        path, (unsigned long long)c);
+                stale = 1;
+                break;
+            }
+            int ok = fd >= 0 && pread(fd, buf, len, off) == (ssize_t)len && chunk_checksum(buf, len) == checksums[c];
+            if (fd >= 0) {
+                posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+            }
+            if (!ok) {
+                printf("chunk %llu is damaged, regenerating\n", c);
+                s->done[c] = 0;
+                continue;
+            }
+        }
+        // compact: one entry per kept chunk, torn and stale entries are dropped
+        entries[kept].chunk = c;
+        entries[kept].checksum = checksums[c];
+        entries[kept].input_checksum = input_checksums[c];
+        entries[kept].check = journal_check(&entries[kept]);
+        kept++;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    free(checksums);
+    free(input_checksums);
+    if (stale) {
+        free(entries);
+        return (-1);
+    }
+
+    ssize_t len = sizeof(struct journal_entry) * kept;
+    int ret = pwrite(s->journal_fd, entries, len, sizeof(h)) == len &&
+              ftruncate(s->journal_fd, sizeof(h) + len) == 0 && fdatasync(s->journal_fd) == 0;
+    free(entries);
+    if (!ret) {
+        fprintf(stderr, "cannot rewrite journal %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    lseek(s->journal_fd, sizeof(h) + len, SEEK_SET);
+    return (kept);
+}
+
+// The writer runs on the calling thread until every chunk is on disk.
+int stream_writer(struct stream *s, struct uring *ring, double sync_interval) {
+    uint64_t written = 0;
+    uint64_t inflight = 0;
+    uint64_t percent = s->todo / 100 + 1;
+    int failed = 0;
+    struct slot **ready = malloc(sizeof(struct slot *) * s->nslots);
+    struct timespec last_sync, now;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+    timeline_thread_name("writer");
+
+    while (written < s->todo) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last_sync.tv_sec) + (now.tv_nsec - last_sync.tv_nsec) / 1e9 >= sync_interval) {
+            uint64_t t0 = timeline_begin();
+            if (journal_commit(s) != 0) {
+                failed = 1;
+                break;
+            }
+            timeline_end("journal commit", t0);
+            last_sync = now;
+        }
+
+        uint64_t nready = 0;
+        pthread_mutex_lock(&s->lock);
+        for (;;) {
+            for (uint64_t i = 0; i < s->nslots; i++) {
+                if (s->slots[i].state == SLOT_READY) {
+                    s->slots[i].state = SLOT_WRITING;
+                    ready[nready++] = &s->slots[i];
+                }
+            }
+            if (nready > 0 || inflight > 0 || s->error) {
+                break;
+            }
+            // no chunk is ready: the generators are behind
+            uint64_t t0 = timeline_begin();
+            pthread_cond_wait(&s->slot_ready, &s->lock);
+            timeline_end("wait ready chunk", t0);
+        }
+        int error = s->error;
+        pthread_mutex_unlock(&s->lock);
+        if (error) {
+            break;
+        }
+
+        for (uint64_t i = 0; i < nready; i++) {
+            struct slot *sl = ready[i];
+            sl->write_start = metrics_now();
+            if (ring == NULL) {
+                if (stream_write_sync(s, sl) != 0) {
+                    failed = 1;
+                    break;
+                }
+                stream_release(s, sl);
+                if (++written % percent == 0) {
+                    printf("written %llu / %llu chunks\n", written, s->todo);
+                }
+                continue;
+            }
+            while (uring_queue_rw(ring, IORING_OP_WRITE, s->out_fd, sl->buf, stream_write_len(s, sl),
+                                  sl->chunk * s->chunk_size, sl - s->slots) != 0) {
+                uring_submit(ring, 0);
+            }
+            inflight++;
+        }
+        if (failed) {
+            break;
+        }
+
+        if (ring == NULL || inflight == 0) {
+            continue;
+        }
+        // block for completions only when there is nothing new to hand over
+        uint64_t t0 = timeline_begin();
+        if (uring_submit(ring, nready == 0 ? 1 : 0) < 0) {
+            fprintf(stderr, "io_uring_enter failed\n");
+            failed = 1;
+            break;
+        }
+        timeline_end(nready == 0 ? "wait completions" : "submit writes", t0);
+        int res;
+        uint64_t user_data;
+        while (uring_reap(ring, &res, &user_data)) {
+            struct slot *sl = &s->slots[user_data];
+            inflight--;
+            if (res < 0 || (uint64_t)res != stream_write_len(s, sl)) {
+                fprintf(stderr, "write of chunk %llu failed: %s\n", sl->chunk, res < 0 ? strerror(-res) : "short write");
+                failed = 1;
+                break;
+            }
+            stream_release(s, sl);
+            if (++written % percent == 0) {
+                printf("written %llu / %llu chunks\n", written, s->todo);
+            }
+        }
+        timeline_counter("chunks in flight", inflight);
+        if (failed) {
+            break;
+        }
+    }
+
+    // drain outstanding writes before the buffers go away
+    while (ring != NULL && inflight > 0) {
+        int res;
+        uint64_t user_data;
+        uring_submit(ring, 1);
+        while (uring_reap(ring, &res, &user_data)) {
+            inflight--;
+        }
+    }
+
+    // chunks released so far are complete even if a later one failed
+    if (journal_commit(s) != 0) {
+        failed = 1;
+    }
+    if (failed) {
+        // stops the workers, including those blocked on a full ring
+        stream_fail(s);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    failed = s->error;
+    pthread_mutex_unlock(&s->lock);
+    free(ready);
+    return (failed ? -1 : 0);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s dataset|mask [options]\n"
+            "  --output PATH        output file (required)\n"
+            "  --input PATH         raw shard to mask (mask mode)\n"
+            "  --size BYTES         dataset size (dataset mode)\n"
+            "  --seed STR           cache seed (default 123)\n"
+            "  --cache-size BYTES   cache size (default 16777216)\n"
+            "  --chunk-size BYTES   chunk size, multiple of %d (default 4194304)\n"
+            "  --mem-cap BYTES      memory for in-flight chunks (default 268435456)\n"
+            "  --threads N          compute threads (default: all online cores)\n"
+            "  --queue-depth N      io_uring queue depth (default 32)\n"
+            "  --no-direct          buffered writes instead of O_DIRECT\n"
+            "  --no-uring           synchronous pwrite instead of io_uring\n"
+            "  --journal PATH       progress journal (default OUTPUT.journal)\n"
+            "  --sync-interval SEC  how often completed chunks are journaled (default 1)\n"
+            "  --no-verify          trust journaled chunks without re-reading them\n"
+            "  --metrics TARGET     export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog, STREAM_ALIGN);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"output", required_argument, 0, 'o'},
+        {"input", required_argument, 0, 'i'},
+        {"size", required_argument, 0, 's'},
+        {"seed", required_argument, 0, 'e'},
+        {"cache-size", required_argument, 0, 'c'},
+        {"chunk-size", required_argument, 0, 'k'},
+        {"mem-cap", required_argument, 0, 'm'},
+        {"threads", required_argument, 0, 't'},
+        {"queue-depth", required_argument, 0, 'q'},
+        {"no-direct", no_argument, 0, 'D'},
+        {"no-uring", no_argument, 0, 'U'},
+        {"journal", required_argument, 0, 'j'},
+        {"sync-interval", required_argument, 0, 'S'},
+        {"no-verify", no_argument, 0, 'V'},
+        {"metrics", required_argument, 0, 'X'},
+        {0, 0, 0, 0},
+    };
+
+    if (argc < 2 || (strcmp(argv[1], "dataset") != 0 && strcmp(argv[1], "mask") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct stream s;
+    memset(&s, 0, sizeof(s));
+    s.mode = strcmp(argv[1], "dataset") == 0 ? STREAM_DATASET : STREAM_MASK;
+    s.cache_size = 16777216;
+    s.chunk_size = 4194304;
+    s.direct = 1;
+    s.in_fd = -1;
+
+    const char *output = NULL;
+    const char *input = NULL;
+    const char *seed = "123";
+    uint64_t mem_cap = 268435456;
+    int threads = dagger_gen_threads();
+    int queue_depth = 32;
+    int use_uring = 1;
+    const char *journal = NULL;
+    double sync_interval = 1;
+    int verify = 1;
+    const char *metrics_target = getenv("DAGGER_METRICS");
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'o': output = optarg; break;
+        case 'i': input = optarg; break;
+        case 's': s.total_size = strtoull(optarg, NULL, 0); break;
+        case 'e': seed = optarg; break;
+        case 'c': s.cache_size = strtoull(optarg, NULL, 0); break;
+        case 'k': s.chunk_size = strtoull(optarg, NULL, 0); break;
+        case 'm': mem_cap = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        case 'q': queue_depth = atoi(optarg); break;
+        case 'D': s.direct = 0; break;
+        case 'U': use_uring = 0; break;
+        case 'j': journal = optarg; break;
+        case 'S': sync_interval = atof(optarg); break;
+        case 'V': verify = 0; break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (output == NULL || (s.mode == STREAM_MASK && input == NULL) || s.chunk_size == 0 ||
+        s.chunk_size % STREAM_ALIGN != 0 || threads < 1) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct stat input_st;
+    if (s.mode == STREAM_MASK) {
+        s.in_fd = open(input, O_RDONLY);
+        if (s.in_fd < 0 || fstat(s.in_fd, &input_st) != 0) {
+            fprintf(stderr, "cannot open %s: %s\n", input, strerror(errno));
+            return (1);
+        }
+        s.total_size = input_st.st_size;
+        posix_fadvise(s.in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    if (s.total_size == 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    s.nchunks = (s.total_size + s.chunk_size - 1) / s.chunk_size;
+
+    s.out_fd = s.direct ? open(output, O_WRONLY | O_CREAT | O_DIRECT, 0644) : -1;
+    if (s.out_fd < 0) {
+        if (s.direct) {
+            fprintf(stderr, "O_DIRECT unavailable (%s), using buffered writes\n", strerror(errno));
+            s.direct = 0;
+        }
+        s.out_fd = open(output, O_WRONLY | O_CREAT, 0644);
+        if (s.out_fd < 0) {
+            fprintf(stderr, "cannot open %s: %s\n", output, strerror(errno));
+            return (1);
+        }
+    }
+
+    char journal_path[4096];
+    if (journal == NULL) {
+        snprintf(journal_path, sizeof(journal_path), "%s.journal", output);
+        journal = journal_path;
+    }
+    struct journal_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.mode = s.mode;
+    header.cache_size = s.cache_size;
+    header.total_size = s.total_size;
+    header.chunk_size = s.chunk_size;
+    SHA512((void *)seed, strlen(seed), header.seed_hash);
+    if (s.mode == STREAM_MASK) {
+        header.input_size = input_st.st_size;
+        header.input_mtime_ns = (uint64_t)input_st.st_mtim.tv_sec * 1000000000ULL + input_st.st_mtim.tv_nsec;
+        header.input_ino = input_st.st_ino;
+    }
+    s.done = calloc(s.nchunks, 1);
+    s.pending = malloc(sizeof(struct journal_entry) * s.nchunks);
+    if (s.done == NULL || s.pending == NULL) {
+        fprintf(stderr, "cannot allocate journal state for %llu chunks\n", s.nchunks);
+        return (1);
+    }
+    int64_t kept = journal_open(&s, journal, output, &header, verify);
+    if (kept < 0) {
+        return (1);
+    }
+    s.todo = s.nchunks - kept;
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        return (1);
+    }
+    metrics_set(METRIC_EPOCH_CHUNKS_TOTAL, s.nchunks);
+    // DAGGER_TRACE_FILE=PATH records cache row accesses in -DDAGGER_TRACE builds
+    uint32_t trace_rows[TRACE_MARKER] = {HASH_BYTES, MIX_BYTES, 0};
+    trace_start_env(trace_rows);
+    // DAGGER_TIMELINE=PATH records a Chrome trace of generation and writes
+    timeline_start_env();
+    metrics_add(METRIC_EPOCH_CHUNKS_DONE, kept);
+    if (kept > 0) {
+        printf("Resuming: %lld of %llu chunks already complete\n", (long long)kept, s.nchunks);
+    }
+
+    // at least one chunk per thread plus one being written keeps both sides busy
+    s.nslots = mem_cap / s.chunk_size;
+    if (s.nslots < 2) {
+        s.nslots = 2;
+    }
+    if (s.nslots > s.todo) {
+        s.nslots = s.todo > 0 ? s.todo : 1;
+    }
+    s.slots = calloc(s.nslots, sizeof(struct slot));
+    for (uint64_t i = 0; i < s.nslots; i++) {
+        if (posix_memalign((void **)&s.slots[i].buf, STREAM_ALIGN, s.chunk_size) != 0) {
+            fprintf(stderr, "cannot allocate %llu chunk buffers\n", s.nslots);
+            return (1);
+        }
+    }
+    metrics_set(METRIC_BUFFER_BYTES, s.nslots * s.chunk_size);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.slot_free, NULL);
+    pthread_cond_init(&s.slot_ready, NULL);
+
+    struct uring ring;
+    struct uring *ringp = NULL;
+    if (use_uring) {
+        int ret = uring_init(&ring, queue_depth);
+        if (ret == 0) {
+            ringp = &ring;
+        } else {
+            fprintf(stderr, "io_uring unavailable (%s), using pwrite\n", strerror(-ret));
+        }
+    }
+
+    struct timespec start, end;
+    int ret = 0;
+    if (s.todo == 0) {
+        printf("Nothing to do, all chunks are complete\n");
+        goto finalize;
+    }
+    printf("Generating cache with size %llu\n", s.cache_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s.cache = generate_cache(s.cache_size, (unsigned char *)seed, strlen(seed));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    metrics_set(METRIC_CACHE_BYTES, s.cache_size);
+
+    printf("Streaming %llu bytes in %llu chunks (%llu missing, %llu in flight, %d threads, %s%s)\n", s.total_size, s.nchunks,
+           s.todo, s.nslots, threads, s.direct ? "O_DIRECT" : "buffered", ringp ? ", io_uring" : "");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    while (tids != NULL && started < threads) {
+        int err = pthread_create(&tids[started], NULL, stream_worker, &s);
+        if (err != 0) {
+            fprintf(stderr, "cannot start compute thread %d: %s\n", started, strerror(err));
+            break;
+        }
+        started++;
+    }
+    if (started == threads) {
+        ret = stream_writer(&s, ringp, sync_interval);
+    } else {
+        // the chunks already computed are not journaled and will be redone
+        stream_fail(&s);
+        ret = -1;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    trace_stop();
+    timeline_stop();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (ret == 0) {
+        uint64_t bytes = s.todo * s.chunk_size < s.total_size ? s.todo * s.chunk_size : s.total_size;
+        printf("Done! Took %0.2fs, %0.2f MB/s\n", used_time, bytes / used_time / 1e6);
+    }
+    free(tids);
+
+finalize:
+    if (ret == 0 && (ftruncate(s.out_fd, s.total_size) != 0 || fsync(s.out_fd) != 0)) {
+        fprintf(stderr, "finalizing %s failed: %s\n", output, strerror(errno));
+        ret = -1;
+    }
+    if (ret != 0) {
+        metrics_add(METRIC_ERRORS, 1);
+    }
+    metrics_stop();
+
+    if (ringp != NULL) {
+        uring_exit(ringp);
+    }
+    close(s.out_fd);
+    if (s.in_fd >= 0) {
+        close(s.in_fd);
+    }
+    for (uint64_t i = 0; i < s.nslots; i++) {
+        free(s.slots[i].buf);
+    }
+    free(s.slots);
+    free(s.cache);
+    free(s.done);
+    free(s.pending);
+    close(s.journal_fd);
+    return (ret == 0 ? 0 : 1);
+}
@@ -0,0 +1,466 @@
+/*
+ * Sampled integrity check of a dataset or masked shard on disk.
+ *
+ *   gcc -O3 -mavx2 -pthread dataset_verify.c -o dataset_verify -lm
+ *   ./dataset_verify dataset --data dataset.bin --confidence 0.999 --bad-fraction 1e-5
+ *   ./dataset_verify mask --data shard.masked --input shard.bin --rate 50 --idle
+ *
+ * The store is split into samples of --sample-items consecutive items.  If a
+ * fraction p of the samples is damaged, checking n random samples misses all
+ * of them with probability (1 - p)^n, so n = ln(1 - c) / ln(1 - p) samples
+ * find damage with confidence c.  Samples are picked at random (--stride picks
+ * evenly spaced ones from a random start instead, which also bounds the
+ * largest unchecked gap) and recomputed with calculate_dataset_item_opt() or
+ * calculate_mask_data() on every core, then compared with the stored bytes.
+ * Damaged items are merged into ranges and reported.
+ *
+ * Reads bypass the page cache when O_DIRECT is available and are throttled by
+ * a token bucket (--rate MB/s); --idle additionally drops to idle I/O and
+ * lowest CPU priority, so the check can run beside a miner.
+ *
+ * Exits 0 when every sample matches, 2 when damage was found, 1 on errors.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+
+#define VERIFY_ALIGN 4096
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+enum verify_mode { VERIFY_DATASET, VERIFY_MASK };
+
+// Items [first, end) of one sample that did not match.
+struct bad_range {
+    uint64_t first;
+    uint64_t end;
+};
+
+struct verify {
+    int mode;
+    unsigned char *cache;
+    uint64_t cache_size;
+    int data_fd;
+    int in_fd; // raw shard in mask mode, -1 to check against zero data
+    uint64_t total_size;
+    uint64_t items;
+    uint64_t sample_items;
+    uint64_t slots; // samples the store is divided into
+    uint64_t samples;
+    int stride;
+    uint64_t rng_seed;
+    uint64_t stride_start;
+
+    uint64_t next_sample;
+    uint64_t checked;
+    uint64_t bad_samples;
+    int error;
+    struct bad_range *bad;
+    uint64_t nbad;
+    uint64_t bad_cap;
+    pthread_mutex_t lock;
+
+    // token bucket, bytes; rate 0 is unlimited
+    double rate;
+    double tokens;
+    uint64_t last_refill;
+    pthread_mutex_t bucket_lock;
+};
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (x ^ (x >> 31));
+}
+
+// Sample k as an index into the slots.
+uint64_t verify_slot(struct verify *v, uint64_t k) {
+    if (v->stride) {
+        return ((v->stride_start + (unsigned __int128)k * v->slots / v->samples) % v->slots);
+    }
+    return (splitmix64(v->rng_seed ^ splitmix64(k)) % v->slots);
+}
+
+// Block until len bytes of read budget are available.
+void verify_throttle(struct verify *v, uint64_t len) {
+    if (v->rate <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&v->bucket_lock);
+    for (;;) {
+        uint64_t now = metrics_now();
+        v->tokens += (now - v->last_refill) / 1e9 * v->rate;
+        v->last_refill = now;
+        // allow a burst of at most a quarter second
+        if (v->tokens > v->rate / 4 + len) {
+            v->tokens = v->rate / 4 + len;
+        }
+        if (v->tokens >= len) {
+            v->tokens -= len;
+            break;
+        }
+        // hold the lock while sleeping so waiting threads queue up in order
+        usleep((useconds_t)((len - v->tokens) / v->rate * 1e6) + 1);
+    }
+    pthread_mutex_unlock(&v->bucket_lock);
+}
+
+int verify_read(int fd, unsigned char *buf, uint64_t len, uint64_t off) {
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, off + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return (-1);
+        }
+        done += n;
+        if (n == 0 || done % VERIFY_ALIGN != 0) {
+            // short read at the end of the file: the caller compares only the real bytes
+            memset(buf + done, 0, len - done);
+            break;
+        }
+    }
+    return (0);
+}
+
+void verify_report_bad(struct verify *v, uint64_t first, uint64_t end) {
+    pthread_mutex_lock(&v->lock);
+    if (v->nbad == v->bad_cap) {
+        v->bad_cap = v->bad_cap ? 2 * v->bad_cap : 64;
+        v->bad = realloc(v->bad, v->bad_cap * sizeof(struct bad_range));
+    }
+    v->bad[v->nbad].first = first;
+    v->bad[v->nbad].end = end;
+    v->nbad++;
+    pthread_mutex_unlock(&v->lock);
+}
+
+void *verify_worker(void *arg) {
+    struct verify *v = arg;
+    timeline_thread_name("verifier");
+    uint64_t buf_len = (v->sample_items * HASH_BYTES + VERIFY_ALIGN - 1) / VERIFY_ALIGN * VERIFY_ALIGN;
+    unsigned char *stored, *expect;
+    if (posix_memalign((void **)&stored, VERIFY_ALIGN, buf_len) != 0 ||
+        posix_memalign((void **)&expect, VERIFY_ALIGN, buf_len) != 0) {
+        v->error = 1;
+        return (NULL);
+    }
+
+    for (;;) {
+        uint64_t k = __atomic_fetch_add(&v->next_sample, 1, __ATOMIC_RELAXED);
+        if (k >= v->samples || v->error) {
+            break;
+        }
+        uint64_t first = verify_slot(v, k) * v->sample_items;
+        uint64_t items = v->items - first < v->sample_items ? v->items - first : v->sample_items;
+        uint64_t off = first * HASH_BYTES;
+        uint64_t len = v->total_size - off < items * HASH_BYTES ? v->total_size - off : items * HASH_BYTES;
+        uint64_t read_len = (len + VERIFY_ALIGN - 1) / VERIFY_ALIGN * VERIFY_ALIGN;
+
+        uint64_t start = metrics_now();
+        uint64_t t0 = timeline_begin();
+        verify_throttle(v, v->in_fd >= 0 ? 2 * read_len : read_len);
+        t0 = timeline_end("throttle", t0);
+        if (verify_read(v->data_fd, stored, read_len, off) != 0 ||
+            (v->in_fd >= 0 && verify_read(v->in_fd, expect, read_len, off) != 0)) {
+            fprintf(stderr, "read at %llu failed: %s\n", off, strerror(errno));
+            metrics_add(METRIC_ERRORS, 1);
+            v->error = 1;
+            break;
+        }
+        start = metrics_observe_since(METRIC_IO_LATENCY, start);
+        t0 = timeline_end("read sample", t0);
+        metrics_add(METRIC_IO_READ_BYTES, v->in_fd >= 0 ? 2 * read_len : read_len);
+
+        if (v->mode == VERIFY_DATASET) {
+            for (uint64_t j = 0; j < items; j++) {
+                calculate_dataset_item_opt(v->cache, v->cache_size, first + j, expect + j * HASH_BYTES);
+            }
+            timeline_end("dataset sample", t0);
+            metrics_observe_since(METRIC_ITEM_LATENCY, start);
+            metrics_add(METRIC_DATASET_ITEMS, items);
+        } else {
+            if (v->in_fd < 0) {
+                memset(expect, 0, items * HASH_BYTES);
+            } else {
+                // a trailing partial item is masked as if zero padded
+                memset(expect + len, 0, items * HASH_BYTES - len);
+            }
+            calculate_mask_blob(v->cache, v->cache_size, first, expect, items * HASH_BYTES);
+            timeline_end("mask sample", t0);
+            metrics_observe_since(METRIC_MASK_LATENCY, start);
+            metrics_add(METRIC_MASK_ITEMS, items);
+        }
+
+        // one range per sample, from the first to the last damaged item
+        uint64_t bad_first = UINT64_MAX, bad_end = 0;
+        for (uint64_t j = 0; j < items; j++) {
+            uint64_t n = len - j * HASH_BYTES < HASH_BYTES ? len - j * HASH_BYTES : HASH_BYTES;
+            if (memcmp(stored + j * HASH_BYTES, expect + j * HASH_BYTES, n) != 0) {
+                if (bad_first == UINT64_MAX) {
+                    bad_first = first + j;
+                }
+                bad_end = first + j + 1;
+            }
+        }
+        if (bad_first != UINT64_MAX) {
+            verify_report_bad(v, bad_first, bad_end);
+            __atomic_fetch_add(&v->bad_samples, 1, __ATOMIC_RELAXED);
+        }
+        uint64_t checked = __atomic_add_fetch(&v->checked, 1, __ATOMIC_RELAXED);
+        uint64_t percent = v->samples / 10 + 1;
+        if (checked % percent == 0) {
+            printf("checked %llu / %llu samples, %llu bad\n", checked, v->samples,
+                   (unsigned long long)__atomic_load_n(&v->bad_samples, __ATOMIC_RELAXED));
+        }
+    }
+    free(stored);
+    free(expect);
+    return (NULL);
+}
+
+int bad_range_cmp(const void *a, const void *b) {
+    const struct bad_range *x = a, *y = b;
+    return (x->first < y->first ? -1 : x->first > y->first);
+}
+
+int open_data(const char *path, int *direct) {
+    int fd = *direct ? open(path, O_RDONLY | O_DIRECT) : -1;
+    *direct = fd >= 0;
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    }
+    return (fd);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s dataset|mask --data PATH [options]\n"
+            "  --data PATH          dataset or masked shard to check (required)\n"
+            "  --input PATH         raw shard the mask was applied to (mask mode, default zero data)\n"
+            "  --seed STR           cache seed (default 123)\n"
+            "  --cache-size BYTES   cache size (default 16777216)\n"
+            "  --confidence C       probability of finding damage (default 0.999)\n"
+            "  --bad-fraction P     smallest damaged fraction of samples to find (default 1e-4)\n"
+            "  --samples N          check N samples instead of deriving it from C and P\n"
+            "  --sample-items N     items per sample (default 64, i.e. 4 KB)\n"
+            "  --stride             evenly spaced samples instead of random ones\n"
+            "  --rng-seed N         sample selection seed (default: time)\n"
+            "  --threads N          compute threads (default: all online cores)\n"
+            "  --rate MB            read at most MB megabytes per second (default unlimited)\n"
+            "  --idle               idle I/O class and lowest CPU priority\n"
+            "  --metrics TARGET     export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"data", required_argument, 0, 'd'},
+        {"input", required_argument, 0, 'i'},
+        {"seed", required_argument, 0, 'e'},
+        {"cache-size", required_argument, 0, 'c'},
+        {"confidence", required_argument, 0, 'C'},
+        {"bad-fraction", required_argument, 0, 'p'},
+        {"samples", required_argument, 0, 'n'},
+        {"sample-items", required_argument, 0, 'I'},
+        {"stride", no_argument, 0, 's'},
+        {"rng-seed", required_argument, 0, 'r'},
+        {"threads", required_argument, 0, 't'},
+        {"rate", required_argument, 0, 'R'},
+        {"idle", no_argument, 0, 'L'},
+        {"metrics", required_argument, 0, 'X'},
+        {0, 0, 0, 0},
+    };
+
+    if (argc < 2 || (strcmp(argv[1], "dataset") != 0 && strcmp(argv[1], "mask") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct verify v;
+    memset(&v, 0, sizeof(v));
+    v.mode = strcmp(argv[1], "dataset") == 0 ? VERIFY_DATASET : VERIFY_MASK;
+    v.cache_size = 16777216;
+    v.sample_items = 64;
+    v.in_fd = -1;
+    v.rng_seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+
+    const char *data = NULL;
+    const char *input = NULL;
+    const char *seed = "123";
+    double confidence = 0.999;
+    double bad_fraction = 1e-4;
+    int threads = dagger_gen_threads();
+    int idle = 0;
+    const char *metrics_target = getenv("DAGGER_METRICS");
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'd': data = optarg; break;
+        case 'i': input = optarg; break;
+        case 'e': seed = optarg; break;
+        case 'c': v.cache_size = strtoull(optarg, NULL, 0); break;
+        case 'C': confidence = atof(optarg); break;
+        case 'p': bad_fraction = atof(optarg); break;
+        case 'n': v.samples = strtoull(optarg, NULL, 0); break;
+        case 'I': v.sample_items = strtoull(optarg, NULL, 0); break;
+        case 's': v.stride = 1; break;
+        case 'r': v.rng_seed = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        case 'R': v.rate = atof(optarg) * 1e6; break;
+        case 'L': idle = 1; break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (data == NULL || (v.mode == VERIFY_DATASET && input != NULL) || v.sample_items == 0 || threads < 1 ||
+        confidence <= 0 || confidence >= 1 || bad_fraction <= 0 || bad_fraction >= 1) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    // O_DIRECT reads need samples that start on a block boundary
+    int direct = v.sample_items * HASH_BYTES % VERIFY_ALIGN == 0;
+    struct stat st;
+    v.data_fd = open_data(data, &direct);
+    if (v.data_fd < 0 || fstat(v.data_fd, &st) != 0) {
+        return (1);
+    }
+    v.total_size = st.st_size;
+    if (input != NULL) {
+        int in_direct = direct;
+        struct stat in_st;
+        v.in_fd = open_data(input, &in_direct);
+        if (v.in_fd < 0 || fstat(v.in_fd, &in_st) != 0) {
+            return (1);
+        }
+        if ((uint64_t)in_st.st_size != v.total_size) {
+            fprintf(stderr, "%s and %s differ in size\n", data, input);
+            return (1);
+        }
+    }
+    if (v.total_size == 0) {
+        fprintf(stderr, "%s is empty\n", data);
+        return (1);
+    }
+    v.items = (v.total_size + HASH_BYTES - 1) / HASH_BYTES;
+    v.slots = (v.items + v.sample_items - 1) / v.sample_items;
+
+    uint64_t derived = (uint64_t)ceil(log(1 - confidence) / log(1 - bad_fraction));
+    if (v.samples == 0) {
+        v.samples = derived;
+    }
+    if (v.stride && v.samples > v.slots) {
+        v.samples = v.slots;
+    }
+    v.stride_start = splitmix64(v.rng_seed) % v.slots;
+    // the confidence actually reached with the samples being checked
+    double reached = 1 - pow(1 - bad_fraction, (double)v.samples);
+
+    if (idle) {
+        syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+        setpriority(PRIO_PROCESS, 0, 19);
+    }
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        return (1);
+    }
+    // DAGGER_TIMELINE=PATH records a Chrome trace of reads and recomputation
+    timeline_start_env();
+
+    struct timespec start, end;
+    printf("Generating cache with size %llu\n", v.cache_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    v.cache = generate_cache(v.cache_size, (unsigned char *)seed, strlen(seed));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    metrics_set(METRIC_CACHE_BYTES, v.cache_size);
+
+    printf("Checking %llu of %llu samples of %llu items (%s, seed %llu, %d threads, %s%s)\n", v.samples, v.slots,
+           v.sample_items, v.stride ? "stride" : "random", (unsigned long long)v.rng_seed, threads,
+           direct ? "O_DIRECT" : "buffered", v.rate > 0 ? ", rate limited" : "");
+    pthread_mutex_init(&v.lock, NULL);
+    pthread_mutex_init(&v.bucket_lock, NULL);
+    v.last_refill = metrics_now();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    while (tids != NULL && started < threads) {
+        int err = pthread_create(&tids[started], NULL, verify_worker, &v);
+        if (err != 0) {
+            fprintf(stderr, "cannot start verify thread %d: %s\n", started, strerror(err));
+            break;
+        }
+        started++;
+    }
+    // the workers share the sample queue, so fewer threads still check every sample
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    if (started == 0) {
+        v.error = 1;
+    }
+    timeline_stop();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Done! Took %0.2fs, %0.2f items/s\n", used_time,
+           (double)v.checked * v.sample_items / used_time);
+
+    // merge adjacent or overlapping ranges
+    qsort(v.bad, v.nbad, sizeof(struct bad_range), bad_range_cmp);
+    uint64_t nmerged = 0;
+    for (uint64_t k = 0; k < v.nbad; k++) {
+        if (nmerged > 0 && v.bad[k].first <= v.bad[nmerged - 1].end) {
+            if (v.bad[k].end > v.bad[nmerged - 1].end) {
+                v.bad[nmerged - 1].end = v.bad[k].end;
+            }
+            continue;
+        }
+        v.bad[nmerged++] = v.bad[k];
+    }
+    for (uint64_t k = 0; k < nmerged; k++) {
+        printf("bad items [%llu, %llu), bytes [%llu, %llu)\n", (unsigned long long)v.bad[k].first,
+               (unsigned long long)v.bad[k].end, (unsigned long long)(v.bad[k].first * HASH_BYTES),
+               (unsigned long long)(v.bad[k].end * HASH_BYTES < v.total_size ? v.bad[k].end * HASH_BYTES
+                                                                               : v.total_size));
+    }
+
+    int ret = 0;
+    if (v.error) {
+        ret = 1;
+    } else if (v.bad_samples > 0) {
+        printf("%llu of %llu samples damaged (~%0.4g%% of the store)\n", (unsigned long long)v.bad_samples,
+               (unsigned long long)v.checked, 100.0 * v.bad_samples / v.checked);
+        ret = 2;
+    } else if (v.stride && v.samples == v.slots) {
+        printf("No damage found: every item was checked\n");
+    } else {
+        printf("No damage found: with %0.4g%% confidence less than %0.4g%% of the samples are damaged\n",
+               100 * reached, 100 * bad_fraction);
+    }
+    metrics_stop();
+    free(tids);
+    free(v.bad);
+    free(v.cache);
+    close(v.data_fd);
+    if (v.in_fd >= 0) {
+        close(v.in_fd);
+    }
+    return (ret);
+}
@@ -0,0 +1,540 @@
+// Design-space explorer for dagger / hashimoto parameters.
+//
+//   g++ -std=c++17 -O3 -march=native -pthread explorer.cpp -o explorer
+//   ./explorer verify
+//   ./explorer run --size 1073741824 --threads 16 --rank score --csv grid.csv
+//   ./explorer run --word 4 --hash sha512 --parents 256 --loop 32,64 --rank verify
+//
+// CACHE_ROUND, DATASET_PARENTS, LOOP_ACCESSES, MIX_BYTES, WORD_BYTES and the
+// hash are #defines in dagger.c and dagger_32.c.  Here every combination of
+//
+//   word bytes   4, 8            (fnv32 / fnv64, as dagger_32.c / dagger.c)
+//   hash         sha512, keccak512
+//   cache rounds 1, 3
+//   parents      128, 256, 512
+//   mix bytes    64, 128, 256
+//   loop         32, 64, 128
+//
+// is a DaggerKernel<> (dagger_kernels.hpp) instantiated at compile time, so
+// each one runs with its constants folded in, exactly as a dedicated build
+// would (which is also why the explorer takes minutes to compile).  The
+// --word, --hash, --rounds, --parents, --mix and --loop lists pick part of
+// the grid.  For every configuration:
+//
+//   gen s     cache generation plus --size / 64 dataset items on --gen-threads
+//             threads, extrapolated from the one-thread item rate over --seconds
+//   full H/s  hashimoto() on --threads threads over a --size dataset (of random
+//             bytes: the access pattern, not the contents, sets the speed)
+//   MB/s      dataset bytes those hashes read, LOOP_ACCESSES * MIX_BYTES each,
+//   bw %      as a share of what the same threads read of the same rows with
+//             no hashing at all (near 100 the hash is memory bound)
+//   light     hashimoto computing every row from the cache, one thread: what a
+//   verify us   verifier without the dataset pays per hash
+//   ratio     full H/s per thread over light H/s: the advantage of keeping the dataset
+//
+// and the report is ranked by --rank: score (ratio * bw % / verify ms: memory
+// bound, a large advantage for the full dataset, cheap to verify), ratio,
+// hashrate, verify, gen or bandwidth.
+//
+// randomChecks and maxKvSizeBits live in the contracts rather than in the
+// kernel; for each pair of --random-checks and --max-kv-size-bits a second
+// table gives what one DecentralizedKVMinable candidate reads (randomChecks
+// blobs), the candidate rate that bounds it to at the measured sequential
+// bandwidth, and the mine() calldata and keccak gas of carrying and hashing
+// those blobs (EIP-2028 for random data, 30 + 6 per word).
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_kernels.cpp"
+#include "keccak.c"
+#include "dagger_profile.c"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct Keccak512Hash {
+    static constexpr unsigned bytes = 64;
+    static constexpr const char *name = "keccak512";
+    static inline void hash(const void *data, uint64_t len, unsigned char *digest) { keccak512(data, len, digest); }
+};
+
+struct ExplorerConfig {
+    std::string name;
+    DaggerKernelEntry k;
+};
+
+template <typename Word, typename Hash, unsigned Rounds, unsigned Parents, unsigned Mix, unsigned Loop>
+ExplorerConfig make_explorer_config() {
+    typedef DaggerKernel<Word, Hash::bytes / sizeof(Word), Parents, Mix, Loop, Hash, Rounds> Kernel;
+    char name[96];
+    snprintf(name, sizeof(name), "w%u-%s-r%u-p%u-m%u-l%u", (unsigned)sizeof(Word), Hash::name, Rounds, Parents, Mix, Loop);
+    ExplorerConfig c{name, make_dagger_kernel_entry<Kernel>("")};
+    return c;
+}
+
+// The grid: one instantiation per combination, added axis by axis.
+template <typename Word, typename Hash, unsigned Rounds, unsigned Parents, unsigned Mix, unsigned... Loop>
+void add_loops(std::vector<ExplorerConfig> &grid, std::integer_sequence<unsigned, Loop...>) {
+    (grid.push_back(make_explorer_config<Word, Hash, Rounds, Parents, Mix, Loop>()), ...);
+}
+
+template <typename Word, typename Hash, unsigned Rounds, unsigned Parents, unsigned... Mix>
+void add_mixes(std::vector<ExplorerConfig> &grid, std::integer_sequence<unsigned, Mix...>) {
+    (add_loops<Word, Hash, Rounds, Parents, Mix>(grid, std::integer_sequence<unsigned, 32, 64, 128>{}), ...);
+}
+
+template <typename Word, typename Hash, unsigned Rounds, unsigned... Parents>
+void add_parents(std::vector<ExplorerConfig> &grid, std::integer_sequence<unsigned, Parents...>) {
+    (add_mixes<Word, Hash, Rounds, Parents>(grid, std::integer_sequence<unsigned, 64, 128, 256>{}), ...);
+}
+
+template <typename Word, typename Hash, unsigned... Rounds>
+void add_rounds(std::vector<ExplorerConfig> &grid, std::integer_sequence<unsigned, Rounds...>) {
+    (add_parents<Word, Hash, Rounds>(grid, std::integer_sequence<unsigned, 128, 256, 512>{}), ...);
+}
+
+std::vector<ExplorerConfig> explorer_grid() {
+    std::vector<ExplorerConfig> grid;
+    add_rounds<uint32_t, Sha512Hash>(grid, std::integer_sequence<unsigned, 1, 3>{});
+    add_rounds<uint64_t, Sha512Hash>(grid, std::integer_sequence<unsigned, 1, 3>{});
+    add_rounds<uint32_t, Keccak512Hash>(grid, std::integer_sequence<unsigned, 1, 3>{});
+    add_rounds<uint64_t, Keccak512Hash>(grid, std::integer_sequence<unsigned, 1, 3>{});
+    return grid;
+}
+
+struct ExplorerResult {
+    const ExplorerConfig *c;
+    double cache_s;
+    double items_per_s;
+    double gen_s;
+    double full_hps;
+    double read_mbs;
+    double bw_share;
+    double light_hps;
+    double ratio;
+    double score;
+};
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Run f(i) for i = 0, 1, ... until seconds have passed; returns calls per second.
+template <typename F>
+static double rate_for(double seconds, F &&f) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t n = 0;
+    double t;
+    do {
+        for (uint64_t end = n + 16; n < end; n++) {
+            f(n);
+        }
+    } while ((t = elapsed(&start)) < seconds);
+    return (n / t);
+}
+
+// rate_for() on threads threads at once; returns the summed rate.
+template <typename F>
+static double threaded_rate(int threads, double seconds, F &&f) {
+    std::vector<double> rates(threads);
+    std::vector<std::thread> tids;
+    for (int t = 0; t < threads; t++) {
+        tids.emplace_back([&, t] { rates[t] = rate_for(seconds, [&](uint64_t n) { f(t, n); }); });
+    }
+    double sum = 0;
+    for (int t = 0; t < threads; t++) {
+        tids[t].join();
+        sum += rates[t];
+    }
+    return (sum);
+}
+
+static inline uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+struct Explorer {
+    unsigned char *dataset;
+    uint64_t size;
+    uint64_t cache_size;
+    int threads;     // hashimoto threads
+    int gen_threads; // dataset generation threads, for gen s
+    double seconds;
+    double seq_mbs;                // sequential read bandwidth on all threads
+    std::vector<double> row_mbs;   // random row reads per mix size, by log2(mix bytes)
+};
+
+// Bytes per second the threads read as dependent random rows of mix bytes, with no hashing.
+static double row_bandwidth(Explorer &e, unsigned mix) {
+    uint64_t rows = e.size / mix;
+    double rate = threaded_rate(e.threads, e.seconds, [&](int t, uint64_t n) {
+        uint64_t s = t * 1000003 + n, x = 0;
+        for (unsigned i = 0; i < 64; i++) {
+            const uint64_t *row = (const uint64_t *)(e.dataset + (splitmix64(&s) ^ x) % rows * mix);
+            for (unsigned w = 0; w < mix / 8; w++) {
+                x += row[w];
+            }
+        }
+        __asm__ volatile("" ::"r"(x));
+    });
+    return (rate * 64 * mix / 1e6);
+}
+
+static double sequential_bandwidth(Explorer &e) {
+    uint64_t piece = e.size / e.threads / 64 * 64;
+    std::vector<std::thread> tids;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < e.threads; t++) {
+        tids.emplace_back([&, t] {
+            const uint64_t *p = (const uint64_t *)(e.dataset + t * piece);
+            uint64_t x = 0;
+            for (uint64_t w = 0; w < piece / 8; w++) {
+                x += p[w];
+            }
+            __asm__ volatile("" ::"r"(x));
+        });
+    }
+    for (std::thread &t : tids) {
+        t.join();
+    }
+    return (piece * e.threads / elapsed(&start) / 1e6);
+}
+
+ExplorerResult explore(Explorer &e, const ExplorerConfig &c) {
+    const DaggerKernelEntry &k = c.k;
+    ExplorerResult r;
+    memset(&r, 0, sizeof(r));
+    r.c = &c;
+    unsigned char seed[] = "123";
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned char *cache = k.generate_cache(e.cache_size, seed, sizeof(seed) - 1);
+    r.cache_s = elapsed(&start);
+    unsigned char item[64];
+    r.items_per_s = rate_for(e.seconds, [&](uint64_t i) { k.calculate_dataset_item(cache, e.cache_size, i, item); });
+    // items only read the cache, so generation scales with the threads
+    r.gen_s = r.cache_s + e.size / 64 / (r.items_per_s * e.gen_threads);
+
+    r.full_hps = threaded_rate(e.threads, e.seconds, [&](int t, uint64_t n) {
+        unsigned char hash[64], digest[64];
+        uint64_t in[2] = {(uint64_t)t, n};
+        SHA512(in, sizeof(in), hash);
+        k.hashimoto(hash, e.size, e.dataset, digest);
+    });
+    r.read_mbs = r.full_hps * k.loop_accesses * k.mix_bytes / 1e6;
+    r.bw_share = r.read_mbs / e.row_mbs[__builtin_ctz(k.mix_bytes)];
+
+    r.light_hps = rate_for(e.seconds, [&](uint64_t n) {
+        unsigned char hash[64], digest[64];
+        SHA512(&n, sizeof(n), hash);
+        c.k.hashimoto_light(hash, e.size, cache, e.cache_size, digest);
+    });
+    r.ratio = r.full_hps / e.threads / r.light_hps;
+    r.score = r.ratio * r.bw_share * r.light_hps / 1e3;
+    free(cache);
+    return (r);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+// Every configuration: light and full hashimoto agree, and the dagger_32.c /
+// dagger.c points of the grid match the registered kernels.
+int explorer_self_verify() {
+    std::vector<ExplorerConfig> grid = explorer_grid();
+    unsigned char seed[] = "123";
+    const uint64_t cache_size = 4096, size = 1 << 14;
+    int ok = check("grid size", grid.size() == 2 * 2 * 2 * 3 * 3 * 3);
+    int baselines = 0;
+    for (const ExplorerConfig &c : grid) {
+        const DaggerKernelEntry &k = c.k;
+        unsigned char *cache = k.generate_cache(cache_size, seed, sizeof(seed) - 1);
+        unsigned char *dataset = (unsigned char *)malloc(size);
+        for (uint64_t i = 0; i < size / 64; i++) {
+            k.calculate_dataset_item(cache, cache_size, i, dataset + i * 64);
+        }
+        for (uint64_t n = 0; n < 4; n++) {
+            unsigned char hash[64], full[64], light[64];
+            SHA512(&n, sizeof(n), hash);
+            k.hashimoto(hash, size, dataset, full);
+            c.k.hashimoto_light(hash, size, cache, cache_size, light);
+            ok &= check(c.name.c_str(), memcmp(full, light, k.mix_bytes / 4) == 0);
+        }
+
+        const DaggerKernelEntry *ref = find_dagger_kernel(k.word_bytes, k.dataset_parents, k.mix_bytes, k.loop_accesses,
+                                                          k.hash_name);
+        if (ref != NULL && c.k.cache_rounds == 3) {
+            baselines++;
+            unsigned char *ref_cache = ref->generate_cache(cache_size, seed, sizeof(seed) - 1);
+            unsigned char item[64], ref_item[64];
+            k.calculate_dataset_item(cache, cache_size, 123, item);
+            ref->calculate_dataset_item(ref_cache, cache_size, 123, ref_item);
+            ok &= check("registered kernel", memcmp(cache, ref_cache, cache_size) == 0 && memcmp(item, ref_item, 64) == 0);
+            free(ref_cache);
+        }
+        free(dataset);
+        free(cache);
+    }
+    ok &= check("dagger_32.c and dagger.c in the grid", baselines == 2);
+    printf(ok ? "explorer_self_verify() passed\n" : "explorer_self_verify() failed!\n");
+    return (!ok);
+}
+
+// Whether value is in the comma separated list, or the list is empty.
+static bool in_list(const char *list, const char *value) {
+    if (list == NULL) {
+        return (true);
+    }
+    size_t n = strlen(value);
+    for (const char *p = list; *p;) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == n && strncmp(p, value, n) == 0) {
+            return (true);
+        }
+        p += len + (end != NULL);
+    }
+    return (false);
+}
+
+static bool in_list(const char *list, unsigned value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", value);
+    return (in_list(list, buf));
+}
+
+// Parse a non-empty comma separated list of integers in [lo, hi] into out.
+static bool parse_list(const char *list, unsigned lo, unsigned hi, std::vector<unsigned> *out) {
+    out->clear();
+    for (const char *p = list;;) {
+        char *end;
+        errno = 0;
+        unsigned long v = strtoul(p, &end, 10);
+        if (end == p || *p == '-' || *p == '+' || errno != 0 || v < lo || v > hi || (*end != ',' && *end != 0)) {
+            return (false);
+        }
+        out->push_back((unsigned)v);
+        if (*end == 0) {
+            return (true);
+        }
+        p = end + 1;
+    }
+}
+
+// Larger is better for every key but verify and gen.
+static double rank_key(const ExplorerResult &r, const char *rank) {
+    if (strcmp(rank, "ratio") == 0) {
+        return (r.ratio);
+    } else if (strcmp(rank, "hashrate") == 0) {
+        return (r.full_hps);
+    } else if (strcmp(rank, "verify") == 0) {
+        return (r.light_hps);
+    } else if (strcmp(rank, "gen") == 0) {
+        return (-r.gen_s);
+    } else if (strcmp(rank, "bandwidth") == 0) {
+        return (r.bw_share);
+    }
+    return (r.score);
+}
+
+// What randomChecks and maxKvSizeBits cost a miner per candidate and mine() per solution.
+static void contract_report(Explorer &e, const std::vector<unsigned> &checks_list,
+                            const std::vector<unsigned> &bits_list) {
+    printf("\n%-14s %-14s %14s %14s %14s %14s\n", "randomChecks", "maxKvSizeBits", "KB/candidate", "max cand/s",
+           "calldata gas", "keccak gas");
+    for (unsigned checks : checks_list) {
+        for (unsigned bits : bits_list) {
+            uint64_t bytes = (uint64_t)checks << bits;
+            // random blobs: 255 of 256 bytes are non-zero at 16 gas, the rest 4
+            double calldata_gas = bytes * (16.0 * 255 + 4) / 256;
+            uint64_t keccak_gas = checks * (30 + 6 * ((1ULL << bits) / 32));
+            printf("%-14u %-14u %14.1f %14.1f %14.0f %14llu\n", checks, bits, bytes / 1024.0, e.seq_mbs * 1e6 / bytes,
+                   calldata_gas, (unsigned long long)keccak_gas);
+        }
+    }
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s run [options]\n"
+            "  --word LIST             word bytes to explore, of 4,8 (default all)\n"
+            "  --hash LIST             of sha512,keccak512 (default all)\n"
+            "  --rounds LIST           cache rounds, of 1,3 (default all)\n"
+            "  --parents LIST          dataset parents, of 128,256,512 (default all)\n"
+            "  --mix LIST              mix bytes, of 64,128,256 (default all)\n"
+            "  --loop LIST             loop accesses, of 32,64,128 (default all)\n"
+            "  --size BYTES            dataset size (default 268435456)\n"
+            "  --cache-size BYTES      cache size (default 4194304)\n"
+            "  --threads N             threads for the full hash rate (default: profile, else all cores)\n"
+            "  --gen-threads N         threads gen s assumes for the dataset (default: all online cores)\n"
+            "  --seconds S             per measurement (default 0.2)\n"
+            "  --rank KEY              score, ratio, hashrate, verify, gen or bandwidth (default score)\n"
+            "  --top N                 rows to print (default all)\n"
+            "  --csv PATH              also write every result as CSV\n"
+            "  --random-checks LIST    randomChecks for the contract table, 1-1024 (default 8,16,32)\n"
+            "  --max-kv-size-bits LIST maxKvSizeBits for the contract table, 5-32 (default 12,17)\n",
+            prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"word", required_argument, 0, 'w'},          {"hash", required_argument, 0, 'h'},
+        {"rounds", required_argument, 0, 'r'},        {"parents", required_argument, 0, 'p'},
+        {"mix", required_argument, 0, 'm'},           {"loop", required_argument, 0, 'l'},
+        {"size", required_argument, 0, 's'},          {"cache-size", required_argument, 0, 'c'},
+        {"threads", required_argument, 0, 't'},       {"seconds", required_argument, 0, 'S'},
+        {"rank", required_argument, 0, 'R'},          {"top", required_argument, 0, 'T'},
+        {"csv", required_argument, 0, 'C'},           {"random-checks", required_argument, 0, 'k'},
+        {"max-kv-size-bits", required_argument, 0, 'b'}, {"gen-threads", required_argument, 0, 'g'},
+        {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (explorer_self_verify());
+    }
+    if (argc < 2 || strcmp(argv[1], "run") != 0) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct dagger_profile profile; // `dagger_32 calibrate` output for this host, if any
+    dagger_profile_load(&profile);
+    const char *words = NULL, *hashes = NULL, *rounds = NULL, *parents = NULL, *mixes = NULL, *loops = NULL;
+    const char *rank = "score", *csv = NULL, *checks_list = "8,16,32", *bits_list = "12,17";
+    Explorer e;
+    e.size = 268435456;
+    e.cache_size = 4194304;
+    e.threads = profile.threads;
+    e.gen_threads = dagger_gen_threads();
+    e.seconds = 0.2;
+    size_t top = SIZE_MAX;
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'w': words = optarg; break;
+        case 'h': hashes = optarg; break;
+        case 'r': rounds = optarg; break;
+        case 'p': parents = optarg; break;
+        case 'm': mixes = optarg; break;
+        case 'l': loops = optarg; break;
+        case 's': e.size = strtoull(optarg, NULL, 0); break;
+        case 'c': e.cache_size = strtoull(optarg, NULL, 0); break;
+        case 't': e.threads = atoi(optarg); break;
+        case 'g': e.gen_threads = atoi(optarg); break;
+        case 'S': e.seconds = atof(optarg); break;
+        case 'R': rank = optarg; break;
+        case 'T': top = strtoull(optarg, NULL, 0); break;
+        case 'C': csv = optarg; break;
+        case 'k': checks_list = optarg; break;
+        case 'b': bits_list = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    // the largest mix must divide the dataset, and a cache row is one 64-byte hash
+    std::vector<unsigned> checks, bits;
+    if (e.size < 256 || e.size % 256 != 0 || e.cache_size < 64 || e.cache_size % 64 != 0 || e.threads < 1 ||
+        e.gen_threads < 1 || e.seconds <= 0 || !in_list("score,ratio,hashrate,verify,gen,bandwidth", rank) ||
+        !parse_list(checks_list, 1, 1024, &checks) || !parse_list(bits_list, 5, 32, &bits)) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    std::vector<ExplorerConfig> grid = explorer_grid();
+    std::vector<const ExplorerConfig *> picked;
+    for (const ExplorerConfig &c : grid) {
+        if (in_list(words, c.k.word_bytes) && in_list(hashes, c.k.hash_name) && in_list(rounds, c.k.cache_rounds) &&
+            in_list(parents, c.k.dataset_parents) && in_list(mixes, c.k.mix_bytes) && in_list(loops, c.k.loop_accesses)) {
+            picked.push_back(&c);
+        }
+    }
+    if (picked.empty()) {
+        fprintf(stderr, "no configuration of the grid matches\n");
+        return (1);
+    }
+
+    e.dataset = (unsigned char *)mmap(NULL, e.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (e.dataset == MAP_FAILED) {
+        fprintf(stderr, "cannot allocate the %llu byte dataset\n", (unsigned long long)e.size);
+        return (1);
+    }
+    if (profile.huge_pages) {
+        madvise(e.dataset, e.size, MADV_HUGEPAGE);
+    }
+    uint64_t s = 1;
+    for (uint64_t w = 0; w < e.size / 8; w++) {
+        ((uint64_t *)e.dataset)[w] = splitmix64(&s);
+    }
+    e.seq_mbs = sequential_bandwidth(e);
+    e.row_mbs.assign(9, 0);
+    for (unsigned mix = 64; mix <= 256; mix *= 2) {
+        e.row_mbs[__builtin_ctz(mix)] = row_bandwidth(e, mix);
+    }
+    printf("Exploring %zu of %zu configurations: dataset %llu bytes, cache %llu bytes, %d threads, %d generating, "
+           "%0.2fs per measurement\n",
+           picked.size(), grid.size(), (unsigned long long)e.size, (unsigned long long)e.cache_size, e.threads,
+           e.gen_threads, e.seconds);
+    printf("Read bandwidth: %0.0f MB/s sequential, %0.0f / %0.0f / %0.0f MB/s random 64 / 128 / 256-byte rows\n",
+           e.seq_mbs, e.row_mbs[6], e.row_mbs[7], e.row_mbs[8]);
+    fflush(stdout);
+
+    std::vector<ExplorerResult> results;
+    for (size_t i = 0; i < picked.size(); i++) {
+        results.push_back(explore(e, *picked[i]));
+        fprintf(stderr, "\r%zu / %zu", i + 1, picked.size());
+    }
+    fprintf(stderr, "\n");
+    std::stable_sort(results.begin(), results.end(), [&](const ExplorerResult &a, const ExplorerResult &b) {
+        return (rank_key(a, rank) > rank_key(b, rank));
+    });
+
+    printf("\n%-4s %-32s %9s %12s %12s %10s %6s %10s %10s %9s %9s\n", "rank", "config", "gen s", "items/s", "full H/s",
+           "MB/s", "bw %", "light H/s", "verify us", "ratio", "score");
+    for (size_t i = 0; i < results.size() && i < top; i++) {
+        const ExplorerResult &r = results[i];
+        printf("%-4zu %-32s %9.2f %12.0f %12.0f %10.0f %6.1f %10.1f %10.1f %9.1f %9.2f\n", i + 1, r.c->name.c_str(),
+               r.gen_s, r.items_per_s, r.full_hps, r.read_mbs, 100 * r.bw_share, r.light_hps, 1e6 / r.light_hps, r.ratio,
+               r.score);
+    }
+    contract_report(e, checks, bits);
+
+    if (csv != NULL) {
+        FILE *f = fopen(csv, "w");
+        if (f == NULL) {
+            fprintf(stderr, "cannot write %s: %s\n", csv, strerror(errno));
+            return (1);
+        }
+        fprintf(f, "rank,config,word_bytes,hash,cache_rounds,dataset_parents,mix_bytes,loop_accesses,cache_s,gen_s,"
+                   "items_per_s,full_hps,read_mbs,bw_share,light_hps,verify_us,ratio,score\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const ExplorerResult &r = results[i];
+            const DaggerKernelEntry &k = r.c->k;
+            fprintf(f, "%zu,%s,%u,%s,%u,%u,%u,%u,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f\n", i + 1, r.c->name.c_str(), k.word_bytes,
+                    k.hash_name, k.cache_rounds, k.dataset_parents, k.mix_bytes, k.loop_accesses, r.cache_s, r.gen_s,
+                    r.items_per_s, r.full_hps, r.read_mbs, r.bw_share, r.light_hps, 1e6 / r.light_hps, r.ratio, r.score);
+        }
+        fclose(f);
+    }
+    munmap(e.dataset, e.size);
+    return (0);
+}
@@ -0,0 +1,415 @@
+/*
+ * fnv256 and storage-hashimoto index derivation, bit-exact with
+ * DKVDaggerHashimoto._fnv256 / _hashimoto and hashimoto.py.
+ *
+ * The fnv256 prime is 0x...01000...0163 = 2^168 + 0x163, so a * prime is
+ * (a << 168) + a * 0x163: one shift and a 9-bit multiply per limb instead of a
+ * full 256x256 product.  Each access of _hashimoto then derives
+ *
+ *   mixData = fnv256(i ^ hash0, mixData)
+ *   parent  = mixData % rows                 (rows = 1 << (shardEntryBits + shardLenBits))
+ *   kvIdx   = parent + (startShardId << shardEntryBits)
+ *   mixOff  = (mixData >> (shardEntryBits + shardLenBits)) % (maxKvSize - 32)
+ *
+ * storage_index() does that for one candidate; storage_index_batch() does it
+ * for many candidates stored as 32-bit limbs, limb-major, so the compiler can
+ * run the carry chain for 8 (AVX2) or 16 (AVX-512) candidates per instruction.
+ *
+ *   gcc -O3 -march=native fnv256.c -o fnv256
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "u256.c"
+
+#define FNV256_SHIFT 168
+#define FNV256_LOW 0x163
+
+// fnv256(a, b) = a * (2^168 + 0x163) ^ b  (mod 2^256)
+u256 fnv256(u256 a, u256 b) {
+    u256 r;
+    unsigned __int128 c = 0;
+    uint64_t s[4] = {
+        0,
+        0,
+        a.w[0] << 40,
+        (a.w[1] << 40) | (a.w[0] >> 24),
+    };
+    for (int k = 0; k < 4; k++) {
+        c += (unsigned __int128)a.w[k] * FNV256_LOW + s[k];
+        r.w[k] = (uint64_t)c ^ b.w[k];
+        c >>= 64;
+    }
+    return (r);
+}
+
+// Reference: the same thing through a generic 256-bit multiply.
+u256 fnv256_generic(u256 a, u256 b) {
+    u256 prime = u256_add(u256_shl(u256_from_u64(1), FNV256_SHIFT), u256_from_u64(FNV256_LOW));
+    return (u256_xor(u256_mul(a, prime), b));
+}
+
+struct storage_index_params {
+    unsigned rows_bits; // shardEntryBits + shardLenBits, at most 64
+    uint64_t kv_base;   // startShardId << shardEntryBits
+    uint64_t mix_mod;   // maxKvSize - 32
+    uint64_t mix_inv;   // floor((2^64 - 1) / mix_mod), for mix_mod < 2^32
+};
+
+void storage_index_init(struct storage_index_params *p, unsigned shard_entry_bits, unsigned shard_len_bits,
+                        uint64_t start_shard_id, unsigned max_kv_size_bits) {
+    p->rows_bits = shard_entry_bits + shard_len_bits;
+    p->kv_base = start_shard_id << shard_entry_bits;
+    p->mix_mod = (1ULL << max_kv_size_bits) - 32;
+    p->mix_inv = UINT64_MAX / p->mix_mod;
+}
+
+// x % mix_mod for x < mix_mod * 2^32, without a division.
+static inline uint64_t storage_reduce(const struct storage_index_params *p, uint64_t x) {
+    uint64_t q = (uint64_t)(((unsigned __int128)x * p->mix_inv) >> 64);
+    uint64_t r = x - q * p->mix_mod;
+    while (r >= p->mix_mod) {
+        r -= p->mix_mod;
+    }
+    return (r);
+}
+
+// One access of _hashimoto: mix_data holds the 32 bytes read at the current
+// mixOff and is replaced by the fnv256 result.  Returns the next mixOff.
+uint64_t storage_index(const struct storage_index_params *p, u256 h0, uint64_t i, u256 *mix_data, uint64_t *parent,
+                       uint64_t *kv_idx) {
+    u256 a = h0;
+    a.w[0] ^= i;
+    *mix_data = fnv256(a, *mix_data);
+
+    uint64_t mask = p->rows_bits >= 64 ? UINT64_MAX : (1ULL << p->rows_bits) - 1;
+    *parent = mix_data->w[0] & mask;
+    *kv_idx = *parent + p->kv_base;
+
+    u256 off = u256_shr(*mix_data, p->rows_bits);
+    if (p->mix_mod >= (1ULL << 32)) {
+        return (u256_mod_u64(off, p->mix_mod));
+    }
+    uint64_t r = 0;
+    for (int k = 3; k >= 0; k--) {
+        r = storage_reduce(p, (r << 32) | (off.w[k] >> 32));
+        r = storage_reduce(p, (r << 32) | (off.w[k] & 0xffffffff));
+    }
+    return (r);
+}
+
+// Limb-major layout for n candidates: x[k * n + j] is 32-bit limb k
+// (least significant first) of candidate j.
+void storage_batch_load(uint32_t *x, uint64_t n, uint64_t j, const unsigned char *be32) {
+    for (int k = 0; k < 8; k++) {
+        const unsigned char *p = be32 + 28 - 4 * k;
+        x[k * n + j] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+}
+
+void storage_batch_store(const uint32_t *x, uint64_t n, uint64_t j, unsigned char *be32) {
+    for (int k = 0; k < 8; k++) {
+        uint32_t v = x[k * n + j];
+        unsigned char *p = be32 + 28 - 4 * k;
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+    }
+}
+
+// storage_index() for n candidates.  h0 and mix_data use the limb-major layout
+// above; mix_data is updated in place.  parent, kv_idx and mix_off get n entries.
+// i must fit in 32 bits (it is the access counter, < randomChecks).
+void storage_index_batch(const struct storage_index_params *p, uint64_t n, const uint32_t *h0, uint32_t i,
+                         uint32_t *mix_data, uint64_t *parent, uint64_t *kv_idx, uint64_t *mix_off) {
+    uint64_t mask = p->rows_bits >= 64 ? UINT64_MAX : (1ULL << p->rows_bits) - 1;
+
+    // fnv256 + parent/kvIdx: straight-line per candidate, vectorized across j.
+    for (uint64_t j = 0; j < n; j++) {
+        uint32_t a[8];
+        for (int k = 0; k < 8; k++) {
+            a[k] = h0[k * n + j];
+        }
+        a[0] ^= i;
+
+        uint64_t c = 0;
+        for (int k = 0; k < 8; k++) {
+            // (a << 168) limb k = (a[k - 5] << 8) | (a[k - 6] >> 24)
+            uint32_t s = (k >= 5 ? a[k - 5] << 8 : 0) | (k >= 6 ? a[k - 6] >> 24 : 0);
+            c += (uint64_t)a[k] * FNV256_LOW + s;
+            mix_data[k * n + j] ^= (uint32_t)c;
+            c >>= 32;
+        }
+        uint64_t low = ((uint64_t)mix_data[n + j] << 32) | mix_data[j];
+        parent[j] = low & mask;
+        kv_idx[j] = parent[j] + p->kv_base;
+    }
+
+    // mixOff: (mixData >> rows_bits) % mix_mod.  The reduction is a 64x64
+    // high multiply that does not vectorize, so it runs as its own pass.
+    unsigned limb_shift = p->rows_bits / 32;
+    unsigned bit_shift = p->rows_bits % 32;
+    for (uint64_t j = 0; j < n; j++) {
+        uint32_t off[8];
+        for (int k = 0; k < 8; k++) {
+            uint64_t lo = k + limb_shift < 8 ? mix_data[(k + limb_shift) * n + j] : 0;
+            uint64_t hi = k + limb_shift + 1 < 8 ? mix_data[(k + limb_shift + 1) * n + j] : 0;
+            off[k] = (uint32_t)(((hi << 32) | lo) >> bit_shift);
+        }
+        if (p->mix_mod >= (1ULL << 32)) {
+            u256 v;
+            for (int k = 0; k < 4; k++) {
+                v.w[k] = ((uint64_t)off[2 * k + 1] << 32) | off[2 * k];
+            }
+            mix_off[j] = u256_mod_u64(v, p->mix_mod);
+            continue;
+        }
+        uint64_t r = 0;
+        for (int k = 7; k >= 0; k--) {
+            r = storage_reduce(p, (r << 32) | off[k]);
+        }
+        mix_off[j] = r;
+    }
+}
+
+#ifndef DAGGER_NO_MAIN
+
+static uint64_t xorshift64(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *s = x;
+    return (x);
+}
+
+static u256 random_u256(uint64_t *s) {
+    u256 r;
+    for (int k = 0; k < 4; k++) {
+        r.w[k] = xorshift64(s);
+    }
+    return (r);
+}
+
+static void print_u256(const char *label, u256 a) {
+    unsigned char b[32];
+    u256_to_be(a, b);
+    printf("%s", label);
+    for (int k = 0; k < 32; k++) {
+        printf("%02x", b[k]);
+    }
+    printf("\n");
+}
+
+// Vectors from hashimoto.py (fnv256 and the index loop of hashimoto()).
+void self_verify() {
+    int ok = 1;
+    unsigned char h0_bytes[32] = {0x2c, 0xfe, 0x7d, 0x0a, 0x1f, 0x6e, 0x8f, 0x3c, 0x90, 0xa7, 0xe1,
+                                  0xb2, 0x4c, 0x5d, 0x6f, 0x70, 0x81, 0x92, 0xa3, 0xb4, 0xc5, 0xd6,
+                                  0xe7, 0xf8, 0x09, 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70};
+    u256 h0 = u256_from_be(h0_bytes);
+
+    u256 ones = {{UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX}};
+    u256 expect = {{0xffffffffffffeca9ULL, UINT64_MAX, 0xfffffeffffffffffULL, UINT64_MAX}};
+    u256 actual = fnv256(ones, u256_from_u64(0x1234));
+    if (u256_cmp(expect, actual) != 0) {
+        printf("fnv256 all-ones failed!\n");
+        print_u256("expect: ", expect);
+        print_u256("actual: ", actual);
+        ok = 0;
+    }
+    u256 expect_h0 = {{0x9653dfa304aae720ULL, 0x2fcba01a9cd54b0cULL, 0x679a8b8da9cce673ULL, 0x17312018af155275ULL}};
+    actual = fnv256(h0, h0);
+    if (u256_cmp(expect_h0, actual) != 0) {
+        printf("fnv256(h0, h0) failed!\n");
+        print_u256("expect: ", expect_h0);
+        print_u256("actual: ", actual);
+        ok = 0;
+    }
+
+    // Specialized vs generic multiply.
+    uint64_t s = 88172645463325252ULL;
+    for (int t = 0; t < 100000; t++) {
+        u256 a = random_u256(&s), b = random_u256(&s);
+        if (u256_cmp(fnv256(a, b), fnv256_generic(a, b)) != 0) {
+            printf("fnv256 vs generic failed at %d!\n", t);
+            ok = 0;
+            break;
+        }
+    }
+
+    // hashimoto.py: shardEntryBits 10, shardLenBits 1, startShardId 3, maxKvSizeBits 12.
+    const uint64_t expect_kv[16] = {4896, 4764, 3766, 3969, 3641, 3527, 4955, 4960,
+                                    4583, 4643, 3835, 3820, 3916, 3476, 4180, 4792};
+    const uint64_t expect_off[16] = {3644, 2314, 514,  3723, 3973, 809,  785,  3367,
+                                     766,  3208, 2341, 2744, 2212, 2538, 714,  843};
+    struct storage_index_params p;
+    storage_index_init(&p, 10, 1, 3, 12);
+    uint64_t size = 4096;
+    unsigned char *mix = malloc(size);
+    for (uint64_t k = 0; k < size; k += 32) {
+        memcpy(mix + k, h0_bytes, 32);
+    }
+    uint64_t mix_off = 0;
+    for (uint64_t i = 0; i < 16; i++) {
+        u256 mix_data = u256_from_be(mix + mix_off);
+        uint64_t parent, kv_idx;
+        mix_off = storage_index(&p, h0, i, &mix_data, &parent, &kv_idx);
+        if (kv_idx != expect_kv[i] || mix_off != expect_off[i]) {
+            printf("storage_index failed at access %llu!\n", (unsigned long long)i);
+            printf("expect: kv_idx %llu mix_off %llu\n", (unsigned long long)expect_kv[i],
+                   (unsigned long long)expect_off[i]);
+            printf("actual: kv_idx %llu mix_off %llu\n", (unsigned long long)kv_idx, (unsigned long long)mix_off);
+            ok = 0;
+            break;
+        }
+        for (uint64_t k = 0; k < size; k++) {
+            mix[k] ^= (unsigned char)(k * 31 + i * 7 + (k >> 8));
+        }
+    }
+    free(mix);
+
+    // Batch vs scalar, including a large modulus and wide rows.
+    const unsigned configs[][4] = {{10, 1, 3, 12}, {20, 4, 7, 17}, {32, 31, 1, 33}, {5, 0, 0, 6}};
+    uint64_t n = 1000;
+    uint32_t *h0_b = malloc(8 * n * sizeof(uint32_t));
+    uint32_t *mix_b = malloc(8 * n * sizeof(uint32_t));
+    uint64_t *parent_b = malloc(n * sizeof(uint64_t));
+    uint64_t *kv_b = malloc(n * sizeof(uint64_t));
+    uint64_t *off_b = malloc(n * sizeof(uint64_t));
+    for (int c = 0; c < 4 && ok; c++) {
+        storage_index_init(&p, configs[c][0], configs[c][1], configs[c][2], configs[c][3]);
+        u256 *h0s = malloc(n * sizeof(u256));
+        u256 *mixes = malloc(n * sizeof(u256));
+        unsigned char be[32];
+        for (uint64_t j = 0; j < n; j++) {
+            h0s[j] = random_u256(&s);
+            mixes[j] = random_u256(&s);
+            u256_to_be(h0s[j], be);
+            storage_batch_load(h0_b, n, j, be);
+            u256_to_be(mixes[j], be);
+            storage_batch_load(mix_b, n, j, be);
+        }
+        uint32_t i = 13;
+        storage_index_batch(&p, n, h0_b, i, mix_b, parent_b, kv_b, off_b);
+        for (uint64_t j = 0; j < n; j++) {
+            uint64_t parent, kv_idx;
+            uint64_t off = storage_index(&p, h0s[j], i, &mixes[j], &parent, &kv_idx);
+            storage_batch_store(mix_b, n, j, be);
+            if (u256_cmp(u256_from_be(be), mixes[j]) != 0 || parent != parent_b[j] || kv_idx != kv_b[j] ||
+                off != off_b[j]) {
+                printf("storage_index_batch failed (config %d, candidate %llu)!\n", c, (unsigned long long)j);
+                ok = 0;
+                break;
+            }
+        }
+        free(h0s);
+        free(mixes);
+    }
+    free(h0_b);
+    free(mix_b);
+    free(parent_b);
+    free(kv_b);
+    free(off_b);
+
+    if (ok) {
+        printf("self_verify() passed\n");
+    }
+    return;
+}
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+    return ((end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+void benchmark_storage_index() {
+    struct timespec start, end;
+    struct storage_index_params p;
+    storage_index_init(&p, 10, 1, 3, 12);
+    uint64_t s = 88172645463325252ULL;
+    uint64_t n = 4096;
+    uint64_t rounds = 2000;
+    uint64_t sink = 0;
+
+    u256 *h0s = malloc(n * sizeof(u256));
+    u256 *mixes = malloc(n * sizeof(u256));
+    for (uint64_t j = 0; j < n; j++) {
+        h0s[j] = random_u256(&s);
+        mixes[j] = random_u256(&s);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (uint64_t j = 0; j < n; j++) {
+            u256 a = h0s[j];
+            a.w[0] ^= r;
+            mixes[j] = fnv256_generic(a, mixes[j]);
+            sink += mixes[j].w[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("fnv256 generic: %0.2f M/s\n", n * rounds / elapsed(&start, &end) / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (uint64_t j = 0; j < n; j++) {
+            u256 a = h0s[j];
+            a.w[0] ^= r;
+            mixes[j] = fnv256(a, mixes[j]);
+            sink += mixes[j].w[0];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("fnv256 specialized: %0.2f M/s\n", n * rounds / elapsed(&start, &end) / 1e6);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t r = 0; r < rounds; r++) {
+        for (uint64_t j = 0; j < n; j++) {
+            uint64_t parent, kv_idx;
+            sink += storage_index(&p, h0s[j], r, &mixes[j], &parent, &kv_idx) + kv_idx;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("storage_index: %0.2f M/s\n", n * rounds / elapsed(&start, &end) / 1e6);
+
+    uint32_t *h0_b = malloc(8 * n * sizeof(uint32_t));
+    uint32_t *mix_b = malloc(8 * n * sizeof(uint32_t));
+    uint64_t *parent_b = malloc(n * sizeof(uint64_t));
+    uint64_t *kv_b = malloc(n * sizeof(uint64_t));
+    uint64_t *off_b = malloc(n * sizeof(uint64_t));
+    unsigned char be[32];
+    for (uint64_t j = 0; j < n; j++) {
+        u256_to_be(h0s[j], be);
+        storage_batch_load(h0_b, n, j, be);
+        u256_to_be(mixes[j], be);
+        storage_batch_load(mix_b, n, j, be);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t r = 0; r < rounds; r++) {
+        storage_index_batch(&p, n, h0_b, r, mix_b, parent_b, kv_b, off_b);
+        sink += kv_b[r % n] + off_b[r % n];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("storage_index_batch: %0.2f M/s\n", n * rounds / elapsed(&start, &end) / 1e6);
+    printf("(checksum %llu)\n", (unsigned long long)sink);
+
+    free(h0s);
+    free(mixes);
+    free(h0_b);
+    free(mix_b);
+    free(parent_b);
+    free(kv_b);
+    free(off_b);
+    return;
+}
+
+int main(int argc, char *argv[]) {
+    self_verify();
+    // benchmark_storage_index();
+    return (0);
+}
+
+#endif
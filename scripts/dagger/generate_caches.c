@@ -0,0 +1,196 @@
+/*
+ * Batched cache generation shared by dagger.c (64-bit words) and dagger_32.c
+ * (32-bit words).  The cache itself does not depend on the word size, so the
+ * code is the same for both; it only needs HASH_BYTES, CACHE_ROUND, CACHE_ITEM
+ * and generate_cache() from the including file.
+ *
+ * Must be included after sha512.c and sha512_mb.c.  Define
+ * CACHE_GROUP_BEGIN()/CACHE_GROUP_END(t0) before including to time each lane
+ * group (dagger_32.c records them on the timeline).
+ */
+
+#ifndef CACHE_GROUP_BEGIN
+#define CACHE_GROUP_BEGIN() 0
+#define CACHE_GROUP_END(t0) ((void)(t0))
+#endif
+
+struct generate_caches_args {
+    uint64_t cache_size;
+    unsigned char **seeds;
+    uint64_t *seed_sizes;
+    uint64_t n;
+    unsigned char **caches;
+    uint64_t next_group;
+};
+
+// Advance up to SHA512_MB_LANES caches in lockstep, one cache per SHA-512 lane.
+void generate_cache_group(uint64_t cache_size, unsigned char **caches, uint64_t lanes) {
+    unsigned char scratch[SHA512_MB_LANES][HASH_BYTES] __attribute__((aligned(64)));
+    unsigned char hash[SHA512_MB_LANES][HASH_BYTES] __attribute__((aligned(64)));
+    unsigned char *in[SHA512_MB_LANES];
+    unsigned char *out[SHA512_MB_LANES];
+    uint64_t rows = cache_size / HASH_BYTES;
+
+    // unused lanes hash a scratch row in place
+    for (uint64_t l = lanes; l < SHA512_MB_LANES; l++) {
+        memset(scratch[l], 0, HASH_BYTES);
+        in[l] = scratch[l];
+        out[l] = scratch[l];
+    }
+
+    for (uint64_t i = 1; i < rows; i++) {
+        for (uint64_t l = 0; l < lanes; l++) {
+            in[l] = CACHE_ITEM(caches[l], i - 1);
+            out[l] = CACHE_ITEM(caches[l], i);
+        }
+        SHA512_64_MB(in, out);
+    }
+    for (uint64_t r = 0; r < CACHE_ROUND; r++) {
+        for (uint64_t i = 0; i < rows; i++) {
+            for (uint64_t l = 0; l < lanes; l++) {
+                // TODO: big order casting
+                uint32_t v = *((uint32_t *)(CACHE_ITEM(caches[l], i))) % rows;
+                unsigned char *p0 = CACHE_ITEM(caches[l], v);
+                unsigned char *p1 = CACHE_ITEM(caches[l], (i - 1 + rows) % rows);
+                for (int k = 0; k < HASH_BYTES; k++) {
+                    hash[l][k] = p0[k] ^ p1[k];
+                }
+                in[l] = hash[l];
+                out[l] = CACHE_ITEM(caches[l], i);
+            }
+            SHA512_64_MB(in, out);
+        }
+    }
+}
+
+void *generate_caches_worker(void *arg) {
+    struct generate_caches_args *args = arg;
+    uint64_t groups = (args->n + SHA512_MB_LANES - 1) / SHA512_MB_LANES;
+    for (;;) {
+        uint64_t g = __atomic_fetch_add(&args->next_group, 1, __ATOMIC_RELAXED);
+        if (g >= groups) {
+            break;
+        }
+        uint64_t first = g * SHA512_MB_LANES;
+        uint64_t lanes = args->n - first < SHA512_MB_LANES ? args->n - first : SHA512_MB_LANES;
+        for (uint64_t l = 0; l < lanes; l++) {
+            SHA512(args->seeds[first + l], args->seed_sizes[first + l], args->caches[first + l]);
+        }
+        uint64_t t0 = CACHE_GROUP_BEGIN();
+        generate_cache_group(args->cache_size, &args->caches[first], lanes);
+        CACHE_GROUP_END(t0);
+    }
+    return (NULL);
+}
+
+/*
+ * Generate n independent caches (one per seed) at once.  Each cache is still a
+ * sequential chain, so the parallelism comes from running SHA512_MB_LANES
+ * caches in lockstep per thread and spreading lane groups over threads.
+ * The result is identical to calling generate_cache() for every seed.
+ */
+unsigned char **generate_caches(uint64_t cache_size, unsigned char **seeds, uint64_t *seed_sizes, uint64_t n, int threads) {
+    unsigned char **caches = calloc(n, sizeof(unsigned char *));
+    if (caches == NULL) {
+        return (NULL);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        caches[i] = malloc(cache_size);
+        if (caches[i] == NULL) {
+            for (uint64_t j = 0; j < i; j++) {
+                free(caches[j]);
+            }
+            free(caches);
+            return (NULL);
+        }
+    }
+
+    struct generate_caches_args args = {cache_size, seeds, seed_sizes, n, caches, 0};
+    uint64_t groups = (n + SHA512_MB_LANES - 1) / SHA512_MB_LANES;
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > groups) {
+        threads = groups;
+    }
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (int t = 1; tids != NULL && t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, generate_caches_worker, &args) == 0) {
+            started++;
+        }
+    }
+    generate_caches_worker(&args);
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    return (caches);
+}
+
+void self_caches_verify() {
+    unsigned char seed0[] = "123";
+    unsigned char seed1[] = "456";
+    unsigned char seed2[] = "a longer seed that spans more than one sha512 block of input...........................................................";
+    unsigned char *seeds[] = {seed0, seed1, seed2, seed0, seed1};
+    uint64_t seed_sizes[] = {sizeof(seed0) - 1, sizeof(seed1) - 1, sizeof(seed2) - 1, sizeof(seed0) - 1, sizeof(seed1) - 1};
+    uint64_t n = sizeof(seeds) / sizeof(seeds[0]);
+
+    unsigned char **caches = generate_caches(1024, seeds, seed_sizes, n, 2);
+    if (caches == NULL) {
+        printf("self_caches_verify() failed: out of memory!\n");
+        return;
+    }
+    int ok = 1;
+    for (uint64_t i = 0; i < n; i++) {
+        unsigned char *cache = generate_cache(1024, seeds[i], seed_sizes[i]);
+        if (ok && (cache == NULL || memcmp(cache, caches[i], 1024) != 0)) {
+            printf("self_caches_verify() failed at seed %llu!\n", i);
+            ok = 0;
+        }
+        free(cache);
+        free(caches[i]);
+    }
+    free(caches);
+
+    if (ok) {
+        printf("self_caches_verify() passed\n");
+    }
+    return;
+}
+
+void benchmark_generate_caches() {
+    struct timespec start, end;
+
+    uint64_t cache_size = 16777216; // 16 MB
+    uint64_t n = 8;
+    uint64_t seed_values[8];
+    unsigned char *seeds[8];
+    uint64_t seed_sizes[8];
+    for (uint64_t i = 0; i < n; i++) {
+        seed_values[i] = i;
+        seeds[i] = (unsigned char *)&seed_values[i];
+        seed_sizes[i] = 8;
+    }
+
+    printf("Generating %llu caches with size %llu one by one\n", n, cache_size);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t i = 0; i < n; i++) {
+        free(generate_cache(cache_size, seeds[i], seed_sizes[i]));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("Generating %llu caches with size %llu in batch (%d lanes, %d threads)\n", n, cache_size, SHA512_MB_LANES, threads);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned char **caches = generate_caches(cache_size, seeds, seed_sizes, n, threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    for (uint64_t i = 0; i < n; i++) {
+        free(caches[i]);
+    }
+    free(caches);
+    return;
+}
@@ -0,0 +1,59 @@
+// The dagger_32.c kernels, compiled once into the cgo package.  The light
+// evaluation has no hand-written copy there and runs the template kernel.
+
+#define DAGGER_NO_MAIN
+#include "../../dagger_32.c"
+#include "../../dagger_kernels.h"
+#include "../../keccak.c"
+
+#include "dagger.h"
+
+void dagger_generate_cache(unsigned char *cache, uint64_t cache_size, unsigned char *seed, uint64_t seed_size) {
+    generate_cache_into(cache, cache_size, seed, seed_size);
+}
+
+void dagger_dataset_items(unsigned char *cache, uint64_t cache_size, uint64_t first, uint64_t count,
+                          unsigned char *items) {
+    for (uint64_t k = 0; k < count; k++) {
+        calculate_dataset_item_opt(cache, cache_size, first + k, items + k * HASH_BYTES);
+    }
+}
+
+void dagger_mask_items(unsigned char *cache, uint64_t cache_size, uint64_t first, uint64_t count,
+                       unsigned char *data) {
+    calculate_mask_blob(cache, cache_size, first, data, count * HASH_BYTES);
+}
+
+// ethash.go hashimotoEx() also returns keccak256(seed || digest).
+static void hashimoto_result(unsigned char *seed, uint32_t *mix, unsigned char *digest, unsigned char *result) {
+    unsigned char buf[HASH_BYTES + 32];
+    memcpy(digest, mix, 32);
+    memcpy(buf, seed, HASH_BYTES);
+    memcpy(buf + HASH_BYTES, digest, 32);
+    keccak256(buf, sizeof(buf), result);
+}
+
+void dagger_hashimoto_full(unsigned char *seeds, uint64_t n, unsigned char *dataset, uint64_t size,
+                           unsigned char *digests, unsigned char *results) {
+    uint32_t mix[MIX_BYTES / 4] __attribute__((aligned(32)));
+    // hashimoto_avx uses aligned loads; Go only guarantees 8-byte alignment
+    int avx = ((uintptr_t)dataset & 31) == 0;
+    for (uint64_t k = 0; k < n; k++) {
+        if (avx) {
+            hashimoto_avx(seeds + k * HASH_BYTES, size, dataset, mix);
+        } else {
+            hashimoto(seeds + k * HASH_BYTES, size, dataset, mix);
+        }
+        hashimoto_result(seeds + k * HASH_BYTES, mix, digests + k * 32, results + k * 32);
+    }
+}
+
+// hashimoto() with every dataset row computed from the cache, as ethash.go hashimotoLight().
+void dagger_hashimoto_light(unsigned char *seeds, uint64_t n, unsigned char *cache, uint64_t cache_size,
+                            uint64_t size, unsigned char *digests, unsigned char *results) {
+    uint32_t mix[MIX_BYTES / 4];
+    for (uint64_t k = 0; k < n; k++) {
+        dagger32_kernel_hashimoto_light(seeds + k * HASH_BYTES, size, cache, cache_size, (unsigned char *)mix);
+        hashimoto_result(seeds + k * HASH_BYTES, mix, digests + k * 32, results + k * 32);
+    }
+}
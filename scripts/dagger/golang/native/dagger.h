@@ -0,0 +1,14 @@
+// Entry points of dagger.c for native.go.  Every call runs a whole batch so
+// that the cgo transition is paid once per batch, not once per item.
+
+#include <stdint.h>
+
+void dagger_generate_cache(unsigned char *cache, uint64_t cache_size, unsigned char *seed, uint64_t seed_size);
+void dagger_dataset_items(unsigned char *cache, uint64_t cache_size, uint64_t first, uint64_t count,
+                          unsigned char *items);
+void dagger_mask_items(unsigned char *cache, uint64_t cache_size, uint64_t first, uint64_t count,
+                       unsigned char *data);
+void dagger_hashimoto_full(unsigned char *seeds, uint64_t n, unsigned char *dataset, uint64_t size,
+                           unsigned char *digests, unsigned char *results);
+void dagger_hashimoto_light(unsigned char *seeds, uint64_t n, unsigned char *cache, uint64_t cache_size,
+                            uint64_t size, unsigned char *digests, unsigned char *results);
@@ -0,0 +1,4 @@
+// The templated kernels behind dagger_kernels.h, compiled once into the cgo package.
+
+#define DAGGER_NO_MAIN
+#include "../../dagger_kernels.cpp"
@@ -0,0 +1,166 @@
+// Package native runs the dagger_32.c cache, dataset, mask and hashimoto
+// kernels through cgo.
+//
+// The functions mirror generateCache, generateDatasetItem, generateMaskItem
+// and hashimotoEx of ../ethash.go with SHA-512 as the hasher, which stays the
+// reference the results are checked against.  Go slices are handed to C
+// directly: cgo keeps them pinned for the duration of each call and the C side
+// never retains them, so nothing is copied.  Results go into caller supplied
+// slices, and the batch forms (GenerateDataset, MaskBlob, HashimotoBatch) pay
+// the cgo transition once per batch instead of once per item.
+package native
+
+/*
+#cgo CFLAGS: -O3 -march=native
+#cgo CXXFLAGS: -std=c++17 -O3 -march=native
+#cgo LDFLAGS: -lpthread -lm
+#include "dagger.h"
+*/
+import "C"
+
+import (
+	"runtime"
+	"sync"
+	"unsafe"
+)
+
+const (
+	HashBytes = 64  // Hash length in bytes
+	HashWords = 16  // Number of 32 bit ints in a hash
+	MixBytes  = 128 // Width of mix
+)
+
+func bytesPtr(b []byte) *C.uchar {
+	return (*C.uchar)(unsafe.Pointer(&b[0]))
+}
+
+func wordsPtr(w []uint32) *C.uchar {
+	return (*C.uchar)(unsafe.Pointer(&w[0]))
+}
+
+func checkCache(cache []uint32) {
+	if len(cache) == 0 || len(cache)%HashWords != 0 {
+		panic("native: cache must be a non-empty whole number of 64-byte rows")
+	}
+}
+
+// GenerateCache fills dest, a whole number of 64-byte rows, with the cache for seed.
+func GenerateCache(dest []uint32, seed []byte) {
+	checkCache(dest)
+	var seedPtr *C.uchar
+	if len(seed) > 0 {
+		seedPtr = bytesPtr(seed)
+	}
+	C.dagger_generate_cache(wordsPtr(dest), C.uint64_t(4*len(dest)), seedPtr, C.uint64_t(len(seed)))
+}
+
+// GenerateDatasetItem writes dataset item index into dest[:HashBytes].
+func GenerateDatasetItem(dest []byte, cache []uint32, index uint32) {
+	checkCache(cache)
+	_ = dest[HashBytes-1]
+	C.dagger_dataset_items(wordsPtr(cache), C.uint64_t(4*len(cache)), C.uint64_t(index), 1, bytesPtr(dest))
+}
+
+// GenerateDataset fills dest with dataset items first, first + 1, ... using
+// threads goroutines (runtime.NumCPU() if threads < 1).
+func GenerateDataset(dest []uint32, cache []uint32, first uint64, threads int) {
+	checkCache(cache)
+	if len(dest)%HashWords != 0 {
+		panic("native: dataset must be a whole number of 64-byte items")
+	}
+	items := uint64(len(dest) / HashWords)
+	if items == 0 {
+		return
+	}
+	if threads < 1 {
+		threads = runtime.NumCPU()
+	}
+	batch := (items + uint64(threads) - 1) / uint64(threads)
+
+	var pend sync.WaitGroup
+	for begin := uint64(0); begin < items; begin += batch {
+		count := batch
+		if begin+count > items {
+			count = items - begin
+		}
+		pend.Add(1)
+		go func(begin, count uint64) {
+			defer pend.Done()
+			out := dest[begin*HashWords : (begin+count)*HashWords]
+			C.dagger_dataset_items(wordsPtr(cache), C.uint64_t(4*len(cache)), C.uint64_t(first+begin),
+				C.uint64_t(count), wordsPtr(out))
+		}(begin, count)
+	}
+	pend.Wait()
+}
+
+// GenerateMaskItem writes initHash masked as item kvIdx into dest[:HashBytes];
+// dest may be initHash itself.
+func GenerateMaskItem(dest []byte, cache []uint32, kvIdx uint32, initHash []byte) {
+	checkCache(cache)
+	_ = dest[HashBytes-1]
+	copy(dest[:HashBytes], initHash[:HashBytes])
+	C.dagger_mask_items(wordsPtr(cache), C.uint64_t(4*len(cache)), C.uint64_t(kvIdx), 1, bytesPtr(dest))
+}
+
+// MaskBlob masks blob in place, the 64-byte piece at byte p as item
+// firstItem + p/64.  len(blob) must be a multiple of HashBytes.
+func MaskBlob(blob []byte, cache []uint32, firstItem uint64) {
+	checkCache(cache)
+	if len(blob)%HashBytes != 0 {
+		panic("native: blob must be a whole number of 64-byte items")
+	}
+	if len(blob) == 0 {
+		return
+	}
+	C.dagger_mask_items(wordsPtr(cache), C.uint64_t(4*len(cache)), C.uint64_t(firstItem),
+		C.uint64_t(len(blob)/HashBytes), bytesPtr(blob))
+}
+
+func checkHashimoto(digests, results, seeds []byte, size uint64) int {
+	n := len(seeds) / HashBytes
+	if len(seeds)%HashBytes != 0 || len(digests) < 32*n || len(results) < 32*n {
+		panic("native: need 64-byte seeds and 32 bytes of digests and results per seed")
+	}
+	if size < MixBytes {
+		panic("native: dataset smaller than one mix")
+	}
+	return n
+}
+
+// HashimotoBatch runs hashimotoEx over dataset for every 64-byte seed in
+// seeds, writing 32-byte digests and results (keccak256(seed || digest)).
+func HashimotoBatch(digests, results []byte, dataset []uint32, seeds []byte) {
+	n := checkHashimoto(digests, results, seeds, 4*uint64(len(dataset)))
+	if n == 0 {
+		return
+	}
+	C.dagger_hashimoto_full(bytesPtr(seeds), C.uint64_t(n), wordsPtr(dataset), C.uint64_t(4*len(dataset)),
+		bytesPtr(digests), bytesPtr(results))
+}
+
+// HashimotoFull is hashimotoEx over a full in-memory dataset.
+func HashimotoFull(dataset []uint32, seed []byte) ([]byte, []byte) {
+	out := make([]byte, 64)
+	HashimotoBatch(out[:32], out[32:], dataset, seed[:HashBytes])
+	return out[:32], out[32:]
+}
+
+// HashimotoLightBatch is HashimotoBatch over a dataset of size bytes that is
+// never materialized: every row is computed from the cache.
+func HashimotoLightBatch(digests, results []byte, size uint64, cache []uint32, seeds []byte) {
+	checkCache(cache)
+	n := checkHashimoto(digests, results, seeds, size)
+	if n == 0 {
+		return
+	}
+	C.dagger_hashimoto_light(bytesPtr(seeds), C.uint64_t(n), wordsPtr(cache), C.uint64_t(4*len(cache)),
+		C.uint64_t(size), bytesPtr(digests), bytesPtr(results))
+}
+
+// HashimotoLight is hashimotoEx with rows computed from the cache.
+func HashimotoLight(size uint64, cache []uint32, seed []byte) ([]byte, []byte) {
+	out := make([]byte, 64)
+	HashimotoLightBatch(out[:32], out[32:], size, cache, seed[:HashBytes])
+	return out[:32], out[32:]
+}
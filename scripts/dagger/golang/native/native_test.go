@@ -0,0 +1,128 @@
+package native
+
+import (
+	"bytes"
+	"crypto/sha512"
+	"encoding/hex"
+	"testing"
+)
+
+// The dagger_32.c self checks: a 1 KB cache for seed "123".
+const (
+	item123   = "c098aa298730026b820035f4587d37737e3f5733010a61e5f833ee4e7535955f6f3cbc75a65881d3957ec972b4fae8226804a78a09bb450d5d0b5303fb836fc1"
+	mask123   = "46df553f850fc96736a154a247c7e511a70d5f8c3f8bdd1fc098c64dad77bd7341be534f0538e525cf79cede6c9ecf45b1c1418aba2cfbc5021b78517d87372a"
+	digest123 = "a35905961116a162bd58f9bf83ea40198b7cb2469ddb6844df1cbc9109f194aa"
+)
+
+func testCache() []uint32 {
+	cache := make([]uint32, 1024/4)
+	GenerateCache(cache, []byte("123"))
+	return cache
+}
+
+func TestVectors(t *testing.T) {
+	cache := testCache()
+	item := make([]byte, HashBytes)
+	GenerateDatasetItem(item, cache, 123)
+	if hex.EncodeToString(item) != item123 {
+		t.Fatalf("item %x", item)
+	}
+	GenerateMaskItem(item, cache, 123, item)
+	if hex.EncodeToString(item) != mask123 {
+		t.Fatalf("mask %x", item)
+	}
+	seed := sha512.Sum512([]byte("123"))
+	// the cache itself as the dataset, as in selfCheck()
+	digest, _ := HashimotoFull(cache, seed[:])
+	if hex.EncodeToString(digest) != digest123 {
+		t.Fatalf("digest %x", digest)
+	}
+}
+
+func TestBatchesAgree(t *testing.T) {
+	cache := testCache()
+	dataset := make([]uint32, 64*HashWords)
+	GenerateDataset(dataset, cache, 0, 3)
+	item := make([]byte, HashBytes)
+	for i := 0; i < 64; i++ {
+		GenerateDatasetItem(item, cache, uint32(i))
+		for k := 0; k < HashWords; k++ {
+			w := uint32(item[4*k]) | uint32(item[4*k+1])<<8 | uint32(item[4*k+2])<<16 | uint32(item[4*k+3])<<24
+			if dataset[i*HashWords+k] != w {
+				t.Fatalf("dataset item %d differs", i)
+			}
+		}
+	}
+
+	blob := make([]byte, 5*HashBytes)
+	for i := range blob {
+		blob[i] = byte(i)
+	}
+	masked := append([]byte{}, blob...)
+	MaskBlob(masked, cache, 7)
+	for i := 0; i < 5; i++ {
+		GenerateMaskItem(item, cache, uint32(7+i), blob[i*HashBytes:])
+		if !bytes.Equal(item, masked[i*HashBytes:(i+1)*HashBytes]) {
+			t.Fatalf("mask item %d differs", i)
+		}
+	}
+
+	seeds := make([]byte, 4*HashBytes)
+	for i := range seeds {
+		seeds[i] = byte(3 * i)
+	}
+	digests, results := make([]byte, 4*32), make([]byte, 4*32)
+	HashimotoBatch(digests, results, dataset, seeds)
+	for i := 0; i < 4; i++ {
+		d, r := HashimotoFull(dataset, seeds[i*HashBytes:])
+		ld, lr := HashimotoLight(4*uint64(len(dataset)), cache, seeds[i*HashBytes:])
+		if !bytes.Equal(d, digests[i*32:(i+1)*32]) || !bytes.Equal(r, results[i*32:(i+1)*32]) {
+			t.Fatalf("batch hashimoto %d differs", i)
+		}
+		if !bytes.Equal(d, ld) || !bytes.Equal(r, lr) {
+			t.Fatalf("light hashimoto %d differs", i)
+		}
+	}
+}
+
+func benchCache(b *testing.B) []uint32 {
+	cache := make([]uint32, (16<<20)/4)
+	GenerateCache(cache, []byte("123"))
+	b.ResetTimer()
+	return cache
+}
+
+func BenchmarkDatasetItem(b *testing.B) {
+	cache := benchCache(b)
+	item := make([]byte, HashBytes)
+	for i := 0; i < b.N; i++ {
+		GenerateDatasetItem(item, cache, uint32(i))
+	}
+}
+
+func BenchmarkMaskBlob(b *testing.B) {
+	cache := benchCache(b)
+	blob := make([]byte, 4096)
+	b.SetBytes(int64(len(blob)))
+	for i := 0; i < b.N; i++ {
+		MaskBlob(blob, cache, uint64(i)*4096/HashBytes)
+	}
+}
+
+func BenchmarkHashimotoBatch(b *testing.B) {
+	cache := make([]uint32, 1024/4)
+	GenerateCache(cache, []byte("123"))
+	dataset := make([]uint32, (16<<20)/4)
+	GenerateDataset(dataset, cache, 0, 0)
+	const n = 256
+	seeds := make([]byte, n*HashBytes)
+	for i := range seeds {
+		seeds[i] = byte(i * 7)
+	}
+	digests, results := make([]byte, n*32), make([]byte, n*32)
+	b.ResetTimer()
+	for i := 0; i < b.N; i += n {
+		seeds[0] = byte(i)
+		HashimotoBatch(digests, results, dataset, seeds)
+	}
+}
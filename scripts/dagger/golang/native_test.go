@@ -0,0 +1,156 @@
+package main
+
+import (
+	"bytes"
+	"crypto/sha512"
+	"encoding/binary"
+	"testing"
+
+	"github.com/web3q/web3q-contracts/native"
+)
+
+// ethash.go with a SHA-512 hasher is the reference for the cgo kernels.
+
+const (
+	nativeTestCacheBytes  = 1024
+	nativeBenchCacheBytes = 1 << 20
+)
+
+func makeTestCaches(size int) ([]uint32, []uint32) {
+	goCache := make([]uint32, size/4)
+	generateCache(goCache, 0, []byte("123"), makeHasher(sha512.New()))
+	cCache := make([]uint32, size/4)
+	native.GenerateCache(cCache, []byte("123"))
+	return goCache, cCache
+}
+
+func TestNativeMatchesEthash(t *testing.T) {
+	goCache, cCache := makeTestCaches(nativeTestCacheBytes)
+	for i := range goCache {
+		if goCache[i] != cCache[i] {
+			t.Fatalf("cache word %d: %x != %x", i, cCache[i], goCache[i])
+		}
+	}
+
+	hasher := makeHasher(sha512.New())
+	item := make([]byte, native.HashBytes)
+	mask := make([]byte, native.HashBytes)
+	for _, index := range []uint32{0, 1, 123, 1 << 20, 0xffffffff} {
+		native.GenerateDatasetItem(item, cCache, index)
+		want := generateDatasetItem(goCache, index, hasher)
+		if !bytes.Equal(item, want) {
+			t.Fatalf("item %d: %x != %x", index, item, want)
+		}
+		native.GenerateMaskItem(mask, cCache, index, item)
+		want = generateMaskItem(goCache, index, hasher, item)
+		if !bytes.Equal(mask, want) {
+			t.Fatalf("mask %d: %x != %x", index, mask, want)
+		}
+	}
+
+	// a 64 KB dataset, looked up through hashimotoEx's callback
+	dataset := make([]uint32, (64<<10)/4)
+	native.GenerateDataset(dataset, cCache, 0, 2)
+	lookup := func(index uint32) []uint32 {
+		return dataset[index*hashWords : (index+1)*hashWords]
+	}
+	seed := make([]byte, native.HashBytes)
+	for n := uint64(0); n < 16; n++ {
+		binary.LittleEndian.PutUint64(seed, n)
+		hasher(seed, seed)
+		digest, result := native.HashimotoFull(dataset, seed)
+		wantDigest, wantResult := hashimotoEx(seed, uint64(len(dataset))*4, lookup)
+		if !bytes.Equal(digest, wantDigest) || !bytes.Equal(result, wantResult) {
+			t.Fatalf("hashimoto %d: %x %x != %x %x", n, digest, result, wantDigest, wantResult)
+		}
+		digest, result = native.HashimotoLight(uint64(len(dataset))*4, cCache, seed)
+		if !bytes.Equal(digest, wantDigest) || !bytes.Equal(result, wantResult) {
+			t.Fatalf("hashimoto light %d differs", n)
+		}
+	}
+}
+
+func BenchmarkGoDatasetItem(b *testing.B) {
+	cache, _ := makeTestCaches(nativeBenchCacheBytes)
+	hasher := makeHasher(sha512.New())
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		generateDatasetItem(cache, uint32(i), hasher)
+	}
+}
+
+func BenchmarkNativeDatasetItem(b *testing.B) {
+	_, cache := makeTestCaches(nativeBenchCacheBytes)
+	item := make([]byte, native.HashBytes)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		native.GenerateDatasetItem(item, cache, uint32(i))
+	}
+}
+
+func BenchmarkGoMaskBlob(b *testing.B) {
+	cache, _ := makeTestCaches(nativeBenchCacheBytes)
+	hasher := makeHasher(sha512.New())
+	blob := make([]byte, 4096)
+	b.SetBytes(int64(len(blob)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		for k := 0; k < len(blob); k += native.HashBytes {
+			copy(blob[k:], generateMaskItem(cache, uint32(i*64+k/native.HashBytes), hasher, blob[k:]))
+		}
+	}
+}
+
+func BenchmarkNativeMaskBlob(b *testing.B) {
+	_, cache := makeTestCaches(nativeBenchCacheBytes)
+	blob := make([]byte, 4096)
+	b.SetBytes(int64(len(blob)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		native.MaskBlob(blob, cache, uint64(i)*64)
+	}
+}
+
+func benchDataset(b *testing.B) []uint32 {
+	_, cache := makeTestCaches(nativeTestCacheBytes)
+	dataset := make([]uint32, (16<<20)/4)
+	native.GenerateDataset(dataset, cache, 0, 0)
+	return dataset
+}
+
+func BenchmarkGoHashimotoFull(b *testing.B) {
+	dataset := benchDataset(b)
+	lookup := func(index uint32) []uint32 {
+		return dataset[index*hashWords : (index+1)*hashWords]
+	}
+	seed := make([]byte, native.HashBytes)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		binary.LittleEndian.PutUint64(seed, uint64(i))
+		hashimotoEx(seed, uint64(len(dataset))*4, lookup)
+	}
+}
+
+func BenchmarkNativeHashimotoFull(b *testing.B) {
+	dataset := benchDataset(b)
+	seed := make([]byte, native.HashBytes)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		binary.LittleEndian.PutUint64(seed, uint64(i))
+		native.HashimotoFull(dataset, seed)
+	}
+}
+
+func BenchmarkNativeHashimotoBatch(b *testing.B) {
+	dataset := benchDataset(b)
+	const n = 256
+	seeds := make([]byte, n*native.HashBytes)
+	digests, results := make([]byte, n*32), make([]byte, n*32)
+	b.ResetTimer()
+	for i := 0; i < b.N; i += n {
+		for k := 0; k < n; k++ {
+			binary.LittleEndian.PutUint64(seeds[k*native.HashBytes:], uint64(i+k))
+		}
+		native.HashimotoBatch(digests, results, dataset, seeds)
+	}
+}
@@ -0,0 +1,434 @@
+/*
+ * Mine while the dataset is still being built.
+ *
+ *   g++ -std=c++17 -O3 -march=native -DDAGGER_NO_MAIN -c dagger_kernels.cpp -o dagger_kernels.o
+ *   gcc -O3 -mavx2 -pthread hybrid_miner.c dagger_kernels.o -o hybrid_miner
+ *   ./hybrid_miner verify
+ *   ./hybrid_miner mine --size 1073741824 --cache-size 16777216 --gen-threads 8 --mine-threads 8 --seconds 600
+ *
+ * The dataset (item i = calculate_dataset_item_opt(i), as dataset_stream
+ * writes it) is built in memory chunk by chunk by --gen-threads, and every
+ * finished chunk sets its bit in a ready bitmap.  Meanwhile --mine-threads
+ * run hashimoto_hybrid(), the template hashimoto loop (dagger_kernels.h) over
+ * a row source where a row whose chunk is ready is read from the
+ * dataset, any other row is computed from the cache on the spot.  Light rows
+ * cost two dataset items (512 cache reads), so the hash rate climbs with the
+ * fraction built instead of starting at zero when the build finishes.  Once
+ * the last chunk is ready the generation threads join the miners and every
+ * miner switches to hashimoto_interleaved() with the batch and prefetch of
+ * the host profile (dagger_profile.c).  Digests are the same either way.
+ *
+ * The generation / mining split is the number of threads of each kind; they
+ * share the cores with the scheduler, so e.g. --gen-threads 12 --mine-threads
+ * 4 on 16 cores builds fast and mines a little, and 4 / 12 the other way
+ * round.  A candidate is SHA512 of its 8-byte nonce, as in benchmark_hashimoto;
+ * nonces whose digest's first 8 bytes, read as a little-endian word, are below
+ * 2^64 / --diff are printed.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdatomic.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+#include "dagger_kernels.h"
+
+struct hybrid {
+    unsigned char *cache;
+    uint64_t cache_size;
+    unsigned char *dataset;
+    uint64_t size;
+    uint64_t chunk_size;        // bytes per ready bit, a multiple of MIX_BYTES
+    uint64_t nchunks;
+    _Atomic uint64_t *ready;    // one bit per chunk
+    _Atomic uint64_t next;      // next chunk to generate
+    _Atomic uint64_t done;      // chunks generated
+};
+
+struct hybrid_stats {
+    _Atomic uint64_t hashes;
+    _Atomic uint64_t full_rows; // rows read from the dataset
+    _Atomic uint64_t light_rows; // rows computed from the cache
+    _Atomic uint64_t found;
+};
+
+int hybrid_init(struct hybrid *h, unsigned char *cache, uint64_t cache_size, uint64_t size, uint64_t chunk_size,
+                int huge_pages) {
+    memset(h, 0, sizeof(*h));
+    h->cache = cache;
+    h->cache_size = cache_size;
+    h->size = size;
+    h->chunk_size = chunk_size;
+    h->nchunks = (size + chunk_size - 1) / chunk_size;
+    h->dataset = alloc_dataset(size, huge_pages);
+    h->ready = calloc((h->nchunks + 63) / 64, sizeof(uint64_t));
+    if (h->dataset == NULL || h->ready == NULL) {
+        return (-1);
+    }
+    return (0);
+}
+
+void hybrid_free(struct hybrid *h) {
+    if (h->dataset != NULL) {
+        munmap(h->dataset, h->size);
+    }
+    free((void *)h->ready);
+}
+
+static inline int hybrid_ready(const struct hybrid *h, uint64_t chunk) {
+    return ((atomic_load_explicit(&h->ready[chunk / 64], memory_order_acquire) >> (chunk % 64)) & 1);
+}
+
+static inline int hybrid_complete(struct hybrid *h) {
+    return (atomic_load_explicit(&h->done, memory_order_acquire) == h->nchunks);
+}
+
+// Generate the next unclaimed chunk and publish it; 0 once every chunk is claimed.
+int hybrid_generate_chunk(struct hybrid *h) {
+    uint64_t chunk = atomic_fetch_add(&h->next, 1);
+    if (chunk >= h->nchunks) {
+        return (0);
+    }
+    uint64_t first = chunk * h->chunk_size;
+    uint64_t end = first + h->chunk_size < h->size ? first + h->chunk_size : h->size;
+    uint64_t t0 = metrics_now(), tl = timeline_begin();
+    for (uint64_t off = first; off < end; off += HASH_BYTES) {
+        calculate_dataset_item_opt(h->cache, h->cache_size, off / HASH_BYTES, h->dataset + off);
+    }
+    timeline_end("dataset chunk", tl);
+    metrics_observe_since(METRIC_ITEM_LATENCY, t0);
+    metrics_add(METRIC_DATASET_ITEMS, (end - first) / HASH_BYTES);
+    metrics_add(METRIC_EPOCH_CHUNKS_DONE, 1);
+    atomic_fetch_or_explicit(&h->ready[chunk / 64], 1ULL << (chunk % 64), memory_order_release);
+    atomic_fetch_add_explicit(&h->done, 1, memory_order_release);
+    return (1);
+}
+
+struct hybrid_rows {
+    struct hybrid *h;
+    uint64_t full_rows;
+};
+
+static const uint32_t *hybrid_row(void *ctx, uint64_t parent, uint32_t *scratch) {
+    struct hybrid_rows *r = ctx;
+    struct hybrid *h = r->h;
+    TRACE_ACCESS(TRACE_DATASET, parent);
+    if (hybrid_ready(h, parent * MIX_BYTES / h->chunk_size)) {
+        r->full_rows++;
+        return ((const uint32_t *)(h->dataset + parent * MIX_BYTES));
+    }
+    for (uint64_t k = 0; k < MIX_BYTES / HASH_BYTES; k++) {
+        calculate_dataset_item_opt(h->cache, h->cache_size, parent * (MIX_BYTES / HASH_BYTES) + k,
+                                   (unsigned char *)scratch + k * HASH_BYTES);
+    }
+    return (scratch);
+}
+
+/*
+ * hashimoto() over the dataset being built: rows of ready chunks come from
+ * h->dataset, the others are computed from the cache into the kernel's
+ * scratch row.  The rows, and so the digest, are the same as over the
+ * finished dataset; mix receives the 32-byte digest.
+ */
+void hashimoto_hybrid(struct hybrid *h, unsigned char *hash, uint32_t *mix, struct hybrid_stats *stats) {
+    struct hybrid_rows r = {h, 0};
+    TRACE_MARK(TRACE_HASH);
+
+    dagger32_kernel_hashimoto_rows(hash, h->size / MIX_BYTES, hybrid_row, &r, (unsigned char *)mix);
+    atomic_fetch_add_explicit(&stats->full_rows, r.full_rows, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->light_rows, LOOP_ACCESSES - r.full_rows, memory_order_relaxed);
+    return;
+}
+
+struct hybrid_miner {
+    struct hybrid *h;
+    const struct dagger_profile *profile;
+    struct hybrid_stats stats;
+    _Atomic uint64_t nonce;
+    uint64_t target; // first digest word must be below this
+    double seconds;
+    struct timespec start;
+    pthread_mutex_t lock; // found nonces go to stdout in one piece
+};
+
+struct hybrid_worker {
+    struct hybrid_miner *m;
+    int generator;
+};
+
+static double hybrid_elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void hybrid_check(struct hybrid_miner *m, uint64_t nonce, const uint32_t *mix) {
+    uint64_t head;
+    memcpy(&head, mix, 8);
+    if (head >= m->target) {
+        return;
+    }
+    atomic_fetch_add(&m->stats.found, 1);
+    pthread_mutex_lock(&m->lock);
+    printf("nonce %llu digest ", (unsigned long long)nonce);
+    for (int k = 0; k < MIX_BYTES / 4; k++) {
+        printf("%02x", ((const unsigned char *)mix)[k]);
+    }
+    printf("\n");
+    pthread_mutex_unlock(&m->lock);
+}
+
+// Generate while chunks are left (generators only), then mine until the time is up.
+static void *hybrid_worker_main(void *arg) {
+    struct hybrid_worker *w = arg;
+    struct hybrid_miner *m = w->m;
+    struct hybrid *h = m->h;
+    uint64_t batch = m->profile->hashimoto_batch < HASHIMOTO_MAX_BATCH ? m->profile->hashimoto_batch : HASHIMOTO_MAX_BATCH;
+    unsigned char hashes[HASH_BYTES * HASHIMOTO_MAX_BATCH];
+    uint32_t mixes[MIX_BYTES / 4 * HASHIMOTO_MAX_BATCH] __attribute__((aligned(32)));
+
+    timeline_thread_name(w->generator ? "generator" : "miner");
+    while (w->generator && hybrid_elapsed(&m->start) < m->seconds && hybrid_generate_chunk(h)) {
+    }
+    while (hybrid_elapsed(&m->start) < m->seconds) {
+        if (!hybrid_complete(h)) {
+            uint64_t nonce = atomic_fetch_add_explicit(&m->nonce, 1, memory_order_relaxed);
+            uint64_t t0 = metrics_now(), tl = timeline_begin();
+            SHA512(&nonce, 8, hashes);
+            hashimoto_hybrid(h, hashes, mixes, &m->stats);
+            timeline_end("hybrid hash", tl);
+            metrics_observe_since(METRIC_HASH_LATENCY, t0);
+            metrics_add(METRIC_HASHES, 1);
+            atomic_fetch_add_explicit(&m->stats.hashes, 1, memory_order_relaxed);
+            hybrid_check(m, nonce, mixes);
+            continue;
+        }
+        // full speed: the profile's interleaved kernel over the finished dataset
+        uint64_t nonce = atomic_fetch_add_explicit(&m->nonce, batch, memory_order_relaxed);
+        uint64_t t0 = metrics_now(), tl = timeline_begin();
+        for (uint64_t l = 0; l < batch; l++) {
+            uint64_t n = nonce + l;
+            SHA512(&n, 8, hashes + l * HASH_BYTES);
+        }
+        hashimoto_interleaved(hashes, batch, h->size, h->dataset, mixes, m->profile->prefetch);
+        timeline_end("hashimoto", tl);
+        // the batch finishes together; each hash gets its share of the batch time
+        uint64_t per_hash = (metrics_now() - t0) / batch;
+        for (uint64_t l = 0; l < batch; l++) {
+            metrics_observe(METRIC_HASH_LATENCY, per_hash);
+            hybrid_check(m, nonce + l, mixes + l * MIX_BYTES / 4);
+        }
+        metrics_add(METRIC_HASHES, batch);
+        atomic_fetch_add_explicit(&m->stats.hashes, batch, memory_order_relaxed);
+        atomic_fetch_add_explicit(&m->stats.full_rows, batch * LOOP_ACCESSES, memory_order_relaxed);
+    }
+    return (NULL);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+int hybrid_self_verify() {
+    unsigned char seed[] = "123";
+    uint64_t cache_size = 4096, size = 1 << 16, chunk_size = 1024;
+    unsigned char *cache = generate_cache(cache_size, seed, sizeof(seed) - 1);
+    struct hybrid h;
+    struct hybrid_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    int ok = check("hybrid_init", hybrid_init(&h, cache, cache_size, size, chunk_size, 0) == 0);
+
+    // the finished dataset, built separately
+    unsigned char *full = malloc(size);
+    for (uint64_t i = 0; i < size / HASH_BYTES; i++) {
+        calculate_dataset_item_opt(cache, cache_size, i, full + i * HASH_BYTES);
+    }
+
+    unsigned char hash[HASH_BYTES];
+    uint32_t want[MIX_BYTES / 4] __attribute__((aligned(32)));
+    uint32_t got[MIX_BYTES / 4] __attribute__((aligned(32)));
+    for (uint64_t nonce = 0; ok && nonce < 8; nonce++) {
+        SHA512(&nonce, 8, hash);
+        hashimoto(hash, size, full, want);
+        hashimoto_hybrid(&h, hash, got, &stats);
+        ok &= check("light rows", memcmp(want, got, MIX_BYTES / 4) == 0);
+        // half built, and then every chunk
+        for (uint64_t c = 0; c < h.nchunks / 2 + (nonce % 2) * h.nchunks; c++) {
+            hybrid_generate_chunk(&h);
+        }
+        hashimoto_hybrid(&h, hash, got, &stats);
+        ok &= check("mixed rows", memcmp(want, got, MIX_BYTES / 4) == 0);
+    }
+    ok &= check("dataset", hybrid_complete(&h) && memcmp(full, h.dataset, size) == 0);
+    ok &= check("rows counted", stats.light_rows > 0 && stats.full_rows > 0);
+    hybrid_free(&h);
+    free(full);
+    free(cache);
+
+    printf(ok ? "hybrid_self_verify() passed\n" : "hybrid_self_verify() failed!\n");
+    return (!ok);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s mine [options]\n"
+            "  --size BYTES         dataset size (default 1073741824)\n"
+            "  --cache-size BYTES   cache size (default 16777216)\n"
+            "  --seed STR           cache seed (default 123)\n"
+            "  --chunk-size BYTES   dataset bytes per ready bit, multiple of %d (default 65536)\n"
+            "  --gen-threads N      threads building the dataset (default: half the profile threads, at least 1)\n"
+            "  --mine-threads N     threads mining from the start (default: the other half, at least 1)\n"
+            "  --seconds S          how long to run (default 60)\n"
+            "  --diff N             print nonces meeting 2^64 / N on the first digest word (default 2^32)\n"
+            "  --interval S         progress line every S seconds (default 1)\n"
+            "  --metrics TARGET     export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog, prog, MIX_BYTES);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"size", required_argument, 0, 's'},        {"cache-size", required_argument, 0, 'c'},
+        {"seed", required_argument, 0, 'e'},        {"chunk-size", required_argument, 0, 'k'},
+        {"gen-threads", required_argument, 0, 'g'}, {"mine-threads", required_argument, 0, 'm'},
+        {"seconds", required_argument, 0, 'S'},     {"diff", required_argument, 0, 'd'},
+        {"interval", required_argument, 0, 'i'},    {"metrics", required_argument, 0, 'X'},
+        {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (hybrid_self_verify());
+    }
+    if (argc < 2 || strcmp(argv[1], "mine") != 0) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct dagger_profile profile;
+    dagger_profile_load(&profile);
+    uint64_t size = 1073741824, cache_size = 16777216, chunk_size = 65536, diff = 1ULL << 32;
+    const char *seed = "123";
+    int gen_threads = profile.threads > 1 ? profile.threads / 2 : 1, mine_threads = -1;
+    double seconds = 60, interval = 1;
+    const char *metrics_target = getenv("DAGGER_METRICS");
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 's': size = strtoull(optarg, NULL, 0); break;
+        case 'c': cache_size = strtoull(optarg, NULL, 0); break;
+        case 'e': seed = optarg; break;
+        case 'k': chunk_size = strtoull(optarg, NULL, 0); break;
+        case 'g': gen_threads = atoi(optarg); break;
+        case 'm': mine_threads = atoi(optarg); break;
+        case 'S': seconds = atof(optarg); break;
+        case 'd': diff = strtoull(optarg, NULL, 0); break;
+        case 'i': interval = atof(optarg); break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (mine_threads < 0) {
+        mine_threads = profile.threads - gen_threads > 1 ? profile.threads - gen_threads : 1;
+    }
+    if (size < MIX_BYTES || size % MIX_BYTES != 0 || cache_size < HASH_BYTES || chunk_size == 0 ||
+        chunk_size % MIX_BYTES != 0 || gen_threads < 0 || mine_threads < 0 || gen_threads + mine_threads < 1 ||
+        diff == 0 || seconds <= 0 || interval <= 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        return (1);
+    }
+    // DAGGER_TIMELINE=PATH records a Chrome trace of generation and mining
+    timeline_start_env();
+
+    printf("Generating cache with size %llu\n", (unsigned long long)cache_size);
+    unsigned char *cache = generate_cache(cache_size, (unsigned char *)seed, strlen(seed));
+    metrics_set(METRIC_CACHE_BYTES, cache_size);
+    struct hybrid h;
+    if (cache == NULL || hybrid_init(&h, cache, cache_size, size, chunk_size, profile.huge_pages) != 0) {
+        fprintf(stderr, "cannot allocate the %llu byte dataset\n", (unsigned long long)size);
+        return (1);
+    }
+    metrics_set(METRIC_EPOCH_CHUNKS_TOTAL, h.nchunks);
+
+    struct hybrid_miner m;
+    memset(&m, 0, sizeof(m));
+    m.h = &h;
+    m.profile = &profile;
+    m.target = diff == 1 ? UINT64_MAX : UINT64_MAX / diff;
+    m.seconds = seconds;
+    pthread_mutex_init(&m.lock, NULL);
+    printf("Mining for %0.0fs while building %llu bytes (%d generating, %d mining, then batch %d prefetch %d)\n",
+           seconds, (unsigned long long)size, gen_threads, mine_threads, profile.hashimoto_batch, profile.prefetch);
+    clock_gettime(CLOCK_MONOTONIC, &m.start);
+
+    int nthreads = gen_threads + mine_threads;
+    pthread_t *tids = malloc(sizeof(pthread_t) * nthreads);
+    struct hybrid_worker *workers = malloc(sizeof(struct hybrid_worker) * nthreads);
+    int started = 0;
+    if (tids == NULL || workers == NULL) {
+        fprintf(stderr, "out of memory\n");
+    }
+    for (int t = 0; tids != NULL && workers != NULL && t < nthreads; t++) {
+        workers[started].m = &m;
+        workers[started].generator = t < gen_threads;
+        int err = pthread_create(&tids[started], NULL, hybrid_worker_main, &workers[started]);
+        if (err != 0) {
+            fprintf(stderr, "cannot start %s thread %d: %s\n", t < gen_threads ? "generating" : "mining", t,
+                    strerror(err));
+            break;
+        }
+        started++;
+    }
+
+    uint64_t last_hashes = 0, last_full = 0, last_light = 0;
+    double last = 0, built_at = 0;
+    // the threads that did start run to the end: generators turn to mining, miners use light rows
+    for (double now = 0; started > 0 && now < seconds; now = hybrid_elapsed(&m.start)) {
+        double sleep = last + interval - now;
+        if (sleep > 0) {
+            struct timespec ts = {(time_t)sleep, (long)((sleep - (time_t)sleep) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+        now = hybrid_elapsed(&m.start);
+        uint64_t hashes = atomic_load(&m.stats.hashes), full = atomic_load(&m.stats.full_rows);
+        uint64_t light = atomic_load(&m.stats.light_rows), done = atomic_load(&h.done);
+        uint64_t rows = full + light - last_full - last_light;
+        timeline_counter("chunks built", done);
+        if (done == h.nchunks && built_at == 0) {
+            built_at = now;
+        }
+        printf("%7.1fs built %5.1f%%, rate %0.2f H/s, %5.1f%% rows from the dataset\n", now,
+               100.0 * done / h.nchunks, (hashes - last_hashes) / (now - last),
+               rows ? 100.0 * (full - last_full) / rows : 0);
+        last_hashes = hashes;
+        last_full = full;
+        last_light = light;
+        last = now;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    timeline_stop();
+    double used_time = hybrid_elapsed(&m.start);
+    if (started > 0) {
+        printf("Done! Took %0.2fs, %llu hashes (%0.2f H/s), %llu found, dataset %s\n", used_time,
+               (unsigned long long)m.stats.hashes, m.stats.hashes / used_time, (unsigned long long)m.stats.found,
+               built_at > 0 ? "built" : "incomplete");
+    }
+    if (built_at > 0) {
+        printf("Dataset built after %0.1fs\n", built_at);
+    }
+
+    free(tids);
+    free(workers);
+    hybrid_free(&h);
+    free(cache);
+    metrics_stop();
+    return (started > 0 ? 0 : 1);
+}
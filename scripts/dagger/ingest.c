@@ -0,0 +1,675 @@
+/*
+ * Single-pass ingestion of a file into DecentralizedKV blobs.
+ *
+ *   gcc -O3 -march=native -pthread ingest.c -o ingest
+ *   ./ingest run --input file.bin --max-kv-size-bits 17 --chunk-size-bits 12 \
+ *       --blobs shard.raw --masked shard.masked --meta file.kvs
+ *   ./ingest verify
+ *
+ * Uploading a file splits it into maxKvSize blobs; the client needs each
+ * blob's kvHash (bytes24 of MerkleLib.merkleRootWithMinTree() over chunkSize
+ * chunks, what DecentralizedKV.put() stores) and usually keccak256 of the blob
+ * to address it, and a storage node keeps the masked slot.  Here the input is
+ * read once, through mmap() (or pread() into the slot with --no-mmap), and
+ * every blob is handled by one worker in groups of KECCAK_MB_LANES chunks: the
+ * group feeds the running keccak of the blob, its full chunks are hashed into
+ * Merkle leaves side by side with KECCAK256_MB(), and it is copied into the
+ * slot and masked, all while it is still in cache.  Workers take blobs in
+ * order into a bounded set of slots (--mem-cap); the writer (the calling
+ * thread) emits them in kv order:
+ *
+ *   --blobs PATH   the raw blobs at their slots, zero padded (a raw shard)
+ *   --masked PATH  the masked slots, as `dataset_stream mask` makes of the raw shard
+ *   --meta PATH    one line per blob: kv index, size, kvHash, keccak256 (default stdout)
+ *
+ * The first blob goes to slot --first-kv of the shard files; masks follow
+ * sparse_shard.c, the 64-byte piece at byte p of the shard is masked as item
+ * --item-base + p / 64.  Input pages are dropped once their blob is written, so
+ * the page cache does not fill with a file that is read only once.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+#include "keccak.c"
+#include "keccak_mb.c"
+#include "merkle.c"
+
+#define INGEST_ALIGN 4096
+
+enum ingest_state { INGEST_FREE, INGEST_BUSY, INGEST_READY };
+
+struct ingest_slot {
+    unsigned char *raw;        // the blob read with pread(), NULL with mmap()
+    unsigned char *masked;     // max_kv_size bytes
+    unsigned char (*leaf)[32]; // max_kv_size / chunk_size Merkle nodes
+    const unsigned char *data; // the blob: in the mapping or raw
+    uint64_t kv;               // blob index in the input
+    uint64_t len;
+    unsigned char kv_hash[32]; // merkleRootWithMinTree(); DecentralizedKV keeps the first 24 bytes
+    unsigned char data_hash[32];
+    int state;
+};
+
+struct ingest {
+    unsigned char *cache; // NULL unless masking
+    uint64_t cache_size;
+    uint64_t max_kv_size;
+    uint64_t chunk_size;
+    uint64_t first_kv;
+    uint64_t item_base;
+    int in_fd;
+    const unsigned char *map; // NULL to pread() instead
+    uint64_t size;
+    int blobs_fd; // -1 when not wanted
+    int masked_fd;
+    FILE *meta;
+    FILE *log; // progress, NULL for none
+
+    struct ingest_slot *slots;
+    uint64_t nslots;
+    uint64_t nblobs;
+    uint64_t next_blob;
+    int error;
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+};
+
+// Hash, tree and mask one group of up to KECCAK_MB_LANES chunks at byte pos of the blob.
+static void ingest_group(struct ingest *g, struct ingest_slot *sl, KECCAK_CTX *ctx, uint64_t pos, uint64_t glen) {
+    uint64_t n = pos < sl->len ? sl->len - pos : 0;
+    if (n > glen) {
+        n = glen;
+    }
+    const unsigned char *src = sl->data + pos;
+    uint64_t first_chunk = pos / g->chunk_size;
+    uint64_t full = n / g->chunk_size;
+    if (n > 0) {
+        keccak_update(ctx, src, n);
+    }
+    if (full > 0) {
+        const unsigned char *in[KECCAK_MB_LANES];
+        unsigned char *out[KECCAK_MB_LANES];
+        unsigned char spare[32];
+        for (uint64_t l = 0; l < KECCAK_MB_LANES; l++) {
+            in[l] = src + (l < full ? l : 0) * g->chunk_size;
+            out[l] = l < full ? sl->leaf[first_chunk + l] : spare;
+        }
+        KECCAK256_MB(in, g->chunk_size, out);
+    }
+    if (n > full * g->chunk_size) {
+        // the short last chunk of the blob
+        keccak256(src + full * g->chunk_size, n - full * g->chunk_size, sl->leaf[first_chunk + full]);
+    }
+    if (g->cache == NULL) {
+        return;
+    }
+    // past the end of the blob the slot holds zeros, masked like any other data
+    memcpy(sl->masked + pos, src, n);
+    memset(sl->masked + pos + n, 0, glen - n);
+    calculate_mask_blob(g->cache, g->cache_size, g->item_base + ((g->first_kv + sl->kv) * g->max_kv_size + pos) / HASH_BYTES,
+                        sl->masked + pos, glen);
+}
+
+void ingest_blob(struct ingest *g, struct ingest_slot *sl) {
+    uint64_t off = sl->kv * g->max_kv_size;
+    uint64_t start = metrics_now();
+    uint64_t t0 = timeline_begin();
+    if (g->map != NULL) {
+        sl->data = g->map + off;
+    } else {
+        uint64_t done = 0;
+        while (done < sl->len) {
+            ssize_t n = pread(g->in_fd, sl->raw + done, sl->len - done, off + done);
+            if (n <= 0) {
+                fprintf(stderr, "read input at %llu failed: %s\n", (unsigned long long)(off + done),
+                        n < 0 ? strerror(errno) : "EOF");
+                pthread_mutex_lock(&g->lock);
+                g->error = 1;
+                pthread_mutex_unlock(&g->lock);
+                return;
+            }
+            done += n;
+        }
+        sl->data = sl->raw;
+        start = metrics_observe_since(METRIC_IO_LATENCY, start);
+        t0 = timeline_end("read blob", t0);
+    }
+    metrics_add(METRIC_IO_READ_BYTES, sl->len);
+
+    KECCAK_CTX ctx;
+    keccak_init(&ctx, 32);
+    uint64_t group = g->chunk_size * KECCAK_MB_LANES;
+    // chunks past the data are zero leaves, and masking still covers the whole slot
+    uint64_t end = g->cache != NULL ? g->max_kv_size : sl->len;
+    for (uint64_t pos = 0; pos < end; pos += group) {
+        ingest_group(g, sl, &ctx, pos, end - pos < group ? end - pos : group);
+    }
+    keccak_final(&ctx, sl->data_hash, 32, KECCAK_PAD);
+
+    uint64_t chunks = (sl->len + g->chunk_size - 1) / g->chunk_size;
+    uint64_t n = 1ULL << merkle_min_bits(sl->len, g->chunk_size);
+    memset(sl->leaf[chunks], 0, 32 * (n - chunks));
+    for (; n > 1; n /= 2) {
+        merkle_level(sl->leaf, n, sl->leaf);
+    }
+    memcpy(sl->kv_hash, sl->leaf[0], 32);
+    timeline_end("ingest blob", t0);
+    if (g->cache != NULL) {
+        metrics_observe_since(METRIC_MASK_LATENCY, start);
+        metrics_add(METRIC_MASK_ITEMS, g->max_kv_size / HASH_BYTES);
+    }
+}
+
+void *ingest_worker(void *arg) {
+    struct ingest *g = arg;
+
+    timeline_thread_name("ingest");
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        if (g->next_blob >= g->nblobs || g->error) {
+            break;
+        }
+        struct ingest_slot *sl = NULL;
+        for (uint64_t i = 0; i < g->nslots; i++) {
+            if (g->slots[i].state == INGEST_FREE) {
+                sl = &g->slots[i];
+                break;
+            }
+        }
+        if (sl == NULL) {
+            // every slot holds a blob the writer has not reached yet
+            uint64_t t0 = timeline_begin();
+            pthread_cond_wait(&g->slot_free, &g->lock);
+            timeline_end("wait free slot", t0);
+            continue;
+        }
+        sl->state = INGEST_BUSY;
+        sl->kv = g->next_blob++;
+        sl->len = g->size - sl->kv * g->max_kv_size;
+        if (sl->len > g->max_kv_size) {
+            sl->len = g->max_kv_size;
+        }
+        pthread_mutex_unlock(&g->lock);
+
+        ingest_blob(g, sl);
+
+        pthread_mutex_lock(&g->lock);
+        sl->state = INGEST_READY;
+        pthread_cond_broadcast(&g->slot_ready);
+    }
+    // the writer may be waiting for a blob that will now never come
+    pthread_cond_broadcast(&g->slot_ready);
+    pthread_mutex_unlock(&g->lock);
+    return (NULL);
+}
+
+void ingest_meta_line(char *line, size_t cap, uint64_t kv, uint64_t len, const unsigned char *kv_hash,
+                      const unsigned char *data_hash) {
+    char kv_hex[2 * 24 + 1], data_hex[2 * 32 + 1];
+    for (int i = 0; i < 32; i++) {
+        if (i < 24) {
+            sprintf(kv_hex + 2 * i, "%02x", kv_hash[i]);
+        }
+        sprintf(data_hex + 2 * i, "%02x", data_hash[i]);
+    }
+    snprintf(line, cap, "%llu %llu 0x%s 0x%s\n", (unsigned long long)kv, (unsigned long long)len, kv_hex, data_hex);
+}
+
+static int ingest_pwrite(int fd, const unsigned char *buf, uint64_t len, uint64_t off, const char *what) {
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, off + done);
+        if (n < 0) {
+            fprintf(stderr, "write of %s at %llu failed: %s\n", what, (unsigned long long)(off + done), strerror(errno));
+            return (-1);
+        }
+        done += n;
+    }
+    metrics_add(METRIC_IO_WRITE_BYTES, len);
+    return (0);
+}
+
+int ingest_write(struct ingest *g, struct ingest_slot *sl) {
+    uint64_t off = (g->first_kv + sl->kv) * g->max_kv_size;
+    uint64_t start = metrics_now();
+    uint64_t t0 = timeline_begin();
+    if (g->blobs_fd >= 0 && ingest_pwrite(g->blobs_fd, sl->data, sl->len, off, "blob") != 0) {
+        return (-1);
+    }
+    if (g->masked_fd >= 0 && ingest_pwrite(g->masked_fd, sl->masked, g->max_kv_size, off, "masked slot") != 0) {
+        return (-1);
+    }
+    char line[160];
+    ingest_meta_line(line, sizeof(line), g->first_kv + sl->kv, sl->len, sl->kv_hash, sl->data_hash);
+    if (g->meta != NULL && fputs(line, g->meta) == EOF) {
+        fprintf(stderr, "write of metadata failed: %s\n", strerror(errno));
+        return (-1);
+    }
+    metrics_observe_since(METRIC_IO_LATENCY, start);
+    timeline_end("write blob", t0);
+
+    // the input is read once: let its pages go
+    uint64_t in_off = sl->kv * g->max_kv_size;
+    if (g->map != NULL) {
+        madvise((void *)(g->map + in_off), sl->len, MADV_DONTNEED);
+    }
+    posix_fadvise(g->in_fd, in_off, sl->len, POSIX_FADV_DONTNEED);
+    return (0);
+}
+
+// The writer runs on the calling thread and takes the blobs in kv order.
+int ingest_writer(struct ingest *g) {
+    uint64_t percent = g->nblobs / 100 + 1;
+    timeline_thread_name("writer");
+    for (uint64_t kv = 0; kv < g->nblobs; kv++) {
+        struct ingest_slot *sl = NULL;
+        pthread_mutex_lock(&g->lock);
+        while (!g->error) {
+            for (uint64_t i = 0; i < g->nslots && sl == NULL; i++) {
+                if (g->slots[i].state == INGEST_READY && g->slots[i].kv == kv) {
+                    sl = &g->slots[i];
+                }
+            }
+            if (sl != NULL) {
+                break;
+            }
+            uint64_t t0 = timeline_begin();
+            pthread_cond_wait(&g->slot_ready, &g->lock);
+            timeline_end("wait ready blob", t0);
+        }
+        pthread_mutex_unlock(&g->lock);
+        if (sl == NULL) {
+            break;
+        }
+
+        int ret = ingest_write(g, sl);
+        pthread_mutex_lock(&g->lock);
+        if (ret != 0) {
+            g->error = 1;
+        }
+        sl->state = INGEST_FREE;
+        pthread_cond_broadcast(&g->slot_free);
+        pthread_mutex_unlock(&g->lock);
+        if (ret != 0) {
+            break;
+        }
+        metrics_add(METRIC_EPOCH_CHUNKS_DONE, 1);
+        if ((kv + 1) % percent == 0 && g->log != NULL) {
+            fprintf(g->log, "ingested %llu / %llu blobs\n", (unsigned long long)(kv + 1), (unsigned long long)g->nblobs);
+        }
+    }
+    return (g->error ? -1 : 0);
+}
+
+// Ingest g->size bytes of g->in_fd with threads workers and nslots blobs in memory.
+int ingest_run(struct ingest *g, int threads, uint64_t nslots) {
+    g->nblobs = (g->size + g->max_kv_size - 1) / g->max_kv_size;
+    g->next_blob = 0;
+    g->error = 0;
+    // one slot per worker plus the one being written keeps both sides busy
+    g->nslots = nslots < (uint64_t)threads + 1 ? (uint64_t)threads + 1 : nslots;
+    g->slots = calloc(g->nslots, sizeof(struct ingest_slot));
+    int ret = g->slots == NULL ? -1 : 0;
+    for (uint64_t i = 0; ret == 0 && i < g->nslots; i++) {
+        struct ingest_slot *sl = &g->slots[i];
+        sl->leaf = malloc(32 * (g->max_kv_size / g->chunk_size));
+        if (sl->leaf == NULL || (g->map == NULL && posix_memalign((void **)&sl->raw, INGEST_ALIGN, g->max_kv_size) != 0) ||
+            (g->cache != NULL && posix_memalign((void **)&sl->masked, INGEST_ALIGN, g->max_kv_size) != 0)) {
+            fprintf(stderr, "cannot allocate %llu blob buffers\n", (unsigned long long)g->nslots);
+            ret = -1;
+        }
+    }
+    metrics_set(METRIC_BUFFER_BYTES, g->nslots * g->max_kv_size * ((g->map == NULL) + (g->cache != NULL)));
+    metrics_set(METRIC_EPOCH_CHUNKS_TOTAL, g->nblobs);
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->slot_free, NULL);
+    pthread_cond_init(&g->slot_ready, NULL);
+
+    if (ret == 0) {
+        pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+        int started = 0;
+        if (tids == NULL) {
+            fprintf(stderr, "cannot allocate %d thread ids\n", threads);
+        }
+        while (tids != NULL && started < threads) {
+            int err = pthread_create(&tids[started], NULL, ingest_worker, g);
+            if (err != 0) {
+                fprintf(stderr, "cannot start ingest thread %d: %s\n", started, strerror(err));
+                break;
+            }
+            started++;
+        }
+        // the workers share the blobs, so fewer of them still ingest everything
+        if (started > 0) {
+            ret = ingest_writer(g);
+        } else {
+            g->error = 1;
+            ret = -1;
+        }
+        pthread_mutex_lock(&g->lock);
+        if (ret != 0) {
+            // wake workers blocked on a full set of slots so they can exit
+            pthread_cond_broadcast(&g->slot_free);
+        }
+        pthread_mutex_unlock(&g->lock);
+        for (int t = 0; t < started; t++) {
+            pthread_join(tids[t], NULL);
+        }
+        free(tids);
+    }
+
+    // short last blobs and empty slots read as zeros
+    uint64_t end = (g->first_kv + g->nblobs) * g->max_kv_size;
+    if (ret == 0 && g->blobs_fd >= 0 && (ftruncate(g->blobs_fd, end) != 0 || fdatasync(g->blobs_fd) != 0)) {
+        fprintf(stderr, "finalizing blobs failed: %s\n", strerror(errno));
+        ret = -1;
+    }
+    if (ret == 0 && g->masked_fd >= 0 && fdatasync(g->masked_fd) != 0) {
+        fprintf(stderr, "finalizing masked slots failed: %s\n", strerror(errno));
+        ret = -1;
+    }
+    if (ret == 0 && g->meta != NULL && fflush(g->meta) != 0) {
+        fprintf(stderr, "finalizing metadata failed: %s\n", strerror(errno));
+        ret = -1;
+    }
+    for (uint64_t i = 0; g->slots != NULL && i < g->nslots; i++) {
+        free(g->slots[i].raw);
+        free(g->slots[i].masked);
+        free(g->slots[i].leaf);
+    }
+    free(g->slots);
+    g->slots = NULL;
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->slot_free);
+    pthread_cond_destroy(&g->slot_ready);
+    return (ret);
+}
+
+static void check(const char *name, int cond) {
+    if (!cond) {
+        fprintf(stderr, "self_verify: %s failed\n", name);
+        exit(1);
+    }
+}
+
+static uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+static int verify_tmpfile() {
+    char path[] = "/tmp/ingest_verify.XXXXXX";
+    int fd = mkstemp(path);
+    check("mkstemp", fd >= 0);
+    unlink(path);
+    return (fd);
+}
+
+static unsigned char *verify_read(int fd, uint64_t len) {
+    unsigned char *buf = calloc(1, len + 1);
+    check("read back", pread(fd, buf, len, 0) == (ssize_t)len);
+    return (buf);
+}
+
+// The pipeline against the separate passes it replaces: merkle_root_min_tree() and
+// keccak256() of every blob, and calculate_mask_blob() over the raw shard.
+void ingest_self_verify() {
+    const uint64_t max_kv_size = 1 << 13, chunk_size = 1 << 10, cache_size = 1 << 16;
+    const uint64_t first_kv = 3, item_base = 5;
+    // full blobs, a short last blob with a short last chunk, and a blob of one chunk
+    const uint64_t sizes[] = {5 * max_kv_size + 1000, 2 * max_kv_size + chunk_size, 100};
+    unsigned char *cache = generate_cache(cache_size, (unsigned char *)"verify", 6);
+    uint64_t seed = 11;
+
+    for (int t = 0; t < 3; t++) {
+        uint64_t size = sizes[t];
+        unsigned char *input = malloc(size);
+        for (uint64_t i = 0; i < size; i++) {
+            input[i] = splitmix64(&seed);
+        }
+        int in_fd = verify_tmpfile();
+        check("write input", write(in_fd, input, size) == (ssize_t)size);
+        unsigned char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, in_fd, 0);
+        check("mmap", map != MAP_FAILED);
+
+        uint64_t nblobs = (size + max_kv_size - 1) / max_kv_size;
+        uint64_t shard_len = (first_kv + nblobs) * max_kv_size;
+        unsigned char *raw = calloc(1, shard_len);
+        memcpy(raw + first_kv * max_kv_size, input, size);
+        unsigned char *masked = malloc(shard_len);
+        memcpy(masked, raw, shard_len);
+        calculate_mask_blob(cache, cache_size, item_base, masked, shard_len);
+
+        for (int use_map = 0; use_map < 2; use_map++) {
+            struct ingest g;
+            memset(&g, 0, sizeof(g));
+            g.cache = cache;
+            g.cache_size = cache_size;
+            g.max_kv_size = max_kv_size;
+            g.chunk_size = chunk_size;
+            g.first_kv = first_kv;
+            g.item_base = item_base;
+            g.in_fd = in_fd;
+            g.map = use_map ? map : NULL;
+            g.size = size;
+            g.blobs_fd = verify_tmpfile();
+            g.masked_fd = verify_tmpfile();
+            g.meta = tmpfile();
+            check("ingest_run", ingest_run(&g, 2, 1) == 0);
+
+            unsigned char *blobs = verify_read(g.blobs_fd, shard_len);
+            unsigned char *slots = verify_read(g.masked_fd, shard_len);
+            check("blobs", memcmp(blobs + first_kv * max_kv_size, raw + first_kv * max_kv_size,
+                                  shard_len - first_kv * max_kv_size) == 0);
+            check("masked slots", memcmp(slots + first_kv * max_kv_size, masked + first_kv * max_kv_size,
+                                         shard_len - first_kv * max_kv_size) == 0);
+
+            rewind(g.meta);
+            for (uint64_t kv = 0; kv < nblobs; kv++) {
+                uint64_t len = size - kv * max_kv_size < max_kv_size ? size - kv * max_kv_size : max_kv_size;
+                unsigned char kv_hash[32], data_hash[32];
+                merkle_root_min_tree(input + kv * max_kv_size, len, chunk_size, kv_hash);
+                keccak256(input + kv * max_kv_size, len, data_hash);
+                char want[160], got[160];
+                ingest_meta_line(want, sizeof(want), first_kv + kv, len, kv_hash, data_hash);
+                check("metadata line", fgets(got, sizeof(got), g.meta) != NULL);
+                check("metadata", strcmp(got, want) == 0);
+            }
+            free(blobs);
+            free(slots);
+            close(g.blobs_fd);
+            close(g.masked_fd);
+            fclose(g.meta);
+        }
+        munmap(map, size);
+        close(in_fd);
+        free(input);
+        free(raw);
+        free(masked);
+    }
+    free(cache);
+    printf("self_verify() passed\n");
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s run|verify [options]\n"
+            "  --input PATH            file to ingest (required)\n"
+            "  --blobs PATH            raw blobs at their slots\n"
+            "  --masked PATH           masked slots\n"
+            "  --meta PATH             kv index, size, kvHash and keccak256 per blob (default stdout)\n"
+            "  --max-kv-size-bits N    blob size (default 17)\n"
+            "  --chunk-size-bits N     MerkleLib chunk size (default 12)\n"
+            "  --first-kv N            slot of the first blob in the shard files (default 0)\n"
+            "  --item-base N           mask item index of the first byte of the shard (default 0)\n"
+            "  --seed STR              cache seed (default 123)\n"
+            "  --cache-size BYTES      cache size (default 16777216)\n"
+            "  --mem-cap BYTES         memory for blobs in flight (default 268435456)\n"
+            "  --threads N             workers (default: all online cores)\n"
+            "  --no-mmap               pread() each blob instead of mapping the input\n"
+            "  --metrics TARGET        export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"input", required_argument, 0, 'i'},
+        {"blobs", required_argument, 0, 'b'},
+        {"masked", required_argument, 0, 'm'},
+        {"meta", required_argument, 0, 'M'},
+        {"max-kv-size-bits", required_argument, 0, 'K'},
+        {"chunk-size-bits", required_argument, 0, 'C'},
+        {"first-kv", required_argument, 0, 'f'},
+        {"item-base", required_argument, 0, 'I'},
+        {"seed", required_argument, 0, 'e'},
+        {"cache-size", required_argument, 0, 'c'},
+        {"mem-cap", required_argument, 0, 'x'},
+        {"threads", required_argument, 0, 't'},
+        {"no-mmap", no_argument, 0, 'N'},
+        {"metrics", required_argument, 0, 'X'},
+        {0, 0, 0, 0},
+    };
+
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        ingest_self_verify();
+        return (0);
+    }
+    if (argc < 2 || strcmp(argv[1], "run") != 0) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct ingest g;
+    memset(&g, 0, sizeof(g));
+    g.cache_size = 16777216;
+    g.blobs_fd = -1;
+    g.masked_fd = -1;
+    const char *input = NULL, *blobs = NULL, *masked = NULL, *meta = NULL;
+    const char *seed = "123";
+    unsigned max_kv_bits = 17, chunk_bits = 12;
+    uint64_t mem_cap = 268435456;
+    int use_mmap = 1;
+    int threads = dagger_gen_threads();
+    const char *metrics_target = getenv("DAGGER_METRICS");
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'i': input = optarg; break;
+        case 'b': blobs = optarg; break;
+        case 'm': masked = optarg; break;
+        case 'M': meta = optarg; break;
+        case 'K': max_kv_bits = atoi(optarg); break;
+        case 'C': chunk_bits = atoi(optarg); break;
+        case 'f': g.first_kv = strtoull(optarg, NULL, 0); break;
+        case 'I': g.item_base = strtoull(optarg, NULL, 0); break;
+        case 'e': seed = optarg; break;
+        case 'c': g.cache_size = strtoull(optarg, NULL, 0); break;
+        case 'x': mem_cap = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        case 'N': use_mmap = 0; break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    // chunks are whole mask items and a blob is whole chunks
+    if (input == NULL || chunk_bits < 6 || max_kv_bits < chunk_bits || max_kv_bits > 30 || threads < 1) {
+        usage(argv[0]);
+        return (1);
+    }
+    g.max_kv_size = 1ULL << max_kv_bits;
+    g.chunk_size = 1ULL << chunk_bits;
+
+    g.in_fd = open(input, O_RDONLY);
+    struct stat st;
+    if (g.in_fd < 0 || fstat(g.in_fd, &st) != 0) {
+        fprintf(stderr, "cannot open %s: %s\n", input, strerror(errno));
+        return (1);
+    }
+    g.size = st.st_size;
+    posix_fadvise(g.in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (use_mmap && g.size > 0) {
+        void *map = mmap(NULL, g.size, PROT_READ, MAP_SHARED, g.in_fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "mmap of %s failed (%s), using pread\n", input, strerror(errno));
+        } else {
+            madvise(map, g.size, MADV_SEQUENTIAL);
+            g.map = map;
+        }
+    }
+    if (blobs != NULL && (g.blobs_fd = open(blobs, O_WRONLY | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", blobs, strerror(errno));
+        return (1);
+    }
+    if (masked != NULL && (g.masked_fd = open(masked, O_WRONLY | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", masked, strerror(errno));
+        return (1);
+    }
+    g.meta = meta == NULL ? stdout : fopen(meta, "w");
+    if (g.meta == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", meta, strerror(errno));
+        return (1);
+    }
+    // progress lines would land in the metadata
+    g.log = g.meta == stdout ? stderr : stdout;
+    FILE *log = g.log;
+
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        return (1);
+    }
+    // DAGGER_TIMELINE=PATH records a Chrome trace of reads, hashing and writes
+    timeline_start_env();
+
+    struct timespec start, end;
+    if (masked != NULL) {
+        fprintf(log, "Generating cache with size %llu\n", (unsigned long long)g.cache_size);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        g.cache = generate_cache(g.cache_size, (unsigned char *)seed, strlen(seed));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        fprintf(log, "Done! Took %0.2fs\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+        metrics_set(METRIC_CACHE_BYTES, g.cache_size);
+    }
+
+    uint64_t nslots = mem_cap / (g.max_kv_size * ((g.map == NULL) + (g.cache != NULL) + 1));
+    fprintf(log, "Ingesting %llu bytes into %llu blobs of %llu bytes (%d threads, %s%s)\n", (unsigned long long)g.size,
+            (unsigned long long)((g.size + g.max_kv_size - 1) / g.max_kv_size), (unsigned long long)g.max_kv_size, threads,
+            g.map != NULL ? "mmap" : "pread", g.cache != NULL ? ", masking" : "");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ret = ingest_run(&g, threads, nslots);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timeline_stop();
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (ret == 0) {
+        fprintf(log, "Done! Took %0.2fs, %0.2f MB/s\n", used_time, g.size / used_time / 1e6);
+    } else {
+        metrics_add(METRIC_ERRORS, 1);
+    }
+    metrics_stop();
+
+    if (g.map != NULL) {
+        munmap((void *)g.map, g.size);
+    }
+    close(g.in_fd);
+    if (g.blobs_fd >= 0) {
+        close(g.blobs_fd);
+    }
+    if (g.masked_fd >= 0) {
+        close(g.masked_fd);
+    }
+    if (g.meta != stdout) {
+        fclose(g.meta);
+    }
+    free(g.cache);
+    return (ret == 0 ? 0 : 1);
+}
@@ -0,0 +1,147 @@
+/*
+ * Keccak-f[1600] and the Ethereum flavour of Keccak-256 / Keccak-512
+ * (original 0x01 padding, not the FIPS-202 SHA3 0x06 padding).
+ *
+ * keccak_init / keccak_update / keccak_final hash a message incrementally;
+ * keccak256() and keccak512() are the one-shot forms.  Passing
+ * SHA3_PAD to keccak_final() gives FIPS-202 SHA3, which is what hashlib
+ * implements and is handy for cross-checking.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define KECCAK_PAD 0x01
+#define SHA3_PAD 0x06
+
+static const uint64_t keccakf_rndc[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+static const unsigned keccakf_rotc[24] = {1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+                                          27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44};
+
+static const unsigned keccakf_piln[24] = {10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+                                          15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1};
+
+#define KECCAK_ROTL64(x, y) (((x) << (y)) | ((x) >> (64 - (y))))
+
+void keccakf1600(uint64_t state[25]) {
+    // work on a local copy so the fully unrolled steps stay in registers
+    uint64_t st[25], bc[5];
+    memcpy(st, state, sizeof(st));
+    for (int round = 0; round < 24; round++) {
+        // theta
+#pragma GCC unroll 5
+        for (int i = 0; i < 5; i++) {
+            bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+        }
+#pragma GCC unroll 5
+        for (int i = 0; i < 5; i++) {
+            uint64_t t = bc[(i + 4) % 5] ^ KECCAK_ROTL64(bc[(i + 1) % 5], 1);
+#pragma GCC unroll 5
+            for (int j = 0; j < 25; j += 5) {
+                st[j + i] ^= t;
+            }
+        }
+        // rho pi
+        uint64_t t = st[1];
+#pragma GCC unroll 24
+        for (int i = 0; i < 24; i++) {
+            int j = keccakf_piln[i];
+            uint64_t tmp = st[j];
+            st[j] = KECCAK_ROTL64(t, keccakf_rotc[i]);
+            t = tmp;
+        }
+        // chi
+#pragma GCC unroll 5
+        for (int j = 0; j < 25; j += 5) {
+#pragma GCC unroll 5
+            for (int i = 0; i < 5; i++) {
+                bc[i] = st[j + i];
+            }
+#pragma GCC unroll 5
+            for (int i = 0; i < 5; i++) {
+                st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+            }
+        }
+        // iota
+        st[0] ^= keccakf_rndc[round];
+    }
+    memcpy(state, st, sizeof(st));
+}
+
+typedef struct {
+    uint64_t st[25];
+    unsigned rate; // bytes absorbed per permutation: 200 - 2 * digest bytes
+    unsigned pos;
+} KECCAK_CTX;
+
+static inline void keccak_xor_byte(KECCAK_CTX *ctx, unsigned pos, unsigned char b) {
+    ctx->st[pos / 8] ^= (uint64_t)b << (8 * (pos % 8));
+}
+
+void keccak_init(KECCAK_CTX *ctx, unsigned digest_bytes) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->rate = 200 - 2 * digest_bytes;
+}
+
+void keccak_update(KECCAK_CTX *ctx, const void *data, uint64_t len) {
+    const unsigned char *in = (const unsigned char *)data;
+    while (len > 0) {
+        if (ctx->pos == 0) {
+            // whole 8-byte lanes while aligned to the start of a block
+            while (len >= ctx->rate) {
+                for (unsigned k = 0; k < ctx->rate / 8; k++) {
+                    uint64_t v = 0;
+                    for (int b = 7; b >= 0; b--) {
+                        v = (v << 8) | in[8 * k + b];
+                    }
+                    ctx->st[k] ^= v;
+                }
+                keccakf1600(ctx->st);
+                in += ctx->rate;
+                len -= ctx->rate;
+            }
+            if (len == 0) {
+                break;
+            }
+        }
+        keccak_xor_byte(ctx, ctx->pos++, *in++);
+        len--;
+        if (ctx->pos == ctx->rate) {
+            keccakf1600(ctx->st);
+            ctx->pos = 0;
+        }
+    }
+}
+
+void keccak_final(KECCAK_CTX *ctx, unsigned char *digest, unsigned digest_bytes, unsigned char pad) {
+    keccak_xor_byte(ctx, ctx->pos, pad);
+    keccak_xor_byte(ctx, ctx->rate - 1, 0x80);
+    keccakf1600(ctx->st);
+    for (unsigned k = 0; k < digest_bytes; k++) {
+        digest[k] = (unsigned char)(ctx->st[k / 8] >> (8 * (k % 8)));
+    }
+}
+
+unsigned char *keccak256(const void *data, uint64_t len, unsigned char *digest) {
+    KECCAK_CTX ctx;
+    keccak_init(&ctx, 32);
+    keccak_update(&ctx, data, len);
+    keccak_final(&ctx, digest, 32, KECCAK_PAD);
+    return (digest);
+}
+
+unsigned char *keccak512(const void *data, uint64_t len, unsigned char *digest) {
+    KECCAK_CTX ctx;
+    keccak_init(&ctx, 64);
+    keccak_update(&ctx, data, len);
+    keccak_final(&ctx, digest, 64, KECCAK_PAD);
+    return (digest);
+}
@@ -0,0 +1,149 @@
+/*
+ * Multi-buffer Keccak-256 for messages of equal length.
+ *
+ * KECCAK256_MB() hashes KECCAK_MB_LANES messages side by side, one message per
+ * 64-bit vector lane (8 lanes with AVX-512F, 4 with AVX2, and a plain scalar
+ * lane otherwise).  The lanes share every permutation, so the messages must
+ * have the same length; callers that hash fewer messages point the spare lanes
+ * at one of the real ones.
+ *
+ * Must be included after keccak.c (reuses the round constants and offsets).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+#define KECCAK_MB_LANES 8
+typedef __m512i kmb_word;
+#define KMB_XOR(a, b) _mm512_xor_si512((a), (b))
+#define KMB_ANDNOT(a, b) _mm512_andnot_si512((a), (b))
+#define KMB_ROTL(x, n) _mm512_rolv_epi64((x), _mm512_set1_epi64(n))
+#define KMB_SET1(v) _mm512_set1_epi64((long long)(v))
+#define KMB_ZERO() _mm512_setzero_si512()
+#define KMB_STORE(p, x) _mm512_storeu_si512((void *)(p), (x))
+#define KMB_GATHER(w) _mm512_set_epi64((w)[7], (w)[6], (w)[5], (w)[4], (w)[3], (w)[2], (w)[1], (w)[0])
+#elif defined(__AVX2__)
+#define KECCAK_MB_LANES 4
+typedef __m256i kmb_word;
+#define KMB_XOR(a, b) _mm256_xor_si256((a), (b))
+#define KMB_ANDNOT(a, b) _mm256_andnot_si256((a), (b))
+#define KMB_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi64((x), (n)), _mm256_srli_epi64((x), 64 - (n)))
+#define KMB_SET1(v) _mm256_set1_epi64x((long long)(v))
+#define KMB_ZERO() _mm256_setzero_si256()
+#define KMB_STORE(p, x) _mm256_storeu_si256((void *)(p), (x))
+#define KMB_GATHER(w) _mm256_set_epi64x((w)[3], (w)[2], (w)[1], (w)[0])
+#else
+#define KECCAK_MB_LANES 1
+typedef uint64_t kmb_word;
+#define KMB_XOR(a, b) ((a) ^ (b))
+#define KMB_ANDNOT(a, b) (~(a) & (b))
+#define KMB_ROTL(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+#define KMB_SET1(v) ((uint64_t)(v))
+#define KMB_ZERO() ((uint64_t)0)
+#define KMB_STORE(p, x) (*(uint64_t *)(p) = (x))
+#define KMB_GATHER(w) ((w)[0])
+#endif
+
+#define KECCAK256_RATE 136
+
+// keccakf1600() on KECCAK_MB_LANES states at once.
+static inline void keccakf1600_mb(kmb_word st[25]) {
+    kmb_word bc[5];
+    for (int round = 0; round < 24; round++) {
+        // theta
+#pragma GCC unroll 5
+        for (int i = 0; i < 5; i++) {
+            bc[i] = KMB_XOR(KMB_XOR(KMB_XOR(st[i], st[i + 5]), KMB_XOR(st[i + 10], st[i + 15])), st[i + 20]);
+        }
+#pragma GCC unroll 5
+        for (int i = 0; i < 5; i++) {
+            kmb_word t = KMB_XOR(bc[(i + 4) % 5], KMB_ROTL(bc[(i + 1) % 5], 1));
+#pragma GCC unroll 5
+            for (int j = 0; j < 25; j += 5) {
+                st[j + i] = KMB_XOR(st[j + i], t);
+            }
+        }
+        // rho pi
+        kmb_word t = st[1];
+#pragma GCC unroll 24
+        for (int i = 0; i < 24; i++) {
+            int j = keccakf_piln[i];
+            kmb_word tmp = st[j];
+            st[j] = KMB_ROTL(t, keccakf_rotc[i]);
+            t = tmp;
+        }
+        // chi
+#pragma GCC unroll 5
+        for (int j = 0; j < 25; j += 5) {
+#pragma GCC unroll 5
+            for (int i = 0; i < 5; i++) {
+                bc[i] = st[j + i];
+            }
+#pragma GCC unroll 5
+            for (int i = 0; i < 5; i++) {
+                st[j + i] = KMB_XOR(st[j + i], KMB_ANDNOT(bc[(i + 1) % 5], bc[(i + 2) % 5]));
+            }
+        }
+        // iota
+        st[0] = KMB_XOR(st[0], KMB_SET1(keccakf_rndc[round]));
+    }
+}
+
+static inline uint64_t kmb_load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8); // little-endian hosts only, like the rest of the kernels
+    return (v);
+}
+
+// Absorb one rate block (KECCAK256_RATE bytes) of every lane.
+static inline void kmb_absorb(kmb_word st[25], const unsigned char *in[KECCAK_MB_LANES], uint64_t off) {
+    uint64_t w[KECCAK_MB_LANES];
+#pragma GCC unroll 17
+    for (int k = 0; k < KECCAK256_RATE / 8; k++) {
+        for (int l = 0; l < KECCAK_MB_LANES; l++) {
+            w[l] = kmb_load64(in[l] + off + 8 * k);
+        }
+        st[k] = KMB_XOR(st[k], KMB_GATHER(w));
+    }
+}
+
+// out[l] = keccak256(in[l][0, len)) for every lane.
+void KECCAK256_MB(const unsigned char *in[KECCAK_MB_LANES], uint64_t len, unsigned char *out[KECCAK_MB_LANES]) {
+    kmb_word st[25];
+    for (int k = 0; k < 25; k++) {
+        st[k] = KMB_ZERO();
+    }
+    uint64_t off = 0;
+    for (; off + KECCAK256_RATE <= len; off += KECCAK256_RATE) {
+        kmb_absorb(st, in, off);
+        keccakf1600_mb(st);
+    }
+
+    // the padded last block of every lane
+    unsigned char tail[KECCAK_MB_LANES][KECCAK256_RATE];
+    const unsigned char *tails[KECCAK_MB_LANES];
+    for (int l = 0; l < KECCAK_MB_LANES; l++) {
+        memset(tail[l], 0, KECCAK256_RATE);
+        memcpy(tail[l], in[l] + off, len - off);
+        tail[l][len - off] ^= KECCAK_PAD;
+        tail[l][KECCAK256_RATE - 1] ^= 0x80;
+        tails[l] = tail[l];
+    }
+    kmb_absorb(st, tails, 0);
+    keccakf1600_mb(st);
+
+    uint64_t words[4][KECCAK_MB_LANES];
+    for (int k = 0; k < 4; k++) {
+        KMB_STORE(words[k], st[k]);
+    }
+    for (int l = 0; l < KECCAK_MB_LANES; l++) {
+        for (int k = 0; k < 4; k++) {
+            memcpy(out[l] + 8 * k, &words[k][l], 8);
+        }
+    }
+}
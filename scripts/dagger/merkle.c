@@ -0,0 +1,139 @@
+/*
+ * MerkleLib.sol off chain.
+ *
+ * Leaves are keccak256 of each chunkSize piece of the data (the last one may
+ * be short); leaves past the end of the data are zero, not the hash of an
+ * empty chunk.  An inner node is keccak256(abi.encode(left, right)), i.e. the
+ * hash of the 64-byte concatenation.  A proof lists the sibling of the chunk's
+ * node at every level, bottom up.
+ *
+ * merkle_tree() keeps every level so that any number of proofs can be read
+ * from one tree; merkle_root() only needs the leaf level.  Include keccak.c
+ * first.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct merkle_tree {
+    unsigned bits;
+    // level l (0 = leaves) holds 1 << (bits - l) nodes starting at node[(2 << bits) - (2 << (bits - l))]
+    unsigned char (*node)[32];
+};
+
+static void merkle_leaves(const unsigned char *data, uint64_t len, uint64_t chunk_size, uint64_t chunks,
+                          unsigned char (*leaf)[32]) {
+    for (uint64_t i = 0; i < chunks; i++) {
+        uint64_t off = i * chunk_size;
+        if (off >= len) {
+            memset(leaf[i], 0, 32 * (chunks - i));
+            break;
+        }
+        uint64_t n = len - off < chunk_size ? len - off : chunk_size;
+        keccak256(data + off, n, leaf[i]);
+    }
+}
+
+// Hash n nodes pairwise into n / 2 parents; parent may alias node.
+static inline void merkle_level(unsigned char (*node)[32], uint64_t n, unsigned char (*parent)[32]) {
+    for (uint64_t i = 0; i < n / 2; i++) {
+        keccak256(node[2 * i], 64, parent[i]);
+    }
+}
+
+// MerkleLib.merkleRoot(); 0 on success, -1 if out of memory.
+int merkle_root(const void *data, uint64_t len, uint64_t chunk_size, unsigned chunk_bits, unsigned char *root) {
+    uint64_t n = 1ULL << chunk_bits;
+    unsigned char(*node)[32] = (unsigned char(*)[32])malloc(32 * n);
+    if (node == NULL) {
+        return (-1);
+    }
+    merkle_leaves((const unsigned char *)data, len, chunk_size, n, node);
+    for (; n > 1; n /= 2) {
+        merkle_level(node, n, node);
+    }
+    memcpy(root, node[0], 32);
+    free(node);
+    return (0);
+}
+
+// Tree height merkleRootWithMinTree() uses: the fewest levels that hold every chunk.
+unsigned merkle_min_bits(uint64_t len, uint64_t chunk_size) {
+    uint64_t n = (len + chunk_size - 1) / chunk_size;
+    unsigned bits = 0;
+    while ((1ULL << bits) < n) {
+        bits++;
+    }
+    return (bits);
+}
+
+// MerkleLib.merkleRootWithMinTree(); empty data has a zero root.
+int merkle_root_min_tree(const void *data, uint64_t len, uint64_t chunk_size, unsigned char *root) {
+    if (len == 0) {
+        memset(root, 0, 32);
+        return (0);
+    }
+    return (merkle_root(data, len, chunk_size, merkle_min_bits(len, chunk_size), root));
+}
+
+int merkle_tree_build(struct merkle_tree *t, const void *data, uint64_t len, uint64_t chunk_size,
+                      unsigned chunk_bits) {
+    uint64_t n = 1ULL << chunk_bits;
+    t->bits = chunk_bits;
+    t->node = (unsigned char(*)[32])malloc(32 * (2 * n - 1));
+    if (t->node == NULL) {
+        return (-1);
+    }
+    merkle_leaves((const unsigned char *)data, len, chunk_size, n, t->node);
+    for (unsigned char(*level)[32] = t->node; n > 1; level += n, n /= 2) {
+        merkle_level(level, n, level + n);
+    }
+    return (0);
+}
+
+void merkle_tree_free(struct merkle_tree *t) {
+    free(t->node);
+    t->node = NULL;
+}
+
+const unsigned char *merkle_tree_root(const struct merkle_tree *t) { return (t->node[(2ULL << t->bits) - 2]); }
+
+// MerkleLib.getProof(): t->bits sibling hashes into proof.
+void merkle_tree_proof(const struct merkle_tree *t, uint64_t chunk_idx, unsigned char *proof) {
+    uint64_t base = 0;
+    for (unsigned l = 0; l < t->bits; l++) {
+        memcpy(proof + 32 * l, t->node[base + (chunk_idx ^ 1)], 32);
+        base += 1ULL << (t->bits - l);
+        chunk_idx >>= 1;
+    }
+}
+
+// MerkleLib.calculateRootWithProof(); chunk_idx must be below 1 << bits.
+void merkle_root_with_proof(const unsigned char *data_hash, uint64_t chunk_idx, const unsigned char *proof,
+                            unsigned bits, unsigned char *root) {
+    unsigned char pair[64];
+    memcpy(root, data_hash, 32);
+    for (unsigned l = 0; l < bits; l++) {
+        if (chunk_idx % 2 == 0) {
+            memcpy(pair, root, 32);
+            memcpy(pair + 32, proof + 32 * l, 32);
+        } else {
+            memcpy(pair, proof + 32 * l, 32);
+            memcpy(pair + 32, root, 32);
+        }
+        keccak256(pair, 64, root);
+        chunk_idx /= 2;
+    }
+}
+
+// MerkleLib.verify(); 1 if the proof leads to root.
+int merkle_verify(const unsigned char *data_hash, uint64_t chunk_idx, const unsigned char *root,
+                  const unsigned char *proof, unsigned bits) {
+    unsigned char r[32];
+    if (bits < 64 && chunk_idx >= (1ULL << bits)) {
+        return (0);
+    }
+    merkle_root_with_proof(data_hash, chunk_idx, proof, bits, r);
+    return (memcmp(r, root, 32) == 0);
+}
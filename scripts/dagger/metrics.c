@@ -0,0 +1,453 @@
+/*
+ * Low-overhead runtime metrics with a Prometheus text exporter.
+ *
+ * Every thread that records anything gets its own block of counters and
+ * latency histograms (allocated on first use and pushed onto a lock-free list),
+ * so the hot path is a thread-local relaxed add.  The exporter sums the blocks
+ * with relaxed loads; nothing is ever locked.
+ *
+ * Histograms are HDR-style log-linear: values (nanoseconds) below 16 are exact
+ * and every power of two above is split into 16 sub-buckets, so any quantile
+ * is within ~6% up to 2^48 ns.  They are exported as Prometheus histograms
+ * with power-of-two buckets, plus p50/p90/p99/p99.9 computed from the fine
+ * buckets.
+ *
+ * metrics_start("file:/var/lib/node_exporter/dagger.prom", 1) rewrites the file
+ * (atomically, via rename) every second, for the node_exporter textfile
+ * collector; metrics_start("unix:/run/dagger.sock", 0) answers every
+ * connection on a unix socket with the current metrics (plain text, or an
+ * HTTP response if the client sent a GET, so `curl --unix-socket` works).
+ * A bare path means file:.  metrics_start_env() does the same from the
+ * DAGGER_METRICS environment variable.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+enum metric_counter {
+    METRIC_HASHES,
+    METRIC_DATASET_ITEMS,
+    METRIC_MASK_ITEMS,
+    METRIC_IO_READ_BYTES,
+    METRIC_IO_WRITE_BYTES,
+    METRIC_EPOCH_CHUNKS_DONE,
+    METRIC_ERRORS,
+    METRIC_COUNTERS
+};
+
+enum metric_gauge {
+    METRIC_EPOCH_CHUNKS_TOTAL,
+    METRIC_CACHE_BYTES,
+    METRIC_BUFFER_BYTES,
+    METRIC_GAUGES
+};
+
+enum metric_histogram {
+    METRIC_HASH_LATENCY,
+    METRIC_ITEM_LATENCY,
+    METRIC_MASK_LATENCY,
+    METRIC_IO_LATENCY,
+    METRIC_HISTOGRAMS
+};
+
+static const char *metric_counter_names[METRIC_COUNTERS][2] = {
+    {"dagger_hashes_total", "Hashimoto candidates evaluated."},
+    {"dagger_dataset_items_total", "Dataset items generated."},
+    {"dagger_mask_items_total", "64-byte pieces masked or synthesized."},
+    {"dagger_io_read_bytes_total", "Bytes read from shards or datasets."},
+    {"dagger_io_write_bytes_total", "Bytes written to shards or datasets."},
+    {"dagger_epoch_chunks_done_total", "Dataset or mask chunks durably written."},
+    {"dagger_errors_total", "Failed reads, writes or candidates."},
+};
+
+static const char *metric_gauge_names[METRIC_GAUGES][2] = {
+    {"dagger_epoch_chunks", "Chunks in the dataset or mask being built."},
+    {"dagger_cache_bytes", "Bytes of dagger cache held."},
+    {"dagger_buffer_bytes", "Bytes of I/O and chunk buffers held."},
+};
+
+static const char *metric_histogram_names[METRIC_HISTOGRAMS][2] = {
+    {"dagger_hash_latency_seconds", "Time to evaluate one hashimoto candidate."},
+    {"dagger_item_latency_seconds", "Time to generate one dataset item or chunk."},
+    {"dagger_mask_latency_seconds", "Time to mask one blob or chunk."},
+    {"dagger_io_latency_seconds", "Time from submitting a read or write to its completion."},
+};
+
+#define METRIC_SUB_BITS 4
+#define METRIC_SUB (1 << METRIC_SUB_BITS)
+#define METRIC_MAX_BITS 48
+#define METRIC_BUCKETS ((METRIC_MAX_BITS - METRIC_SUB_BITS + 1) * METRIC_SUB)
+
+struct metric_histogram_data {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[METRIC_BUCKETS];
+};
+
+struct metric_block {
+    uint64_t counters[METRIC_COUNTERS];
+    struct metric_histogram_data histograms[METRIC_HISTOGRAMS];
+    struct metric_block *next;
+};
+
+static struct metric_block *metric_blocks;
+static int64_t metric_gauges[METRIC_GAUGES];
+static __thread struct metric_block *metric_tls;
+// shared by the threads whose own block could not be allocated, so it is
+// updated with atomic adds instead of single-writer stores
+static struct metric_block metric_overflow;
+static int metric_overflow_linked;
+
+static struct metric_block *metric_block_get() {
+    struct metric_block *b = metric_tls;
+    if (__builtin_expect(b != NULL, 1)) {
+        return (b);
+    }
+    b = (struct metric_block *)calloc(1, sizeof(*b));
+    if (b == NULL) {
+        metric_tls = &metric_overflow;
+        if (__atomic_exchange_n(&metric_overflow_linked, 1, __ATOMIC_ACQ_REL)) {
+            return (metric_tls);
+        }
+        b = &metric_overflow;
+    }
+    b->next = __atomic_load_n(&metric_blocks, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&metric_blocks, &b->next, b, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    }
+    metric_tls = b;
+    return (b);
+}
+
+uint64_t metrics_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static inline void metric_bump(struct metric_block *b, uint64_t *c, uint64_t n) {
+    if (__builtin_expect(b == &metric_overflow, 0)) {
+        __atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
+void metrics_add(int counter, uint64_t n) {
+    struct metric_block *b = metric_block_get();
+    metric_bump(b, &b->counters[counter], n);
+}
+
+void metrics_set(int gauge, int64_t v) {
+    __atomic_store_n(&metric_gauges[gauge], v, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_add(int gauge, int64_t v) {
+    __atomic_fetch_add(&metric_gauges[gauge], v, __ATOMIC_RELAXED);
+}
+
+static inline unsigned metric_bucket(uint64_t v) {
+    if (v >= (1ULL << METRIC_MAX_BITS)) {
+        v = (1ULL << METRIC_MAX_BITS) - 1;
+    }
+    if (v < METRIC_SUB) {
+        return ((unsigned)v);
+    }
+    unsigned msb = 63 - __builtin_clzll(v);
+    return ((msb - METRIC_SUB_BITS + 1) * METRIC_SUB + ((v >> (msb - METRIC_SUB_BITS)) & (METRIC_SUB - 1)));
+}
+
+// Smallest value that lands in bucket b.
+static uint64_t metric_bucket_low(unsigned b) {
+    if (b < METRIC_SUB) {
+        return (b);
+    }
+    unsigned e = b / METRIC_SUB;
+    return ((uint64_t)(METRIC_SUB + b % METRIC_SUB) << (e - 1));
+}
+
+void metrics_observe(int histogram, uint64_t ns) {
+    struct metric_block *mb = metric_block_get();
+    struct metric_histogram_data *h = &mb->histograms[histogram];
+    unsigned b = metric_bucket(ns);
+    metric_bump(mb, &h->count, 1);
+    metric_bump(mb, &h->sum, ns);
+    metric_bump(mb, &h->buckets[b], 1);
+}
+
+// Observe the time since start (from metrics_now()) and return the current time.
+uint64_t metrics_observe_since(int histogram, uint64_t start) {
+    uint64_t now = metrics_now();
+    metrics_observe(histogram, now - start);
+    return (now);
+}
+
+static uint64_t metric_rss_bytes() {
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long long size, rss;
+    if (f == NULL) {
+        return (0);
+    }
+    int n = fscanf(f, "%llu %llu", &size, &rss);
+    fclose(f);
+    return (n == 2 ? rss * (uint64_t)sysconf(_SC_PAGESIZE) : 0);
+}
+
+// Render the merged metrics in Prometheus text format; returns a malloc'ed
+// string, or NULL if it cannot be allocated.  Safe to call from several threads.
+char *metrics_render() {
+    struct metric_histogram_data merged;
+    size_t cap = 65536, len = 0;
+    char *out = (char *)malloc(cap);
+    if (out == NULL) {
+        return (NULL);
+    }
+#define METRIC_PRINTF(...)                                                                                             \
+    do {                                                                                                               \
+        int n_ = snprintf(out + len, cap - len, __VA_ARGS__);                                                          \
+        if ((size_t)n_ >= cap - len) {                                                                                 \
+            cap = 2 * cap + n_;                                                                                        \
+            char *grown_ = (char *)realloc(out, cap);                                                                  \
+            if (grown_ == NULL) {                                                                                      \
+                free(out);                                                                                             \
+                return (NULL);                                                                                         \
+            }                                                                                                          \
+            out = grown_;                                                                                              \
+            n_ = snprintf(out + len, cap - len, __VA_ARGS__);                                                          \
+        }                                                                                                              \
+        len += n_;                                                                                                     \
+    } while (0)
+
+    struct metric_block *head = __atomic_load_n(&metric_blocks, __ATOMIC_ACQUIRE);
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        uint64_t v = 0;
+        for (struct metric_block *b = head; b != NULL; b = b->next) {
+            v += __atomic_load_n(&b->counters[c], __ATOMIC_RELAXED);
+        }
+        METRIC_PRINTF("# HELP %s %s\n# TYPE %s counter\n%s %llu\n", metric_counter_names[c][0],
+                      metric_counter_names[c][1], metric_counter_names[c][0], metric_counter_names[c][0],
+                      (unsigned long long)v);
+    }
+    for (int g = 0; g < METRIC_GAUGES; g++) {
+        METRIC_PRINTF("# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", metric_gauge_names[g][0], metric_gauge_names[g][1],
+                      metric_gauge_names[g][0], metric_gauge_names[g][0],
+                      (long long)__atomic_load_n(&metric_gauges[g], __ATOMIC_RELAXED));
+    }
+    METRIC_PRINTF("# HELP dagger_resident_bytes Resident set size of the process.\n"
+                  "# TYPE dagger_resident_bytes gauge\ndagger_resident_bytes %llu\n",
+                  (unsigned long long)metric_rss_bytes());
+
+    for (int hi = 0; hi < METRIC_HISTOGRAMS; hi++) {
+        memset(&merged, 0, sizeof(merged));
+        for (struct metric_block *b = head; b != NULL; b = b->next) {
+            struct metric_histogram_data *h = &b->histograms[hi];
+            merged.count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+            merged.sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+            for (unsigned k = 0; k < METRIC_BUCKETS; k++) {
+                merged.buckets[k] += __atomic_load_n(&h->buckets[k], __ATOMIC_RELAXED);
+            }
+        }
+        // the buckets are read one by one, so use their total as the count
+        uint64_t total = 0;
+        for (unsigned k = 0; k < METRIC_BUCKETS; k++) {
+            total += merged.buckets[k];
+        }
+        const char *name = metric_histogram_names[hi][0];
+        METRIC_PRINTF("# HELP %s %s\n# TYPE %s histogram\n", name, metric_histogram_names[hi][1], name);
+        uint64_t cumulative = 0;
+        unsigned k = 0;
+        // power-of-two bucket bounds from 1us to ~78h coincide with HDR bucket edges
+        for (unsigned bits = 10; bits <= METRIC_MAX_BITS; bits++) {
+            while (k < METRIC_BUCKETS && metric_bucket_low(k) < (1ULL << bits)) {
+                cumulative += merged.buckets[k++];
+            }
+            METRIC_PRINTF("%s_bucket{le=\"%.9g\"} %llu\n", name, (double)(1ULL << bits) / 1e9,
+                          (unsigned long long)cumulative);
+        }
+        METRIC_PRINTF("%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n", name, (unsigned long long)total,
+                      name, merged.sum / 1e9, name, (unsigned long long)total);
+
+        static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        METRIC_PRINTF("# HELP %s_quantile %s\n# TYPE %s_quantile gauge\n", name, metric_histogram_names[hi][1], name);
+        for (unsigned q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            uint64_t rank = (uint64_t)(quantiles[q] * total), seen = 0;
+            unsigned b = 0;
+            while (b < METRIC_BUCKETS - 1 && seen + merged.buckets[b] <= rank) {
+                seen += merged.buckets[b++];
+            }
+            double v = total == 0 ? 0 : (metric_bucket_low(b) + metric_bucket_low(b + 1)) / 2e9;
+            METRIC_PRINTF("%s_quantile{quantile=\"%g\"} %.9g\n", name, quantiles[q], v);
+        }
+    }
+#undef METRIC_PRINTF
+    return (out);
+}
+
+// Write the metrics to path through a temporary file and rename().
+int metrics_write_file(const char *path) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    char *text = metrics_render();
+    if (text == NULL) {
+        return (-1);
+    }
+    size_t len = strlen(text);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ret = -1;
+    if (fd >= 0 && write(fd, text, len) == (ssize_t)len && close(fd) == 0) {
+        ret = rename(tmp, path);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    free(text);
+    return (ret);
+}
+
+struct metrics_exporter {
+    pthread_t thread;
+    int running;
+    int stop;
+    int listen_fd;
+    char path[108];
+    double interval;
+};
+
+static struct metrics_exporter metric_exporter;
+
+static void metrics_serve(int fd) {
+    char req[1024];
+    struct pollfd p = {fd, POLLIN, 0};
+    ssize_t n = 0;
+    // a client that sends nothing within 50 ms just gets the plain text
+    if (poll(&p, 1, 50) > 0) {
+        n = read(fd, req, sizeof(req) - 1);
+    }
+    char *text = metrics_render();
+    if (text == NULL) {
+        close(fd);
+        return;
+    }
+    size_t len = strlen(text);
+    if (n >= 4 && memcmp(req, "GET ", 4) == 0) {
+        char header[256];
+        int hn = snprintf(header, sizeof(header),
+                          "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                          len);
+        if (write(fd, header, hn) != hn) {
+            len = 0;
+        }
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = write(fd, text + done, len - done);
+        if (w <= 0) {
+            break;
+        }
+        done += w;
+    }
+    free(text);
+    close(fd);
+}
+
+static void *metrics_exporter_thread(void *arg) {
+    struct metrics_exporter *e = (struct metrics_exporter *)arg;
+    while (!__atomic_load_n(&e->stop, __ATOMIC_ACQUIRE)) {
+        if (e->listen_fd >= 0) {
+            struct pollfd p = {e->listen_fd, POLLIN, 0};
+            if (poll(&p, 1, 200) > 0) {
+                int fd = accept(e->listen_fd, NULL, NULL);
+                if (fd >= 0) {
+                    metrics_serve(fd);
+                }
+            }
+            continue;
+        }
+        metrics_write_file(e->path);
+        // sleep in short steps so metrics_stop() returns promptly
+        for (double slept = 0; slept < e->interval && !__atomic_load_n(&e->stop, __ATOMIC_ACQUIRE); slept += 0.1) {
+            usleep(100000);
+        }
+    }
+    if (e->listen_fd < 0) {
+        metrics_write_file(e->path); // final values
+    }
+    return (NULL);
+}
+
+// Start exporting to "file:PATH", "unix:PATH" or PATH (a file).  interval is
+// the file rewrite period in seconds.  Returns 0 or -1.
+int metrics_start(const char *target, double interval) {
+    struct metrics_exporter *e = &metric_exporter;
+    if (e->running || target == NULL || *target == '\0') {
+        return (-1);
+    }
+    memset(e, 0, sizeof(*e));
+    e->listen_fd = -1;
+    e->interval = interval > 0 ? interval : 1;
+    if (strncmp(target, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(target + 5) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "metrics socket path too long: %s\n", target + 5);
+            return (-1);
+        }
+        strcpy(addr.sun_path, target + 5);
+        unlink(addr.sun_path);
+        e->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (e->listen_fd < 0 || bind(e->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(e->listen_fd, 16) != 0) {
+            fprintf(stderr, "cannot listen on %s: %s\n", addr.sun_path, strerror(errno));
+            if (e->listen_fd >= 0) {
+                close(e->listen_fd);
+            }
+            return (-1);
+        }
+        strcpy(e->path, addr.sun_path);
+    } else {
+        const char *path = strncmp(target, "file:", 5) == 0 ? target + 5 : target;
+        if (strlen(path) >= sizeof(e->path) - 4) {
+            fprintf(stderr, "metrics file path too long: %s\n", path);
+            return (-1);
+        }
+        strcpy(e->path, path);
+    }
+    if (pthread_create(&e->thread, NULL, metrics_exporter_thread, e) != 0) {
+        return (-1);
+    }
+    e->running = 1;
+    return (0);
+}
+
+int metrics_start_env() {
+    const char *target = getenv("DAGGER_METRICS");
+    const char *interval = getenv("DAGGER_METRICS_INTERVAL");
+    if (target == NULL) {
+        return (-1);
+    }
+    return (metrics_start(target, interval ? atof(interval) : 1));
+}
+
+// Stop the exporter; a file target gets one last write.
+void metrics_stop() {
+    struct metrics_exporter *e = &metric_exporter;
+    if (!e->running) {
+        return;
+    }
+    __atomic_store_n(&e->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(e->thread, NULL);
+    if (e->listen_fd >= 0) {
+        close(e->listen_fd);
+        unlink(e->path);
+    }
+    e->running = 0;
+}
@@ -0,0 +1,859 @@
+/*
+ * mine() calldata straight from the mapped shard file.
+ *
+ *   gcc -O3 -march=native mine_calldata.c -o mine_calldata
+ *   ./mine_calldata verify
+ *   ./mine_calldata encode --data shard.masked --max-kv-size-bits 17 --chunk-size-bits 12 --shard-entry-bits 5 \
+ *       --init-hash 0x... --miner 0x... --mined-ts 1700000000 --nonce 12345 --output mine.bin
+ *   ./mine_calldata encode --contract minable --data shard.masked --max-kv-size-bits 17 --kvs 3,17,5 ...
+ *   ./mine_calldata bench
+ *
+ * DKVDaggerHashimoto.mine(uint256,uint256,address,uint256,uint256,bytes32[][],bytes[])
+ * and DecentralizedKVMinable.mine(uint256,uint256,address,uint256,uint256,bytes[])
+ * carry randomChecks chunks or whole blobs: hundreds of KB that are already in
+ * the shard file.  A struct calldata is the ABI encoding as an iovec list:
+ * only the selector, head words, array lengths, offsets and padding live in
+ * its own buffer; every maskedData element points into the mmap()ed shard
+ * and every proof into the caller's proof words.  writev() then hands the
+ * pages to the kernel without another copy, calldata_keccak() hashes (and
+ * prices, EIP-2028) the same list in one pass, and calldata_write_hex()
+ * streams the 0x form a JSON-RPC request needs through a small buffer.
+ *
+ * The data file is laid out as storage_hashimoto_async.cpp reads it: the
+ * masked blobs of shards [startShardId, startShardId + 2^shardLenBits) back to
+ * back, maxKvSize bytes per kv.  For DKVDaggerHashimoto, mine_replay_merkle()
+ * walks the _hashimotoMerkleProof chain of the winning nonce over the mapping
+ * (hashing hash0 and the chunk in place) and mine_merkle_proofs() builds the
+ * chunk proofs from the masked blobs, as TestSystemContract.checkDaggerDataWithProof
+ * checks them.  DecentralizedKVMinable picks its blobs through the hash0
+ * precompile, so its kv indices come from the caller.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "keccak.c"
+#include "u256.c"
+#include "merkle.c"
+
+#define MINE_DAGGER_SIG "mine(uint256,uint256,address,uint256,uint256,bytes32[][],bytes[])"
+#define MINE_MINABLE_SIG "mine(uint256,uint256,address,uint256,uint256,bytes[])"
+
+struct calldata {
+    struct iovec *iov;
+    size_t niov, iov_cap;
+    unsigned char *hdr; // selector, head words, lengths and offsets; never reallocated
+    size_t hdr_len, hdr_cap;
+    uint64_t size;
+};
+
+// What mine() takes besides the arrays.
+struct mine_call {
+    uint64_t start_shard_id;
+    uint64_t shard_len_bits;
+    unsigned char miner[20];
+    uint64_t mined_ts;
+    uint64_t nonce;
+    unsigned checks;
+    const unsigned char **data; // maskedData[i], data_len[i] bytes
+    const uint64_t *data_len;
+    const unsigned char **proofs; // proofsDim2[i], proof_words[i] 32-byte words (dagger only)
+    const unsigned *proof_words;
+};
+
+static const unsigned char calldata_zero[32];
+
+void calldata_free(struct calldata *c) {
+    free(c->iov);
+    free(c->hdr);
+    memset(c, 0, sizeof(*c));
+}
+
+static int calldata_alloc(struct calldata *c, size_t iov_cap, size_t hdr_cap) {
+    memset(c, 0, sizeof(*c));
+    c->iov = malloc(iov_cap * sizeof(struct iovec));
+    c->hdr = malloc(hdr_cap);
+    c->iov_cap = iov_cap;
+    c->hdr_cap = hdr_cap;
+    if (c->iov == NULL || c->hdr == NULL) {
+        calldata_free(c);
+        return (-1);
+    }
+    return (0);
+}
+
+// len header bytes, zeroed; merged into the previous iovec when that one ends at the header tail.
+static unsigned char *calldata_header(struct calldata *c, size_t len) {
+    unsigned char *p = c->hdr + c->hdr_len;
+    memset(p, 0, len);
+    struct iovec *last = c->niov > 0 ? &c->iov[c->niov - 1] : NULL;
+    if (last != NULL && (unsigned char *)last->iov_base + last->iov_len == p) {
+        last->iov_len += len;
+    } else {
+        c->iov[c->niov++] = (struct iovec){p, len};
+    }
+    c->hdr_len += len;
+    c->size += len;
+    return (p);
+}
+
+static void calldata_word_u64(unsigned char *w, uint64_t v) {
+    for (int k = 0; k < 8; k++) {
+        w[31 - k] = (unsigned char)(v >> (8 * k));
+    }
+}
+
+static void calldata_put_u64(struct calldata *c, uint64_t v) { calldata_word_u64(calldata_header(c, 32), v); }
+
+// A reference to len bytes of the caller's memory, zero padded to a word.
+static void calldata_ref(struct calldata *c, const void *p, uint64_t len) {
+    if (len > 0) {
+        c->iov[c->niov++] = (struct iovec){(void *)p, len};
+        c->size += len;
+    }
+    if (len % 32 != 0) {
+        c->iov[c->niov++] = (struct iovec){(void *)calldata_zero, 32 - len % 32};
+        c->size += 32 - len % 32;
+    }
+}
+
+static uint64_t calldata_pad(uint64_t len) { return ((len + 31) / 32 * 32); }
+
+void calldata_selector(const char *sig, unsigned char *out) {
+    unsigned char h[32];
+    keccak256(sig, strlen(sig), h);
+    memcpy(out, h, 4);
+}
+
+// Selector and the five static arguments; returns the head, whose offset words are filled in later.
+static unsigned char *calldata_head(struct calldata *c, const char *sig, const struct mine_call *m, unsigned words) {
+    calldata_selector(sig, calldata_header(c, 4));
+    unsigned char *head = calldata_header(c, 32 * words);
+    calldata_word_u64(head, m->start_shard_id);
+    calldata_word_u64(head + 32, m->shard_len_bits);
+    memcpy(head + 64 + 12, m->miner, 20);
+    calldata_word_u64(head + 96, m->mined_ts);
+    calldata_word_u64(head + 128, m->nonce);
+    return (head);
+}
+
+// bytes[] maskedData.
+static void calldata_bytes_array(struct calldata *c, const struct mine_call *m) {
+    unsigned n = m->checks;
+    uint64_t size = 32 + 32 * (uint64_t)n;
+    calldata_put_u64(c, n);
+    unsigned char *offs = calldata_header(c, 32 * (size_t)n);
+    for (unsigned i = 0; i < n; i++) {
+        calldata_word_u64(offs + 32 * i, size - 32);
+        calldata_put_u64(c, m->data_len[i]);
+        calldata_ref(c, m->data[i], m->data_len[i]);
+        size += 32 + calldata_pad(m->data_len[i]);
+    }
+}
+
+// DKVDaggerHashimoto.mine(); -1 if out of memory.
+int calldata_encode_dagger(struct calldata *c, const struct mine_call *m) {
+    unsigned n = m->checks;
+    // header bytes: head words, two array lengths, 2n offsets, n proof and n data lengths;
+    // iovecs: a header, a proof, a header, data and padding per check
+    if (calldata_alloc(c, 5 * (size_t)n + 2, 4 + 32 * (9 + 4 * (size_t)n)) != 0) {
+        return (-1);
+    }
+    unsigned char *head = calldata_head(c, MINE_DAGGER_SIG, m, 7);
+    uint64_t size = 32 + 32 * (uint64_t)n;
+    calldata_word_u64(head + 160, 7 * 32);
+    calldata_put_u64(c, n);
+    unsigned char *offs = calldata_header(c, 32 * (size_t)n);
+    for (unsigned i = 0; i < n; i++) {
+        calldata_word_u64(offs + 32 * i, size - 32);
+        calldata_put_u64(c, m->proof_words[i]);
+        calldata_ref(c, m->proofs[i], 32 * (uint64_t)m->proof_words[i]);
+        size += 32 + 32 * (uint64_t)m->proof_words[i];
+    }
+    calldata_word_u64(head + 192, 7 * 32 + size);
+    calldata_bytes_array(c, m);
+    return (0);
+}
+
+// DecentralizedKVMinable.mine(); -1 if out of memory.
+int calldata_encode_minable(struct calldata *c, const struct mine_call *m) {
+    unsigned n = m->checks;
+    if (calldata_alloc(c, 3 * (size_t)n + 1, 4 + 32 * (7 + 2 * (size_t)n)) != 0) {
+        return (-1);
+    }
+    unsigned char *head = calldata_head(c, MINE_MINABLE_SIG, m, 6);
+    calldata_word_u64(head + 160, 6 * 32);
+    calldata_bytes_array(c, m);
+    return (0);
+}
+
+// keccak256 of the calldata and its EIP-2028 gas (4 per zero byte, 16 per other byte).
+void calldata_keccak(const struct calldata *c, unsigned char *hash, uint64_t *gas) {
+    KECCAK_CTX ctx;
+    uint64_t zeros = 0;
+    keccak_init(&ctx, 32);
+    for (size_t i = 0; i < c->niov; i++) {
+        const unsigned char *p = c->iov[i].iov_base;
+        uint64_t len = c->iov[i].iov_len;
+        keccak_update(&ctx, p, len);
+        if (gas != NULL) {
+            for (uint64_t k = 0; k < len; k++) {
+                zeros += p[k] == 0;
+            }
+        }
+    }
+    keccak_final(&ctx, hash, 32, KECCAK_PAD);
+    if (gas != NULL) {
+        *gas = 4 * zeros + 16 * (c->size - zeros);
+    }
+}
+
+// The calldata in one buffer of c->size bytes, for callers that need it contiguous.
+void calldata_flatten(const struct calldata *c, unsigned char *out) {
+    for (size_t i = 0; i < c->niov; i++) {
+        memcpy(out, c->iov[i].iov_base, c->iov[i].iov_len);
+        out += c->iov[i].iov_len;
+    }
+}
+
+// Everything to fd, IOV_MAX iovecs per writev() and resuming after short writes.
+int calldata_writev(const struct calldata *c, int fd) {
+    struct iovec part[IOV_MAX];
+    size_t i = 0;
+    uint64_t skip = 0; // bytes of iov[i] already written
+    while (i < c->niov) {
+        size_t n = 0;
+        for (; n < IOV_MAX && i + n < c->niov; n++) {
+            part[n] = c->iov[i + n];
+        }
+        part[0].iov_base = (unsigned char *)part[0].iov_base + skip;
+        part[0].iov_len -= skip;
+        ssize_t w = writev(fd, part, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (-1);
+        }
+        uint64_t left = w + skip;
+        while (i < c->niov && left >= c->iov[i].iov_len) {
+            left -= c->iov[i].iov_len;
+            i++;
+        }
+        skip = left;
+    }
+    return (0);
+}
+
+// "0x" and the calldata in hex, through a 64 KB buffer.
+int calldata_write_hex(const struct calldata *c, FILE *f) {
+    static const char digits[] = "0123456789abcdef";
+    char buf[65536];
+    size_t used = 0;
+    if (fputs("0x", f) == EOF) {
+        return (-1);
+    }
+    for (size_t i = 0; i < c->niov; i++) {
+        const unsigned char *p = c->iov[i].iov_base;
+        for (uint64_t k = 0; k < c->iov[i].iov_len; k++) {
+            buf[used++] = digits[p[k] >> 4];
+            buf[used++] = digits[p[k] & 15];
+            if (used == sizeof(buf)) {
+                if (fwrite(buf, 1, used, f) != used) {
+                    return (-1);
+                }
+                used = 0;
+            }
+        }
+    }
+    return (fwrite(buf, 1, used, f) == used ? 0 : -1);
+}
+
+struct mine_shard {
+    const unsigned char *base; // PROT_READ mapping of the whole file
+    uint64_t size;
+    unsigned max_kv_size_bits;
+    unsigned chunk_size_bits;
+    unsigned shard_entry_bits;
+    unsigned shard_len_bits;
+    uint64_t start_shard_id;
+};
+
+int mine_shard_open(struct mine_shard *s, const char *path) {
+    s->base = NULL;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return (-1);
+    }
+    uint64_t need = 1ULL << (s->shard_entry_bits + s->shard_len_bits + s->max_kv_size_bits);
+    if ((uint64_t)st.st_size < need) {
+        fprintf(stderr, "%s must hold %llu bytes of masked blobs\n", path, (unsigned long long)need);
+        close(fd);
+        return (-1);
+    }
+    void *p = mmap(NULL, need, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    s->base = p;
+    s->size = need;
+    return (0);
+}
+
+void mine_shard_close(struct mine_shard *s) {
+    if (s->base != NULL) {
+        munmap((void *)s->base, s->size);
+    }
+    s->base = NULL;
+}
+
+// Masked blob of kv parent (relative to the first kv of startShardId).
+static inline const unsigned char *mine_shard_blob(const struct mine_shard *s, uint64_t parent) {
+    return (s->base + (parent << s->max_kv_size_bits));
+}
+
+// hash0 = keccak256(abi.encode(hash0, miner, minedTs, nonce)) as in _mine().
+void mine_hash0(const unsigned char *init_hash, const unsigned char *miner, uint64_t mined_ts, uint64_t nonce,
+                unsigned char *hash0) {
+    unsigned char enc[128];
+    memset(enc, 0, sizeof(enc));
+    memcpy(enc, init_hash, 32);
+    memcpy(enc + 32 + 12, miner, 20);
+    calldata_word_u64(enc + 64, mined_ts);
+    calldata_word_u64(enc + 96, nonce);
+    keccak256(enc, sizeof(enc), hash0);
+}
+
+/*
+ * The _hashimotoMerkleProof chain from hash0: for every check, the parent
+ * (kv relative to the file, chunk) it reads and a pointer to that chunk in the
+ * mapping.  hash receives the final hash0.  Like storage_hashimoto_async.cpp
+ * it hashes exactly the chunk after hash0.
+ */
+void mine_replay_merkle(const struct mine_shard *s, const unsigned char *hash0, unsigned checks, uint64_t *kv,
+                        uint64_t *chunk, const unsigned char **data, unsigned char *hash) {
+    unsigned chunk_len_bits = s->max_kv_size_bits - s->chunk_size_bits;
+    unsigned rows_bits = s->shard_entry_bits + s->shard_len_bits + chunk_len_bits;
+    uint64_t mask = rows_bits >= 64 ? UINT64_MAX : (1ULL << rows_bits) - 1;
+    unsigned char h[32];
+    memcpy(h, hash0, 32);
+    for (unsigned i = 0; i < checks; i++) {
+        uint64_t parent = u256_from_be(h).w[0] & mask;
+        kv[i] = parent >> chunk_len_bits;
+        chunk[i] = parent & ((1ULL << chunk_len_bits) - 1);
+        data[i] = mine_shard_blob(s, kv[i]) + (chunk[i] << s->chunk_size_bits);
+        KECCAK_CTX ctx;
+        keccak_init(&ctx, 32);
+        keccak_update(&ctx, h, 32);
+        keccak_update(&ctx, data[i], 1ULL << s->chunk_size_bits);
+        keccak_final(&ctx, h, 32, KECCAK_PAD);
+    }
+    memcpy(hash, h, 32);
+}
+
+/*
+ * Merkle proofs of the chunks over their masked blobs, chunk_len_bits words
+ * each, into proofs (checks * chunk_len_bits words).  The tree of a kv read by
+ * several checks is built once, at its first check, and proves all of them.
+ * -1 if out of memory.
+ */
+int mine_merkle_proofs(const struct mine_shard *s, unsigned checks, const uint64_t *kv, const uint64_t *chunk,
+                       unsigned char *proofs) {
+    unsigned bits = s->max_kv_size_bits - s->chunk_size_bits;
+    for (unsigned i = 0; i < checks; i++) {
+        unsigned j = 0;
+        while (j < i && kv[j] != kv[i]) {
+            j++;
+        }
+        if (j < i) {
+            continue; // proved with the tree of check j
+        }
+        struct merkle_tree t = {0, NULL};
+        if (merkle_tree_build(&t, mine_shard_blob(s, kv[i]), 1ULL << s->max_kv_size_bits, 1ULL << s->chunk_size_bits,
+                              bits) != 0) {
+            return (-1);
+        }
+        for (unsigned k = i; k < checks; k++) {
+            if (kv[k] == kv[i]) {
+                merkle_tree_proof(&t, chunk[k], proofs + 32 * (uint64_t)bits * k);
+            }
+        }
+        merkle_tree_free(&t);
+    }
+    return (0);
+}
+
+#ifndef DAGGER_NO_MAIN
+static int parse_hex(const char *hex, unsigned char *out, int len) {
+    if (strncmp(hex, "0x", 2) == 0) {
+        hex += 2;
+    }
+    if ((int)strlen(hex) != 2 * len) {
+        return (0);
+    }
+    for (int i = 0; i < len; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) {
+            return (0);
+        }
+        out[i] = v;
+    }
+    return (1);
+}
+
+static void print_hex(FILE *f, const unsigned char *p, int len) {
+    for (int i = 0; i < len; i++) {
+        fprintf(f, "%02x", p[i]);
+    }
+}
+
+struct tool_options {
+    int minable;
+    const char *data;
+    const char *output;
+    const char *kvs;
+    struct mine_shard shard;
+    unsigned random_checks;
+    unsigned char init_hash[32];
+    unsigned char miner[20];
+    uint64_t mined_ts;
+    uint64_t nonce;
+};
+
+static int tool_encode(struct tool_options *o) {
+    struct mine_shard *s = &o->shard;
+    unsigned n = o->random_checks, bits = s->max_kv_size_bits - s->chunk_size_bits;
+    uint64_t *kv = calloc(n, sizeof(uint64_t)), *chunk = calloc(n, sizeof(uint64_t));
+    uint64_t *len = calloc(n, sizeof(uint64_t));
+    const unsigned char **data = calloc(n, sizeof(unsigned char *)), **proofs = calloc(n, sizeof(unsigned char *));
+    unsigned *words = calloc(n, sizeof(unsigned));
+    unsigned char *proof_buf = calloc((size_t)n * (bits > 0 ? bits : 1), 32);
+    unsigned char hash0[32], hash[32];
+    struct calldata c;
+    int ret = 1;
+    s->base = NULL;
+    if (kv == NULL || chunk == NULL || len == NULL || data == NULL || proofs == NULL || words == NULL ||
+        proof_buf == NULL) {
+        fprintf(stderr, "out of memory\n");
+        goto out;
+    }
+    if (mine_shard_open(s, o->data) != 0) {
+        goto out;
+    }
+    struct mine_call m = {s->start_shard_id, s->shard_len_bits, {0}, o->mined_ts, o->nonce, n, data, len, proofs, words};
+    memcpy(m.miner, o->miner, 20);
+
+    if (o->minable) {
+        // kv indices as the contract numbers them
+        const char *p = o->kvs;
+        uint64_t kv_base = s->start_shard_id << s->shard_entry_bits;
+        for (unsigned i = 0; i < n; i++) {
+            char *end;
+            uint64_t k = strtoull(p, &end, 0);
+            if (end == p || k < kv_base || k - kv_base >= (1ULL << (s->shard_entry_bits + s->shard_len_bits)) ||
+                (*end != (i + 1 < n ? ',' : 0))) {
+                fprintf(stderr, "--kvs needs %u kv indices of the mined shards, comma separated\n", n);
+                goto out;
+            }
+            data[i] = mine_shard_blob(s, k - kv_base);
+            len[i] = 1ULL << s->max_kv_size_bits;
+            p = end + 1;
+        }
+        if (calldata_encode_minable(&c, &m) != 0) {
+            goto out;
+        }
+    } else {
+        mine_hash0(o->init_hash, o->miner, o->mined_ts, o->nonce, hash0);
+        mine_replay_merkle(s, hash0, n, kv, chunk, data, hash);
+        if (mine_merkle_proofs(s, n, kv, chunk, proof_buf) != 0) {
+            goto out;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            len[i] = 1ULL << s->chunk_size_bits;
+            proofs[i] = proof_buf + 32 * (uint64_t)bits * i;
+            words[i] = bits;
+        }
+        fprintf(stderr, "hash 0x");
+        print_hex(stderr, hash, 32);
+        fprintf(stderr, "\n");
+        if (calldata_encode_dagger(&c, &m) != 0) {
+            goto out;
+        }
+    }
+
+    uint64_t gas;
+    unsigned char digest[32];
+    calldata_keccak(&c, digest, &gas);
+    if (o->output != NULL) {
+        int fd = open(o->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = fd < 0 || calldata_writev(&c, fd) != 0;
+        if (fd >= 0 && close(fd) != 0) {
+            err = 1;
+        }
+        if (err) {
+            fprintf(stderr, "cannot write %s: %s\n", o->output, strerror(errno));
+            calldata_free(&c);
+            goto out;
+        }
+    } else if (calldata_write_hex(&c, stdout) != 0 || printf("\n") < 0) {
+        calldata_free(&c);
+        goto out;
+    }
+    fprintf(stderr, "calldata %llu bytes in %zu pieces, %zu header bytes copied, gas %llu, keccak 0x",
+            (unsigned long long)c.size, c.niov, c.hdr_len, (unsigned long long)gas);
+    print_hex(stderr, digest, 32);
+    fprintf(stderr, "\n");
+    calldata_free(&c);
+    ret = 0;
+out:
+    mine_shard_close(s);
+    free(kv);
+    free(chunk);
+    free(len);
+    free(data);
+    free(proofs);
+    free(words);
+    free(proof_buf);
+    return (ret);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+static uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+// The straightforward encoder: every part copied into one buffer, word by word.
+static unsigned char *naive_word(unsigned char *p, uint64_t v) {
+    memset(p, 0, 32);
+    calldata_word_u64(p, v);
+    return (p + 32);
+}
+
+static unsigned char *naive_bytes(unsigned char *p, const unsigned char *data, uint64_t len) {
+    p = naive_word(p, len);
+    memset(p, 0, calldata_pad(len));
+    memcpy(p, data, len);
+    return (p + calldata_pad(len));
+}
+
+static uint64_t naive_encode(const struct mine_call *m, int dagger, unsigned char *out) {
+    unsigned char *p = out, *head;
+    calldata_selector(dagger ? MINE_DAGGER_SIG : MINE_MINABLE_SIG, p);
+    p += 4;
+    head = p;
+    p = naive_word(p, m->start_shard_id);
+    p = naive_word(p, m->shard_len_bits);
+    memset(p, 0, 32);
+    memcpy(p + 12, m->miner, 20);
+    p = naive_word(p + 32, m->mined_ts);
+    p = naive_word(p, m->nonce);
+    unsigned char *offsets = p;
+    p += 32 * (dagger ? 2 : 1);
+    if (dagger) {
+        naive_word(offsets, p - head);
+        offsets += 32;
+        unsigned char *base = p = naive_word(p, m->checks);
+        unsigned char *inner = p + 32 * m->checks;
+        for (unsigned i = 0; i < m->checks; i++) {
+            naive_word(base + 32 * i, inner - base);
+            inner = naive_word(inner, m->proof_words[i]);
+            memcpy(inner, m->proofs[i], 32 * m->proof_words[i]);
+            inner += 32 * m->proof_words[i];
+        }
+        p = inner;
+    }
+    naive_word(offsets, p - head);
+    unsigned char *base = p = naive_word(p, m->checks);
+    unsigned char *inner = p + 32 * m->checks;
+    for (unsigned i = 0; i < m->checks; i++) {
+        naive_word(base + 32 * i, inner - base);
+        inner = naive_bytes(inner, m->data[i], m->data_len[i]);
+    }
+    return (inner - out);
+}
+
+int self_verify() {
+    int ok = 1;
+    unsigned char sel[4], hash[32], want[32];
+    calldata_selector("transfer(address,uint256)", sel);
+    ok &= check("selector", memcmp(sel, "\xa9\x05\x9c\xbb", 4) == 0);
+
+    // a mapped shard of 2^3 kvs of 4 KB with 256-byte chunks
+    struct mine_shard s = {NULL, 0, 12, 8, 3, 0, 5};
+    s.size = 1ULL << (s.shard_entry_bits + s.max_kv_size_bits);
+    unsigned char *file = malloc(s.size);
+    uint64_t rng = 1;
+    for (uint64_t k = 0; k < s.size; k++) {
+        file[k] = splitmix64(&rng) % 3 == 0 ? 0 : (unsigned char)splitmix64(&rng);
+    }
+    s.base = file;
+
+    enum { CHECKS = 9 };
+    uint64_t kv[CHECKS], chunk[CHECKS], len[CHECKS];
+    const unsigned char *data[CHECKS], *proofs[CHECKS];
+    unsigned words[CHECKS], bits = s.max_kv_size_bits - s.chunk_size_bits;
+    unsigned char proof_buf[CHECKS * 4 * 32], init_hash[32] = {1, 2, 3}, hash0[32];
+    struct mine_call m = {s.start_shard_id, s.shard_len_bits, {0xde, 0xad}, 1700000000, 42, CHECKS,
+                          data, len, proofs, words};
+    mine_hash0(init_hash, m.miner, m.mined_ts, m.nonce, hash0);
+    mine_replay_merkle(&s, hash0, CHECKS, kv, chunk, data, hash);
+
+    // the chain with every chunk copied next to hash0
+    unsigned char buf[32 + 256];
+    memcpy(want, hash0, 32);
+    for (unsigned i = 0; i < CHECKS; i++) {
+        uint64_t parent = u256_from_be(want).w[0] & ((1ULL << (s.shard_entry_bits + bits)) - 1);
+        memcpy(buf, want, 32);
+        memcpy(buf + 32, file + parent * 256, 256);
+        keccak256(buf, sizeof(buf), want);
+        ok &= check("replay chunk", data[i] == file + parent * 256);
+    }
+    ok &= check("replay hash", memcmp(hash, want, 32) == 0);
+
+    // proofs lead to the root of each blob; one kv read twice keeps both proofs
+    kv[CHECKS - 1] = kv[0];
+    chunk[CHECKS - 1] = chunk[0] ^ 1;
+    data[CHECKS - 1] = mine_shard_blob(&s, kv[0]) + (chunk[CHECKS - 1] << s.chunk_size_bits);
+    ok &= check("mine_merkle_proofs", mine_merkle_proofs(&s, CHECKS, kv, chunk, proof_buf) == 0);
+    for (unsigned i = 0; i < CHECKS; i++) {
+        unsigned char root[32], leaf[32];
+        merkle_root(mine_shard_blob(&s, kv[i]), 4096, 256, bits, root);
+        keccak256(data[i], 256, leaf);
+        ok &= check("proof", merkle_verify(leaf, chunk[i], root, proof_buf + 32 * bits * i, bits));
+        len[i] = 256;
+        proofs[i] = proof_buf + 32 * bits * i;
+        words[i] = i % 3 == 0 ? 0 : bits; // empty proofs encode too
+    }
+
+    // both layouts, with odd lengths for padding, against the copying encoder
+    unsigned char *flat = malloc(1 << 20), *naive = malloc(1 << 20);
+    for (int dagger = 0; dagger < 2; dagger++) {
+        for (int odd = 0; odd < 2; odd++) {
+            for (unsigned i = 0; i < CHECKS; i++) {
+                len[i] = odd ? 1 + splitmix64(&rng) % 300 : (dagger ? 256 : 4096);
+                data[i] = dagger ? data[i] : mine_shard_blob(&s, splitmix64(&rng) % 8);
+            }
+            struct calldata c;
+            ok &= check("encode", (dagger ? calldata_encode_dagger(&c, &m) : calldata_encode_minable(&c, &m)) == 0);
+            uint64_t size = naive_encode(&m, dagger, naive);
+            calldata_flatten(&c, flat);
+            ok &= check("size", c.size == size);
+            ok &= check("layout", memcmp(flat, naive, size) == 0);
+
+            uint64_t gas, zeros = 0;
+            calldata_keccak(&c, hash, &gas);
+            keccak256(naive, size, want);
+            for (uint64_t k = 0; k < size; k++) {
+                zeros += naive[k] == 0;
+            }
+            ok &= check("calldata_keccak", memcmp(hash, want, 32) == 0);
+            ok &= check("gas", gas == 4 * zeros + 16 * (size - zeros));
+
+            FILE *f = tmpfile();
+            ok &= check("calldata_writev", f != NULL && calldata_writev(&c, fileno(f)) == 0);
+            rewind(f);
+            ok &= check("writev contents", fread(flat, 1, size + 1, f) == size && memcmp(flat, naive, size) == 0);
+            fclose(f);
+            f = tmpfile();
+            calldata_write_hex(&c, f);
+            rewind(f);
+            char pre[3] = {0};
+            unsigned v;
+            int hex_ok = fread(pre, 1, 2, f) == 2 && strcmp(pre, "0x") == 0;
+            for (uint64_t k = 0; hex_ok && k < size; k++) {
+                hex_ok = fscanf(f, "%2x", &v) == 1 && v == naive[k];
+            }
+            ok &= check("calldata_write_hex", hex_ok && fgetc(f) == EOF);
+            fclose(f);
+            calldata_free(&c);
+        }
+    }
+    free(flat);
+    free(naive);
+    free(file);
+
+    printf(ok ? "self_verify() passed\n" : "self_verify() failed!\n");
+    return (!ok);
+}
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+    return ((end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// 16 blobs of 128 KB (minable) and 16 chunks of 4 KB with 5-word proofs (dagger).
+static void bench() {
+    uint64_t size = 32ULL << 17, rng = 3;
+    unsigned char *file = malloc(size), *flat = malloc(size + 65536), words_buf[16 * 5 * 32];
+    for (uint64_t k = 0; k < size; k += 8) {
+        uint64_t v = splitmix64(&rng);
+        memcpy(file + k, &v, 8);
+    }
+    uint64_t len[16];
+    const unsigned char *data[16], *proofs[16];
+    unsigned words[16];
+    int devnull = open("/dev/null", O_WRONLY);
+    struct mine_call m = {0, 0, {0}, 1700000000, 42, 16, data, len, proofs, words};
+    const char *names[2] = {"minable 16 x 128 KB", "dagger 16 x 4 KB"};
+    for (int dagger = 0; dagger < 2; dagger++) {
+        for (unsigned i = 0; i < 16; i++) {
+            len[i] = dagger ? 4096 : 1 << 17;
+            data[i] = file + (splitmix64(&rng) % 32) * (1 << 17) + (dagger ? (splitmix64(&rng) % 32) * 4096 : 0);
+            proofs[i] = words_buf + 5 * 32 * i;
+            words[i] = 5;
+        }
+        struct timespec t0, t1, t2, t3, t4;
+        int rounds = 200;
+        double t_enc = 0, t_flat = 0, t_hash = 0, t_write = 0;
+        struct calldata c;
+        for (int r = 0; r < rounds; r++) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            dagger ? calldata_encode_dagger(&c, &m) : calldata_encode_minable(&c, &m);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            calldata_flatten(&c, flat);
+            clock_gettime(CLOCK_MONOTONIC, &t2);
+            calldata_writev(&c, devnull);
+            clock_gettime(CLOCK_MONOTONIC, &t3);
+            unsigned char h[32];
+            calldata_keccak(&c, h, NULL);
+            clock_gettime(CLOCK_MONOTONIC, &t4);
+            t_enc += elapsed(&t0, &t1);
+            t_flat += elapsed(&t1, &t2);
+            t_write += elapsed(&t2, &t3);
+            t_hash += elapsed(&t3, &t4);
+            if (r + 1 < rounds) {
+                calldata_free(&c);
+            }
+        }
+        printf("%-20s %7llu bytes: encode %6.2f us (%zu header bytes), one flatten copy %7.2f us, "
+               "writev %6.2f us, keccak %7.2f us\n",
+               names[dagger], (unsigned long long)c.size, t_enc / rounds * 1e6, c.hdr_len, t_flat / rounds * 1e6,
+               t_write / rounds * 1e6, t_hash / rounds * 1e6);
+        calldata_free(&c);
+    }
+    close(devnull);
+    free(file);
+    free(flat);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify|bench\n"
+            "       %s encode --data PATH [options]\n"
+            "  --contract dagger|minable  DKVDaggerHashimoto or DecentralizedKVMinable mine() (default dagger)\n"
+            "  --max-kv-size-bits N       (default 12)\n"
+            "  --chunk-size-bits N        dagger chunk size (default max-kv-size-bits)\n"
+            "  --shard-entry-bits N       (default 5)\n"
+            "  --shard-len-bits N         (default 0)\n"
+            "  --start-shard N            (default 0)\n"
+            "  --random-checks N          (default 16)\n"
+            "  --init-hash HEX32          dagger: hash0 from _calculateDiffAndInitHash (default 0)\n"
+            "  --miner HEX20              (default 0)\n"
+            "  --mined-ts N               (default 0)\n"
+            "  --nonce N                  the nonce found (default 0)\n"
+            "  --kvs K1,K2,...            minable: the kv index of every check\n"
+            "  --output PATH              write the raw calldata there (default: 0x hex to stdout)\n",
+            prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"contract", required_argument, 0, 'C'},         {"data", required_argument, 0, 'D'},
+        {"max-kv-size-bits", required_argument, 0, 'k'}, {"chunk-size-bits", required_argument, 0, 'c'},
+        {"shard-entry-bits", required_argument, 0, 'e'}, {"shard-len-bits", required_argument, 0, 'l'},
+        {"start-shard", required_argument, 0, 's'},      {"random-checks", required_argument, 0, 'r'},
+        {"init-hash", required_argument, 0, 'h'},        {"miner", required_argument, 0, 'a'},
+        {"mined-ts", required_argument, 0, 't'},         {"nonce", required_argument, 0, 'n'},
+        {"kvs", required_argument, 0, 'K'},              {"output", required_argument, 0, 'o'},
+        {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (self_verify());
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return (0);
+    }
+    if (argc < 2 || strcmp(argv[1], "encode") != 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    struct tool_options o;
+    memset(&o, 0, sizeof(o));
+    o.shard.max_kv_size_bits = 12;
+    o.shard.shard_entry_bits = 5;
+    o.random_checks = 16;
+    int chunk_bits = -1;
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'C':
+            if (strcmp(optarg, "dagger") != 0 && strcmp(optarg, "minable") != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            o.minable = strcmp(optarg, "minable") == 0;
+            break;
+        case 'D': o.data = optarg; break;
+        case 'k': o.shard.max_kv_size_bits = atoi(optarg); break;
+        case 'c': chunk_bits = atoi(optarg); break;
+        case 'e': o.shard.shard_entry_bits = atoi(optarg); break;
+        case 'l': o.shard.shard_len_bits = atoi(optarg); break;
+        case 's': o.shard.start_shard_id = strtoull(optarg, NULL, 0); break;
+        case 'r': o.random_checks = atoi(optarg); break;
+        case 'h':
+            if (!parse_hex(optarg, o.init_hash, 32)) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'a':
+            if (!parse_hex(optarg, o.miner, 20)) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 't': o.mined_ts = strtoull(optarg, NULL, 0); break;
+        case 'n': o.nonce = strtoull(optarg, NULL, 0); break;
+        case 'K': o.kvs = optarg; break;
+        case 'o': o.output = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    o.shard.chunk_size_bits = chunk_bits < 0 ? o.shard.max_kv_size_bits : chunk_bits;
+    if (o.data == NULL || o.random_checks == 0 || o.shard.max_kv_size_bits < 5 || o.shard.max_kv_size_bits > 30 ||
+        o.shard.chunk_size_bits < 5 || o.shard.chunk_size_bits > o.shard.max_kv_size_bits ||
+        o.shard.shard_entry_bits + o.shard.shard_len_bits > 32 || (o.minable && o.kvs == NULL)) {
+        usage(argv[0]);
+        return (1);
+    }
+    return (tool_encode(&o));
+}
+#endif
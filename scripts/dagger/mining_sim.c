@@ -0,0 +1,888 @@
+/*
+ * Monte Carlo simulator of DecentralizedKVDaggerHashimoto mining economics.
+ *
+ *   gcc -O3 -pthread mining_sim.c -o mining_sim -lm
+ *   ./mining_sim verify
+ *   ./mining_sim --snapshot chain.snap --miner 20000x4 --miner 50000:0-7 --put-rate 0.05 \
+ *       --rounds 1000000 --sweep diffAdjDivisor=512,1024,2048 --sweep cutoff=20,40 --seeds 4 > sweep.csv
+ *
+ * Every scenario starts from a snapshot (see shard_scheduler.c; shards up to
+ * lastMinableShardIdx() without a "shard" line start as opened at startTime)
+ * with --set / --sweep overrides of its parameters, and runs until --rounds
+ * blocks are mined or --duration seconds pass.  Miners are given as
+ * RATE[xCOUNT][:SHARDS[:START/BITS]]: hashes per second, how many such
+ * miners, the shards they hold ("all", the default, follows the shard
+ * openings) and, if given, the one range they always mine.  Otherwise a
+ * miner mines the range with the best expected reward per hash, as
+ * shard_scheduler picks it.
+ *
+ * Contract state only changes through the contract math, in u256 and
+ * bit-exact: MiningLib.expectedDiff and update, _paymentIn with
+ * BinaryRelated.pow, the coinbase split, _preparePutWithTimestamp and the
+ * upfront payment of every put.  What the chain leaves to chance is drawn
+ * here: puts arrive as a Poisson process of --put-rate kvs per second, and a
+ * miner on a range finds a block at rate hashRate * (stored / rows)^randomChecks
+ * / diff.  Difficulties only change at whole seconds (interval / cutoff
+ * steps), so the total rate is constant between events and the next block is
+ * one exponential draw; a block at time t is mined with minedTs = floor(t).
+ * Miners re-plan on every block, put, difficulty step of a shard being mined
+ * and at least every --replan seconds.
+ *
+ * Scenarios run in parallel, one CSV summary row each, in scenario order.
+ */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+
+#define DAGGER_NO_MAIN
+#include "shard_scheduler.c"
+
+#define SIM_STALL_INTERVALS 1000 // target intervals without a block or put before a run gives up
+
+struct sim_miner {
+    double rate;
+    const unsigned char *held; // NULL: every shard
+    uint64_t nheld;
+    int fixed;
+    uint64_t start;
+    unsigned bits;
+};
+
+struct sim_params {
+    const struct snapshot *base;
+    const struct sim_miner *miners;
+    unsigned nminers;
+    double put_rate;
+    uint64_t rounds;
+    double duration;
+    double replan;
+};
+
+struct sim_result {
+    double seconds;
+    uint64_t blocks;
+    uint64_t puts;
+    uint64_t put_reverts; // puts whose upfront payment reverts
+    uint64_t reverts;
+    uint64_t last_kv_idx;
+    uint64_t shards;
+    uint64_t intervals; // per shard, between two mines
+    double interval_mean;
+    double interval_m2;
+    double diff_mean; // per shard difficulty of the mined blocks
+    u256 collected;   // upfront payments of the puts
+    u256 miner_paid;
+    u256 coinbase_paid;
+    uint64_t *miner_blocks;
+    u256 *miner_reward;
+};
+
+// Live contract state, plus what the planner caches per shard.
+struct sim_state {
+    const struct econ_config *c;
+    uint64_t last_kv_idx;
+    uint64_t nshards, cap;
+    struct mining_info *infos;
+    u256 *pow_last; // dcfFactor^(lastMineTime - startTime), the first pow of the next payment
+    double *pow_last_d;
+    uint64_t *diff_until;   // base_diff_ok and base_diff hold before this second; 0 after a mine
+    unsigned char *base_diff_ok;
+    unsigned char *base_ok; // per shard at the planning second
+    double *base_diff;
+    double *base_pay;
+    unsigned char *ok; // range table of one holding
+    double *diff;
+    double *pay;
+};
+
+struct sim_choice {
+    int active;
+    uint64_t start;
+    unsigned bits;
+    double valid;
+    double lambda;
+};
+
+static uint64_t sim_next(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+// Uniform in (0, 1].
+static double sim_uniform(uint64_t *s) {
+    return (((sim_next(s) >> 11) + 1) * 0x1p-53);
+}
+
+static int sim_grow(struct sim_state *st, uint64_t n) {
+    if (n <= st->cap) {
+        return (0);
+    }
+    uint64_t cap = st->cap ? st->cap : 64;
+    while (cap < n) {
+        cap *= 2;
+    }
+    void **arrays[] = {(void **)&st->infos,        (void **)&st->pow_last, (void **)&st->pow_last_d,
+                       (void **)&st->diff_until,   (void **)&st->base_diff_ok, (void **)&st->base_ok,
+                       (void **)&st->base_diff,    (void **)&st->base_pay, (void **)&st->ok,
+                       (void **)&st->diff,         (void **)&st->pay};
+    size_t sizes[] = {sizeof(struct mining_info), sizeof(u256), sizeof(double), sizeof(uint64_t), 1, 1,
+                      sizeof(double),             sizeof(double), 1, sizeof(double), sizeof(double)};
+    for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        void *p = realloc(*arrays[k], cap * sizes[k]);
+        if (p == NULL) {
+            return (-1);
+        }
+        *arrays[k] = p;
+    }
+    memset(st->infos + st->cap, 0, (cap - st->cap) * sizeof(struct mining_info));
+    memset(st->pow_last + st->cap, 0, (cap - st->cap) * sizeof(u256));
+    memset(st->pow_last_d + st->cap, 0, (cap - st->cap) * sizeof(double));
+    memset(st->diff_until + st->cap, 0, (cap - st->cap) * sizeof(uint64_t));
+    st->cap = cap;
+    return (0);
+}
+
+// Shard id opened (or reset) at ts: lastMineTime = ts and the pow cache to match.
+static void sim_open_shard(struct sim_state *st, uint64_t id, uint64_t ts) {
+    st->infos[id].last_mine_time = ts;
+    if (econ_pow(st->c->dcf_factor, ts - st->c->start_time, &st->pow_last[id]) != 0) {
+        st->pow_last[id] = u256_from_u64(0);
+    }
+    st->pow_last_d[id] = u256_to_double(st->pow_last[id]);
+    st->diff_until[id] = 0;
+}
+
+static int sim_init(struct sim_state *st, const struct snapshot *s) {
+    memset(st, 0, sizeof(*st));
+    st->c = &s->cfg;
+    st->last_kv_idx = s->last_kv_idx;
+    st->nshards = last_minable_shard(s) + 1;
+    if (sim_grow(st, st->nshards) != 0) {
+        return (-1);
+    }
+    memcpy(st->infos, s->infos, st->nshards * sizeof(struct mining_info));
+    for (uint64_t id = 0; id < st->nshards; id++) {
+        uint64_t ts = st->infos[id].last_mine_time;
+        sim_open_shard(st, id, ts < s->cfg.start_time ? s->cfg.start_time : ts);
+    }
+    return (0);
+}
+
+static void sim_free(struct sim_state *st) {
+    free(st->infos);
+    free(st->pow_last);
+    free(st->pow_last_d);
+    free(st->diff_until);
+    free(st->base_diff_ok);
+    free(st->base_ok);
+    free(st->base_diff);
+    free(st->base_pay);
+    free(st->ok);
+    free(st->diff);
+    free(st->pay);
+}
+
+static double sim_stored_fraction(const struct sim_state *st, uint64_t start, unsigned bits) {
+    unsigned entry_bits = st->c->shard_entry_bits;
+    uint64_t first = start << entry_bits;
+    uint64_t rows = 1ULL << (entry_bits + bits);
+    uint64_t stored = st->last_kv_idx <= first ? 0 : st->last_kv_idx - first;
+    return (stored >= rows ? 1.0 : (double)stored / rows);
+}
+
+static int sim_held(const struct sim_miner *m, uint64_t id) {
+    return (m->held == NULL || (id < m->nheld && m->held[id]));
+}
+
+// Next second after now at which the expectedDiff of shard id steps.
+static uint64_t sim_next_step(const struct sim_state *st, uint64_t id, uint64_t now) {
+    const struct econ_config *c = st->c;
+    uint64_t last = st->infos[id].last_mine_time;
+    uint64_t next = last + ((now - last) / c->cutoff + 1) * c->cutoff;
+    if (now < last + c->target_interval_sec && last + c->target_interval_sec < next) {
+        next = last + c->target_interval_sec;
+    }
+    return (next);
+}
+
+/*
+ * Choose every miner's range at second now.  Miners holding every shard
+ * share one doubling table (as in plan_ranges(), in doubles: the choice
+ * only ranks); the others get their own.  Returns the total block rate and
+ * sets *next_step to the earliest difficulty step among the chosen ranges.
+ */
+static double sim_plan(struct sim_state *st, const struct sim_params *p, uint64_t now, struct sim_choice *choice,
+                       uint64_t *next_step) {
+    const struct econ_config *c = st->c;
+    uint64_t n = st->nshards;
+    u256 pow_now;
+    double total = 0;
+    *next_step = UINT64_MAX;
+    if (econ_pow(c->dcf_factor, now - c->start_time, &pow_now) != 0) {
+        return (0);
+    }
+    double pow_now_d = u256_to_double(pow_now);
+    double x = u256_to_double(c->storage_cost) * (double)(1ULL << c->shard_entry_bits) * 0x1p-128;
+    double miner_share = (10000 - c->coinbase_share) / 10000.0;
+
+    unsigned char *base_ok = st->base_ok;
+    double *base_diff = st->base_diff, *base_pay = st->base_pay;
+    for (uint64_t id = 0; id < n; id++) {
+        // expectedDiff is flat between cutoff steps, so recompute it only past one
+        if (now >= st->diff_until[id]) {
+            u256 d;
+            st->base_diff_ok[id] = econ_expected_diff(c, &st->infos[id], now, &d) == 0;
+            base_diff[id] = st->base_diff_ok[id] ? u256_to_double(d) : 0;
+            st->diff_until[id] = st->base_diff_ok[id] ? sim_next_step(st, id, now) : now + 1;
+        }
+        base_ok[id] = st->base_diff_ok[id] && u256_cmp(st->pow_last[id], pow_now) >= 0;
+        base_pay[id] = x * (st->pow_last_d[id] - pow_now_d);
+    }
+
+    int shared_done = 0;
+    struct sim_choice shared = {0};
+    for (unsigned i = 0; i < p->nminers; i++) {
+        const struct sim_miner *m = &p->miners[i];
+        struct sim_choice best = {0};
+        double best_score = 0;
+        if (m->fixed) {
+            uint64_t len = 1ULL << m->bits;
+            int ok = m->start + len <= n;
+            double d = 0;
+            for (uint64_t id = m->start; ok && id < m->start + len; id++) {
+                ok = base_ok[id] && sim_held(m, id);
+                d += base_diff[id];
+            }
+            double valid = ok ? powi(sim_stored_fraction(st, m->start, m->bits), c->random_checks) : 0;
+            if (valid > 0 && d > 0) {
+                best = (struct sim_choice){1, m->start, m->bits, valid, 0};
+                best.lambda = m->rate * valid / d;
+            }
+        } else if (m->held == NULL && shared_done) {
+            best = shared;
+            best.lambda = best.active ? m->rate * shared.lambda : 0;
+        } else {
+            // only ranges inside [lo, hi) can be all held
+            uint64_t lo = 0, hi = n;
+            if (m->held != NULL) {
+                hi = m->nheld < n ? m->nheld : n;
+                while (lo < hi && !m->held[lo]) {
+                    lo++;
+                }
+            }
+            for (uint64_t id = lo; id < hi; id++) {
+                st->ok[id] = base_ok[id] && sim_held(m, id);
+                st->diff[id] = base_diff[id];
+                st->pay[id] = base_pay[id];
+            }
+            for (unsigned bits = 0; lo + (1ULL << bits) <= hi; bits++) {
+                uint64_t len = 1ULL << bits;
+                for (uint64_t id = lo; bits > 0 && id + len <= hi; id++) {
+                    uint64_t half = id + len / 2;
+                    st->ok[id] = st->ok[id] && st->ok[half];
+                    st->diff[id] += st->diff[half];
+                    st->pay[id] += st->pay[half];
+                }
+                for (uint64_t id = lo; id + len <= hi; id++) {
+                    if (!st->ok[id] || st->diff[id] <= 0) {
+                        continue;
+                    }
+                    double stored = sim_stored_fraction(st, id, bits);
+                    double valid = stored == 1.0 ? 1.0 : powi(stored, c->random_checks);
+                    double score = st->pay[id] * miner_share * valid / st->diff[id];
+                    if (valid > 0 && (!best.active || score > best_score)) {
+                        best = (struct sim_choice){1, id, bits, valid, valid / st->diff[id]};
+                        best_score = score;
+                    }
+                }
+            }
+            if (m->held == NULL) {
+                shared = best; // lambda per unit hash rate
+                shared_done = 1;
+            }
+            best.lambda *= m->rate;
+        }
+        choice[i] = best;
+        total += best.lambda;
+        for (uint64_t id = best.start; best.active && id < best.start + (1ULL << best.bits); id++) {
+            uint64_t step = sim_next_step(st, id, now);
+            *next_step = step < *next_step ? step : *next_step;
+        }
+    }
+    return (total);
+}
+
+// _mine() of a found block: difficulties, payments, MiningLib.update.
+static void sim_mine(struct sim_state *st, const struct sim_choice *ch, unsigned miner, uint64_t ts,
+                     struct sim_result *r) {
+    const struct econ_config *c = st->c;
+    uint64_t end = ch->start + (1ULL << ch->bits);
+    uint64_t last_payable = (st->last_kv_idx >> c->shard_entry_bits) + 1;
+    u256 pow_now, diff, t, sum = u256_from_u64(0), total = u256_from_u64(0);
+    u256 x = u256_shl(c->storage_cost, c->shard_entry_bits);
+    int revert = econ_pow(c->dcf_factor, ts - c->start_time, &pow_now) != 0;
+    for (uint64_t id = ch->start; !revert && id < end; id++) {
+        revert = econ_expected_diff(c, &st->infos[id], ts, &diff) != 0;
+        t = u256_add(sum, diff);
+        revert |= u256_cmp(t, sum) < 0;
+        sum = t;
+        if (!revert && id <= last_payable) {
+            u256 pay;
+            revert = u256_cmp(st->pow_last[id], pow_now) < 0 ||
+                     q128_mul_shr(x, u256_sub(st->pow_last[id], pow_now), &pay);
+            t = u256_add(total, pay);
+            revert |= u256_cmp(t, total) < 0;
+            total = t;
+        }
+    }
+    u256 to_miner;
+    if (revert || econ_miner_reward(c, total, &to_miner) != 0) {
+        r->reverts++;
+        return;
+    }
+    for (uint64_t id = ch->start; id < end && id <= last_payable; id++) {
+        struct mining_info *info = &st->infos[id];
+        econ_expected_diff(c, info, ts, &diff);
+        double interval = ts - info->last_mine_time;
+        r->intervals++;
+        double delta = interval - r->interval_mean;
+        r->interval_mean += delta / r->intervals;
+        r->interval_m2 += delta * (interval - r->interval_mean);
+        r->diff_mean += (u256_to_double(diff) - r->diff_mean) / r->intervals;
+
+        info->block_mined++;
+        info->difficulty = diff;
+        info->last_mine_time = ts;
+        st->pow_last[id] = pow_now;
+        st->pow_last_d[id] = u256_to_double(pow_now);
+        st->diff_until[id] = 0;
+    }
+    r->blocks++;
+    r->miner_blocks[miner]++;
+    r->miner_reward[miner] = u256_add(r->miner_reward[miner], to_miner);
+    r->miner_paid = u256_add(r->miner_paid, to_miner);
+    r->coinbase_paid = u256_add(r->coinbase_paid, u256_sub(total, to_miner));
+}
+
+// put() of a new kv at ts: _preparePutWithTimestamp, then the upfront payment.
+// A put whose payment reverts changes nothing but the revert count.
+static int sim_put(struct sim_state *st, uint64_t ts, struct sim_result *r) {
+    const struct econ_config *c = st->c;
+    u256 pay;
+    if (econ_payment_inf(c, c->storage_cost, ts, &pay) != 0) {
+        r->put_reverts++;
+        return (0);
+    }
+    if (((st->last_kv_idx + 1) % (1ULL << c->shard_entry_bits)) == 0) {
+        uint64_t next = ((st->last_kv_idx + 1) >> c->shard_entry_bits) + 1;
+        if (sim_grow(st, next + 1) != 0) {
+            return (-1);
+        }
+        sim_open_shard(st, next, ts);
+        memcpy(st->infos[next].mining_hash, st->infos[next - 1].mining_hash, 32);
+        st->nshards = next + 1;
+    }
+    r->collected = u256_add(r->collected, pay);
+    st->last_kv_idx++;
+    r->puts++;
+    return (0);
+}
+
+int sim_run(const struct sim_params *p, uint64_t seed, struct sim_result *r) {
+    struct sim_state st;
+    struct sim_choice *choice = calloc(p->nminers, sizeof(struct sim_choice));
+    if (choice == NULL || sim_init(&st, p->base) != 0) {
+        free(choice);
+        return (-1);
+    }
+    uint64_t rng = seed;
+    double t = p->base->cfg.start_time;
+    for (uint64_t id = 0; id < st.nshards; id++) {
+        t = st.infos[id].last_mine_time > t ? st.infos[id].last_mine_time : t;
+    }
+    double start = t, end = t + p->duration;
+    double next_put = p->put_rate > 0 ? t - log(sim_uniform(&rng)) / p->put_rate : INFINITY;
+    double progress = t;
+    int err = 0;
+
+    while (!err && r->blocks < p->rounds && t < end) {
+        uint64_t now = (uint64_t)t;
+        uint64_t step;
+        double lambda = sim_plan(&st, p, now, choice, &step);
+        double next = now + p->replan;
+        next = step < next ? step : next;
+        next = next_put < next ? next_put : next;
+        next = end < next ? end : next;
+        double found = lambda > 0 ? t - log(sim_uniform(&rng)) / lambda : INFINITY;
+        if (found < next) {
+            t = found;
+            double pick = sim_uniform(&rng) * lambda, acc = choice[0].lambda;
+            unsigned w = 0;
+            while (w + 1 < p->nminers && acc < pick) {
+                acc += choice[++w].lambda;
+            }
+            while (!choice[w].active) { // rounding at the end of the sum
+                w--;
+            }
+            sim_mine(&st, &choice[w], w, (uint64_t)t, r);
+            progress = t;
+        } else {
+            t = next;
+            if (t == next_put) {
+                err = sim_put(&st, (uint64_t)t, r);
+                next_put = t - log(sim_uniform(&rng)) / p->put_rate;
+                progress = t;
+            } else if (lambda == 0 && next_put == INFINITY && t - progress > SIM_STALL_INTERVALS * st.c->target_interval_sec + st.c->cutoff) {
+                break; // nothing to mine and nothing will change it
+            }
+        }
+    }
+    r->seconds = t - start;
+    r->last_kv_idx = st.last_kv_idx;
+    r->shards = st.nshards;
+    sim_free(&st);
+    free(choice);
+    return (err);
+}
+
+#define SIM_MAX_SWEEPS 8
+
+struct sweep {
+    const char *name;
+    char **values;
+    unsigned nvalues;
+};
+
+struct scenario {
+    struct snapshot s;
+    double put_rate;
+    uint64_t seed;
+    unsigned value[SIM_MAX_SWEEPS]; // index into each sweep's values
+    struct sim_result r;
+    int err;
+};
+
+struct sim_batch {
+    struct sim_params p;
+    struct scenario *scenarios;
+    uint64_t nscenarios;
+    uint64_t next;
+};
+
+static void *sim_worker(void *arg) {
+    struct sim_batch *b = arg;
+    for (;;) {
+        uint64_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+        if (i >= b->nscenarios) {
+            break;
+        }
+        struct scenario *sc = &b->scenarios[i];
+        struct sim_params p = b->p;
+        p.base = &sc->s;
+        p.put_rate = sc->put_rate;
+        sc->err = sim_run(&p, sc->seed, &sc->r);
+    }
+    return (NULL);
+}
+
+// putRate is the simulator's own parameter; the rest go to the snapshot.
+static int sim_set(struct snapshot *s, double *put_rate, const char *name, const char *value) {
+    if (strcmp(name, "putRate") == 0) {
+        char *end;
+        *put_rate = strtod(value, &end);
+        return (end == value || *end != 0 || *put_rate < 0 ? -1 : 0);
+    }
+    return (snapshot_set(s, name, value));
+}
+
+// "RATE[xCOUNT][:SHARDS[:START/BITS]]"
+static int parse_miner(const char *spec, struct sim_miner **miners, unsigned *n) {
+    char *copy = strdup(spec);
+    char *held = strchr(copy, ':'), *fixed = NULL;
+    if (held != NULL) {
+        *held++ = 0;
+        fixed = strchr(held, ':');
+        if (fixed != NULL) {
+            *fixed++ = 0;
+        }
+    }
+    struct sim_miner m = {0};
+    unsigned long count = 1;
+    char *x = strchr(copy, 'x'), *end;
+    if (x != NULL) {
+        *x = 0;
+        count = strtoul(x + 1, &end, 10);
+        if (*end != 0 || count == 0) {
+            free(copy);
+            return (-1);
+        }
+    }
+    m.rate = strtod(copy, &end);
+    int err = *end != 0 || m.rate <= 0;
+    if (!err && held != NULL && strcmp(held, "all") != 0) {
+        unsigned char *h;
+        err = parse_held(held, &h, &m.nheld) != 0;
+        m.held = h;
+    }
+    if (!err && fixed != NULL) {
+        m.fixed = 1;
+        err = sscanf(fixed, "%" SCNu64 "/%u", &m.start, &m.bits) != 2 || m.bits >= 32;
+    }
+    free(copy);
+    if (err) {
+        return (-1);
+    }
+    *miners = realloc(*miners, (*n + count) * sizeof(struct sim_miner));
+    for (unsigned long k = 0; k < count; k++) {
+        (*miners)[(*n)++] = m;
+    }
+    return (0);
+}
+
+static int parse_sweep(const char *spec, struct sweep *sw) {
+    char *copy = strdup(spec);
+    char *eq = strchr(copy, '=');
+    if (eq == NULL || eq == copy || eq[1] == 0) {
+        free(copy);
+        return (-1);
+    }
+    *eq = 0;
+    sw->name = copy;
+    sw->values = NULL;
+    sw->nvalues = 0;
+    char *save = NULL;
+    for (char *v = strtok_r(eq + 1, ",", &save); v != NULL; v = strtok_r(NULL, ",", &save)) {
+        sw->values = realloc(sw->values, (sw->nvalues + 1) * sizeof(char *));
+        sw->values[sw->nvalues++] = v;
+    }
+    return (0);
+}
+
+static void print_signed(FILE *out, u256 plus, u256 minus) {
+    char buf[80];
+    if (u256_cmp(plus, minus) >= 0) {
+        fprintf(out, ",%s", u256_to_dec(u256_sub(plus, minus), buf));
+    } else {
+        fprintf(out, ",-%s", u256_to_dec(u256_sub(minus, plus), buf));
+    }
+}
+
+static void print_csv(FILE *out, const struct sim_batch *b, const struct sweep *sweeps, unsigned nsweeps) {
+    fprintf(out, "scenario,seed");
+    for (unsigned k = 0; k < nsweeps; k++) {
+        fprintf(out, ",%s", sweeps[k].name);
+    }
+    fprintf(out, ",seconds,blocks,blocks_per_hour,puts,put_reverts,last_kv_idx,shards,reverts,"
+                 "shard_interval_mean,shard_interval_stddev,shard_diff_mean,collected_wei,miner_paid_wei,coinbase_paid_wei,"
+                 "net_wei");
+    for (unsigned i = 0; i < b->p.nminers; i++) {
+        fprintf(out, ",miner%u_blocks,miner%u_reward_wei", i, i);
+    }
+    fprintf(out, "\n");
+
+    char buf[80];
+    for (uint64_t i = 0; i < b->nscenarios; i++) {
+        const struct scenario *sc = &b->scenarios[i];
+        const struct sim_result *r = &sc->r;
+        if (sc->err) {
+            fprintf(stderr, "scenario %llu failed\n", (unsigned long long)i);
+            continue;
+        }
+        fprintf(out, "%llu,%llu", (unsigned long long)i, (unsigned long long)sc->seed);
+        for (unsigned k = 0; k < nsweeps; k++) {
+            fprintf(out, ",%s", sweeps[k].values[sc->value[k]]);
+        }
+        fprintf(out, ",%.0f,%llu,%.3f,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%.6g", r->seconds,
+                (unsigned long long)r->blocks, r->seconds > 0 ? r->blocks * 3600 / r->seconds : 0,
+                (unsigned long long)r->puts, (unsigned long long)r->put_reverts,
+                (unsigned long long)r->last_kv_idx, (unsigned long long)r->shards, (unsigned long long)r->reverts,
+                r->interval_mean, r->intervals > 1 ? sqrt(r->interval_m2 / (r->intervals - 1)) : 0, r->diff_mean);
+        fprintf(out, ",%s", u256_to_dec(r->collected, buf));
+        fprintf(out, ",%s", u256_to_dec(r->miner_paid, buf));
+        fprintf(out, ",%s", u256_to_dec(r->coinbase_paid, buf));
+        print_signed(out, r->collected, u256_add(r->miner_paid, r->coinbase_paid));
+        for (unsigned m = 0; m < b->p.nminers; m++) {
+            fprintf(out, ",%llu,%s", (unsigned long long)r->miner_blocks[m], u256_to_dec(r->miner_reward[m], buf));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+// Checks against the contract model that need no chain.
+static int self_verify() {
+    int ok = 1;
+    struct snapshot s;
+    memset(&s, 0, sizeof(s));
+    const char *cfg[][2] = {
+        {"maxKvSizeBits", "17"},      {"chunkSizeBits", "12"},  {"shardSizeBits", "20"},
+        {"randomChecks", "2"},        {"minimumDiff", "1000"},  {"targetIntervalSec", "60"},
+        {"cutoff", "40"},             {"diffAdjDivisor", "64"}, {"coinbaseShare", "1000"},
+        {"storageCost", "1000000000000000000"},
+        {"dcfFactor", "340282365784068676928457747575078800565"},
+        {"startTime", "1000"},        {"lastKvIdx", "12"},
+    };
+    for (unsigned k = 0; k < sizeof(cfg) / sizeof(cfg[0]); k++) {
+        snapshot_set(&s, cfg[k][0], cfg[k][1]);
+    }
+    snapshot_check(&s);
+
+    // one miner on everything: the block interval settles around targetIntervalSec
+    struct sim_miner miner = {1000.0};
+    struct sim_params p = {&s, &miner, 1, 0.01, 20000, 1e12, 10};
+    struct sim_result r;
+    memset(&r, 0, sizeof(r));
+    uint64_t blocks[1];
+    u256 reward[1];
+    r.miner_blocks = blocks;
+    r.miner_reward = reward;
+    blocks[0] = 0;
+    reward[0] = u256_from_u64(0);
+    ok &= check("sim_run", sim_run(&p, 1, &r) == 0 && r.blocks == p.rounds && r.reverts == 0);
+    ok &= check("interval near target", r.interval_mean > 30 && r.interval_mean < 120);
+    u256 paid = u256_add(r.miner_paid, r.coinbase_paid);
+    ok &= check("coinbase share", fabs(u256_to_double(r.coinbase_paid) / u256_to_double(paid) - 0.1) < 1e-9);
+    ok &= check("miner totals", u256_cmp(reward[0], r.miner_paid) == 0 && blocks[0] == r.blocks);
+
+    // the same seed gives the same run
+    struct sim_result again;
+    uint64_t blocks2[1] = {0};
+    u256 reward2[1] = {u256_from_u64(0)};
+    memset(&again, 0, sizeof(again));
+    again.miner_blocks = blocks2;
+    again.miner_reward = reward2;
+    sim_run(&p, 1, &again);
+    ok &= check("deterministic", again.seconds == r.seconds && u256_cmp(again.miner_paid, r.miner_paid) == 0);
+
+    // payments telescope: a shard mined at t1 then t2 pays what one mine at t2 would
+    struct sim_state st;
+    sim_init(&st, &s);
+    struct sim_choice ch = {1, 0, 0, 1, 1};
+    struct sim_result one;
+    memset(&one, 0, sizeof(one));
+    one.miner_blocks = blocks;
+    one.miner_reward = reward;
+    sim_mine(&st, &ch, 0, 5000, &one);
+    u256 expect;
+    struct mining_info opened;
+    memset(&opened, 0, sizeof(opened));
+    opened.last_mine_time = 1000; // shard 0 opens at startTime
+    econ_shard_payment(&s.cfg, &opened, 5000, &expect);
+    ok &= check("sim_mine payment", u256_cmp(u256_add(one.miner_paid, one.coinbase_paid), expect) == 0);
+    ok &= check("sim_mine update", st.infos[0].last_mine_time == 5000 && st.infos[0].block_mined == 1 &&
+                                       u256_cmp(st.infos[0].difficulty, s.cfg.minimum_diff) == 0);
+
+    // a put that fills shard 0 opens shard 2 at its timestamp
+    s.last_kv_idx = 7; // shardEntryBits = 3
+    sim_free(&st);
+    sim_init(&st, &s);
+    sim_put(&st, 7000, &one);
+    ok &= check("sim_put", st.nshards == 3 && st.infos[2].last_mine_time == 7000 && st.last_kv_idx == 8);
+    econ_payment_inf(&s.cfg, s.cfg.storage_cost, 7000, &expect);
+    ok &= check("sim_put payment", u256_cmp(one.collected, expect) == 0);
+    // before startTime the payment reverts and the put leaves no trace
+    sim_put(&st, 999, &one);
+    ok &= check("sim_put revert", one.put_reverts == 1 && one.puts == 1 && st.nshards == 3 && st.last_kv_idx == 8 &&
+                                      u256_cmp(one.collected, expect) == 0);
+    sim_free(&st);
+    snapshot_free(&s);
+
+    if (ok) {
+        printf("self_verify() passed\n");
+    }
+    return (!ok);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s --snapshot PATH --miner SPEC [--miner SPEC ...] [options]\n"
+            "  --snapshot PATH      starting contract state, see shard_scheduler.c\n"
+            "  --miner SPEC         RATE[xCOUNT][:SHARDS[:START/BITS]], e.g. 20000x4 or 5000:0-7:2/1\n"
+            "  --set NAME=VALUE     override a snapshot parameter, or putRate\n"
+            "  --sweep NAME=V1,V2   run every combination of the swept values (up to %d sweeps)\n"
+            "  --put-rate R         new kvs per second (default 0)\n"
+            "  --rounds N           blocks per scenario (default 100000)\n"
+            "  --duration S         simulated seconds per scenario at most (default unlimited)\n"
+            "  --replan S           re-plan at least every S seconds (default 10)\n"
+            "  --seeds N            runs per combination (default 1)\n"
+            "  --seed N             first seed (default 1)\n"
+            "  --threads N          (default: all cores)\n"
+            "  --output PATH        CSV file (default stdout)\n",
+            prog, prog, SIM_MAX_SWEEPS);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"snapshot", required_argument, 0, 's'}, {"miner", required_argument, 0, 'm'},
+        {"set", required_argument, 0, 'S'},      {"sweep", required_argument, 0, 'w'},
+        {"put-rate", required_argument, 0, 'p'}, {"rounds", required_argument, 0, 'n'},
+        {"duration", required_argument, 0, 'd'}, {"replan", required_argument, 0, 'r'},
+        {"seeds", required_argument, 0, 'N'},    {"seed", required_argument, 0, 'e'},
+        {"threads", required_argument, 0, 't'},  {"output", required_argument, 0, 'o'},
+        {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (self_verify());
+    }
+
+    const char *snapshot_path = NULL, *output = NULL;
+    struct sim_batch b;
+    memset(&b, 0, sizeof(b));
+    struct sim_miner *miners = NULL;
+    struct sweep sweeps[SIM_MAX_SWEEPS];
+    unsigned nsweeps = 0;
+    const char *sets[64];
+    unsigned nsets = 0;
+    double put_rate = 0;
+    uint64_t seeds = 1, seed = 1;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    b.p.rounds = 100000;
+    b.p.duration = INFINITY;
+    b.p.replan = 10;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 's': snapshot_path = optarg; break;
+        case 'm':
+            if (parse_miner(optarg, &miners, &b.p.nminers) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'S':
+            if (nsets == sizeof(sets) / sizeof(sets[0])) {
+                usage(argv[0]);
+                return (1);
+            }
+            sets[nsets++] = optarg;
+            break;
+        case 'w':
+            if (nsweeps == SIM_MAX_SWEEPS || parse_sweep(optarg, &sweeps[nsweeps]) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            nsweeps++;
+            break;
+        case 'p': put_rate = atof(optarg); break;
+        case 'n': b.p.rounds = strtoull(optarg, NULL, 0); break;
+        case 'd': b.p.duration = atof(optarg); break;
+        case 'r': b.p.replan = atof(optarg); break;
+        case 'N': seeds = strtoull(optarg, NULL, 0); break;
+        case 'e': seed = strtoull(optarg, NULL, 0); break;
+        case 't': threads = atoi(optarg); break;
+        case 'o': output = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (snapshot_path == NULL || b.p.nminers == 0 || seeds == 0 || threads < 1 || b.p.replan < 1) {
+        usage(argv[0]);
+        return (1);
+    }
+    b.p.miners = miners;
+
+    struct snapshot base;
+    if (snapshot_load(snapshot_path, &base) != 0) {
+        return (1);
+    }
+    for (unsigned k = 0; k < nsets; k++) {
+        char name[64];
+        const char *eq = strchr(sets[k], '=');
+        if (eq == NULL || eq - sets[k] >= (long)sizeof(name)) {
+            usage(argv[0]);
+            return (1);
+        }
+        snprintf(name, sizeof(name), "%.*s", (int)(eq - sets[k]), sets[k]);
+        if (sim_set(&base, &put_rate, name, eq + 1) != 0) {
+            fprintf(stderr, "cannot set %s\n", sets[k]);
+            return (1);
+        }
+    }
+
+    // the cartesian product of the sweeps, seeds innermost
+    b.nscenarios = seeds;
+    for (unsigned k = 0; k < nsweeps; k++) {
+        b.nscenarios *= sweeps[k].nvalues;
+    }
+    b.scenarios = calloc(b.nscenarios, sizeof(struct scenario));
+    uint64_t *miner_blocks = calloc(b.nscenarios * b.p.nminers, sizeof(uint64_t));
+    u256 *miner_reward = calloc(b.nscenarios * b.p.nminers, sizeof(u256));
+    if (b.scenarios == NULL || miner_blocks == NULL || miner_reward == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return (1);
+    }
+    for (uint64_t i = 0; i < b.nscenarios; i++) {
+        struct scenario *sc = &b.scenarios[i];
+        sc->s = base;
+        sc->s.infos = malloc(base.nshards * sizeof(struct mining_info));
+        memcpy(sc->s.infos, base.infos, base.nshards * sizeof(struct mining_info));
+        sc->put_rate = put_rate;
+        sc->seed = seed + i % seeds;
+        uint64_t rest = i / seeds;
+        for (int k = nsweeps - 1; k >= 0; k--) {
+            sc->value[k] = rest % sweeps[k].nvalues;
+            rest /= sweeps[k].nvalues;
+            if (sim_set(&sc->s, &sc->put_rate, sweeps[k].name, sweeps[k].values[sc->value[k]]) != 0) {
+                fprintf(stderr, "cannot set %s=%s\n", sweeps[k].name, sweeps[k].values[sc->value[k]]);
+                return (1);
+            }
+        }
+        if (snapshot_check(&sc->s) != 0) {
+            fprintf(stderr, "scenario %llu: inconsistent contract parameters\n", (unsigned long long)i);
+            return (1);
+        }
+        sc->r.miner_blocks = miner_blocks + i * b.p.nminers;
+        sc->r.miner_reward = miner_reward + i * b.p.nminers;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((uint64_t)threads > b.nscenarios) {
+        threads = b.nscenarios;
+    }
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    for (int t = 1; t < threads; t++) {
+        pthread_create(&tids[t], NULL, sim_worker, &b);
+    }
+    sim_worker(&b);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", output, strerror(errno));
+        return (1);
+    }
+    print_csv(out, &b, sweeps, nsweeps);
+    if (out != stdout) {
+        fclose(out);
+    }
+    uint64_t blocks = 0;
+    for (uint64_t i = 0; i < b.nscenarios; i++) {
+        blocks += b.scenarios[i].r.blocks;
+        snapshot_free(&b.scenarios[i].s);
+    }
+    double used = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu scenarios, %llu blocks in %.2fs (%.0f blocks/s, %d threads)\n",
+            (unsigned long long)b.nscenarios, (unsigned long long)blocks, used, blocks / used, threads);
+    free(tids);
+    free(miner_blocks);
+    free(miner_reward);
+    free(b.scenarios);
+    snapshot_free(&base);
+    free(miners);
+    return (0);
+}
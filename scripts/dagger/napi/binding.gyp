@@ -0,0 +1,15 @@
+{
+  "targets": [
+    {
+      "target_name": "dagger_addon",
+      "sources": ["dagger_addon.cpp"],
+      "cflags!": ["-fno-exceptions"],
+      "cflags_cc!": ["-fno-exceptions"],
+      "cflags_cc": ["-std=c++17", "-O3", "-march=native"],
+      "xcode_settings": {
+        "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+        "OTHER_CPLUSPLUSFLAGS": ["-std=c++17", "-O3", "-march=native"]
+      }
+    }
+  ]
+}
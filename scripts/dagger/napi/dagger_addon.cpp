@@ -0,0 +1,964 @@
+// Node-API bindings for the dagger mask, storage hashimoto and MerkleLib code.
+//
+//   cd scripts/dagger/napi && npx node-gyp rebuild
+//   const dagger = require("./scripts/dagger/napi");
+//
+// Byte arguments are Buffers or any Uint8Array, read in place; 0x-prefixed
+// hex strings (what ethers returns) are accepted too and copied.  Results are
+// Buffers the kernels write directly, and maskBlob() can write into a caller
+// supplied Buffer, including its input to mask in place.
+//
+// The *Async variants run on the libuv thread pool and return a Promise; their
+// inputs are referenced, not copied, until the work completes, so callers must
+// not modify them meanwhile.
+//
+// The storage hashimoto functions take the DecentralizedKV parameters
+//   { maxKvSizeBits, shardEntryBits, shardLenBits, startShardId, randomChecks, chunkSizeBits }
+// and a mode naming the DKVDaggerHashimoto routine to mirror: "hashimoto"
+// (_hashimoto, the default), "keccak256" (_hashimotoKeccak256) or "merkle"
+// (_hashimotoMerkleProof).  The shard is an array of masked blobs indexed by
+// kvIdx - (startShardId << shardEntryBits).
+
+#include <node_api.h>
+
+#define DAGGER_NO_MAIN
+#include "../dagger_kernels.cpp"
+#include "../keccak.c"
+#include "../fnv256.c"
+#include "../merkle.c"
+
+#include <new>
+#include <string>
+#include <vector>
+
+// Thrown by argument checks; wrap() turns it into a JS exception.
+struct JsError {
+    bool range;
+    std::string msg;
+};
+
+// A N-API call failed and left its exception pending.
+struct JsPending {};
+
+static void check(napi_env env, napi_status status) {
+    if (status == napi_ok) {
+        return;
+    }
+    bool pending = false;
+    napi_is_exception_pending(env, &pending);
+    if (pending) {
+        throw JsPending();
+    }
+    const napi_extended_error_info *info = NULL;
+    napi_get_last_error_info(env, &info);
+    throw JsError{false, info && info->error_message ? info->error_message : "N-API call failed"};
+}
+
+struct Args {
+    napi_env env;
+    size_t argc = 8;
+    napi_value argv[8];
+
+    bool has(size_t i) const {
+        if (i >= argc) {
+            return false;
+        }
+        napi_valuetype t;
+        check(env, napi_typeof(env, argv[i], &t));
+        return t != napi_undefined && t != napi_null;
+    }
+};
+
+typedef napi_value (*Method)(napi_env env, Args &a);
+
+template <Method M> static napi_value wrap(napi_env env, napi_callback_info info) {
+    Args a;
+    a.env = env;
+    try {
+        check(env, napi_get_cb_info(env, info, &a.argc, a.argv, NULL, NULL));
+        return M(env, a);
+    } catch (const JsError &e) {
+        if (e.range) {
+            napi_throw_range_error(env, NULL, e.msg.c_str());
+        } else {
+            napi_throw_type_error(env, NULL, e.msg.c_str());
+        }
+    } catch (const JsPending &) {
+    } catch (const std::bad_alloc &) {
+        napi_throw_error(env, NULL, "out of memory");
+    }
+    return NULL;
+}
+
+// A byte argument: a view of a Uint8Array, or the decoded bytes of a hex string.
+struct Bytes {
+    const unsigned char *data = NULL;
+    size_t len = 0;
+    napi_value value = NULL;
+    std::vector<unsigned char> owned;
+
+    // data may point into owned, which survives a move but not a copy
+    Bytes() = default;
+    Bytes(Bytes &&) = default;
+    Bytes &operator=(Bytes &&) = default;
+    Bytes(const Bytes &) = delete;
+};
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static Bytes get_bytes(napi_env env, napi_value v, const char *name) {
+    Bytes b;
+    b.value = v;
+    napi_valuetype t;
+    check(env, napi_typeof(env, v, &t));
+    if (t == napi_string) {
+        size_t n;
+        check(env, napi_get_value_string_utf8(env, v, NULL, 0, &n));
+        std::string s(n, '\0');
+        check(env, napi_get_value_string_utf8(env, v, &s[0], n + 1, &n));
+        if (n < 2 || s[0] != '0' || (s[1] | 0x20) != 'x' || n % 2 != 0) {
+            throw JsError{false, std::string(name) + " must be a Buffer or a 0x-prefixed hex string"};
+        }
+        for (size_t k = 2; k < n; k += 2) {
+            int hi = hex_digit(s[k]), lo = hex_digit(s[k + 1]);
+            if (hi < 0 || lo < 0) {
+                throw JsError{false, std::string(name) + " is not valid hex"};
+            }
+            b.owned.push_back((unsigned char)(hi << 4 | lo));
+        }
+        b.data = b.owned.data();
+        b.len = b.owned.size();
+        return b;
+    }
+    bool is_typed = false;
+    check(env, napi_is_typedarray(env, v, &is_typed));
+    napi_typedarray_type type;
+    void *data = NULL;
+    if (!is_typed || (check(env, napi_get_typedarray_info(env, v, &type, &b.len, &data, NULL, NULL)),
+                      type != napi_uint8_array && type != napi_uint8_clamped_array)) {
+        throw JsError{false, std::string(name) + " must be a Buffer or Uint8Array"};
+    }
+    b.data = (const unsigned char *)data;
+    return b;
+}
+
+static Bytes get_hash32(napi_env env, napi_value v, const char *name) {
+    Bytes b = get_bytes(env, v, name);
+    if (b.len != 32) {
+        throw JsError{true, std::string(name) + " must be 32 bytes"};
+    }
+    return b;
+}
+
+// A number or a BigInt that fits in 64 bits.
+static uint64_t get_u64(napi_env env, napi_value v, const char *name) {
+    napi_valuetype t;
+    check(env, napi_typeof(env, v, &t));
+    if (t == napi_bigint) {
+        uint64_t r;
+        bool lossless;
+        check(env, napi_get_value_bigint_uint64(env, v, &r, &lossless));
+        if (!lossless) {
+            throw JsError{true, std::string(name) + " does not fit in 64 bits"};
+        }
+        return r;
+    }
+    double d;
+    if (t != napi_number || (check(env, napi_get_value_double(env, v, &d)), !(d >= 0 && d < 0x1p64) ||
+                             d != (double)(uint64_t)d)) {
+        throw JsError{false, std::string(name) + " must be a non-negative integer"};
+    }
+    return (uint64_t)d;
+}
+
+static uint64_t get_named_u64(napi_env env, napi_value obj, const char *name, bool required, uint64_t def) {
+    bool has;
+    check(env, napi_has_named_property(env, obj, name, &has));
+    napi_value v = NULL;
+    if (has) {
+        check(env, napi_get_named_property(env, obj, name, &v));
+        napi_valuetype t;
+        check(env, napi_typeof(env, v, &t));
+        has = t != napi_undefined;
+    }
+    if (!has) {
+        if (required) {
+            throw JsError{false, std::string("params.") + name + " is required"};
+        }
+        return def;
+    }
+    return get_u64(env, v, name);
+}
+
+static std::string get_string(napi_env env, napi_value v, const char *name) {
+    size_t n;
+    if (napi_get_value_string_utf8(env, v, NULL, 0, &n) != napi_ok) {
+        throw JsError{false, std::string(name) + " must be a string"};
+    }
+    std::string s(n, '\0');
+    check(env, napi_get_value_string_utf8(env, v, &s[0], n + 1, &n));
+    return s;
+}
+
+static napi_value new_buffer(napi_env env, size_t len, unsigned char **data) {
+    napi_value v;
+    check(env, napi_create_buffer(env, len, (void **)data, &v));
+    return v;
+}
+
+static napi_value copy_buffer(napi_env env, const unsigned char *data, size_t len) {
+    napi_value v;
+    check(env, napi_create_buffer_copy(env, len, data, NULL, &v));
+    return v;
+}
+
+// Work for the libuv thread pool.  The inputs and the result stay referenced
+// until complete() resolves the promise with the result.
+struct AsyncJob {
+    napi_async_work work = NULL;
+    napi_deferred deferred = NULL;
+    std::vector<napi_ref> refs;
+    napi_ref result = NULL;
+    std::string error;
+
+    virtual ~AsyncJob() {}
+    virtual void run() = 0;
+
+    void keep(napi_env env, napi_value v) {
+        napi_ref r;
+        check(env, napi_create_reference(env, v, 1, &r));
+        refs.push_back(r);
+    }
+
+    // Hex strings were decoded into b.owned and need no reference.
+    void keep(napi_env env, const Bytes &b) {
+        if (b.owned.empty()) {
+            keep(env, b.value);
+        }
+    }
+
+    static void execute(napi_env env, void *data) {
+        AsyncJob *job = (AsyncJob *)data;
+        try {
+            job->run();
+        } catch (const std::bad_alloc &) {
+            job->error = "out of memory";
+        } catch (const JsError &e) {
+            job->error = e.msg;
+        }
+    }
+
+    static void complete(napi_env env, napi_status status, void *data) {
+        AsyncJob *job = (AsyncJob *)data;
+        napi_value v = NULL;
+        if (status == napi_ok && job->error.empty()) {
+            napi_get_reference_value(env, job->result, &v);
+            napi_resolve_deferred(env, job->deferred, v);
+        } else {
+            napi_value msg;
+            napi_create_string_utf8(env, job->error.empty() ? "cancelled" : job->error.c_str(), NAPI_AUTO_LENGTH,
+                                    &msg);
+            napi_create_error(env, NULL, msg, &v);
+            napi_reject_deferred(env, job->deferred, v);
+        }
+        for (napi_ref r : job->refs) {
+            napi_delete_reference(env, r);
+        }
+        napi_delete_reference(env, job->result);
+        napi_delete_async_work(env, job->work);
+        delete job;
+    }
+
+    // Queues the job and returns its promise; takes ownership of job.
+    static napi_value queue(napi_env env, AsyncJob *job, napi_value result, const char *name) {
+        napi_value promise, resource_name;
+        try {
+            check(env, napi_create_reference(env, result, 1, &job->result));
+            check(env, napi_create_promise(env, &job->deferred, &promise));
+            check(env, napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resource_name));
+            check(env, napi_create_async_work(env, NULL, resource_name, execute, complete, job, &job->work));
+            check(env, napi_queue_async_work(env, job->work));
+        } catch (...) {
+            // a created promise is left pending; nothing else can observe it
+            for (napi_ref r : job->refs) {
+                napi_delete_reference(env, r);
+            }
+            if (job->result != NULL) {
+                napi_delete_reference(env, job->result);
+            }
+            if (job->work != NULL) {
+                napi_delete_async_work(env, job->work);
+            }
+            delete job;
+            throw;
+        }
+        return promise;
+    }
+};
+
+static napi_value js_keccak256(napi_env env, Args &a) {
+    if (!a.has(0)) {
+        throw JsError{false, "keccak256(data)"};
+    }
+    Bytes data = get_bytes(env, a.argv[0], "data");
+    unsigned char *out;
+    napi_value ret = new_buffer(env, 32, &out);
+    keccak256(data.data, data.len, out);
+    return ret;
+}
+
+// ---- dagger cache and mask ----
+
+static const DaggerKernelEntry *get_kernel(napi_env env, Args &a, size_t i) {
+    std::string name = a.has(i) ? get_string(env, a.argv[i], "kernel") : "dagger32-sha512";
+    size_t n;
+    const DaggerKernelEntry *k = dagger_kernels(&n);
+    for (size_t j = 0; j < n; j++) {
+        if (name == k[j].name) {
+            return &k[j];
+        }
+    }
+    throw JsError{true, "unknown kernel " + name};
+}
+
+static napi_value js_generate_cache(napi_env env, Args &a) {
+    if (!a.has(1)) {
+        throw JsError{false, "generateCache(cacheSize, seed, kernel?)"};
+    }
+    uint64_t cache_size = get_u64(env, a.argv[0], "cacheSize") / 64 * 64;
+    Bytes seed = get_bytes(env, a.argv[1], "seed");
+    const DaggerKernelEntry *k = get_kernel(env, a, 2);
+    if (cache_size == 0) {
+        throw JsError{true, "cacheSize must be at least 64"};
+    }
+    unsigned char *cache = k->generate_cache(cache_size, seed.data, seed.len);
+    if (cache == NULL) {
+        throw std::bad_alloc();
+    }
+    napi_value ret;
+    napi_status status = napi_create_buffer_copy(env, cache_size, cache, NULL, &ret);
+    free(cache);
+    check(env, status);
+    return ret;
+}
+
+struct MaskJob : AsyncJob {
+    const DaggerKernelEntry *kernel;
+    Bytes cache, data;
+    uint64_t first;
+    unsigned char *out;
+
+    // The 64-byte piece at byte p is masked as item first + p / 64, and a
+    // trailing partial piece as if zero padded, like dataset_stream mask mode.
+    void run() {
+        if (out != data.data) {
+            memmove(out, data.data, data.len);
+        }
+        uint64_t items = data.len / 64;
+        for (uint64_t j = 0; j < items; j++) {
+            kernel->calculate_mask_data(cache.data, cache.len, first + j, out + 64 * j);
+        }
+        if (data.len % 64 != 0) {
+            unsigned char tail[64] = {0};
+            memcpy(tail, out + 64 * items, data.len % 64);
+            kernel->calculate_mask_data(cache.data, cache.len, first + items, tail);
+            memcpy(out + 64 * items, tail, data.len % 64);
+        }
+    }
+};
+
+// maskBlob(cache, firstItem, data, out?, kernel?)
+static MaskJob *mask_job(napi_env env, Args &a, napi_value *result) {
+    if (!a.has(2)) {
+        throw JsError{false, "maskBlob(cache, firstItem, data, out?, kernel?)"};
+    }
+    MaskJob *job = new MaskJob();
+    try {
+        job->cache = get_bytes(env, a.argv[0], "cache");
+        job->first = get_u64(env, a.argv[1], "firstItem");
+        job->data = get_bytes(env, a.argv[2], "data");
+        job->kernel = get_kernel(env, a, 4);
+        if (job->cache.len == 0 || job->cache.len % 64 != 0) {
+            throw JsError{true, "cache size must be a non-zero multiple of 64"};
+        }
+        if (a.has(3)) {
+            Bytes out = get_bytes(env, a.argv[3], "out");
+            if (out.value == NULL || !out.owned.empty() || out.len < job->data.len) {
+                throw JsError{true, "out must be a Buffer at least as long as data"};
+            }
+            job->out = (unsigned char *)out.data;
+            *result = out.value;
+        } else {
+            *result = new_buffer(env, job->data.len, &job->out);
+        }
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return job;
+}
+
+static napi_value js_mask_blob(napi_env env, Args &a) {
+    napi_value result;
+    MaskJob *job = mask_job(env, a, &result);
+    job->run();
+    delete job;
+    return result;
+}
+
+static napi_value js_mask_blob_async(napi_env env, Args &a) {
+    napi_value result;
+    MaskJob *job = mask_job(env, a, &result);
+    try {
+        job->keep(env, job->cache);
+        job->keep(env, job->data);
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return AsyncJob::queue(env, job, result, "dagger.maskBlob");
+}
+
+// ---- storage hashimoto ----
+
+enum storage_mode { MODE_HASHIMOTO, MODE_KECCAK256, MODE_MERKLE };
+
+struct StorageParams {
+    unsigned max_kv_size_bits;
+    unsigned shard_entry_bits;
+    unsigned shard_len_bits;
+    unsigned chunk_size_bits;
+    unsigned chunk_len_bits;
+    uint64_t start_shard_id;
+    uint64_t random_checks;
+    int mode;
+    struct storage_index_params index;
+};
+
+static StorageParams get_params(napi_env env, Args &a, size_t i, size_t mode_arg) {
+    napi_valuetype t;
+    if (!a.has(i) || (check(env, napi_typeof(env, a.argv[i], &t)), t != napi_object)) {
+        throw JsError{false, "params must be an object"};
+    }
+    StorageParams p;
+    napi_value o = a.argv[i];
+    p.max_kv_size_bits = get_named_u64(env, o, "maxKvSizeBits", true, 0);
+    p.shard_entry_bits = get_named_u64(env, o, "shardEntryBits", true, 0);
+    p.shard_len_bits = get_named_u64(env, o, "shardLenBits", false, 0);
+    p.start_shard_id = get_named_u64(env, o, "startShardId", false, 0);
+    p.random_checks = get_named_u64(env, o, "randomChecks", true, 0);
+    p.chunk_size_bits = get_named_u64(env, o, "chunkSizeBits", false, p.max_kv_size_bits);
+    std::string mode = a.has(mode_arg) ? get_string(env, a.argv[mode_arg], "mode") : "hashimoto";
+    if (mode == "hashimoto") {
+        p.mode = MODE_HASHIMOTO;
+    } else if (mode == "keccak256") {
+        p.mode = MODE_KECCAK256;
+    } else if (mode == "merkle") {
+        p.mode = MODE_MERKLE;
+    } else {
+        throw JsError{true, "mode must be hashimoto, keccak256 or merkle"};
+    }
+    if (p.max_kv_size_bits < 6 || p.max_kv_size_bits > 32 || p.chunk_size_bits > p.max_kv_size_bits) {
+        throw JsError{true, "need 6 <= maxKvSizeBits <= 32 and chunkSizeBits <= maxKvSizeBits"};
+    }
+    p.chunk_len_bits = p.max_kv_size_bits - p.chunk_size_bits;
+    if (p.shard_entry_bits + p.shard_len_bits + p.chunk_len_bits > 48) {
+        throw JsError{true, "shard too large to hold in memory"};
+    }
+    storage_index_init(&p.index, p.shard_entry_bits, p.shard_len_bits, p.start_shard_id, p.max_kv_size_bits);
+    return p;
+}
+
+// The masked blobs of a shard; kept referenced by async jobs.
+struct Shard {
+    std::vector<Bytes> blobs;
+    napi_value value;
+};
+
+static Shard get_shard(napi_env env, napi_value v, const StorageParams &p) {
+    bool is_array;
+    check(env, napi_is_array(env, v, &is_array));
+    if (!is_array) {
+        throw JsError{false, "shard must be an array of blobs"};
+    }
+    Shard s;
+    s.value = v;
+    uint32_t n;
+    check(env, napi_get_array_length(env, v, &n));
+    if (n > (1ULL << (p.shard_entry_bits + p.shard_len_bits))) {
+        throw JsError{true, "shard has more blobs than shardLen << shardEntryBits"};
+    }
+    s.blobs.resize(n);
+    for (uint32_t j = 0; j < n; j++) {
+        napi_value b;
+        napi_valuetype t;
+        check(env, napi_get_element(env, v, j, &b));
+        check(env, napi_typeof(env, b, &t));
+        if (t == napi_undefined || t == napi_null) {
+            continue;
+        }
+        s.blobs[j] = get_bytes(env, b, "blob");
+        if (s.blobs[j].len != (1ULL << p.max_kv_size_bits)) {
+            throw JsError{true, "blob " + std::to_string(j) + " is not maxKvSize bytes"};
+        }
+    }
+    return s;
+}
+
+static const unsigned char *shard_blob(const Shard &s, uint64_t local) {
+    if (local >= s.blobs.size() || s.blobs[local].data == NULL) {
+        throw JsError{true, "shard has no blob for local kv index " + std::to_string(local)};
+    }
+    return s.blobs[local].data;
+}
+
+// One DKVDaggerHashimoto hashimoto of hash0 over the shard.  The kv and
+// chunk index of every access go to kv_idx and chunk_idx when non-NULL.
+static void storage_hashimoto(const StorageParams &p, const Shard &s, const unsigned char *hash0,
+                              std::vector<unsigned char> &scratch, unsigned char *out, uint64_t *kv_idx,
+                              uint64_t *chunk_idx) {
+    uint64_t max_kv_size = 1ULL << p.max_kv_size_bits;
+    uint64_t chunk_size = 1ULL << p.chunk_size_bits;
+    uint64_t kv_base = p.start_shard_id << p.shard_entry_bits;
+    scratch.resize(32 + max_kv_size);
+    unsigned char *buf = scratch.data();
+
+    if (p.mode == MODE_HASHIMOTO) {
+        for (uint64_t k = 0; k < max_kv_size; k += 32) {
+            memcpy(buf + k, hash0, 32);
+        }
+        u256 h0 = u256_from_be(hash0);
+        uint64_t mix_off = 0;
+        for (uint64_t i = 0; i < p.random_checks; i++) {
+            u256 mix_data = u256_from_be(buf + mix_off);
+            uint64_t parent, kv;
+            mix_off = storage_index(&p.index, h0, i, &mix_data, &parent, &kv);
+            const unsigned char *data = shard_blob(s, parent);
+            for (uint64_t k = 0; k < max_kv_size; k++) {
+                buf[k] ^= data[k];
+            }
+            if (kv_idx != NULL) {
+                kv_idx[i] = kv;
+                chunk_idx[i] = 0;
+            }
+        }
+        keccak256(buf, max_kv_size, out);
+        return;
+    }
+
+    // _hashimotoKeccak256 chains h = keccak256(h || blob).  _hashimotoMerkleProof
+    // picks a chunk of a blob and chains h = keccak256(h || chunk), as the
+    // off-chain check in test/dkv-dagger-hashimoto-test.js does.
+    unsigned bits = p.shard_entry_bits + p.shard_len_bits + (p.mode == MODE_MERKLE ? p.chunk_len_bits : 0);
+    uint64_t len = p.mode == MODE_MERKLE ? chunk_size : max_kv_size;
+    memcpy(buf, hash0, 32);
+    for (uint64_t i = 0; i < p.random_checks; i++) {
+        uint64_t parent = u256_from_be(buf).w[0] & ((1ULL << bits) - 1);
+        uint64_t local = parent, chunk = 0;
+        if (p.mode == MODE_MERKLE) {
+            local = parent >> p.chunk_len_bits;
+            chunk = parent & ((1ULL << p.chunk_len_bits) - 1);
+        }
+        memcpy(buf + 32, shard_blob(s, local) + chunk * chunk_size, len);
+        keccak256(buf, 32 + len, buf);
+        if (kv_idx != NULL) {
+            kv_idx[i] = local + kv_base;
+            chunk_idx[i] = chunk;
+        }
+    }
+    memcpy(out, buf, 32);
+}
+
+static napi_value u64_array(napi_env env, const std::vector<uint64_t> &v) {
+    napi_value arr, x;
+    check(env, napi_create_array_with_length(env, v.size(), &arr));
+    for (size_t j = 0; j < v.size(); j++) {
+        check(env, napi_create_double(env, (double)v[j], &x));
+        check(env, napi_set_element(env, arr, j, x));
+    }
+    return arr;
+}
+
+// hashimoto(params, hash0, shard, mode?) -> { hash, kvIdx: [], chunkIdx: [] }
+static napi_value js_hashimoto(napi_env env, Args &a) {
+    if (!a.has(2)) {
+        throw JsError{false, "hashimoto(params, hash0, shard, mode?)"};
+    }
+    StorageParams p = get_params(env, a, 0, 3);
+    Bytes hash0 = get_hash32(env, a.argv[1], "hash0");
+    Shard s = get_shard(env, a.argv[2], p);
+    std::vector<unsigned char> scratch;
+    std::vector<uint64_t> kv_idx(p.random_checks), chunk_idx(p.random_checks);
+    unsigned char *out;
+    napi_value hash = new_buffer(env, 32, &out);
+    storage_hashimoto(p, s, hash0.data, scratch, out, kv_idx.data(), chunk_idx.data());
+
+    napi_value ret;
+    check(env, napi_create_object(env, &ret));
+    check(env, napi_set_named_property(env, ret, "hash", hash));
+    check(env, napi_set_named_property(env, ret, "kvIdx", u64_array(env, kv_idx)));
+    check(env, napi_set_named_property(env, ret, "chunkIdx", u64_array(env, chunk_idx)));
+    return ret;
+}
+
+struct HashimotoBatchJob : AsyncJob {
+    StorageParams params;
+    Shard shard;
+    Bytes hash0s;
+    unsigned char *out;
+
+    void run() {
+        std::vector<unsigned char> scratch;
+        for (size_t j = 0; j < hash0s.len / 32; j++) {
+            storage_hashimoto(params, shard, hash0s.data + 32 * j, scratch, out + 32 * j, NULL, NULL);
+        }
+    }
+};
+
+// hashimotoBatch(params, hash0s, shard, mode?): one 32-byte result per 32-byte hash0 in hash0s
+static HashimotoBatchJob *hashimoto_batch_job(napi_env env, Args &a, napi_value *result) {
+    if (!a.has(2)) {
+        throw JsError{false, "hashimotoBatch(params, hash0s, shard, mode?)"};
+    }
+    HashimotoBatchJob *job = new HashimotoBatchJob();
+    try {
+        job->params = get_params(env, a, 0, 3);
+        job->hash0s = get_bytes(env, a.argv[1], "hash0s");
+        if (job->hash0s.len % 32 != 0) {
+            throw JsError{true, "hash0s must be a concatenation of 32-byte hashes"};
+        }
+        job->shard = get_shard(env, a.argv[2], job->params);
+        *result = new_buffer(env, job->hash0s.len, &job->out);
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return job;
+}
+
+static napi_value js_hashimoto_batch(napi_env env, Args &a) {
+    napi_value result;
+    HashimotoBatchJob *job = hashimoto_batch_job(env, a, &result);
+    try {
+        job->run();
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    delete job;
+    return result;
+}
+
+static napi_value js_hashimoto_batch_async(napi_env env, Args &a) {
+    napi_value result;
+    HashimotoBatchJob *job = hashimoto_batch_job(env, a, &result);
+    try {
+        job->keep(env, job->hash0s);
+        job->keep(env, job->shard.value);
+        for (const Bytes &b : job->shard.blobs) {
+            if (b.value != NULL) {
+                job->keep(env, b);
+            }
+        }
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return AsyncJob::queue(env, job, result, "dagger.hashimotoBatch");
+}
+
+// mineHashes(hash0, miner, minedTs, firstNonce, count): keccak256(abi.encode(hash0, miner, minedTs, nonce))
+// for count nonces, the hash0 _mine() passes to the hashimoto.
+static napi_value js_mine_hashes(napi_env env, Args &a) {
+    if (!a.has(4)) {
+        throw JsError{false, "mineHashes(hash0, miner, minedTs, firstNonce, count)"};
+    }
+    Bytes hash0 = get_hash32(env, a.argv[0], "hash0");
+    Bytes miner = get_bytes(env, a.argv[1], "miner");
+    uint64_t mined_ts = get_u64(env, a.argv[2], "minedTs");
+    uint64_t first = get_u64(env, a.argv[3], "firstNonce");
+    uint64_t count = get_u64(env, a.argv[4], "count");
+    if (miner.len != 20) {
+        throw JsError{true, "miner must be a 20-byte address"};
+    }
+    unsigned char abi[128] = {0};
+    memcpy(abi, hash0.data, 32);
+    memcpy(abi + 44, miner.data, 20);
+    for (int k = 0; k < 8; k++) {
+        abi[95 - k] = (unsigned char)(mined_ts >> (8 * k));
+    }
+    unsigned char *out;
+    napi_value ret = new_buffer(env, 32 * count, &out);
+    for (uint64_t j = 0; j < count; j++) {
+        for (int k = 0; k < 8; k++) {
+            abi[127 - k] = (unsigned char)((first + j) >> (8 * k));
+        }
+        keccak256(abi, sizeof(abi), out + 32 * j);
+    }
+    return ret;
+}
+
+// ---- MerkleLib ----
+
+static unsigned get_chunk_bits(napi_env env, napi_value v) {
+    uint64_t bits = get_u64(env, v, "nChunkBits");
+    if (bits > 40) {
+        throw JsError{true, "nChunkBits must be at most 40"};
+    }
+    return (unsigned)bits;
+}
+
+static uint64_t get_chunk_size(napi_env env, napi_value v) {
+    uint64_t chunk_size = get_u64(env, v, "chunkSize");
+    if (chunk_size == 0) {
+        throw JsError{true, "chunkSize must be positive"};
+    }
+    return chunk_size;
+}
+
+// merkleRoot(data, chunkSize, nChunkBits)
+static napi_value js_merkle_root(napi_env env, Args &a) {
+    if (!a.has(2)) {
+        throw JsError{false, "merkleRoot(data, chunkSize, nChunkBits)"};
+    }
+    Bytes data = get_bytes(env, a.argv[0], "data");
+    uint64_t chunk_size = get_chunk_size(env, a.argv[1]);
+    unsigned bits = get_chunk_bits(env, a.argv[2]);
+    unsigned char *out;
+    napi_value ret = new_buffer(env, 32, &out);
+    if (merkle_root(data.data, data.len, chunk_size, bits, out) != 0) {
+        throw std::bad_alloc();
+    }
+    return ret;
+}
+
+// merkleRootWithMinTree(data, chunkSize)
+static napi_value js_merkle_root_min_tree(napi_env env, Args &a) {
+    if (!a.has(1)) {
+        throw JsError{false, "merkleRootWithMinTree(data, chunkSize)"};
+    }
+    Bytes data = get_bytes(env, a.argv[0], "data");
+    uint64_t chunk_size = get_chunk_size(env, a.argv[1]);
+    unsigned char *out;
+    napi_value ret = new_buffer(env, 32, &out);
+    if (merkle_root_min_tree(data.data, data.len, chunk_size, out) != 0) {
+        throw std::bad_alloc();
+    }
+    return ret;
+}
+
+static napi_value proof_array(napi_env env, const unsigned char *proof, unsigned bits) {
+    napi_value arr;
+    check(env, napi_create_array_with_length(env, bits, &arr));
+    for (unsigned l = 0; l < bits; l++) {
+        check(env, napi_set_element(env, arr, l, copy_buffer(env, proof + 32 * l, 32)));
+    }
+    return arr;
+}
+
+// getProof(data, chunkSize, nChunkBits, chunkIdx) -> [32-byte sibling per level]
+// getProof(data, chunkSize, nChunkBits, [chunkIdx, ...]) -> one proof per index, from one tree
+static napi_value js_get_proof(napi_env env, Args &a) {
+    if (!a.has(3)) {
+        throw JsError{false, "getProof(data, chunkSize, nChunkBits, chunkIdx)"};
+    }
+    Bytes data = get_bytes(env, a.argv[0], "data");
+    uint64_t chunk_size = get_chunk_size(env, a.argv[1]);
+    unsigned bits = get_chunk_bits(env, a.argv[2]);
+    bool many;
+    check(env, napi_is_array(env, a.argv[3], &many));
+    std::vector<uint64_t> idx;
+    uint32_t n = 1;
+    if (many) {
+        check(env, napi_get_array_length(env, a.argv[3], &n));
+    }
+    for (uint32_t j = 0; j < n; j++) {
+        napi_value v = a.argv[3];
+        if (many) {
+            check(env, napi_get_element(env, a.argv[3], j, &v));
+        }
+        idx.push_back(get_u64(env, v, "chunkIdx"));
+        if (idx.back() >= (1ULL << bits)) {
+            throw JsError{true, "index out of scope"};
+        }
+    }
+
+    struct merkle_tree t;
+    if (merkle_tree_build(&t, data.data, data.len, chunk_size, bits) != 0) {
+        throw std::bad_alloc();
+    }
+    std::vector<unsigned char> proof(32 * bits);
+    napi_value ret = NULL;
+    try {
+        if (many) {
+            check(env, napi_create_array_with_length(env, n, &ret));
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            merkle_tree_proof(&t, idx[j], proof.data());
+            napi_value p = proof_array(env, proof.data(), bits);
+            if (!many) {
+                ret = p;
+            } else {
+                check(env, napi_set_element(env, ret, j, p));
+            }
+        }
+    } catch (...) {
+        merkle_tree_free(&t);
+        throw;
+    }
+    merkle_tree_free(&t);
+    return ret;
+}
+
+static std::vector<unsigned char> get_proof_arg(napi_env env, napi_value v) {
+    bool is_array;
+    check(env, napi_is_array(env, v, &is_array));
+    if (!is_array) {
+        throw JsError{false, "proofs must be an array of 32-byte hashes"};
+    }
+    uint32_t n;
+    check(env, napi_get_array_length(env, v, &n));
+    std::vector<unsigned char> proof(32 * n);
+    for (uint32_t l = 0; l < n; l++) {
+        napi_value p;
+        check(env, napi_get_element(env, v, l, &p));
+        memcpy(proof.data() + 32 * l, get_hash32(env, p, "proof").data, 32);
+    }
+    return proof;
+}
+
+// calculateRootWithProof(dataHash, chunkIdx, proofs)
+static napi_value js_root_with_proof(napi_env env, Args &a) {
+    if (!a.has(2)) {
+        throw JsError{false, "calculateRootWithProof(dataHash, chunkIdx, proofs)"};
+    }
+    Bytes hash = get_hash32(env, a.argv[0], "dataHash");
+    uint64_t idx = get_u64(env, a.argv[1], "chunkIdx");
+    std::vector<unsigned char> proof = get_proof_arg(env, a.argv[2]);
+    unsigned bits = proof.size() / 32;
+    if (bits < 64 && idx >= (1ULL << bits)) {
+        throw JsError{true, "chunkId overflows"};
+    }
+    unsigned char *out;
+    napi_value ret = new_buffer(env, 32, &out);
+    merkle_root_with_proof(hash.data, idx, proof.data(), bits, out);
+    return ret;
+}
+
+// verify(dataHash, chunkIdx, root, proofs)
+static napi_value js_verify(napi_env env, Args &a) {
+    if (!a.has(3)) {
+        throw JsError{false, "verify(dataHash, chunkIdx, root, proofs)"};
+    }
+    Bytes hash = get_hash32(env, a.argv[0], "dataHash");
+    uint64_t idx = get_u64(env, a.argv[1], "chunkIdx");
+    Bytes root = get_hash32(env, a.argv[2], "root");
+    std::vector<unsigned char> proof = get_proof_arg(env, a.argv[3]);
+    unsigned bits = proof.size() / 32;
+    if (bits < 64 && idx >= (1ULL << bits)) {
+        throw JsError{true, "chunkId overflows"};
+    }
+    napi_value ret;
+    check(env, napi_get_boolean(env, merkle_verify(hash.data, idx, root.data, proof.data(), bits), &ret));
+    return ret;
+}
+
+struct MerkleBatchJob : AsyncJob {
+    std::vector<Bytes> blobs;
+    uint64_t chunk_size;
+    unsigned bits;
+    unsigned char *out;
+
+    void run() {
+        for (size_t j = 0; j < blobs.size(); j++) {
+            if (merkle_root(blobs[j].data, blobs[j].len, chunk_size, bits, out + 32 * j) != 0) {
+                throw std::bad_alloc();
+            }
+        }
+    }
+};
+
+// merkleRootBatch(blobs, chunkSize, nChunkBits): the roots of every blob, concatenated
+static MerkleBatchJob *merkle_batch_job(napi_env env, Args &a, napi_value *result) {
+    bool is_array = false;
+    if (!a.has(2) || (check(env, napi_is_array(env, a.argv[0], &is_array)), !is_array)) {
+        throw JsError{false, "merkleRootBatch(blobs, chunkSize, nChunkBits)"};
+    }
+    MerkleBatchJob *job = new MerkleBatchJob();
+    try {
+        uint32_t n;
+        check(env, napi_get_array_length(env, a.argv[0], &n));
+        for (uint32_t j = 0; j < n; j++) {
+            napi_value v;
+            check(env, napi_get_element(env, a.argv[0], j, &v));
+            job->blobs.push_back(get_bytes(env, v, "blob"));
+        }
+        job->chunk_size = get_chunk_size(env, a.argv[1]);
+        job->bits = get_chunk_bits(env, a.argv[2]);
+        *result = new_buffer(env, 32 * n, &job->out);
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return job;
+}
+
+static napi_value js_merkle_root_batch(napi_env env, Args &a) {
+    napi_value result;
+    MerkleBatchJob *job = merkle_batch_job(env, a, &result);
+    try {
+        job->run();
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    delete job;
+    return result;
+}
+
+static napi_value js_merkle_root_batch_async(napi_env env, Args &a) {
+    napi_value result;
+    MerkleBatchJob *job = merkle_batch_job(env, a, &result);
+    try {
+        job->keep(env, a.argv[0]);
+        for (const Bytes &b : job->blobs) {
+            job->keep(env, b);
+        }
+    } catch (...) {
+        delete job;
+        throw;
+    }
+    return AsyncJob::queue(env, job, result, "dagger.merkleRootBatch");
+}
+
+static napi_value init(napi_env env, napi_value exports) {
+    static const napi_property_descriptor methods[] = {
+        {"keccak256", NULL, wrap<js_keccak256>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"generateCache", NULL, wrap<js_generate_cache>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"maskBlob", NULL, wrap<js_mask_blob>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"maskBlobAsync", NULL, wrap<js_mask_blob_async>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"hashimoto", NULL, wrap<js_hashimoto>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"hashimotoBatch", NULL, wrap<js_hashimoto_batch>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"hashimotoBatchAsync", NULL, wrap<js_hashimoto_batch_async>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"mineHashes", NULL, wrap<js_mine_hashes>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"merkleRoot", NULL, wrap<js_merkle_root>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"merkleRootWithMinTree", NULL, wrap<js_merkle_root_min_tree>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"getProof", NULL, wrap<js_get_proof>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"calculateRootWithProof", NULL, wrap<js_root_with_proof>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"verify", NULL, wrap<js_verify>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"merkleRootBatch", NULL, wrap<js_merkle_root_batch>, NULL, NULL, NULL, napi_enumerable, NULL},
+        {"merkleRootBatchAsync", NULL, wrap<js_merkle_root_batch_async>, NULL, NULL, NULL, napi_enumerable, NULL},
+    };
+    if (napi_define_properties(env, exports, sizeof(methods) / sizeof(methods[0]), methods) != napi_ok) {
+        return NULL;
+    }
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
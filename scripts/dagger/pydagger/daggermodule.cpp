@@ -0,0 +1,639 @@
+// CPython bindings for the native dagger and storage hashimoto kernels.
+//
+//   cd scripts/dagger/pydagger && python3 setup.py build_ext --inplace
+//   python3 -c "import pydagger; print(pydagger.calc_dataset_item(pydagger.generate_cache(1024, b'123'), 123).hex())"
+//
+// The functions keep the signatures of scripts/dagger.py and
+// scripts/hashimoto.py, so `from pydagger import *` is a drop-in replacement
+// for either.  Caches may be passed as dagger.py builds them (a list of 64-byte
+// rows, or the list of 32-bit words from to_cache_u()) or, much faster, as any
+// bytes-like object; generate_cache(..., flat=True) returns one.  dagger.py
+// hashes with keccak512, which is the default here too; hash="sha512" selects
+// the dagger_32.c kernels.  Batch entry points (calc_dataset, mask_blob,
+// dagger_hashimoto, hashimoto_batch) work on whole buffers, and every kernel
+// runs with the GIL released.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define DAGGER_NO_MAIN
+#include "../dagger_kernels.cpp"
+#include "../keccak.c"
+#include "../fnv256.c"
+
+#include <vector>
+
+struct Keccak512Hash {
+    static constexpr unsigned bytes = 64;
+    static constexpr const char *name = "keccak512";
+    static inline void hash(const void *data, uint64_t len, unsigned char *digest) { keccak512(data, len, digest); }
+};
+
+// dagger.py: 32-bit words, fnv32, keccak512
+typedef DaggerKernel<uint32_t, 16, 256, 128, 64, Keccak512Hash> Dagger32KeccakKernel;
+
+static const DaggerKernelEntry keccak_kernel =
+    make_dagger_kernel_entry<Dagger32KeccakKernel>("dagger32-keccak512");
+
+static const DaggerKernelEntry *get_kernel(const char *hash) {
+    if (hash == NULL || strcmp(hash, Keccak512Hash::name) == 0) {
+        return &keccak_kernel;
+    }
+    const DaggerKernelEntry *k = find_dagger_kernel(4, 256, 128, 64, hash);
+    if (k == NULL) {
+        PyErr_Format(PyExc_ValueError, "unknown hash %s, expected keccak512 or sha512", hash);
+    }
+    return k;
+}
+
+// A cache argument: a buffer, a list of rows or a list of 32-bit words.
+struct CacheArg {
+    Py_buffer view;
+    bool has_view = false;
+    std::vector<unsigned char> owned;
+    const unsigned char *data = NULL;
+    uint64_t size = 0;
+
+    ~CacheArg() {
+        if (has_view) {
+            PyBuffer_Release(&view);
+        }
+    }
+};
+
+static int get_cache(PyObject *obj, CacheArg *c) {
+    if (PyObject_CheckBuffer(obj)) {
+        if (PyObject_GetBuffer(obj, &c->view, PyBUF_SIMPLE) != 0) {
+            return -1;
+        }
+        c->has_view = true;
+        c->data = (const unsigned char *)c->view.buf;
+        c->size = c->view.len;
+    } else {
+        PyObject *seq = PySequence_Fast(obj, "cache must be bytes-like or a list of rows or words");
+        if (seq == NULL) {
+            return -1;
+        }
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+        PyObject **items = PySequence_Fast_ITEMS(seq);
+        for (Py_ssize_t k = 0; k < n; k++) {
+            if (PyLong_Check(items[k])) {
+                unsigned long w = PyLong_AsUnsignedLong(items[k]);
+                if ((w == (unsigned long)-1 && PyErr_Occurred()) || w > UINT32_MAX) {
+                    PyErr_SetString(PyExc_ValueError, "cache words must be 32-bit unsigned");
+                    Py_DECREF(seq);
+                    return -1;
+                }
+                for (int b = 0; b < 4; b++) {
+                    c->owned.push_back((unsigned char)(w >> (8 * b)));
+                }
+                continue;
+            }
+            char *row;
+            Py_ssize_t len;
+            if (PyBytes_AsStringAndSize(items[k], &row, &len) != 0) {
+                Py_DECREF(seq);
+                return -1;
+            }
+            c->owned.insert(c->owned.end(), row, row + len);
+        }
+        Py_DECREF(seq);
+        c->data = c->owned.data();
+        c->size = c->owned.size();
+    }
+    if (c->size == 0 || c->size % 64 != 0) {
+        PyErr_SetString(PyExc_ValueError, "cache size must be a non-zero multiple of 64");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *py_generate_cache(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"cache_size", "seed", "hash", "flat", NULL};
+    unsigned long long cache_size;
+    Py_buffer seed;
+    const char *hash = NULL;
+    int flat = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Ky*|zp", (char **)kwlist, &cache_size, &seed, &hash, &flat)) {
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    if (k == NULL || cache_size < 64) {
+        if (k != NULL) {
+            PyErr_SetString(PyExc_ValueError, "cache_size must be at least 64");
+        }
+        PyBuffer_Release(&seed);
+        return NULL;
+    }
+    cache_size = cache_size / 64 * 64;
+    unsigned char *cache;
+    Py_BEGIN_ALLOW_THREADS
+    cache = k->generate_cache(cache_size, (const unsigned char *)seed.buf, seed.len);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&seed);
+    if (cache == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    PyObject *ret;
+    if (flat) {
+        ret = PyBytes_FromStringAndSize((const char *)cache, cache_size);
+    } else {
+        // dagger.py returns the rows as a list
+        ret = PyList_New(cache_size / 64);
+        for (uint64_t i = 0; ret != NULL && i < cache_size / 64; i++) {
+            PyObject *row = PyBytes_FromStringAndSize((const char *)cache + 64 * i, 64);
+            if (row == NULL) {
+                Py_CLEAR(ret);
+                break;
+            }
+            PyList_SET_ITEM(ret, i, row);
+        }
+    }
+    free(cache);
+    return ret;
+}
+
+static PyObject *py_to_cache_u(PyObject *self, PyObject *arg) {
+    CacheArg c;
+    if (get_cache(arg, &c) != 0) {
+        return NULL;
+    }
+    PyObject *ret = PyList_New(c.size / 4);
+    for (uint64_t k = 0; ret != NULL && k < c.size / 4; k++) {
+        uint32_t w;
+        memcpy(&w, c.data + 4 * k, 4);
+        PyObject *v = PyLong_FromUnsignedLong(w);
+        if (v == NULL) {
+            Py_CLEAR(ret);
+            break;
+        }
+        PyList_SET_ITEM(ret, k, v);
+    }
+    return ret;
+}
+
+static PyObject *py_calc_dataset_item(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"cache_u", "i", "hash", NULL};
+    PyObject *cache_obj;
+    unsigned long long i;
+    const char *hash = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OK|z", (char **)kwlist, &cache_obj, &i, &hash)) {
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    CacheArg c;
+    if (k == NULL || get_cache(cache_obj, &c) != 0) {
+        return NULL;
+    }
+    unsigned char item[64];
+    Py_BEGIN_ALLOW_THREADS
+    k->calculate_dataset_item(c.data, c.size, i, item);
+    Py_END_ALLOW_THREADS
+    return PyBytes_FromStringAndSize((const char *)item, 64);
+}
+
+static PyObject *py_calc_mask_data(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"cache_u", "i", "init_hash", "hash", NULL};
+    PyObject *cache_obj;
+    unsigned long long i;
+    Py_buffer init_hash;
+    const char *hash = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OKy*|z", (char **)kwlist, &cache_obj, &i, &init_hash, &hash)) {
+        return NULL;
+    }
+    unsigned char data[64];
+    bool ok = init_hash.len == 64;
+    if (ok) {
+        memcpy(data, init_hash.buf, 64);
+    }
+    PyBuffer_Release(&init_hash);
+    if (!ok) {
+        PyErr_SetString(PyExc_ValueError, "init_hash must be 64 bytes");
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    CacheArg c;
+    if (k == NULL || get_cache(cache_obj, &c) != 0) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    k->calculate_mask_data(c.data, c.size, i, data);
+    Py_END_ALLOW_THREADS
+    return PyBytes_FromStringAndSize((const char *)data, 64);
+}
+
+static PyObject *py_calc_dataset(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"cache", "first", "count", "hash", NULL};
+    PyObject *cache_obj;
+    unsigned long long first, count;
+    const char *hash = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OKK|z", (char **)kwlist, &cache_obj, &first, &count, &hash)) {
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    CacheArg c;
+    if (k == NULL || get_cache(cache_obj, &c) != 0) {
+        return NULL;
+    }
+    PyObject *ret = PyBytes_FromStringAndSize(NULL, count * 64);
+    if (ret == NULL) {
+        return NULL;
+    }
+    unsigned char *out = (unsigned char *)PyBytes_AS_STRING(ret);
+    Py_BEGIN_ALLOW_THREADS
+    for (uint64_t j = 0; j < count; j++) {
+        k->calculate_dataset_item(c.data, c.size, first + j, out + 64 * j);
+    }
+    Py_END_ALLOW_THREADS
+    return ret;
+}
+
+static PyObject *py_mask_blob(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"cache", "first_item", "data", "hash", NULL};
+    PyObject *cache_obj;
+    unsigned long long first;
+    Py_buffer data;
+    const char *hash = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OKy*|z", (char **)kwlist, &cache_obj, &first, &data, &hash)) {
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    CacheArg c;
+    if (k == NULL || get_cache(cache_obj, &c) != 0) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+    // a trailing partial item is masked as if zero padded, as dataset_stream does
+    uint64_t items = (data.len + 63) / 64;
+    std::vector<unsigned char> buf(items * 64, 0);
+    memcpy(buf.data(), data.buf, data.len);
+    Py_BEGIN_ALLOW_THREADS
+    for (uint64_t j = 0; j < items; j++) {
+        k->calculate_mask_data(c.data, c.size, first + j, buf.data() + 64 * j);
+    }
+    Py_END_ALLOW_THREADS
+    PyObject *ret = PyBytes_FromStringAndSize((const char *)buf.data(), data.len);
+    PyBuffer_Release(&data);
+    return ret;
+}
+
+static PyObject *py_dagger_hashimoto(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"hashes", "dataset", "hash", NULL};
+    Py_buffer hashes, dataset;
+    const char *hash = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*y*|z", (char **)kwlist, &hashes, &dataset, &hash)) {
+        return NULL;
+    }
+    const DaggerKernelEntry *k = get_kernel(hash);
+    PyObject *ret = NULL;
+    if (k != NULL && (hashes.len % 64 != 0 || dataset.len < 128)) {
+        PyErr_SetString(PyExc_ValueError, "hashes must be 64-byte seeds and dataset at least one 128-byte row");
+    } else if (k != NULL) {
+        uint64_t n = hashes.len / 64;
+        ret = PyBytes_FromStringAndSize(NULL, n * 32);
+        if (ret != NULL) {
+            unsigned char *out = (unsigned char *)PyBytes_AS_STRING(ret);
+            const unsigned char *in = (const unsigned char *)hashes.buf;
+            Py_BEGIN_ALLOW_THREADS
+            for (uint64_t j = 0; j < n; j++) {
+                k->hashimoto(in + 64 * j, dataset.len, (const unsigned char *)dataset.buf, out + 32 * j);
+            }
+            Py_END_ALLOW_THREADS
+        }
+    }
+    PyBuffer_Release(&hashes);
+    PyBuffer_Release(&dataset);
+    return ret;
+}
+
+// Parameters and blobs of a hashimoto.py call, collected with the GIL held.
+struct StorageCall {
+    uint64_t shard_id;
+    uint64_t data_size;
+    unsigned shard_size_bits;
+    unsigned nshard_bits;
+    uint64_t naccess;
+    bool full_data_list;
+    std::vector<Py_buffer> data;
+    std::vector<uint64_t> idx;
+    bool has_idx = false;
+
+    ~StorageCall() {
+        for (Py_buffer &b : data) {
+            PyBuffer_Release(&b);
+        }
+    }
+};
+
+enum storage_error { STORAGE_OK, STORAGE_INDEX, STORAGE_ASSERT };
+
+static int get_storage_data(PyObject *data_list, PyObject *idx_list, StorageCall *s) {
+    if (s->data_size < 64 || s->data_size % 32 != 0 || s->shard_size_bits + s->nshard_bits > 63) {
+        PyErr_SetString(PyExc_ValueError, "data_size must be a multiple of 32 of at least 64");
+        return -1;
+    }
+    PyObject *seq = PySequence_Fast(data_list, "data_list must be a list of blobs");
+    if (seq == NULL) {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    s->data.reserve(n);
+    for (Py_ssize_t k = 0; k < n; k++) {
+        Py_buffer b;
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, k), &b, PyBUF_SIMPLE) != 0) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        s->data.push_back(b);
+        if ((uint64_t)b.len != s->data_size) {
+            // hashimoto.py asserts len(data) == data_size
+            PyErr_SetString(PyExc_AssertionError, "blob length differs from data_size");
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+    Py_DECREF(seq);
+    if (idx_list != NULL && idx_list != Py_None) {
+        seq = PySequence_Fast(idx_list, "idx_list must be a list of ints");
+        if (seq == NULL) {
+            return -1;
+        }
+        for (Py_ssize_t k = 0; k < PySequence_Fast_GET_SIZE(seq); k++) {
+            unsigned long long v = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, k));
+            if (v == (unsigned long long)-1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                return -1;
+            }
+            s->idx.push_back(v);
+        }
+        Py_DECREF(seq);
+        s->has_idx = true;
+    }
+    return 0;
+}
+
+// The blob access i reads, or NULL (with *err set) like the IndexError/assert in hashimoto.py.
+static const unsigned char *storage_blob(const StorageCall *s, uint64_t i, uint64_t kv_idx, int *err) {
+    if (s->has_idx && (i >= s->idx.size() || s->idx[i] != kv_idx)) {
+        *err = i >= s->idx.size() ? STORAGE_INDEX : STORAGE_ASSERT;
+        return NULL;
+    }
+    uint64_t k = s->full_data_list ? kv_idx : i;
+    if (k >= s->data.size()) {
+        *err = STORAGE_INDEX;
+        return NULL;
+    }
+    return (const unsigned char *)s->data[k].buf;
+}
+
+// hashimoto.py hashimoto(): _hashimoto of DKVDaggerHashimoto.
+static int storage_hashimoto(const StorageCall *s, const unsigned char *h0, unsigned char *mix, unsigned char *out) {
+    unsigned rows_bits = s->shard_size_bits + s->nshard_bits;
+    for (uint64_t k = 0; k < s->data_size; k += 32) {
+        memcpy(mix + k, h0, 32);
+    }
+    u256 h0v = u256_from_be(h0);
+    uint64_t mix_off = 0;
+    for (uint64_t i = 0; i < s->naccess; i++) {
+        u256 mix_data = fnv256(u256_xor(u256_from_u64(i), h0v), u256_from_be(mix + mix_off));
+        uint64_t parent = mix_data.w[0] & ((1ULL << rows_bits) - 1);
+        uint64_t kv_idx = parent + (s->shard_id << s->shard_size_bits);
+        int err = STORAGE_OK;
+        const unsigned char *data = storage_blob(s, i, kv_idx, &err);
+        if (data == NULL) {
+            return err;
+        }
+        for (uint64_t k = 0; k < s->data_size; k++) {
+            mix[k] ^= data[k];
+        }
+        mix_off = u256_mod_u64(u256_shr(mix_data, rows_bits), s->data_size - 32);
+    }
+    keccak256(mix, s->data_size, out);
+    return STORAGE_OK;
+}
+
+// hashimoto.py hashimoto_keccak256(): h = keccak256(h + data) per access.
+static int storage_hashimoto_keccak256(const StorageCall *s, const unsigned char *h0, unsigned char *buf,
+                                       unsigned char *out) {
+    unsigned rows_bits = s->shard_size_bits + s->nshard_bits;
+    memcpy(buf, h0, 32);
+    for (uint64_t i = 0; i < s->naccess; i++) {
+        uint64_t parent = u256_from_be(buf).w[0] & ((1ULL << rows_bits) - 1);
+        uint64_t kv_idx = parent + (s->shard_id << s->shard_size_bits);
+        int err = STORAGE_OK;
+        const unsigned char *data = storage_blob(s, i, kv_idx, &err);
+        if (data == NULL) {
+            return err;
+        }
+        memcpy(buf + 32, data, s->data_size);
+        keccak256(buf, 32 + s->data_size, buf);
+    }
+    memcpy(out, buf, 32);
+    return STORAGE_OK;
+}
+
+static PyObject *storage_error(int err) {
+    if (err == STORAGE_ASSERT) {
+        PyErr_SetString(PyExc_AssertionError, "idx_list does not match the derived kv index");
+    } else {
+        PyErr_SetString(PyExc_IndexError, "list index out of range");
+    }
+    return NULL;
+}
+
+static PyObject *py_storage_hashimoto(PyObject *args, PyObject *kwargs, bool merkle) {
+    static const char *kwlist[] = {"shard_id", "data_size", "shard_size_bits", "nshard_bits", "naccess",
+                                   "h0", "data_list", "idx_list", "full_data_list", NULL};
+    StorageCall s;
+    Py_buffer h0;
+    PyObject *data_list, *idx_list = NULL;
+    int full = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KKIIKy*O|Op", (char **)kwlist, &s.shard_id, &s.data_size,
+                                     &s.shard_size_bits, &s.nshard_bits, &s.naccess, &h0, &data_list, &idx_list,
+                                     &full)) {
+        return NULL;
+    }
+    s.full_data_list = full;
+    unsigned char hash0[32];
+    bool ok = h0.len == 32;
+    if (ok) {
+        memcpy(hash0, h0.buf, 32);
+    }
+    PyBuffer_Release(&h0);
+    if (!ok) {
+        PyErr_SetString(PyExc_ValueError, "h0 must be 32 bytes");
+        return NULL;
+    }
+    if (get_storage_data(data_list, idx_list, &s) != 0) {
+        return NULL;
+    }
+    std::vector<unsigned char> scratch(32 + s.data_size);
+    unsigned char out[32];
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = merkle ? storage_hashimoto_keccak256(&s, hash0, scratch.data(), out)
+                 : storage_hashimoto(&s, hash0, scratch.data(), out);
+    Py_END_ALLOW_THREADS
+    if (err != STORAGE_OK) {
+        return storage_error(err);
+    }
+    return PyBytes_FromStringAndSize((const char *)out, 32);
+}
+
+static PyObject *py_hashimoto(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return py_storage_hashimoto(args, kwargs, false);
+}
+
+static PyObject *py_hashimoto_keccak256(PyObject *self, PyObject *args, PyObject *kwargs) {
+    return py_storage_hashimoto(args, kwargs, true);
+}
+
+static PyObject *py_hashimoto_batch(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"shard_id", "data_size", "shard_size_bits", "nshard_bits", "naccess",
+                                   "h0s", "data_list", "keccak256", NULL};
+    StorageCall s;
+    Py_buffer h0s;
+    PyObject *data_list;
+    int merkle = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KKIIKy*O|p", (char **)kwlist, &s.shard_id, &s.data_size,
+                                     &s.shard_size_bits, &s.nshard_bits, &s.naccess, &h0s, &data_list, &merkle)) {
+        return NULL;
+    }
+    s.full_data_list = true;
+    PyObject *ret = NULL;
+    if (h0s.len % 32 != 0) {
+        PyErr_SetString(PyExc_ValueError, "h0s must be a concatenation of 32-byte hashes");
+    } else if (get_storage_data(data_list, NULL, &s) == 0) {
+        uint64_t n = h0s.len / 32;
+        ret = PyBytes_FromStringAndSize(NULL, 32 * n);
+        if (ret != NULL) {
+            unsigned char *out = (unsigned char *)PyBytes_AS_STRING(ret);
+            const unsigned char *in = (const unsigned char *)h0s.buf;
+            std::vector<unsigned char> scratch(32 + s.data_size);
+            int err = STORAGE_OK;
+            Py_BEGIN_ALLOW_THREADS
+            for (uint64_t j = 0; j < n && err == STORAGE_OK; j++) {
+                err = merkle ? storage_hashimoto_keccak256(&s, in + 32 * j, scratch.data(), out + 32 * j)
+                             : storage_hashimoto(&s, in + 32 * j, scratch.data(), out + 32 * j);
+            }
+            Py_END_ALLOW_THREADS
+            if (err != STORAGE_OK) {
+                Py_CLEAR(ret);
+                storage_error(err);
+            }
+        }
+    }
+    PyBuffer_Release(&h0s);
+    return ret;
+}
+
+static PyObject *py_fnv32(PyObject *self, PyObject *args) {
+    unsigned long a, b;
+    if (!PyArg_ParseTuple(args, "kk", &a, &b)) {
+        return NULL;
+    }
+    // dagger.py masks the product to 32 bits but xors b in unmasked
+    return PyLong_FromUnsignedLongLong((uint64_t)(uint32_t)(a * 0x01000193) ^ (uint64_t)b);
+}
+
+static int int_to_u256(PyObject *v, u256 *out) {
+    // hashimoto.py's fnv256 reduces mod 2^256, so only the low 256 bits matter
+    PyObject *mask = PyLong_FromString("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", NULL, 16);
+    PyObject *low = mask ? PyNumber_And(v, mask) : NULL;
+    Py_XDECREF(mask);
+    if (low == NULL) {
+        return -1;
+    }
+    PyObject *bytes = PyObject_CallMethod(low, "to_bytes", "is", 32, "big");
+    Py_DECREF(low);
+    if (bytes == NULL) {
+        return -1;
+    }
+    *out = u256_from_be((const unsigned char *)PyBytes_AS_STRING(bytes));
+    Py_DECREF(bytes);
+    return 0;
+}
+
+static PyObject *py_fnv256(PyObject *self, PyObject *args) {
+    PyObject *a, *b;
+    u256 x, y;
+    if (!PyArg_ParseTuple(args, "O!O!", &PyLong_Type, &a, &PyLong_Type, &b) || int_to_u256(a, &x) != 0 ||
+        int_to_u256(b, &y) != 0) {
+        return NULL;
+    }
+    unsigned char be[32];
+    u256_to_be(fnv256(x, y), be);
+    return PyObject_CallMethod((PyObject *)&PyLong_Type, "from_bytes", "y#s", be, (Py_ssize_t)32, "big");
+}
+
+typedef unsigned char *(*digest_fn)(const void *data, uint64_t len, unsigned char *digest);
+
+static unsigned char *sha512_digest(const void *data, uint64_t len, unsigned char *digest) {
+    return SHA512((void *)data, len, digest);
+}
+
+static PyObject *py_digest(PyObject *arg, digest_fn fn, int bytes) {
+    Py_buffer b;
+    if (PyObject_GetBuffer(arg, &b, PyBUF_SIMPLE) != 0) {
+        return NULL;
+    }
+    unsigned char digest[64];
+    Py_BEGIN_ALLOW_THREADS
+    fn(b.buf, b.len, digest);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&b);
+    return PyBytes_FromStringAndSize((const char *)digest, bytes);
+}
+
+static PyObject *py_keccak256(PyObject *self, PyObject *arg) { return py_digest(arg, keccak256, 32); }
+static PyObject *py_keccak512(PyObject *self, PyObject *arg) { return py_digest(arg, keccak512, 64); }
+static PyObject *py_sha512(PyObject *self, PyObject *arg) { return py_digest(arg, sha512_digest, 64); }
+
+static PyMethodDef dagger_methods[] = {
+    {"generate_cache", (PyCFunction)(void (*)(void))py_generate_cache, METH_VARARGS | METH_KEYWORDS,
+     "generate_cache(cache_size, seed, hash='keccak512', flat=False) -> list of 64-byte rows, or bytes if flat"},
+    {"to_cache_u", py_to_cache_u, METH_O, "to_cache_u(cache) -> list of 32-bit little-endian words"},
+    {"calc_dataset_item", (PyCFunction)(void (*)(void))py_calc_dataset_item, METH_VARARGS | METH_KEYWORDS,
+     "calc_dataset_item(cache_u, i, hash='keccak512') -> 64-byte dataset item i"},
+    {"calc_mask_data", (PyCFunction)(void (*)(void))py_calc_mask_data, METH_VARARGS | METH_KEYWORDS,
+     "calc_mask_data(cache_u, i, init_hash, hash='keccak512') -> init_hash masked as item i"},
+    {"calc_dataset", (PyCFunction)(void (*)(void))py_calc_dataset, METH_VARARGS | METH_KEYWORDS,
+     "calc_dataset(cache, first, count, hash='keccak512') -> items [first, first + count) concatenated"},
+    {"mask_blob", (PyCFunction)(void (*)(void))py_mask_blob, METH_VARARGS | METH_KEYWORDS,
+     "mask_blob(cache, first_item, data, hash='keccak512') -> data masked as items first_item, first_item + 1, ..."},
+    {"dagger_hashimoto", (PyCFunction)(void (*)(void))py_dagger_hashimoto, METH_VARARGS | METH_KEYWORDS,
+     "dagger_hashimoto(hashes, dataset, hash='keccak512') -> 32-byte digest per 64-byte seed in hashes"},
+    {"hashimoto", (PyCFunction)(void (*)(void))py_hashimoto, METH_VARARGS | METH_KEYWORDS,
+     "hashimoto(shard_id, data_size, shard_size_bits, nshard_bits, naccess, h0, data_list, idx_list=None, "
+     "full_data_list=False) -> _hashimoto result"},
+    {"hashimoto_keccak256", (PyCFunction)(void (*)(void))py_hashimoto_keccak256, METH_VARARGS | METH_KEYWORDS,
+     "hashimoto_keccak256(shard_id, data_size, shard_size_bits, nshard_bits, naccess, h0, data_list, "
+     "idx_list=None, full_data_list=False) -> chained keccak256 result"},
+    {"hashimoto_batch", (PyCFunction)(void (*)(void))py_hashimoto_batch, METH_VARARGS | METH_KEYWORDS,
+     "hashimoto_batch(shard_id, data_size, shard_size_bits, nshard_bits, naccess, h0s, data_list, "
+     "keccak256=False) -> one 32-byte result per 32-byte h0 in h0s, data_list indexed by kv index"},
+    {"fnv32", py_fnv32, METH_VARARGS, "fnv32(a, b)"},
+    {"fnv256", py_fnv256, METH_VARARGS, "fnv256(a, b), mod 2**256"},
+    {"keccak256", py_keccak256, METH_O, "keccak256(data) -> 32 bytes"},
+    {"keccak512", py_keccak512, METH_O, "keccak512(data) -> 64 bytes"},
+    {"sha512", py_sha512, METH_O, "sha512(data) -> 64 bytes"},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef dagger_module = {
+    PyModuleDef_HEAD_INIT, "pydagger", "Native dagger and storage hashimoto kernels.", -1, dagger_methods,
+};
+
+PyMODINIT_FUNC PyInit_pydagger(void) {
+    PyObject *m = PyModule_Create(&dagger_module);
+    if (m == NULL) {
+        return NULL;
+    }
+    PyModule_AddIntConstant(m, "HASH_BYTES", 64);
+    PyModule_AddIntConstant(m, "WORD_BYTES", 4);
+    PyModule_AddIntConstant(m, "WORDS_PER_HASH", 16);
+    PyModule_AddIntConstant(m, "CACHE_ROUNDS", 3);
+    PyModule_AddIntConstant(m, "DATASET_PARENTS", 256);
+    return m;
+}
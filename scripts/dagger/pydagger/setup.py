@@ -0,0 +1,27 @@
+# Build the pydagger extension next to this file:
+#
+#   python3 setup.py build_ext --inplace
+
+from setuptools import Extension, setup
+
+setup(
+    name="pydagger",
+    version="0.1.0",
+    description="Native dagger and storage hashimoto kernels",
+    ext_modules=[
+        Extension(
+            "pydagger",
+            sources=["daggermodule.cpp"],
+            depends=[
+                "../dagger_kernels.cpp",
+                "../dagger_kernels.hpp",
+                "../sha512.c",
+                "../keccak.c",
+                "../fnv256.c",
+                "../u256.c",
+            ],
+            language="c++",
+            extra_compile_args=["-std=c++17", "-O3", "-march=native"],
+        )
+    ],
+)
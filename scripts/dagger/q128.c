@@ -0,0 +1,192 @@
+/*
+ * Q128.128 fixed point of DecentralizedKV, bit-exact in u256.
+ *
+ *   q128_mul_shr()     (a * b) >> 128 with Solidity's checked mul
+ *   q128_pow()         BinaryRelated.pow / DecentralizedKV.pow
+ *   q128_from_frac()   to_Q128x128() of scripts/dcf_convert.py
+ *   q128_find_root()   find_root() of scripts/dcf_convert.py
+ *   q128_quote*()      _upfrontPayment() for many (kvSize, timestamp) pairs
+ *
+ * pow() squares fp once per bit of n whatever the bits are, so the squares
+ * fp^(2^k) only depend on dcfFactor.  A quoter computes them once and each
+ * quote then costs one 128x128 multiply per set bit of ts - startTime;
+ * consecutive quotes of the same second (what a gateway sees) reuse the last
+ * pow.
+ * Functions that would revert on chain return -1.
+ *
+ * Must be included after u256.c.
+ */
+
+// (a * b) >> 128 of two values below 1.0: only the top half of a 128x128 product.
+static inline unsigned __int128 q128_mulhi(unsigned __int128 a, unsigned __int128 b) {
+    unsigned __int128 ll = (unsigned __int128)(uint64_t)a * (uint64_t)b;
+    unsigned __int128 lh = (unsigned __int128)(uint64_t)a * (uint64_t)(b >> 64);
+    unsigned __int128 hl = (unsigned __int128)(uint64_t)(a >> 64) * (uint64_t)b;
+    unsigned __int128 hh = (unsigned __int128)(uint64_t)(a >> 64) * (uint64_t)(b >> 64);
+    unsigned __int128 mid = (ll >> 64) + (uint64_t)lh + (uint64_t)hl;
+    return (hh + (lh >> 64) + (hl >> 64) + (mid >> 64));
+}
+
+// (a * b) >> 128; -1 if a * b overflows 256 bits.
+int q128_mul_shr(u256 a, u256 b, u256 *out) {
+    if ((a.w[2] | a.w[3] | b.w[2] | b.w[3]) == 0) {
+        // both below 1.0, the usual case for discount factors
+        unsigned __int128 hi = q128_mulhi((unsigned __int128)a.w[1] << 64 | a.w[0], (unsigned __int128)b.w[1] << 64 | b.w[0]);
+        *out = (u256){{(uint64_t)hi, (uint64_t)(hi >> 64), 0, 0}};
+        return (0);
+    }
+    u256 p;
+    if (u256_mul_checked(a, b, &p)) {
+        return (-1);
+    }
+    *out = u256_shr(p, 128);
+    return (0);
+}
+
+// BinaryRelated.pow(fp, n): v = v * fp >> 128 per set bit, fp = fp * fp >> 128 per bit.
+int q128_pow(u256 fp, uint64_t n, u256 *out) {
+    u256 v = u256_shl(u256_from_u64(1), 128);
+    while (n != 0) {
+        if ((n & 1) && q128_mul_shr(v, fp, &v)) {
+            return (-1);
+        }
+        if (q128_mul_shr(fp, fp, &fp)) {
+            return (-1);
+        }
+        n /= 2;
+    }
+    *out = v;
+    return (0);
+}
+
+/*
+ * num / den in Q128.128, one bit of long division at a time and rounded
+ * half up, as to_Q128x128(frac3) computes num / 1000.  num < den.
+ */
+u256 q128_from_frac(uint64_t num, uint64_t den) {
+    u256 r = u256_from_u64(0);
+    unsigned __int128 f = num;
+    for (int i = 0; i < 128; i++) {
+        f *= 2;
+        r = u256_shl(r, 1);
+        r.w[0] |= (uint64_t)(f / den);
+        f %= den;
+    }
+    if (2 * f >= den) {
+        r = u256_add(r, u256_from_u64(1));
+    }
+    return (r);
+}
+
+/*
+ * The fp in [v, 1.0) whose pow(fp, nroot) is closest to v, by the same
+ * binary search as find_root() (first closest wins), so dcfFactor comes out
+ * identical to the Python script.  -1 if pow reverts along the way.
+ */
+int q128_find_root(u256 v, uint64_t nroot, u256 *out) {
+    u256 l = v, r = u256_shl(u256_from_u64(1), 128);
+    u256 best = v, best_diff = {{0, 0, 0, 0}};
+    int have = 0;
+    while (u256_cmp(l, r) < 0) {
+        u256 m = u256_shr(u256_add(l, r), 1); // l + r < 2^129
+        u256 mv, d;
+        if (q128_pow(m, nroot, &mv)) {
+            return (-1);
+        }
+        d = u256_cmp(v, mv) >= 0 ? u256_sub(v, mv) : u256_sub(mv, v);
+        if (!have || u256_cmp(d, best_diff) < 0) {
+            best = m;
+            best_diff = d;
+            have = 1;
+        }
+        if (u256_cmp(mv, v) < 0) {
+            l = u256_add(m, u256_from_u64(1));
+        } else {
+            r = u256_sub(m, u256_from_u64(1));
+        }
+    }
+    *out = best;
+    return (0);
+}
+
+struct q128_quoter {
+    u256 storage_cost;
+    uint64_t start_time;
+    uint64_t max_kv_size;
+    int pow_ok;                 // dcfFactor < 1.0: below that no square overflows, at or above it the first does
+    unsigned __int128 sq[64];   // sq[k] = dcfFactor^(2^k) as pow() squares it
+    uint64_t last_n;            // the last pow, for runs of quotes in one second
+    unsigned __int128 last_pow;
+    int have_last;
+};
+
+void q128_quoter_init(struct q128_quoter *q, u256 dcf_factor, u256 storage_cost, uint64_t start_time,
+                      uint64_t max_kv_size) {
+    memset(q, 0, sizeof(*q));
+    q->storage_cost = storage_cost;
+    q->start_time = start_time;
+    q->max_kv_size = max_kv_size;
+    q->pow_ok = (dcf_factor.w[2] | dcf_factor.w[3]) == 0;
+    q->sq[0] = (unsigned __int128)dcf_factor.w[1] << 64 | dcf_factor.w[0];
+    for (int k = 1; k < 64; k++) {
+        q->sq[k] = q128_mulhi(q->sq[k - 1], q->sq[k - 1]);
+    }
+}
+
+/*
+ * pow(dcfFactor, n) from the squares table, bit-exact with q128_pow(): the
+ * products are taken in the same order, and the first one, 1.0 * fp, is fp.
+ */
+static int q128_quoter_pow(struct q128_quoter *q, uint64_t n, u256 *out) {
+    if (n == 0) {
+        *out = u256_shl(u256_from_u64(1), 128);
+        return (0);
+    }
+    if (!q->pow_ok) {
+        return (-1);
+    }
+    if (!q->have_last || q->last_n != n) {
+        uint64_t bits = n;
+        unsigned __int128 v = q->sq[__builtin_ctzll(bits)];
+        for (bits &= bits - 1; bits != 0; bits &= bits - 1) {
+            v = q128_mulhi(v, q->sq[__builtin_ctzll(bits)]);
+        }
+        q->last_n = n;
+        q->last_pow = v;
+        q->have_last = 1;
+    }
+    *out = (u256){{(uint64_t)q->last_pow, (uint64_t)(q->last_pow >> 64), 0, 0}};
+    return (0);
+}
+
+/*
+ * What put() of kv_size bytes at timestamp ts requires in msg.value:
+ * _upfrontPayment(ts) = storageCost * pow(dcfFactor, ts - startTime) >> 128.
+ * The price does not depend on the size; -1 if put() would revert ("data too
+ * large", ts before startTime, or an overflow).
+ */
+int q128_quote(struct q128_quoter *q, uint64_t kv_size, uint64_t ts, u256 *out) {
+    u256 p;
+    if (kv_size > q->max_kv_size || ts < q->start_time || q128_quoter_pow(q, ts - q->start_time, &p)) {
+        return (-1);
+    }
+    return (q128_mul_shr(q->storage_cost, p, out));
+}
+
+/*
+ * q128_quote() for n pairs; status[i] is its return value for pair i.  Returns
+ * the number quoted.  This is a plain loop that shares the quoter's last pow
+ * across the pairs.  Quotes are independent, but each q128_mulhi() is already
+ * four independent 64x64 multiplies, so interleaving several quotes' chains
+ * only queues more work on the one scalar multiplier, and AVX2 has no
+ * 64x64 -> 128 lane multiply to spread them over.
+ */
+size_t q128_quote_many(struct q128_quoter *q, const uint64_t *kv_size, const uint64_t *ts, size_t n, u256 *out,
+                        int *status) {
+    size_t quoted = 0;
+    for (size_t i = 0; i < n; i++) {
+        status[i] = q128_quote(q, kv_size[i], ts[i], &out[i]);
+        quoted += status[i] == 0;
+    }
+    return (quoted);
+}
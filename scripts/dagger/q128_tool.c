@@ -0,0 +1,262 @@
+/*
+ * dcfFactor conversion and upfront payment quotes (see q128.c).
+ *
+ *   gcc -O3 q128_tool.c -o q128_tool
+ *   ./q128_tool convert --frac 900 --seconds 31536000
+ *   ./q128_tool quote --dcf 340282365784068676928457747575078800565 --storage-cost 1000000000000000000 \
+ *       --start-time 1650000000 --max-kv-size 131072 < requests.txt
+ *   ./q128_tool verify
+ *   ./q128_tool bench --quotes 100000
+ *
+ * `convert` prints to_Q128x128(frac) and find_root() of scripts/dcf_convert.py:
+ * the discount over --seconds as Q128.128 and the per second dcfFactor whose
+ * pow() over --seconds comes closest to it.  `quote` reads "kvSize timestamp"
+ * lines and prints the msg.value put() requires at that timestamp, or
+ * "revert".
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "u256.c"
+#include "q128.c"
+
+struct tool_options {
+    uint64_t frac, den, seconds;
+    u256 dcf, storage_cost;
+    uint64_t start_time, max_kv_size;
+    uint64_t quotes;
+};
+
+static int tool_convert(const struct tool_options *o) {
+    char buf[80];
+    u256 v = q128_from_frac(o->frac, o->den), root;
+    printf("%s\n", u256_to_dec(v, buf));
+    if (q128_find_root(v, o->seconds, &root) != 0) {
+        fprintf(stderr, "pow overflows\n");
+        return (1);
+    }
+    printf("%s\n", u256_to_dec(root, buf));
+    return (0);
+}
+
+static int tool_quote(const struct tool_options *o) {
+    struct q128_quoter q;
+    q128_quoter_init(&q, o->dcf, o->storage_cost, o->start_time, o->max_kv_size);
+    char line[256], buf[80];
+    unsigned long long size, ts;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        u256 quote;
+        if (sscanf(line, "%llu %llu", &size, &ts) != 2) {
+            fprintf(stderr, "bad line: %s", line);
+            return (1);
+        }
+        if (q128_quote(&q, size, ts, &quote) != 0) {
+            printf("revert\n");
+        } else {
+            printf("%s\n", u256_to_dec(quote, buf));
+        }
+    }
+    return (0);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+static int check_dec(const char *name, u256 v, const char *expect) {
+    char buf[80];
+    return (check(name, strcmp(u256_to_dec(v, buf), expect) == 0));
+}
+
+static uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+static int self_verify(void) {
+    int ok = 1;
+    u256 dcf, v, root, cost = u256_from_u64(1000000000000000000ULL);
+    u256_from_string("340282365784068676928457747575078800565", &dcf);
+
+    // vectors from scripts/dcf_convert.py
+    ok &= check_dec("to_Q128x128(900)", q128_from_frac(900, 1000), "306254130228844617117037146688591390310");
+    ok &= check_dec("to_Q128x128(1)", q128_from_frac(1, 1000), "340282366920938463463374607431768211");
+    ok &= check("find_root", q128_find_root(q128_from_frac(900, 1000), 365 * 24 * 3600, &root) == 0 &&
+                                 u256_cmp(root, dcf) == 0);
+    ok &= check("find_root(0.5, 1 day)", q128_find_root(q128_from_frac(500, 1000), 86400, &root) == 0);
+    ok &= check_dec("find_root(0.5, 1 day) value", root, "340279637004073797267798999204409335614");
+
+    ok &= check("pow(0)", q128_pow(dcf, 0, &v) == 0 && u256_cmp(v, u256_shl(u256_from_u64(1), 128)) == 0);
+    ok &= check("pow(1)", q128_pow(dcf, 1, &v) == 0 && u256_cmp(v, dcf) == 0);
+    ok &= check("pow(2^128) overflows", q128_pow(u256_shl(u256_from_u64(1), 128), 1, &v) != 0);
+
+    struct q128_quoter q;
+    q128_quoter_init(&q, dcf, cost, 1000, 131072);
+    ok &= check("quote(1)", q128_quote(&q, 1, 1001, &v) == 0);
+    ok &= check_dec("quote(1) value", v, "999999996659039970");
+    ok &= check("quote(1y)", q128_quote(&q, 131072, 1000 + 365 * 24 * 3600, &v) == 0);
+    ok &= check_dec("quote(1y) value", v, "900000000000000000");
+    ok &= check("quote(12345678)", q128_quote(&q, 4096, 1000 + 12345678, &v) == 0);
+    ok &= check_dec("quote(12345678) value", v, "959592641063034770");
+    ok &= check("data too large", q128_quote(&q, 131073, 2000, &v) != 0);
+    ok &= check("before startTime", q128_quote(&q, 1, 999, &v) != 0);
+
+    // the squares table against pow() itself, twice per n for the same second cache
+    uint64_t rng = 1;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t n = splitmix64(&rng) >> (1 + splitmix64(&rng) % 63);
+        u256 p, want, got;
+        int rw = q128_pow(dcf, n, &p) || q128_mul_shr(cost, p, &want);
+        int rg = q128_quote(&q, 1, 1000 + n, &got);
+        rg |= q128_quote(&q, 1, 1000 + n, &got);
+        if (!check("quote == storageCost * pow(dcf, n) >> 128", rw == rg && (rw != 0 || u256_cmp(want, got) == 0))) {
+            printf("n = %llu\n", (unsigned long long)n);
+            ok = 0;
+            break;
+        }
+    }
+
+    // the 128x128 fast path of q128_mul_shr() against the generic one
+    for (int i = 0; i < 10000; i++) {
+        u256 a = {{splitmix64(&rng), splitmix64(&rng), 0, 0}}, b = {{splitmix64(&rng), splitmix64(&rng), 0, 0}}, p,
+             x;
+        u256_mul_checked(a, b, &p);
+        q128_mul_shr(a, b, &x);
+        if (!check("q128_mul_shr", u256_cmp(x, u256_shr(p, 128)) == 0)) {
+            ok = 0;
+            break;
+        }
+    }
+
+    printf(ok ? "self_verify() passed\n" : "self_verify() failed!\n");
+    return (!ok);
+}
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+    return ((end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void bench(const struct tool_options *o) {
+    uint64_t n = o->quotes, rng = 7, now = o->start_time + 2 * 365 * 24 * 3600ULL;
+    uint64_t *sizes = malloc(n * sizeof(uint64_t)), *ts[2] = {malloc(n * sizeof(uint64_t)), malloc(n * sizeof(uint64_t))};
+    u256 *out = malloc(n * sizeof(u256));
+    int *status = malloc(n * sizeof(int));
+    for (uint64_t i = 0; i < n; i++) {
+        sizes[i] = splitmix64(&rng) % (o->max_kv_size + 1);
+        ts[0][i] = now + i / 1000; // a gateway: 1000 requests per second
+        ts[1][i] = o->start_time + splitmix64(&rng) % (10 * 365 * 24 * 3600ULL);
+    }
+    const char *names[2] = {"1000 per second", "random ts"};
+    struct timespec start, end;
+    for (int k = 0; k < 2; k++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint64_t i = 0; i < n; i++) {
+            u256 p;
+            status[i] = ts[k][i] < o->start_time || q128_pow(o->dcf, ts[k][i] - o->start_time, &p) ||
+                        q128_mul_shr(o->storage_cost, p, &out[i]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double t_pow = elapsed(&start, &end);
+
+        struct q128_quoter q;
+        q128_quoter_init(&q, o->dcf, o->storage_cost, o->start_time, o->max_kv_size);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        q128_quote_many(&q, sizes, ts[k], n, out, status);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double t_many = elapsed(&start, &end);
+        printf("%-16s pow() per quote %8.1f ns, q128_quote_many() %8.1f ns\n", names[k], t_pow / n * 1e9,
+               t_many / n * 1e9);
+    }
+    free(sizes);
+    free(ts[0]);
+    free(ts[1]);
+    free(out);
+    free(status);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s convert|quote|verify|bench [options]\n"
+            "  --frac N             convert: discount over --seconds, N / --den (default 900)\n"
+            "  --den N              (default 1000)\n"
+            "  --seconds N          convert: period of --frac (default 31536000)\n"
+            "  --dcf X              quote/bench: dcfFactor, Q128.128\n"
+            "  --storage-cost X     quote/bench: storageCost in wei (default 1e18)\n"
+            "  --start-time T       quote/bench: startTime (default 0)\n"
+            "  --max-kv-size N      quote/bench: maxKvSize (default 131072)\n"
+            "  --quotes N           bench: quotes per run (default 1000000)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"frac", required_argument, 0, 'f'},         {"den", required_argument, 0, 'd'},
+        {"seconds", required_argument, 0, 's'},      {"dcf", required_argument, 0, 'D'},
+        {"storage-cost", required_argument, 0, 'c'}, {"start-time", required_argument, 0, 't'},
+        {"max-kv-size", required_argument, 0, 'm'},  {"quotes", required_argument, 0, 'n'},
+        {0, 0, 0, 0},
+    };
+    const char *cmds[] = {"convert", "quote", "verify", "bench"};
+    int cmd = -1;
+    for (int k = 0; argc >= 2 && k < 4; k++) {
+        cmd = strcmp(argv[1], cmds[k]) == 0 ? k : cmd;
+    }
+    if (cmd < 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    struct tool_options o = {900, 1000, 365 * 24 * 3600};
+    o.storage_cost = u256_from_u64(1000000000000000000ULL);
+    o.max_kv_size = 131072;
+    o.quotes = 1000000;
+    u256_from_string("340282365784068676928457747575078800565", &o.dcf);
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f': o.frac = strtoull(optarg, NULL, 0); break;
+        case 'd': o.den = strtoull(optarg, NULL, 0); break;
+        case 's': o.seconds = strtoull(optarg, NULL, 0); break;
+        case 'D':
+            if (u256_from_string(optarg, &o.dcf) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'c':
+            if (u256_from_string(optarg, &o.storage_cost) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 't': o.start_time = strtoull(optarg, NULL, 0); break;
+        case 'm': o.max_kv_size = strtoull(optarg, NULL, 0); break;
+        case 'n': o.quotes = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (o.den == 0 || o.frac >= o.den || o.seconds == 0 || o.quotes == 0) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    switch (cmd) {
+    case 0: return (tool_convert(&o));
+    case 1: return (tool_quote(&o));
+    case 2: return (self_verify());
+    default: bench(&o); return (0);
+    }
+}
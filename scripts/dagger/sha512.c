@@ -473,5 +473,8 @@ SHA512(void *data, unsigned int data_len, unsigned char *digest)
     SHA512_Init(&ctx);
     SHA512_Update(&ctx, data, data_len);
     SHA512_Final(digest, &ctx);
+    /* The digest is stored as 64-bit words while callers read it back through
+     * other word types; stop the optimizer from reordering those accesses. */
+    __asm__ __volatile__("" ::: "memory");
     return digest;
 }
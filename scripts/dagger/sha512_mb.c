@@ -0,0 +1,130 @@
+/*
+ * Multi-buffer SHA-512 for fixed 64-byte messages.
+ *
+ * Every hash in the cache chain and in the CACHE_ROUND passes is a SHA-512 of
+ * exactly one 64-byte row, so the message always fits into a single padded
+ * block.  SHA512_64_MB() runs SHA512_MB_LANES such messages side by side, one
+ * message per 64-bit vector lane (8 lanes with AVX-512F, 4 with AVX2, and a
+ * plain scalar lane otherwise).
+ *
+ * Must be included after sha512.c (reuses K512 and the initial hash value).
+ */
+
+#include <stdint.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+#define SHA512_MB_LANES 8
+typedef __m512i mb_word;
+#define MB_ADD(a, b) _mm512_add_epi64((a), (b))
+#define MB_XOR(a, b) _mm512_xor_si512((a), (b))
+#define MB_AND(a, b) _mm512_and_si512((a), (b))
+#define MB_ANDNOT(a, b) _mm512_andnot_si512((a), (b))
+#define MB_ROTR(x, n) _mm512_ror_epi64((x), (n))
+#define MB_SHR(x, n) _mm512_srli_epi64((x), (n))
+#define MB_SET1(v) _mm512_set1_epi64((long long)(v))
+#define MB_LOAD(p) _mm512_load_si512((void *)(p))
+#define MB_STORE(p, x) _mm512_store_si512((void *)(p), (x))
+#elif defined(__AVX2__)
+#define SHA512_MB_LANES 4
+typedef __m256i mb_word;
+#define MB_ADD(a, b) _mm256_add_epi64((a), (b))
+#define MB_XOR(a, b) _mm256_xor_si256((a), (b))
+#define MB_AND(a, b) _mm256_and_si256((a), (b))
+#define MB_ANDNOT(a, b) _mm256_andnot_si256((a), (b))
+#define MB_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64 - (n)))
+#define MB_SHR(x, n) _mm256_srli_epi64((x), (n))
+#define MB_SET1(v) _mm256_set1_epi64x((long long)(v))
+#define MB_LOAD(p) _mm256_load_si256((void *)(p))
+#define MB_STORE(p, x) _mm256_store_si256((void *)(p), (x))
+#else
+#define SHA512_MB_LANES 1
+typedef uint64_t mb_word;
+#define MB_ADD(a, b) ((a) + (b))
+#define MB_XOR(a, b) ((a) ^ (b))
+#define MB_AND(a, b) ((a) & (b))
+#define MB_ANDNOT(a, b) (~(a) & (b))
+#define MB_ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define MB_SHR(x, n) ((x) >> (n))
+#define MB_SET1(v) ((uint64_t)(v))
+#define MB_LOAD(p) (*(uint64_t *)(p))
+#define MB_STORE(p, x) (*(uint64_t *)(p) = (x))
+#endif
+
+#define MB_SIGMA0(x) MB_XOR(MB_XOR(MB_ROTR(x, 28), MB_ROTR(x, 34)), MB_ROTR(x, 39))
+#define MB_SIGMA1(x) MB_XOR(MB_XOR(MB_ROTR(x, 14), MB_ROTR(x, 18)), MB_ROTR(x, 41))
+#define MB_sigma0(x) MB_XOR(MB_XOR(MB_ROTR(x, 1), MB_ROTR(x, 8)), MB_SHR(x, 7))
+#define MB_sigma1(x) MB_XOR(MB_XOR(MB_ROTR(x, 19), MB_ROTR(x, 61)), MB_SHR(x, 6))
+#define MB_CH(x, y, z) MB_XOR(MB_AND(x, y), MB_ANDNOT(x, z))
+#define MB_MAJ(x, y, z) MB_XOR(MB_XOR(MB_AND(x, y), MB_AND(x, z)), MB_AND(y, z))
+
+/*
+ * out[l] = SHA512(in[l], 64) for every lane l.  All inputs are read before any
+ * output is written, so in[l] may alias out[l].
+ */
+void SHA512_64_MB(unsigned char *in[SHA512_MB_LANES], unsigned char *out[SHA512_MB_LANES]) {
+    uint64_t buf[16][SHA512_MB_LANES] __attribute__((aligned(64)));
+    mb_word w[16];
+
+    // transpose the messages into lane order (big-endian words)
+    for (int t = 0; t < 8; t++) {
+        for (int l = 0; l < SHA512_MB_LANES; l++) {
+            buf[t][l] = __builtin_bswap64(((uint64_t *)in[l])[t]);
+        }
+        w[t] = MB_LOAD(buf[t]);
+    }
+    // padding of a 512-bit message
+    w[8] = MB_SET1(0x8000000000000000ULL);
+    for (int t = 9; t < 15; t++) {
+        w[t] = MB_SET1(0);
+    }
+    w[15] = MB_SET1(512);
+
+    mb_word a = MB_SET1(sha512_initial_hash_value[0]);
+    mb_word b = MB_SET1(sha512_initial_hash_value[1]);
+    mb_word c = MB_SET1(sha512_initial_hash_value[2]);
+    mb_word d = MB_SET1(sha512_initial_hash_value[3]);
+    mb_word e = MB_SET1(sha512_initial_hash_value[4]);
+    mb_word f = MB_SET1(sha512_initial_hash_value[5]);
+    mb_word g = MB_SET1(sha512_initial_hash_value[6]);
+    mb_word h = MB_SET1(sha512_initial_hash_value[7]);
+
+    for (int t = 0; t < 80; t++) {
+        mb_word wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            wt = MB_ADD(MB_ADD(MB_sigma1(w[(t - 2) & 15]), w[(t - 7) & 15]),
+                        MB_ADD(MB_sigma0(w[(t - 15) & 15]), w[t & 15]));
+            w[t & 15] = wt;
+        }
+        mb_word t1 = MB_ADD(MB_ADD(MB_ADD(h, MB_SIGMA1(e)), MB_ADD(MB_CH(e, f, g), MB_SET1(K512[t]))), wt);
+        mb_word t2 = MB_ADD(MB_SIGMA0(a), MB_MAJ(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = MB_ADD(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = MB_ADD(t1, t2);
+    }
+
+    MB_STORE(buf[0], MB_ADD(a, MB_SET1(sha512_initial_hash_value[0])));
+    MB_STORE(buf[1], MB_ADD(b, MB_SET1(sha512_initial_hash_value[1])));
+    MB_STORE(buf[2], MB_ADD(c, MB_SET1(sha512_initial_hash_value[2])));
+    MB_STORE(buf[3], MB_ADD(d, MB_SET1(sha512_initial_hash_value[3])));
+    MB_STORE(buf[4], MB_ADD(e, MB_SET1(sha512_initial_hash_value[4])));
+    MB_STORE(buf[5], MB_ADD(f, MB_SET1(sha512_initial_hash_value[5])));
+    MB_STORE(buf[6], MB_ADD(g, MB_SET1(sha512_initial_hash_value[6])));
+    MB_STORE(buf[7], MB_ADD(h, MB_SET1(sha512_initial_hash_value[7])));
+
+    for (int t = 0; t < 8; t++) {
+        for (int l = 0; l < SHA512_MB_LANES; l++) {
+            ((uint64_t *)out[l])[t] = __builtin_bswap64(buf[t][l]);
+        }
+    }
+}
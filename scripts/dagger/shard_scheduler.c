@@ -0,0 +1,797 @@
+/*
+ * Pick the shard range to mine by expected reward per hash.
+ *
+ *   gcc -O3 shard_scheduler.c -o shard_scheduler
+ *   ./shard_scheduler verify
+ *   ./shard_scheduler plan --snapshot chain.snap --hold 0-15 --hash-rate 20000
+ *   ./shard_scheduler run --snapshot chain.snap --hold 0-15 --exec "./mine.sh" --interval 5
+ *
+ * DKVDaggerHashimoto.mine() covers 2^shardLenBits shards from startShardId.
+ * Its target is (2^256 - 1) / sum(MiningLib.expectedDiff) over those shards,
+ * and it pays _paymentIn(storageCost << shardEntryBits, lastMineTime,
+ * minedTs) for each of them up to lastMinableShardIdx(), minus the coinbase
+ * share.  A hash also only counts if all randomChecks accesses land on stored
+ * kvs (kvIdx < lastKvIdx), since nothing else can be proven.  So for every
+ * range [start, start + 2^bits) of shards we hold
+ *
+ *   reward per hash = minerReward(minedTs) * (stored / rows)^randomChecks / diff(minedTs)
+ *
+ * `plan` ranks all of them at one minedTs.  `run` re-reads the snapshot when
+ * it changes, re-plans every --interval seconds at minedTs = now, and when the
+ * best range, its init hash or its difficulty changes, restarts the hashing
+ * engine: `--exec CMD` runs `sh -c "CMD ARGS"` with ARGS the
+ * storage_hashimoto_async mine options for the range (--mode merkle
+ * --start-shard ... --init-hash ... --mined-ts ... --diff ...), and
+ * --plan-file gets the same line, replaced atomically, for engines that poll.
+ *
+ * The snapshot is a text file of the contract state, one "name value" per
+ * line, names as in the contract; values are decimal or 0x hex, # starts a
+ * comment:
+ *
+ *   maxKvSizeBits 17          chunkSizeBits 12         shardSizeBits 22
+ *   randomChecks 16           minimumDiff 5000000      targetIntervalSec 60
+ *   cutoff 40                 diffAdjDivisor 1024      coinbaseShare 1000
+ *   storageCost 1000000000000000000
+ *   dcfFactor 340282365784068676928457747575078800565
+ *   startTime 1650000000      lastKvIdx 1000
+ *   shard 0 <lastMineTime> <difficulty> <miningHash> [blockMined]
+ *
+ * Shards without a "shard" line read as the zero MiningInfo, as on chain.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "keccak.c"
+#include "u256.c"
+#include "q128.c"
+#include "storage_econ.c"
+
+struct snapshot {
+    struct econ_config cfg;
+    unsigned shard_size_bits;
+    uint64_t last_kv_idx;
+    uint64_t nshards; // infos[0, nshards) covers every minable shard
+    struct mining_info *infos;
+};
+
+struct shard_plan {
+    uint64_t start_shard;
+    unsigned shard_len_bits;
+    u256 diff;
+    u256 reward;  // the miner's part
+    double valid; // chance that every access hits a stored kv
+    double reward_per_hash;
+};
+
+static int parse_u64(const char *s, uint64_t *v) {
+    char *end;
+    errno = 0;
+    *v = strtoull(s, &end, 0);
+    return (errno != 0 || end == s || *end != 0 ? -1 : 0);
+}
+
+static int parse_hash(const char *s, unsigned char out[32]) {
+    u256 v;
+    if (strncmp(s, "0x", 2) != 0 || strlen(s) != 66 || u256_from_string(s, &v) != 0) {
+        return (-1);
+    }
+    u256_to_be(v, out);
+    return (0);
+}
+
+uint64_t last_minable_shard(const struct snapshot *s) {
+    return ((s->last_kv_idx >> s->cfg.shard_entry_bits) + 1);
+}
+
+void snapshot_free(struct snapshot *s) {
+    free(s->infos);
+    s->infos = NULL;
+}
+
+// Set one contract parameter by its contract name; -1 if unknown or malformed.
+int snapshot_set(struct snapshot *s, const char *name, const char *value) {
+    struct econ_config *c = &s->cfg;
+    uint64_t v;
+    if (strcmp(name, "minimumDiff") == 0) {
+        return (u256_from_string(value, &c->minimum_diff));
+    } else if (strcmp(name, "storageCost") == 0) {
+        return (u256_from_string(value, &c->storage_cost));
+    } else if (strcmp(name, "dcfFactor") == 0) {
+        return (u256_from_string(value, &c->dcf_factor));
+    } else if (parse_u64(value, &v) != 0) {
+        return (-1);
+    } else if (strcmp(name, "maxKvSizeBits") == 0) {
+        c->max_kv_size_bits = v;
+    } else if (strcmp(name, "chunkSizeBits") == 0) {
+        c->chunk_size_bits = v;
+    } else if (strcmp(name, "shardSizeBits") == 0) {
+        s->shard_size_bits = v;
+    } else if (strcmp(name, "randomChecks") == 0) {
+        c->random_checks = v;
+    } else if (strcmp(name, "targetIntervalSec") == 0) {
+        c->target_interval_sec = v;
+    } else if (strcmp(name, "cutoff") == 0) {
+        c->cutoff = v;
+    } else if (strcmp(name, "diffAdjDivisor") == 0) {
+        c->diff_adj_divisor = v;
+    } else if (strcmp(name, "coinbaseShare") == 0) {
+        c->coinbase_share = v;
+    } else if (strcmp(name, "startTime") == 0) {
+        c->start_time = v;
+    } else if (strcmp(name, "lastKvIdx") == 0) {
+        s->last_kv_idx = v;
+    } else {
+        return (-1);
+    }
+    return (0);
+}
+
+// Validate the parameters, derive shardEntryBits and cover every minable shard with infos.
+int snapshot_check(struct snapshot *s) {
+    const struct econ_config *c = &s->cfg;
+    if (s->shard_size_bits < c->max_kv_size_bits || c->chunk_size_bits == 0 || c->max_kv_size_bits < c->chunk_size_bits ||
+        s->shard_size_bits - c->max_kv_size_bits >= 40 || c->random_checks == 0 || c->cutoff == 0 ||
+        c->diff_adj_divisor == 0 || c->coinbase_share > 10000) {
+        return (-1);
+    }
+    s->cfg.shard_entry_bits = s->shard_size_bits - c->max_kv_size_bits;
+
+    uint64_t need = last_minable_shard(s) + 1;
+    if (s->nshards < need) {
+        struct mining_info *p = realloc(s->infos, need * sizeof(*p));
+        if (p == NULL) {
+            return (-1);
+        }
+        memset(p + s->nshards, 0, (need - s->nshards) * sizeof(*p));
+        s->infos = p;
+        s->nshards = need;
+    }
+    return (0);
+}
+
+int snapshot_load(const char *path, struct snapshot *s) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    memset(s, 0, sizeof(*s));
+    uint64_t cap = 0;
+    int err = 0;
+    char line[1024];
+    for (unsigned lineno = 1; !err && fgets(line, sizeof(line), f) != NULL; lineno++) {
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = 0;
+        }
+        char *tok[6];
+        int n = 0;
+        for (char *p = strtok(line, " \t\r\n"); p != NULL && n < 6; p = strtok(NULL, " \t\r\n")) {
+            tok[n++] = p;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (strcmp(tok[0], "shard") != 0) {
+            err = n != 2 || snapshot_set(s, tok[0], tok[1]) != 0 ? lineno : 0;
+            continue;
+        }
+        struct mining_info info;
+        memset(&info, 0, sizeof(info));
+        uint64_t id;
+        if (n < 5 || parse_u64(tok[1], &id) || parse_u64(tok[2], &info.last_mine_time) ||
+            u256_from_string(tok[3], &info.difficulty) || parse_hash(tok[4], info.mining_hash) ||
+            (n > 5 && parse_u64(tok[5], &info.block_mined)) || id >= (1ULL << 32)) {
+            err = lineno;
+            break;
+        }
+        if (id >= cap) {
+            uint64_t ncap = cap ? cap : 64;
+            while (ncap <= id) {
+                ncap *= 2;
+            }
+            struct mining_info *p = realloc(s->infos, ncap * sizeof(*p));
+            if (p == NULL) {
+                err = lineno;
+                break;
+            }
+            memset(p + cap, 0, (ncap - cap) * sizeof(*p));
+            s->infos = p;
+            cap = ncap;
+        }
+        s->infos[id] = info;
+        if (id >= s->nshards) {
+            s->nshards = id + 1;
+        }
+    }
+    fclose(f);
+    if (err) {
+        fprintf(stderr, "%s:%d: cannot parse\n", path, err);
+        snapshot_free(s);
+        return (-1);
+    }
+    if (snapshot_check(s) != 0) {
+        fprintf(stderr, "%s: incomplete or inconsistent contract parameters\n", path);
+        snapshot_free(s);
+        return (-1);
+    }
+    return (0);
+}
+
+// hash0 of _calculateDiffAndInitHash: keccak256(abi.encode(hash0, shardId, miningHash)) per shard.
+void plan_init_hash(const struct snapshot *s, uint64_t start, unsigned bits, unsigned char hash0[32]) {
+    unsigned char enc[96];
+    memset(hash0, 0, 32);
+    for (uint64_t id = start; id < start + (1ULL << bits); id++) {
+        memcpy(enc, hash0, 32);
+        u256_to_be(u256_from_u64(id), enc + 32);
+        memcpy(enc + 64, s->infos[id].mining_hash, 32);
+        keccak256(enc, sizeof(enc), hash0);
+    }
+}
+
+static double stored_fraction(const struct snapshot *s, uint64_t start, unsigned bits) {
+    uint64_t first = start << s->cfg.shard_entry_bits;
+    uint64_t rows = 1ULL << (s->cfg.shard_entry_bits + bits);
+    uint64_t stored = s->last_kv_idx <= first ? 0 : s->last_kv_idx - first;
+    return (stored >= rows ? 1.0 : (double)stored / rows);
+}
+
+static double powi(double x, unsigned n) {
+    double r = 1;
+    for (; n != 0; n /= 2, x *= x) {
+        if (n & 1) {
+            r *= x;
+        }
+    }
+    return (r);
+}
+
+static int plan_cmp(const void *a, const void *b) {
+    const struct shard_plan *x = a, *y = b;
+    if (x->reward_per_hash != y->reward_per_hash) {
+        return (x->reward_per_hash > y->reward_per_hash ? -1 : 1);
+    }
+    if (x->shard_len_bits != y->shard_len_bits) {
+        return (x->shard_len_bits < y->shard_len_bits ? -1 : 1); // fewer shards, less data to read
+    }
+    return (x->start_shard < y->start_shard ? -1 : 1);
+}
+
+/*
+ * All ranges inside the held shards [0, lastMinableShardIdx] that mine() would
+ * accept at mined_ts and that can find a provable hash, best first.  Range
+ * sums for 2^bits shards are built from two halves of 2^(bits - 1), so the
+ * whole table costs O(n log n) checked u256 adds.  Returns the number of plans
+ * (*plans is malloc'ed), or -1 if out of memory.
+ */
+int64_t plan_ranges(const struct snapshot *s, const unsigned char *held, uint64_t mined_ts, struct shard_plan **plans) {
+    const struct econ_config *c = &s->cfg;
+    uint64_t n = last_minable_shard(s) + 1;
+    u256 *diff = malloc(n * sizeof(u256));
+    u256 *pay = malloc(n * sizeof(u256));
+    unsigned char *ok = malloc(n);
+    uint64_t cap = 64, count = 0;
+    *plans = malloc(cap * sizeof(struct shard_plan));
+    if (diff == NULL || pay == NULL || ok == NULL || *plans == NULL) {
+        free(diff);
+        free(pay);
+        free(ok);
+        free(*plans);
+        return (-1);
+    }
+
+    for (uint64_t id = 0; id < n; id++) {
+        ok[id] = held[id] && econ_expected_diff(c, &s->infos[id], mined_ts, &diff[id]) == 0 &&
+                 econ_shard_payment(c, &s->infos[id], mined_ts, &pay[id]) == 0;
+    }
+    for (unsigned bits = 0; (1ULL << bits) <= n; bits++) {
+        uint64_t len = 1ULL << bits;
+        if (bits > 0) {
+            // ranges of len from the two halves of len / 2, in place from the left
+            for (uint64_t id = 0; id + len <= n; id++) {
+                uint64_t hi = id + len / 2;
+                u256 d = u256_add(diff[id], diff[hi]);
+                u256 p = u256_add(pay[id], pay[hi]);
+                ok[id] = ok[id] && ok[hi] && u256_cmp(d, diff[id]) >= 0 && u256_cmp(p, pay[id]) >= 0;
+                diff[id] = d;
+                pay[id] = p;
+            }
+        }
+        for (uint64_t id = 0; id + len <= n; id++) {
+            struct shard_plan p = {id, bits};
+            if (!ok[id] || econ_miner_reward(c, pay[id], &p.reward) != 0) {
+                continue;
+            }
+            p.diff = diff[id];
+            p.valid = powi(stored_fraction(s, id, bits), c->random_checks);
+            p.reward_per_hash = u256_to_double(p.reward) * p.valid * econ_hit_probability(p.diff);
+            if (p.valid == 0) {
+                continue;
+            }
+            if (count == cap) {
+                struct shard_plan *q = realloc(*plans, 2 * cap * sizeof(*q));
+                if (q == NULL) {
+                    free(diff);
+                    free(pay);
+                    free(ok);
+                    free(*plans);
+                    return (-1);
+                }
+                *plans = q;
+                cap *= 2;
+            }
+            (*plans)[count++] = p;
+        }
+    }
+    free(diff);
+    free(pay);
+    free(ok);
+    qsort(*plans, count, sizeof(struct shard_plan), plan_cmp);
+    return (count);
+}
+
+// storage_hashimoto_async mine options for a plan.
+void plan_engine_args(const struct snapshot *s, const struct shard_plan *p, uint64_t mined_ts, char *buf,
+                      size_t len) {
+    unsigned char hash0[32];
+    char hex[65], diff[80];
+    plan_init_hash(s, p->start_shard, p->shard_len_bits, hash0);
+    for (int k = 0; k < 32; k++) {
+        sprintf(hex + 2 * k, "%02x", hash0[k]);
+    }
+    snprintf(buf, len,
+             "--mode merkle --max-kv-size-bits %u --chunk-size-bits %u --shard-entry-bits %u --random-checks %u "
+             "--start-shard %llu --shard-len-bits %u --init-hash 0x%s --mined-ts %llu --diff %s",
+             s->cfg.max_kv_size_bits, s->cfg.chunk_size_bits, s->cfg.shard_entry_bits, s->cfg.random_checks,
+             (unsigned long long)p->start_shard, p->shard_len_bits, hex, (unsigned long long)mined_ts,
+             u256_to_dec(p->diff, diff));
+}
+
+// Parse "0-15,20,22-23" into held[0, n).
+static int parse_held(const char *spec, unsigned char **held, uint64_t *n) {
+    char *copy = strdup(spec), *save = NULL;
+    *held = NULL;
+    *n = 0;
+    if (copy == NULL) {
+        return (-1);
+    }
+    for (char *r = strtok_r(copy, ",", &save); r != NULL; r = strtok_r(NULL, ",", &save)) {
+        char *dash = strchr(r, '-');
+        uint64_t lo, hi;
+        if (dash != NULL) {
+            *dash = 0;
+        }
+        if (parse_u64(r, &lo) != 0 || parse_u64(dash ? dash + 1 : r, &hi) != 0 || hi < lo || hi >= (1ULL << 32)) {
+            free(copy);
+            free(*held);
+            *held = NULL;
+            return (-1);
+        }
+        if (hi >= *n) {
+            unsigned char *p = realloc(*held, hi + 1);
+            if (p == NULL) {
+                free(copy);
+                free(*held);
+                *held = NULL;
+                return (-1);
+            }
+            memset(p + *n, 0, hi + 1 - *n);
+            *held = p;
+            *n = hi + 1;
+        }
+        memset(*held + lo, 1, hi - lo + 1);
+    }
+    free(copy);
+    return (*held == NULL ? -1 : 0);
+}
+
+#ifndef DAGGER_NO_MAIN
+
+static void print_plans(const struct shard_plan *plans, int64_t n, int64_t top, double hash_rate) {
+    char diff[80], reward[80];
+    printf("%8s %4s %22s %26s %8s %12s", "start", "bits", "diff", "reward (wei)", "valid", "wei/hash");
+    if (hash_rate > 0) {
+        printf(" %12s %12s", "wei/s", "exp. time");
+    }
+    printf("\n");
+    for (int64_t i = 0; i < n && i < top; i++) {
+        const struct shard_plan *p = &plans[i];
+        printf("%8llu %4u %22s %26s %7.3f%% %12.4g", (unsigned long long)p->start_shard, p->shard_len_bits,
+               u256_to_dec(p->diff, diff), u256_to_dec(p->reward, reward), 100 * p->valid, p->reward_per_hash);
+        if (hash_rate > 0) {
+            double hit = p->valid * econ_hit_probability(p->diff);
+            printf(" %12.4g %11.4gs", p->reward_per_hash * hash_rate, 1 / (hit * hash_rate));
+        }
+        printf("\n");
+    }
+}
+
+// held[] covering every shard of the snapshot.
+static unsigned char *held_for(const struct snapshot *s, const unsigned char *held, uint64_t nheld) {
+    unsigned char *h = calloc(s->nshards, 1);
+    if (h != NULL) {
+        memcpy(h, held, nheld < s->nshards ? nheld : s->nshards);
+    }
+    return (h);
+}
+
+static int check(const char *name, int cond) {
+    if (!cond) {
+        printf("%s failed!\n", name);
+    }
+    return (cond);
+}
+
+static int check_dec(const char *name, u256 v, const char *expect) {
+    char buf[80];
+    u256_to_dec(v, buf);
+    if (strcmp(buf, expect) != 0) {
+        printf("%s failed!\nexpect: %s\nactual: %s\n", name, expect, buf);
+        return (0);
+    }
+    return (1);
+}
+
+// Vectors from test/decentralized-kv-test.js and test/dkv-dagger-hashimoto-test.js.
+static int self_verify() {
+    int ok = 1;
+    u256 v, r;
+    struct econ_config c;
+    memset(&c, 0, sizeof(c));
+
+    // u256 helpers
+    ok &= check("u256_from_string", u256_from_string("0x10000000000000000000000000000000000000000000000000000000000000000",
+                                                     &v) != 0);
+    u256_from_string("115792089237316195423570985008687907853269984665640564039457584007913129639935", &v);
+    ok &= check_dec("u256_div", u256_div(v, u256_from_u64(10), &r), "11579208923731619542357098500868790785326998466564056403945758400791312963993");
+    ok &= check_dec("u256_div remainder", r, "5");
+    u256_from_string("0x8000000000000000000000000000000000000000000000000000000000000001", &r);
+    ok &= check_dec("u256_div large", u256_div(v, r, NULL), "1");
+    ok &= check_dec("econ_required", econ_required(u256_from_u64(3)),
+                    "38597363079105398474523661669562635951089994888546854679819194669304376546645");
+
+    // 1e18 upfront payment with a 0.9 yearly dcf
+    u256_from_string("1000000000000000000", &c.storage_cost);
+    u256_from_string("340282365784068676928457747575078800565", &c.dcf_factor);
+    econ_payment_inf(&c, c.storage_cost, 0, &v);
+    ok &= check_dec("upfrontPayment 0", v, "1000000000000000000");
+    econ_payment_inf(&c, c.storage_cost, 1, &v);
+    ok &= check_dec("upfrontPayment 1", v, "999999996659039970");
+    econ_payment_inf(&c, c.storage_cost, 3600 * 24 * 365, &v);
+    ok &= check_dec("upfrontPayment 1y", v, "900000000000000000");
+    econ_payment_in(&c, c.storage_cost, 0, 3600 * 24 * 365, &v);
+    ok &= check_dec("paymentIn 1y", v, "99999999999999999");
+
+    // expectedDiff with minimumDiff 10, targetIntervalSec 60, cutoff 40, diffAdjDivisor 1024
+    c.minimum_diff = u256_from_u64(10);
+    c.target_interval_sec = 60;
+    c.cutoff = 40;
+    c.diff_adj_divisor = 1024;
+    struct mining_info info;
+    memset(&info, 0, sizeof(info));
+    econ_expected_diff(&c, &info, 5, &v);
+    ok &= check_dec("expectedDiff genesis", v, "10");
+    info.last_mine_time = 1000;
+    info.difficulty = u256_from_u64(10240);
+    uint64_t intervals[] = {30, 50, 70, 100, 2000};
+    const char *diffs[] = {"10250", "10240", "10240", "10230", "9750"};
+    for (int k = 0; k < 5; k++) {
+        ok &= check("expectedDiff", econ_expected_diff(&c, &info, 1000 + intervals[k], &v) == 0) &&
+              check_dec("expectedDiff", v, diffs[k]);
+    }
+    ok &= check("expectedDiff minedTs too small", econ_expected_diff(&c, &info, 999, &v) != 0);
+    c.cutoff = 5;
+    ok &= check("expectedDiff underflow", econ_expected_diff(&c, &info, 1020, &v) != 0);
+
+    // the doubling table against direct sums, on a random snapshot
+    struct snapshot s;
+    memset(&s, 0, sizeof(s));
+    s.cfg = c;
+    s.cfg.cutoff = 40;
+    s.cfg.shard_entry_bits = 5;
+    s.cfg.random_checks = 4;
+    s.cfg.coinbase_share = 1000;
+    s.last_kv_idx = 37 * 32 + 7;
+    s.nshards = last_minable_shard(&s) + 1;
+    s.infos = calloc(s.nshards, sizeof(struct mining_info));
+    unsigned char *held = malloc(s.nshards);
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+    for (uint64_t id = 0; id < s.nshards; id++) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        s.infos[id].last_mine_time = 1000 + (rng >> 33) % 600;
+        s.infos[id].difficulty = u256_from_u64(1000 + (rng >> 20) % 100000);
+        s.infos[id].mining_hash[0] = id;
+        held[id] = id != 11;
+    }
+    struct shard_plan *plans;
+    int64_t n = plan_ranges(&s, held, 1700, &plans);
+    ok &= check("plan_ranges", n > 0);
+    int64_t expect_n = 0;
+    for (unsigned bits = 0; (1ULL << bits) <= s.nshards; bits++) {
+        for (uint64_t start = 0; start + (1ULL << bits) <= s.nshards; start++) {
+            u256 d = u256_from_u64(0), p = u256_from_u64(0), x;
+            int feasible = stored_fraction(&s, start, bits) > 0;
+            for (uint64_t id = start; id < start + (1ULL << bits); id++) {
+                feasible &= held[id] && econ_expected_diff(&s.cfg, &s.infos[id], 1700, &x) == 0;
+                d = u256_add(d, x);
+                feasible &= econ_shard_payment(&s.cfg, &s.infos[id], 1700, &x) == 0;
+                p = u256_add(p, x);
+            }
+            if (!feasible) {
+                continue;
+            }
+            expect_n++;
+            econ_miner_reward(&s.cfg, p, &p);
+            int found = 0;
+            for (int64_t i = 0; i < n; i++) {
+                if (plans[i].start_shard == start && plans[i].shard_len_bits == bits) {
+                    found = u256_cmp(plans[i].diff, d) == 0 && u256_cmp(plans[i].reward, p) == 0;
+                }
+            }
+            ok &= check("plan_ranges sums", found);
+        }
+    }
+    ok &= check("plan_ranges count", n == expect_n);
+    for (int64_t i = 1; i < n; i++) {
+        ok &= check("plan_ranges order", plans[i - 1].reward_per_hash >= plans[i].reward_per_hash);
+    }
+    free(plans);
+    free(held);
+    snapshot_free(&s);
+
+    if (ok) {
+        printf("self_verify() passed\n");
+    }
+    return (!ok);
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig) {
+    stopping = 1;
+}
+
+static void stop_engine(pid_t *child) {
+    if (*child > 0) {
+        kill(*child, SIGTERM);
+        waitpid(*child, NULL, 0);
+        *child = 0;
+    }
+}
+
+static int write_plan_file(const char *path, const char *line) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL || fprintf(f, "%s\n", line) < 0 || fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "cannot write %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    return (0);
+}
+
+struct run_options {
+    const char *snapshot;
+    const unsigned char *held;
+    uint64_t nheld;
+    const char *exec;
+    const char *plan_file;
+    double interval;
+    int64_t clock_offset;
+    uint64_t rounds; // 0: until interrupted
+};
+
+// Re-plan forever; restart the engine whenever the best choice changes.
+static int run(const struct run_options *o) {
+    struct snapshot s;
+    memset(&s, 0, sizeof(s));
+    struct timespec loaded = {0, 0};
+    struct shard_plan cur;
+    unsigned char cur_hash[32];
+    int have_cur = 0;
+    pid_t child = 0;
+    char args[1024];
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    for (uint64_t round = 0; !stopping && (o->rounds == 0 || round < o->rounds); round++) {
+        if (round > 0) {
+            struct timespec ts = {(time_t)o->interval, (long)((o->interval - (time_t)o->interval) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+        struct stat st;
+        if (stat(o->snapshot, &st) != 0) {
+            fprintf(stderr, "cannot stat %s: %s\n", o->snapshot, strerror(errno));
+            continue;
+        }
+        if (st.st_mtim.tv_sec != loaded.tv_sec || st.st_mtim.tv_nsec != loaded.tv_nsec) {
+            struct snapshot next;
+            if (snapshot_load(o->snapshot, &next) != 0) {
+                continue; // keep mining on the last good snapshot
+            }
+            snapshot_free(&s);
+            s = next;
+            loaded = st.st_mtim;
+        }
+        if (s.infos == NULL) {
+            continue;
+        }
+        if (child > 0 && waitpid(child, NULL, WNOHANG) == child) {
+            child = 0; // the engine ran out of nonces; start it again
+        }
+
+        uint64_t now = time(NULL) + o->clock_offset;
+        unsigned char *held = held_for(&s, o->held, o->nheld);
+        struct shard_plan *plans;
+        int64_t n = held ? plan_ranges(&s, held, now, &plans) : -1;
+        free(held);
+        if (n < 0) {
+            fprintf(stderr, "out of memory\n");
+            break;
+        }
+        if (n == 0) {
+            if (have_cur) {
+                printf("%llu: nothing minable in the held shards, stopping the engine\n", (unsigned long long)now);
+                stop_engine(&child);
+                have_cur = 0;
+            }
+            free(plans);
+            continue;
+        }
+
+        // the running engine keeps its minedTs; only a new range, init hash or target is worth a restart
+        unsigned char hash0[32];
+        plan_init_hash(&s, plans[0].start_shard, plans[0].shard_len_bits, hash0);
+        int changed = !have_cur || cur.start_shard != plans[0].start_shard ||
+                      cur.shard_len_bits != plans[0].shard_len_bits || memcmp(cur_hash, hash0, 32) != 0 ||
+                      u256_cmp(cur.diff, plans[0].diff) != 0;
+        if (changed || (o->exec != NULL && child == 0)) {
+            cur = plans[0];
+            memcpy(cur_hash, hash0, 32);
+            have_cur = 1;
+            plan_engine_args(&s, &cur, now, args, sizeof(args));
+            printf("%llu: shards [%llu, %llu), %.4g wei/hash, %.3f%% provable\n", (unsigned long long)now,
+                   (unsigned long long)cur.start_shard, (unsigned long long)(cur.start_shard + (1ULL << cur.shard_len_bits)),
+                   cur.reward_per_hash, 100 * cur.valid);
+            fflush(stdout);
+            if (o->plan_file != NULL) {
+                write_plan_file(o->plan_file, args);
+            }
+            if (o->exec != NULL) {
+                stop_engine(&child);
+                char cmd[4096];
+                snprintf(cmd, sizeof(cmd), "%s %s", o->exec, args);
+                child = fork();
+                if (child == 0) {
+                    execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+                    _exit(127);
+                } else if (child < 0) {
+                    fprintf(stderr, "fork: %s\n", strerror(errno));
+                    child = 0;
+                }
+            }
+        }
+        free(plans);
+    }
+    stop_engine(&child);
+    snapshot_free(&s);
+    return (0);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s plan|run --snapshot PATH --hold SHARDS [options]\n"
+            "  --snapshot PATH      contract state, see the top of shard_scheduler.c\n"
+            "  --hold SHARDS        shards we store, e.g. 0-15,20\n"
+            "  --mined-ts N         plan: minedTs to plan for (default now)\n"
+            "  --clock-offset S     chain time minus local time (default 0)\n"
+            "  --top N              plan: ranges to list (default 20)\n"
+            "  --hash-rate H        plan: hashes per second, for reward/s and time to a block\n"
+            "  --interval S         run: seconds between re-plans (default 5)\n"
+            "  --exec CMD           run: engine command, restarted with the mine options appended\n"
+            "  --plan-file PATH     run: write the mine options of the current plan here\n"
+            "  --rounds N           run: stop after N re-plans (default: until interrupted)\n",
+            prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"snapshot", required_argument, 0, 's'},  {"hold", required_argument, 0, 'H'},
+        {"mined-ts", required_argument, 0, 'T'},  {"clock-offset", required_argument, 0, 'o'},
+        {"top", required_argument, 0, 'n'},       {"hash-rate", required_argument, 0, 'r'},
+        {"interval", required_argument, 0, 'i'},  {"exec", required_argument, 0, 'e'},
+        {"plan-file", required_argument, 0, 'p'}, {"rounds", required_argument, 0, 'R'},
+        {0, 0, 0, 0},
+    };
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        return (self_verify());
+    }
+    if (argc < 2 || (strcmp(argv[1], "plan") != 0 && strcmp(argv[1], "run") != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    struct run_options o;
+    memset(&o, 0, sizeof(o));
+    o.interval = 5;
+    unsigned char *held = NULL;
+    uint64_t mined_ts = 0;
+    int64_t top = 20;
+    double hash_rate = 0;
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 's': o.snapshot = optarg; break;
+        case 'H':
+            if (parse_held(optarg, &held, &o.nheld) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'T': mined_ts = strtoull(optarg, NULL, 0); break;
+        case 'o': o.clock_offset = strtoll(optarg, NULL, 0); break;
+        case 'n': top = strtoll(optarg, NULL, 0); break;
+        case 'r': hash_rate = atof(optarg); break;
+        case 'i': o.interval = atof(optarg); break;
+        case 'e': o.exec = optarg; break;
+        case 'p': o.plan_file = optarg; break;
+        case 'R': o.rounds = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    if (o.snapshot == NULL || held == NULL || o.interval <= 0) {
+        usage(argv[0]);
+        return (1);
+    }
+    o.held = held;
+
+    if (strcmp(argv[1], "run") == 0) {
+        int ret = run(&o);
+        free(held);
+        return (ret);
+    }
+
+    struct snapshot s;
+    if (snapshot_load(o.snapshot, &s) != 0) {
+        return (1);
+    }
+    if (mined_ts == 0) {
+        mined_ts = time(NULL) + o.clock_offset;
+    }
+    unsigned char *h = held_for(&s, held, o.nheld);
+    struct shard_plan *plans;
+    int64_t n = h ? plan_ranges(&s, h, mined_ts, &plans) : -1;
+    if (n < 0) {
+        fprintf(stderr, "out of memory\n");
+        return (1);
+    }
+    printf("minedTs %llu, lastKvIdx %llu, shards 0-%llu minable, %lld feasible ranges\n",
+           (unsigned long long)mined_ts, (unsigned long long)s.last_kv_idx, (unsigned long long)last_minable_shard(&s),
+           (long long)n);
+    print_plans(plans, n, top, hash_rate);
+    if (n > 0) {
+        char args[1024];
+        plan_engine_args(&s, &plans[0], mined_ts, args, sizeof(args));
+        printf("mine %s\n", args);
+    }
+    free(plans);
+    free(h);
+    free(held);
+    snapshot_free(&s);
+    return (0);
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Sparse masked shards.
+ *
+ * DecentralizedKV slots at or past lastKvIdx, and blobs that are all zero,
+ * read as zero data.  The masked form of zero data is just the mask, which is
+ * regenerated from the cache (calculate_mask_blob() over zeros), so a sparse
+ * shard stores the masked bytes of non-empty slots only and synthesizes the
+ * rest on demand.  A freshly opened shard costs a slot table instead of
+ * entries * maxKvSize bytes of disk and write bandwidth.
+ *
+ * Layout:
+ *   struct sparse_header
+ *   uint64_t slot[entries]        SPARSE_EMPTY, or the index of the stored blob
+ *   (padding to SPARSE_ALIGN)
+ *   stored blobs, max_kv_size bytes each, in the order they were added
+ *
+ * Masks follow dataset_stream mask mode: the 64-byte piece at byte p of the
+ * (dense) shard is masked as item item_base + p / 64.
+ *
+ * The masking function is passed in so C (dagger_32.c calculate_mask_blob)
+ * and C++ (Dagger32Kernel) users share this file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SPARSE_MAGIC 0x3153525053474144ULL // "DAGSPRS1"
+#define SPARSE_EMPTY UINT64_MAX
+#define SPARSE_ALIGN 4096
+#define SPARSE_ITEM_BYTES 64
+
+struct sparse_header {
+    uint64_t magic;
+    uint64_t max_kv_size;
+    uint64_t entries;
+    uint64_t item_base;
+    uint64_t cache_size;
+    uint64_t stored;
+    unsigned char seed_hash[64];
+};
+
+typedef void (*sparse_mask_fn)(unsigned char *cache, uint64_t cache_size, uint64_t first_item, unsigned char *blob,
+                               uint64_t size);
+
+struct sparse_shard {
+    int fd;
+    struct sparse_header h;
+    uint64_t *slots;
+    uint64_t data_off;
+    unsigned char *cache;
+    sparse_mask_fn mask;
+};
+
+uint64_t sparse_data_offset(uint64_t entries) {
+    uint64_t table_end = sizeof(struct sparse_header) + entries * sizeof(uint64_t);
+    return ((table_end + SPARSE_ALIGN - 1) / SPARSE_ALIGN * SPARSE_ALIGN);
+}
+
+int sparse_blob_is_zero(const unsigned char *blob, uint64_t size) {
+    uint64_t acc = 0;
+    uint64_t k = 0;
+    for (; k + 8 <= size; k += 8) {
+        uint64_t w;
+        memcpy(&w, blob + k, 8);
+        acc |= w;
+    }
+    for (; k < size; k++) {
+        acc |= blob[k];
+    }
+    return (acc == 0);
+}
+
+// Open an existing sparse shard.  The caller sets cache and mask, generated
+// for h.cache_size and the seed behind h.seed_hash, before reading.
+int sparse_shard_open(struct sparse_shard *s, const char *path, int flags) {
+    memset(s, 0, sizeof(*s));
+    s->fd = open(path, flags);
+    if (s->fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    if (pread(s->fd, &s->h, sizeof(s->h), 0) != sizeof(s->h) || s->h.magic != SPARSE_MAGIC ||
+        s->h.max_kv_size % SPARSE_ITEM_BYTES != 0) {
+        fprintf(stderr, "%s is not a sparse shard\n", path);
+        close(s->fd);
+        return (-1);
+    }
+    uint64_t table = s->h.entries * sizeof(uint64_t);
+    s->slots = (uint64_t *)malloc(table);
+    if (s->slots == NULL || pread(s->fd, s->slots, table, sizeof(s->h)) != (ssize_t)table) {
+        fprintf(stderr, "cannot read slot table of %s\n", path);
+        free(s->slots);
+        close(s->fd);
+        return (-1);
+    }
+    // the header and the table entry of the last put share one sync, so a crash
+    // may keep the entry but lose the count; never hand out a referenced blob again
+    for (uint64_t kv = 0; kv < s->h.entries; kv++) {
+        if (s->slots[kv] != SPARSE_EMPTY && s->slots[kv] >= s->h.stored) {
+            s->h.stored = s->slots[kv] + 1;
+        }
+    }
+    s->data_off = sparse_data_offset(s->h.entries);
+    return (0);
+}
+
+void sparse_shard_close(struct sparse_shard *s) {
+    free(s->slots);
+    close(s->fd);
+}
+
+// File offset of byte off of slot kv, or -1 if the slot is synthesized.
+int64_t sparse_shard_offset(const struct sparse_shard *s, uint64_t kv, uint64_t off) {
+    if (kv >= s->h.entries || s->slots[kv] == SPARSE_EMPTY) {
+        return (-1);
+    }
+    return ((int64_t)(s->data_off + s->slots[kv] * s->h.max_kv_size + off));
+}
+
+// Masked bytes [off, off + len) of an empty slot; off and len are multiples of 64.
+void sparse_shard_synthesize(const struct sparse_shard *s, uint64_t kv, uint64_t off, uint64_t len,
+                             unsigned char *buf) {
+    memset(buf, 0, len);
+    uint64_t first_item = s->h.item_base + (kv * s->h.max_kv_size + off) / SPARSE_ITEM_BYTES;
+    s->mask(s->cache, s->h.cache_size, first_item, buf, len);
+}
+
+// Masked bytes [off, off + len) of slot kv, from disk or synthesized.
+int sparse_shard_read(const struct sparse_shard *s, uint64_t kv, uint64_t off, uint64_t len, unsigned char *buf) {
+    int64_t pos = sparse_shard_offset(s, kv, off);
+    if (pos < 0) {
+        sparse_shard_synthesize(s, kv, off, len, buf);
+        return (0);
+    }
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(s->fd, buf + done, len - done, pos + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (-1);
+        }
+        done += n;
+    }
+    return (0);
+}
+
+// Store raw (unmasked) data into slot kv.  Zero data empties the slot again.
+// New data always goes to a fresh blob, so a crash leaves either the old or the
+// new blob behind, never a torn one; a replaced blob, like the blob of an
+// emptied slot, stays as garbage until the shard is repacked.  blob is masked
+// in place.
+int sparse_shard_put(struct sparse_shard *s, uint64_t kv, unsigned char *blob) {
+    uint64_t size = s->h.max_kv_size;
+    if (kv >= s->h.entries) {
+        return (-1);
+    }
+    uint64_t slot = SPARSE_EMPTY;
+    if (!sparse_blob_is_zero(blob, size)) {
+        s->mask(s->cache, s->h.cache_size, s->h.item_base + kv * size / SPARSE_ITEM_BYTES, blob, size);
+        slot = s->h.stored;
+        if (pwrite(s->fd, blob, size, s->data_off + slot * size) != (ssize_t)size) {
+            return (-1);
+        }
+        s->h.stored++;
+    }
+    // data first, then the header that counts it, then the table entry that points at it
+    if (fdatasync(s->fd) != 0 || pwrite(s->fd, &s->h, sizeof(s->h), 0) != sizeof(s->h) ||
+        pwrite(s->fd, &slot, sizeof(uint64_t), sizeof(s->h) + kv * sizeof(uint64_t)) != sizeof(uint64_t)) {
+        return (-1);
+    }
+    s->slots[kv] = slot;
+    return (0);
+}
+
+// Build a sparse shard at path from a raw (unmasked) dense shard.  Slots at or
+// past last_kv and all-zero slots are left empty; a raw file shorter than
+// entries * max_kv_size reads as zeros past its end.  h supplies every header
+// field but magic and stored.  Returns the number of stored blobs or -1.
+int64_t sparse_shard_pack(int raw_fd, const char *path, struct sparse_header *h, uint64_t last_kv,
+                          unsigned char *cache, sparse_mask_fn mask) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    uint64_t size = h->max_kv_size;
+    uint64_t data_off = sparse_data_offset(h->entries);
+    uint64_t *slots = (uint64_t *)malloc(h->entries * sizeof(uint64_t));
+    unsigned char *blob = (unsigned char *)malloc(size);
+    if (slots == NULL || blob == NULL) {
+        fprintf(stderr, "cannot pack %s: out of memory\n", path);
+        free(slots);
+        free(blob);
+        close(fd);
+        return (-1);
+    }
+    h->magic = SPARSE_MAGIC;
+    h->stored = 0;
+
+    int64_t ret = 0;
+    for (uint64_t kv = 0; kv < h->entries; kv++) {
+        slots[kv] = SPARSE_EMPTY;
+        if (kv >= last_kv) {
+            continue;
+        }
+        ssize_t n = pread(raw_fd, blob, size, kv * size);
+        if (n < 0) {
+            fprintf(stderr, "read of slot %llu failed: %s\n", (unsigned long long)kv, strerror(errno));
+            ret = -1;
+            break;
+        }
+        memset(blob + n, 0, size - n);
+        if (sparse_blob_is_zero(blob, size)) {
+            continue;
+        }
+        mask(cache, h->cache_size, h->item_base + kv * size / SPARSE_ITEM_BYTES, blob, size);
+        if (pwrite(fd, blob, size, data_off + h->stored * size) != (ssize_t)size) {
+            fprintf(stderr, "write of slot %llu failed: %s\n", (unsigned long long)kv, strerror(errno));
+            ret = -1;
+            break;
+        }
+        slots[kv] = h->stored++;
+    }
+    if (ret == 0 && (pwrite(fd, h, sizeof(*h), 0) != sizeof(*h) ||
+                     pwrite(fd, slots, h->entries * sizeof(uint64_t), sizeof(*h)) !=
+                         (ssize_t)(h->entries * sizeof(uint64_t)) ||
+                     ftruncate(fd, data_off + h->stored * size) != 0 || fsync(fd) != 0)) {
+        fprintf(stderr, "finalizing %s failed: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    free(slots);
+    free(blob);
+    close(fd);
+    return (ret < 0 ? -1 : (int64_t)h->stored);
+}
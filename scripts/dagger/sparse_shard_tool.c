@@ -0,0 +1,366 @@
+/*
+ * Build and inspect sparse masked shards (see sparse_shard.c).
+ *
+ *   gcc -O3 -mavx2 -pthread sparse_shard_tool.c -o sparse_shard_tool
+ *   ./sparse_shard_tool pack --input shard.raw --output shard.sparse --entries 32 --last-kv-idx 5
+ *   ./sparse_shard_tool put --output shard.sparse --kv 5 --input blob.raw
+ *   ./sparse_shard_tool unpack --input shard.sparse --output shard.masked
+ *   ./sparse_shard_tool cat --input shard.sparse --kv 7 > kv7.masked
+ *   ./sparse_shard_tool verify
+ *
+ * unpack writes the dense masked shard, byte-identical to
+ * `dataset_stream mask` on the raw shard (with --item-base 0).
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <sys/stat.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_32.c"
+#include "sparse_shard.c"
+
+struct tool_options {
+    const char *input;
+    const char *output;
+    const char *seed;
+    uint64_t cache_size;
+    uint64_t max_kv_size;
+    uint64_t entries;
+    uint64_t last_kv;
+    uint64_t item_base;
+    uint64_t kv;
+};
+
+static unsigned char *tool_cache(const char *seed, uint64_t cache_size) {
+    fprintf(stderr, "Generating cache with size %llu\n", (unsigned long long)cache_size);
+    return (generate_cache(cache_size, (unsigned char *)seed, strlen(seed)));
+}
+
+// Open a sparse shard and attach a cache generated from seed.
+static int tool_open(struct sparse_shard *s, const char *path, int flags, const char *seed) {
+    if (sparse_shard_open(s, path, flags) != 0) {
+        return (-1);
+    }
+    unsigned char seed_hash[HASH_BYTES];
+    SHA512((void *)seed, strlen(seed), seed_hash);
+    if (memcmp(seed_hash, s->h.seed_hash, HASH_BYTES) != 0) {
+        fprintf(stderr, "%s was masked with a different seed\n", path);
+        sparse_shard_close(s);
+        return (-1);
+    }
+    s->cache = tool_cache(seed, s->h.cache_size);
+    if (s->cache == NULL) {
+        fprintf(stderr, "cannot allocate %llu bytes of cache\n", (unsigned long long)s->h.cache_size);
+        sparse_shard_close(s);
+        return (-1);
+    }
+    s->mask = calculate_mask_blob;
+    return (0);
+}
+
+int tool_pack(struct tool_options *o) {
+    int raw_fd = open(o->input, O_RDONLY);
+    struct stat st;
+    if (raw_fd < 0 || fstat(raw_fd, &st) != 0) {
+        fprintf(stderr, "cannot open %s: %s\n", o->input, strerror(errno));
+        return (-1);
+    }
+    struct sparse_header h;
+    memset(&h, 0, sizeof(h));
+    h.max_kv_size = o->max_kv_size;
+    h.entries = o->entries ? o->entries : (st.st_size + o->max_kv_size - 1) / o->max_kv_size;
+    h.item_base = o->item_base;
+    h.cache_size = o->cache_size;
+    SHA512((void *)o->seed, strlen(o->seed), h.seed_hash);
+
+    unsigned char *cache = tool_cache(o->seed, o->cache_size);
+    int64_t stored = sparse_shard_pack(raw_fd, o->output, &h, o->last_kv, cache, calculate_mask_blob);
+    close(raw_fd);
+    free(cache);
+    if (stored < 0) {
+        return (-1);
+    }
+    printf("Packed %llu slots, %lld stored, %llu synthesized (%llu bytes instead of %llu)\n",
+           (unsigned long long)h.entries, (long long)stored, (unsigned long long)(h.entries - stored),
+           (unsigned long long)(sparse_data_offset(h.entries) + stored * h.max_kv_size),
+           (unsigned long long)(h.entries * h.max_kv_size));
+    return (0);
+}
+
+int tool_put(struct tool_options *o) {
+    struct sparse_shard s;
+    if (tool_open(&s, o->output, O_RDWR, o->seed) != 0) {
+        return (-1);
+    }
+    int ret = -1;
+    int fd = -1;
+    unsigned char *blob = calloc(1, s.h.max_kv_size);
+    if (blob == NULL) {
+        fprintf(stderr, "cannot allocate a %llu byte blob\n", (unsigned long long)s.h.max_kv_size);
+        goto out;
+    }
+    fd = open(o->input, O_RDONLY);
+    if (fd < 0 || read(fd, blob, s.h.max_kv_size) < 0) {
+        fprintf(stderr, "cannot read %s: %s\n", o->input, strerror(errno));
+        goto out;
+    }
+    ret = sparse_shard_put(&s, o->kv, blob);
+    if (ret != 0) {
+        fprintf(stderr, "put of slot %llu failed\n", (unsigned long long)o->kv);
+    }
+out:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(blob);
+    free(s.cache);
+    sparse_shard_close(&s);
+    return (ret);
+}
+
+int tool_unpack(struct tool_options *o) {
+    struct sparse_shard s;
+    if (tool_open(&s, o->input, O_RDONLY, o->seed) != 0) {
+        return (-1);
+    }
+    int ret = -1;
+    unsigned char *blob = NULL;
+    int fd = open(o->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", o->output, strerror(errno));
+        goto out;
+    }
+    blob = malloc(s.h.max_kv_size);
+    if (blob == NULL) {
+        fprintf(stderr, "cannot allocate a %llu byte blob\n", (unsigned long long)s.h.max_kv_size);
+        goto out;
+    }
+    ret = 0;
+    for (uint64_t kv = 0; kv < s.h.entries && ret == 0; kv++) {
+        if (sparse_shard_read(&s, kv, 0, s.h.max_kv_size, blob) != 0 ||
+            pwrite(fd, blob, s.h.max_kv_size, kv * s.h.max_kv_size) != (ssize_t)s.h.max_kv_size) {
+            fprintf(stderr, "slot %llu failed\n", (unsigned long long)kv);
+            ret = -1;
+        }
+    }
+out:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(blob);
+    free(s.cache);
+    sparse_shard_close(&s);
+    return (ret);
+}
+
+int tool_cat(struct tool_options *o) {
+    struct sparse_shard s;
+    if (tool_open(&s, o->input, O_RDONLY, o->seed) != 0) {
+        return (-1);
+    }
+    unsigned char *blob = malloc(s.h.max_kv_size);
+    int ret = blob == NULL ? -1 : sparse_shard_read(&s, o->kv, 0, s.h.max_kv_size, blob);
+    if (ret == 0 && fwrite(blob, 1, s.h.max_kv_size, stdout) != s.h.max_kv_size) {
+        ret = -1;
+    }
+    free(blob);
+    free(s.cache);
+    sparse_shard_close(&s);
+    return (ret);
+}
+
+// Pack a shard with empty, zero and past-lastKvIdx slots and compare every
+// read (and put) with masking the dense raw shard directly.
+void sparse_self_verify() {
+    const char *seed = "123";
+    uint64_t cache_size = 1024, size = 256, entries = 16, last_kv = 12;
+    char raw_path[] = "/tmp/sparse_verify_raw.XXXXXX";
+    char sparse_path[] = "/tmp/sparse_verify.XXXXXX";
+    int raw_fd = mkstemp(raw_path);
+    close(mkstemp(sparse_path));
+    int ok = 1;
+
+    unsigned char *raw = calloc(entries, size);
+    for (uint64_t kv = 0; kv < entries; kv++) {
+        if (kv % 3 == 1) {
+            continue; // zero blob
+        }
+        for (uint64_t k = 0; k < size; k++) {
+            raw[kv * size + k] = (unsigned char)(kv * 7 + k);
+        }
+    }
+    // only 14 slots on disk: the tail reads as zeros
+    if (write(raw_fd, raw, 14 * size) != (ssize_t)(14 * size)) {
+        printf("cannot write %s\n", raw_path);
+        return;
+    }
+
+    struct sparse_header h;
+    memset(&h, 0, sizeof(h));
+    h.max_kv_size = size;
+    h.entries = entries;
+    h.item_base = 5;
+    h.cache_size = cache_size;
+    SHA512((void *)seed, strlen(seed), h.seed_hash);
+    unsigned char *cache = generate_cache(cache_size, (unsigned char *)seed, strlen(seed));
+    int64_t stored = sparse_shard_pack(raw_fd, sparse_path, &h, last_kv, cache, calculate_mask_blob);
+    if (stored != 8) {
+        printf("sparse_shard_pack failed!\n");
+        printf("expect: 8 stored\n");
+        printf("actual: %lld stored\n", (long long)stored);
+        ok = 0;
+    }
+
+    struct sparse_shard s;
+    if (sparse_shard_open(&s, sparse_path, O_RDWR) != 0) {
+        return;
+    }
+    s.cache = cache;
+    s.mask = calculate_mask_blob;
+    unsigned char expect[256], actual[256];
+    for (uint64_t kv = 0; kv < entries && ok; kv++) {
+        memcpy(expect, raw + kv * size, size);
+        if (kv >= last_kv) {
+            memset(expect, 0, size);
+        }
+        calculate_mask_blob(cache, cache_size, h.item_base + kv * size / 64, expect, size);
+        // a piece in the middle, like a merkle chunk read
+        if (sparse_shard_read(&s, kv, 0, size, actual) != 0 || memcmp(expect, actual, size) != 0 ||
+            sparse_shard_read(&s, kv, 128, 64, actual) != 0 || memcmp(expect + 128, actual, 64) != 0) {
+            printf("sparse_shard_read of slot %llu failed!\n", (unsigned long long)kv);
+            ok = 0;
+        }
+    }
+
+    // fill an empty slot, rewrite it, then empty a stored one
+    unsigned char blob[256];
+    for (uint64_t k = 0; k < size; k++) {
+        blob[k] = expect[k] = (unsigned char)(k * 13);
+    }
+    calculate_mask_blob(cache, cache_size, h.item_base + 13 * size / 64, expect, size);
+    memset(actual, 0, size);
+    if (sparse_shard_put(&s, 13, blob) != 0 || sparse_shard_offset(&s, 13, 0) < 0 ||
+        sparse_shard_read(&s, 13, 0, size, actual) != 0 || memcmp(expect, actual, size) != 0) {
+        printf("sparse_shard_put of slot 13 failed!\n");
+        ok = 0;
+    }
+    // rewriting a stored slot moves it to a fresh blob
+    int64_t old_pos = sparse_shard_offset(&s, 13, 0);
+    for (uint64_t k = 0; k < size; k++) {
+        blob[k] = expect[k] = (unsigned char)(k * 7 + 1);
+    }
+    calculate_mask_blob(cache, cache_size, h.item_base + 13 * size / 64, expect, size);
+    if (sparse_shard_put(&s, 13, blob) != 0 || sparse_shard_offset(&s, 13, 0) == old_pos ||
+        sparse_shard_read(&s, 13, 0, size, actual) != 0 || memcmp(expect, actual, size) != 0) {
+        printf("sparse_shard_put rewrite of slot 13 failed!\n");
+        ok = 0;
+    }
+    memset(blob, 0, size);
+    if (sparse_shard_put(&s, 0, blob) != 0 || sparse_shard_offset(&s, 0, 0) >= 0) {
+        printf("sparse_shard_put of zero blob failed!\n");
+        ok = 0;
+    }
+    sparse_shard_close(&s);
+
+    // the table updates must be durable: reopen and read slot 13 again
+    if (sparse_shard_open(&s, sparse_path, O_RDONLY) == 0) {
+        s.cache = cache;
+        s.mask = calculate_mask_blob;
+        if (s.h.stored != 10 || sparse_shard_read(&s, 13, 0, size, actual) != 0 || memcmp(expect, actual, size) != 0) {
+            printf("reopened sparse shard failed!\n");
+            ok = 0;
+        }
+        sparse_shard_close(&s);
+    }
+
+    free(raw);
+    free(cache);
+    close(raw_fd);
+    unlink(raw_path);
+    unlink(sparse_path);
+    if (ok) {
+        printf("sparse_self_verify() passed\n");
+    }
+    return;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s pack|put|unpack|cat|verify [options]\n"
+            "  --input PATH            raw shard (pack), raw blob (put) or sparse shard (unpack, cat)\n"
+            "  --output PATH           sparse shard (pack, put) or dense masked shard (unpack)\n"
+            "  --max-kv-size-bits N    slot size (pack, default 12)\n"
+            "  --entries N             slots in the shard (pack, default: input size / slot size)\n"
+            "  --last-kv-idx N         first slot past lastKvIdx, relative to the shard (pack, default: all)\n"
+            "  --item-base N           mask item index of the first byte (pack, default 0)\n"
+            "  --kv N                  slot (put, cat)\n"
+            "  --seed STR              cache seed (default 123)\n"
+            "  --cache-size BYTES      cache size (pack, default 16777216)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"input", required_argument, 0, 'i'},
+        {"output", required_argument, 0, 'o'},
+        {"max-kv-size-bits", required_argument, 0, 'K'},
+        {"entries", required_argument, 0, 'e'},
+        {"last-kv-idx", required_argument, 0, 'l'},
+        {"item-base", required_argument, 0, 'b'},
+        {"kv", required_argument, 0, 'k'},
+        {"seed", required_argument, 0, 's'},
+        {"cache-size", required_argument, 0, 'c'},
+        {0, 0, 0, 0},
+    };
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return (1);
+    }
+    const char *cmd = argv[1];
+    if (strcmp(cmd, "verify") == 0) {
+        sparse_self_verify();
+        return (0);
+    }
+
+    struct tool_options o;
+    memset(&o, 0, sizeof(o));
+    o.seed = "123";
+    o.cache_size = 16777216;
+    o.max_kv_size = 4096;
+    o.last_kv = UINT64_MAX;
+    o.kv = UINT64_MAX;
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'i': o.input = optarg; break;
+        case 'o': o.output = optarg; break;
+        case 'K': o.max_kv_size = 1ULL << atoi(optarg); break;
+        case 'e': o.entries = strtoull(optarg, NULL, 0); break;
+        case 'l': o.last_kv = strtoull(optarg, NULL, 0); break;
+        case 'b': o.item_base = strtoull(optarg, NULL, 0); break;
+        case 'k': o.kv = strtoull(optarg, NULL, 0); break;
+        case 's': o.seed = optarg; break;
+        case 'c': o.cache_size = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+
+    int ret;
+    if (strcmp(cmd, "pack") == 0 && o.input && o.output && o.max_kv_size >= HASH_BYTES) {
+        ret = tool_pack(&o);
+    } else if (strcmp(cmd, "put") == 0 && o.input && o.output && o.kv != UINT64_MAX) {
+        ret = tool_put(&o);
+    } else if (strcmp(cmd, "unpack") == 0 && o.input && o.output) {
+        ret = tool_unpack(&o);
+    } else if (strcmp(cmd, "cat") == 0 && o.input && o.kv != UINT64_MAX) {
+        ret = tool_cat(&o);
+    } else {
+        usage(argv[0]);
+        return (1);
+    }
+    return (ret == 0 ? 0 : 1);
+}
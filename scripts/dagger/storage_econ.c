@@ -0,0 +1,125 @@
+/*
+ * Storage mining economics of DecentralizedKVDaggerHashimoto, bit-exact in u256.
+ *
+ *   econ_pow()            BinaryRelated.pow, Q128.128 (q128_pow())
+ *   econ_payment_in()     DecentralizedKV._paymentIn
+ *   econ_expected_diff()  MiningLib.expectedDiff
+ *   econ_shard_payment()  what _rewardMiner pays for one shard
+ *   econ_required()       the largest hash mine() accepts for a difficulty
+ *
+ * Every function that can revert on chain (checked arithmetic, "minedTs too
+ * small") returns -1 instead, so callers can drop the choice the contract
+ * would reject.  Timestamps are seconds and fit in 64 bits.
+ *
+ * Must be included after u256.c and q128.c.
+ */
+
+struct econ_config {
+    unsigned max_kv_size_bits;
+    unsigned chunk_size_bits;
+    unsigned shard_entry_bits;
+    unsigned random_checks;
+    u256 minimum_diff;
+    uint64_t target_interval_sec;
+    uint64_t cutoff;
+    uint64_t diff_adj_divisor;
+    uint64_t coinbase_share; // 10000 = 1.0
+    u256 storage_cost;
+    u256 dcf_factor; // Q128.128 per second
+    uint64_t start_time;
+};
+
+// MiningLib.MiningInfo
+struct mining_info {
+    unsigned char mining_hash[32];
+    uint64_t last_mine_time;
+    u256 difficulty;
+    uint64_t block_mined;
+};
+
+int econ_pow(u256 fp, uint64_t n, u256 *out) {
+    return (q128_pow(fp, n, out));
+}
+
+// _paymentIn(x, from_ts, to_ts): x * (dcf^(from - start) - dcf^(to - start)) >> 128
+int econ_payment_in(const struct econ_config *c, u256 x, uint64_t from_ts, uint64_t to_ts, u256 *out) {
+    u256 p0, p1;
+    if (from_ts < c->start_time || to_ts < c->start_time || econ_pow(c->dcf_factor, from_ts - c->start_time, &p0) ||
+        econ_pow(c->dcf_factor, to_ts - c->start_time, &p1) || u256_cmp(p0, p1) < 0) {
+        return (-1);
+    }
+    return (q128_mul_shr(x, u256_sub(p0, p1), out));
+}
+
+// _paymentInf(x, ts - start)
+int econ_payment_inf(const struct econ_config *c, u256 x, uint64_t ts, u256 *out) {
+    u256 p;
+    if (ts < c->start_time || econ_pow(c->dcf_factor, ts - c->start_time, &p)) {
+        return (-1);
+    }
+    return (q128_mul_shr(x, p, out));
+}
+
+// MiningLib.expectedDiff
+int econ_expected_diff(const struct econ_config *c, const struct mining_info *info, uint64_t mine_time, u256 *out) {
+    if (mine_time < info->last_mine_time || c->cutoff == 0 || c->diff_adj_divisor == 0) {
+        return (-1);
+    }
+    uint64_t interval = mine_time - info->last_mine_time;
+    uint64_t steps = interval / c->cutoff;
+    u256 diff = info->difficulty;
+    u256 t;
+    if (interval < c->target_interval_sec) {
+        if (steps > 1) {
+            return (-1); // 1 - interval / cutoff underflows
+        }
+        u256 inc = u256_div_u64(steps == 0 ? diff : u256_from_u64(0), c->diff_adj_divisor, NULL);
+        t = u256_add(diff, inc);
+        if (u256_cmp(t, diff) < 0) {
+            return (-1);
+        }
+        diff = t;
+        if (u256_cmp(diff, c->minimum_diff) < 0) {
+            diff = c->minimum_diff;
+        }
+    } else {
+        if (steps == 0 || u256_mul_checked(u256_from_u64(steps - 1), diff, &t)) {
+            return (-1);
+        }
+        u256 dec = u256_div_u64(t, c->diff_adj_divisor, NULL);
+        t = u256_add(dec, c->minimum_diff);
+        if (u256_cmp(t, dec) < 0) {
+            return (-1);
+        }
+        diff = u256_cmp(t, diff) > 0 ? c->minimum_diff : u256_sub(diff, dec);
+    }
+    *out = diff;
+    return (0);
+}
+
+// One full shard payment of _rewardMiner, before the coinbase share.
+int econ_shard_payment(const struct econ_config *c, const struct mining_info *info, uint64_t mined_ts, u256 *out) {
+    u256 x = u256_shl(c->storage_cost, c->shard_entry_bits);
+    return (econ_payment_in(c, x, info->last_mine_time, mined_ts, out));
+}
+
+// The miner's part of a reward; the rest goes to block.coinbase.
+int econ_miner_reward(const struct econ_config *c, u256 total, u256 *out) {
+    u256 coinbase;
+    if (u256_mul_checked(total, u256_from_u64(c->coinbase_share), &coinbase)) {
+        return (-1);
+    }
+    *out = u256_sub(total, u256_div_u64(coinbase, 10000, NULL));
+    return (0);
+}
+
+// (2^256 - 1) / diff: mine() accepts a hash0 no larger than this.
+u256 econ_required(u256 diff) {
+    u256 max = {{UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX}};
+    return (u256_div(max, diff, NULL));
+}
+
+// Probability that one hash meets diff, (required + 1) / 2^256.
+double econ_hit_probability(u256 diff) {
+    return ((u256_to_double(econ_required(diff)) + 1) / 0x1p256);
+}
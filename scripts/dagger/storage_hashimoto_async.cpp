@@ -0,0 +1,949 @@
+// Storage hashimoto over on-disk shards with one coroutine per candidate nonce.
+//
+//   g++ -std=c++20 -O3 -march=native -pthread storage_hashimoto_async.cpp -o storage_hashimoto_async
+//   ./storage_hashimoto_async verify
+//   ./storage_hashimoto_async mine --data shard.masked --max-kv-size-bits 12 --shard-entry-bits 5 ...
+//
+// Every storage-hashimoto candidate needs randomChecks reads, each depending on
+// the previous one, so a thread per candidate spends its time blocked.  Here a
+// candidate is a coroutine that suspends on its next blob read.  Each thread
+// runs a Scheduler that keeps --inflight candidates alive, collects their reads,
+// sorts every submission window by file offset and hands it to io_uring, then
+// resumes the candidates whose reads completed.  One core keeps thousands of
+// candidates (and the drive queue) busy.
+//
+// Two hash chains are supported, matching DKVDaggerHashimoto:
+//   xor     _hashimoto: fnv256-derived kvIdx, blob XORed into a maxKvSize mix
+//   merkle  _hashimotoMerkleProof: chunk index from hash0, hash0 = keccak256(hash0 || chunk)
+//
+// The data file holds the masked blobs of shards [startShardId, startShardId +
+// 2^shardLenBits) back to back, maxKvSize bytes per kv, so kv / chunk parent p
+// lives at p * maxKvSize (xor) or p * chunkSize (merkle).  With --sparse it is
+// a sparse shard (sparse_shard.c) instead: empty slots are not read but
+// synthesized from the cache without suspending the candidate.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // g++ already defines it
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define DAGGER_NO_MAIN
+#include "dagger_kernels.cpp"
+#include "keccak.c"
+#include "fnv256.c"
+#include "metrics.c"
+#include "timeline.c"
+#include "sparse_shard.c"
+#include "uring.c"
+#include "dagger_profile.c"
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define BLOB_ALIGN 4096
+
+enum hashimoto_mode { HASHIMOTO_XOR, HASHIMOTO_MERKLE };
+
+struct StorageParams {
+    int mode;
+    unsigned max_kv_size_bits;
+    unsigned chunk_size_bits;
+    unsigned shard_entry_bits;
+    unsigned shard_len_bits;
+    uint64_t start_shard_id;
+    unsigned random_checks;
+    struct storage_index_params index;
+
+    void init() {
+        storage_index_init(&index, shard_entry_bits, shard_len_bits, start_shard_id, max_kv_size_bits);
+    }
+    uint64_t max_kv_size() const { return 1ULL << max_kv_size_bits; }
+    uint64_t chunk_size() const { return 1ULL << chunk_size_bits; }
+    // bytes read per access
+    uint64_t read_size() const { return mode == HASHIMOTO_XOR ? max_kv_size() : chunk_size(); }
+};
+
+class Scheduler;
+
+// A candidate coroutine.  It starts suspended; the scheduler resumes it and
+// destroys it once done() after a resume.  slot is the scheduler's in-flight
+// slot, so the caller can keep per-candidate state in plain arrays.
+struct Candidate {
+    struct promise_type {
+        unsigned slot = 0;
+        Candidate get_return_object() {
+            return Candidate{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+// co_await scheduler.read_slot(...) suspends the candidate until the read
+// completes and yields the number of bytes read (or -errno).  Synthesized
+// reads are ready at once.
+struct BlobRead {
+    Scheduler *sched;
+    void *buf;
+    unsigned len;
+    uint64_t off;
+    int res;
+    bool ready;
+    std::coroutine_handle<> waiter;
+    uint64_t start; // metrics_now() when the read was issued
+
+    bool await_ready() const noexcept { return ready; }
+    void await_suspend(std::coroutine_handle<> h);
+    int await_resume() const noexcept { return res; }
+};
+
+class Scheduler {
+  public:
+    Scheduler(int fd, struct uring *ring, unsigned window, uint64_t slot_size, const struct sparse_shard *sparse)
+        : fd_(fd), ring_(ring), window_(window), slot_size_(slot_size), sparse_(sparse) {}
+
+    BlobRead read(void *buf, unsigned len, uint64_t off) {
+        return BlobRead{this, buf, len, off, 0, false, {}, metrics_now()};
+    }
+
+    // Masked bytes [off, off + len) of kv slot kv (relative to the file).
+    BlobRead read_slot(void *buf, unsigned len, uint64_t kv, uint64_t off) {
+        if (sparse_ == NULL) {
+            return read(buf, len, kv * slot_size_ + off);
+        }
+        int64_t pos = sparse_shard_offset(sparse_, kv, off);
+        if (pos < 0) {
+            uint64_t start = metrics_now(), t0 = timeline_begin();
+            sparse_shard_synthesize(sparse_, kv, off, len, (unsigned char *)buf);
+            timeline_end("synthesize", t0);
+            metrics_observe_since(METRIC_MASK_LATENCY, start);
+            metrics_add(METRIC_MASK_ITEMS, len / SPARSE_ITEM_BYTES);
+            synthesized_++;
+            return BlobRead{this, buf, len, off, (int)len, true, {}, start};
+        }
+        return read(buf, len, pos);
+    }
+
+    void enqueue(BlobRead *r) { pending_.push_back(r); }
+
+    // Keep up to inflight candidates alive.  spawn(slot, &c) creates the next
+    // candidate in a free slot or returns false when there are no more;
+    // done(slot) is called when the candidate in slot has finished.
+    template <typename Spawn, typename Done>
+    void run(unsigned inflight, Spawn &&spawn, Done &&done) {
+        std::vector<std::coroutine_handle<Candidate::promise_type>> ready;
+        std::vector<unsigned> free_slots;
+        for (unsigned k = inflight; k > 0; k--) {
+            free_slots.push_back(k - 1);
+        }
+        bool more = true;
+
+        while (true) {
+            while (more && !free_slots.empty()) {
+                Candidate c;
+                if (!spawn(free_slots.back(), &c)) {
+                    more = false;
+                    break;
+                }
+                c.handle.promise().slot = free_slots.back();
+                free_slots.pop_back();
+                ready.push_back(c.handle);
+            }
+            while (!ready.empty()) {
+                auto h = ready.back();
+                ready.pop_back();
+                h.resume();
+                if (h.done()) {
+                    unsigned slot = h.promise().slot;
+                    h.destroy();
+                    done(slot);
+                    free_slots.push_back(slot);
+                }
+                if (pending_.size() >= window_) {
+                    submit();
+                }
+            }
+            if (free_slots.size() == inflight && !more) {
+                break;
+            }
+            if (pending_.empty() && submitted_ == 0 && done_.empty()) {
+                continue; // finished candidates made room for new ones
+            }
+            submit();
+            complete(&ready);
+        }
+    }
+
+    uint64_t reads() const { return reads_; }
+    uint64_t synthesized() const { return synthesized_; }
+
+  private:
+    // Sort the current window by offset and queue as much of it as the ring takes.
+    void submit() {
+        if (pending_.empty()) {
+            return;
+        }
+        std::sort(pending_.begin(), pending_.end(), [](const BlobRead *a, const BlobRead *b) { return a->off < b->off; });
+        if (ring_ == NULL) {
+            for (BlobRead *r : pending_) {
+                r->res = pread_full(r->buf, r->len, r->off);
+                done_.push_back(r);
+            }
+            reads_ += pending_.size();
+            pending_.clear();
+            return;
+        }
+        size_t n = 0;
+        while (n < pending_.size()) {
+            BlobRead *r = pending_[n];
+            if (uring_queue_rw(ring_, IORING_OP_READ, fd_, r->buf, r->len, r->off, (uint64_t)(uintptr_t)r) != 0) {
+                break;
+            }
+            n++;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + n);
+        submitted_ += n;
+        reads_ += n;
+        int ret = uring_submit(ring_, 0);
+        if (ret < 0) {
+            ring_failed(ret);
+        }
+    }
+
+    // io_uring_enter failed with err: fail the reads the kernel did not take so
+    // their candidates finish with an error.
+    void ring_failed(int err) {
+        fprintf(stderr, "io_uring_enter failed: %s\n", strerror(-err));
+        uint64_t user_data;
+        while (uring_unqueue(ring_, &user_data)) {
+            BlobRead *r = (BlobRead *)(uintptr_t)user_data;
+            r->res = err;
+            done_.push_back(r);
+            submitted_--;
+        }
+    }
+
+    // Wait for at least one read and move every completed candidate to ready.
+    void complete(std::vector<std::coroutine_handle<Candidate::promise_type>> *ready) {
+        if (ring_ != NULL && submitted_ > 0) {
+            int res;
+            uint64_t user_data;
+            bool reaped = uring_reap(ring_, &res, &user_data);
+            while (!reaped && submitted_ > 0) {
+                int ret = uring_submit(ring_, 1);
+                if (ret < 0) {
+                    ring_failed(ret);
+                    // reads the kernel already took still complete without entering it
+                    struct timespec ts = {0, 100000};
+                    nanosleep(&ts, NULL);
+                }
+                reaped = uring_reap(ring_, &res, &user_data);
+            }
+            while (reaped) {
+                BlobRead *r = (BlobRead *)(uintptr_t)user_data;
+                r->res = res;
+                if (res >= 0 && (unsigned)res < r->len) {
+                    // short read on a regular file: finish it synchronously
+                    int rest = pread_full((char *)r->buf + res, r->len - res, r->off + res);
+                    r->res = rest < 0 ? rest : res + rest;
+                }
+                done_.push_back(r);
+                submitted_--;
+                reaped = uring_reap(ring_, &res, &user_data);
+            }
+        }
+        uint64_t now = done_.empty() ? 0 : metrics_now();
+        for (BlobRead *r : done_) {
+            metrics_observe(METRIC_IO_LATENCY, now - r->start);
+            timeline_span("blob read", r->start, now);
+            if (r->res > 0) {
+                metrics_add(METRIC_IO_READ_BYTES, r->res);
+            }
+            ready->push_back(std::coroutine_handle<Candidate::promise_type>::from_address(r->waiter.address()));
+        }
+        done_.clear();
+    }
+
+    int pread_full(void *buf, unsigned len, uint64_t off) {
+        unsigned done = 0;
+        while (done < len) {
+            ssize_t n = pread(fd_, (char *)buf + done, len - done, off + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return (-errno);
+            }
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+        return (done);
+    }
+
+    int fd_;
+    struct uring *ring_;
+    unsigned window_;
+    uint64_t slot_size_;
+    const struct sparse_shard *sparse_;
+    std::vector<BlobRead *> pending_;
+    std::vector<BlobRead *> done_;
+    uint64_t submitted_ = 0;
+    uint64_t reads_ = 0;
+    uint64_t synthesized_ = 0;
+};
+
+void BlobRead::await_suspend(std::coroutine_handle<> h) {
+    waiter = h;
+    sched->enqueue(this);
+}
+
+struct CandidateResult {
+    uint64_t nonce;
+    unsigned char hash[32];
+    int error;
+};
+
+static unsigned char *alloc_blob(uint64_t size) {
+    void *p = NULL;
+    if (posix_memalign(&p, BLOB_ALIGN, size < BLOB_ALIGN ? BLOB_ALIGN : size) != 0) {
+        return (NULL);
+    }
+    return ((unsigned char *)p);
+}
+
+// _hashimoto: hash0 is replicated over a maxKvSize mix; every access reads the
+// blob picked by fnv256 of the mix and XORs it in.  out = keccak256(mix).
+Candidate hashimoto_xor(Scheduler &s, const StorageParams &p, const unsigned char *hash0, CandidateResult *out) {
+    uint64_t size = p.max_kv_size();
+    unsigned char *mix = alloc_blob(size);
+    unsigned char *data = alloc_blob(size);
+    if (mix == NULL || data == NULL) {
+        free(mix);
+        free(data);
+        out->error = 1;
+        co_return;
+    }
+    for (uint64_t k = 0; k < size; k += 32) {
+        memcpy(mix + k, hash0, 32);
+    }
+    u256 h0 = u256_from_be(hash0);
+
+    uint64_t mix_off = 0;
+    out->error = 0;
+    for (unsigned i = 0; i < p.random_checks; i++) {
+        u256 mix_data = u256_from_be(mix + mix_off);
+        uint64_t parent, kv_idx;
+        mix_off = storage_index(&p.index, h0, i, &mix_data, &parent, &kv_idx);
+
+        int res = co_await s.read_slot(data, size, parent, 0);
+        if (res != (int)size) {
+            out->error = 1;
+            break;
+        }
+        for (uint64_t k = 0; k < size; k++) {
+            mix[k] ^= data[k];
+        }
+    }
+    if (!out->error) {
+        keccak256(mix, size, out->hash);
+    }
+    free(mix);
+    free(data);
+}
+
+// _hashimotoMerkleProof: the chunk index comes straight from hash0 and every
+// access chains hash0 = keccak256(hash0 || chunk).  The contract hashes
+// maxKvSize bytes after hash0, which is the chunk only when chunkSize ==
+// maxKvSize; like hashimoto.py we hash exactly the chunk.
+Candidate hashimoto_merkle(Scheduler &s, const StorageParams &p, const unsigned char *hash0, CandidateResult *out) {
+    uint64_t size = p.chunk_size();
+    unsigned chunk_len_bits = p.max_kv_size_bits - p.chunk_size_bits;
+    unsigned rows_bits = p.shard_entry_bits + p.shard_len_bits + chunk_len_bits;
+    unsigned char *buf = alloc_blob(32 + size + BLOB_ALIGN);
+    if (buf == NULL) {
+        out->error = 1;
+        co_return;
+    }
+    // the chunk lands aligned; hash0 sits in the 32 bytes right before it
+    unsigned char *data = buf + BLOB_ALIGN;
+    unsigned char *h = data - 32;
+    memcpy(h, hash0, 32);
+
+    out->error = 0;
+    for (unsigned i = 0; i < p.random_checks; i++) {
+        u256 hv = u256_from_be(h);
+        uint64_t mask = rows_bits >= 64 ? UINT64_MAX : (1ULL << rows_bits) - 1;
+        uint64_t parent = hv.w[0] & mask;
+
+        uint64_t chunk = parent & ((1ULL << chunk_len_bits) - 1);
+        int res = co_await s.read_slot(data, size, parent >> chunk_len_bits, chunk * size);
+        if (res != (int)size) {
+            out->error = 1;
+            break;
+        }
+        keccak256(h, 32 + size, h);
+    }
+    if (!out->error) {
+        memcpy(out->hash, h, 32);
+    }
+    free(buf);
+}
+
+Candidate run_candidate(Scheduler &s, const StorageParams &p, const unsigned char *hash0, CandidateResult *out) {
+    if (p.mode == HASHIMOTO_XOR) {
+        return hashimoto_xor(s, p, hash0, out);
+    }
+    return hashimoto_merkle(s, p, hash0, out);
+}
+
+// sparse_mask_fn over Dagger32Kernel, bit-exact with dagger_32.c calculate_mask_blob().
+void dagger32_mask_blob(unsigned char *cache, uint64_t cache_size, uint64_t first_item, unsigned char *blob,
+                        uint64_t size) {
+    for (uint64_t k = 0; k < size / Dagger32Kernel::hash_bytes; k++) {
+        Dagger32Kernel::calculate_mask_data(cache, cache_size, first_item + k, blob + k * Dagger32Kernel::hash_bytes);
+    }
+}
+
+// hash0 = keccak256(abi.encode(hash0, miner, minedTs, nonce)) as in _mine().
+void candidate_hash0(const unsigned char *init_hash, const unsigned char *miner, uint64_t mined_ts, uint64_t nonce,
+                     unsigned char *hash0) {
+    unsigned char enc[128];
+    memset(enc, 0, sizeof(enc));
+    memcpy(enc, init_hash, 32);
+    memcpy(enc + 32 + 12, miner, 20);
+    u256_to_be(u256_from_u64(mined_ts), enc + 64);
+    u256_to_be(u256_from_u64(nonce), enc + 96);
+    keccak256(enc, sizeof(enc), hash0);
+}
+
+static int check_hex(const char *name, const unsigned char *data, int len, const char *expect) {
+    char actual[2 * 64 + 1];
+    for (int i = 0; i < len; i++) {
+        sprintf(actual + 2 * i, "%02x", data[i]);
+    }
+    if (strcmp(actual, expect) != 0) {
+        printf("%s failed!\n", name);
+        printf("expect: %s\n", expect);
+        printf("actual: %s\n", actual);
+        return (0);
+    }
+    return (1);
+}
+
+static int parse_hex(const char *hex, unsigned char *out, int len) {
+    if (strncmp(hex, "0x", 2) == 0) {
+        hex += 2;
+    }
+    if ((int)strlen(hex) != 2 * len) {
+        return (0);
+    }
+    for (int i = 0; i < len; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) {
+            return (0);
+        }
+        out[i] = v;
+    }
+    return (1);
+}
+
+// Run n copies of one hash0 through the scheduler; all must give expect.
+static int check_scheduled(const char *name, int fd, struct uring *ring, const StorageParams &p,
+                           const struct sparse_shard *sparse, const unsigned char *hash0, unsigned n,
+                           const char *expect) {
+    Scheduler s(fd, ring, 16, p.max_kv_size(), sparse);
+    std::vector<CandidateResult> results(n);
+    unsigned next = 0;
+    s.run(
+        n,
+        [&](unsigned slot, Candidate *c) {
+            if (next == n) {
+                return false;
+            }
+            next++;
+            *c = run_candidate(s, p, hash0, &results[slot]);
+            return true;
+        },
+        [](unsigned) {});
+    for (unsigned j = 0; j < n; j++) {
+        if (results[j].error || !check_hex(name, results[j].hash, 32, expect)) {
+            return (0);
+        }
+    }
+    return (1);
+}
+
+static int write_file(const char *path, const unsigned char *data, uint64_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, data, size) != (ssize_t)size) {
+        return (-1);
+    }
+    return (fd);
+}
+
+// Vectors from test/dkv-dagger-hashimoto-test.js and hashlib (SHA3 padding).
+void self_verify() {
+    unsigned char digest[64];
+    int ok = 1;
+
+    keccak256("", 0, digest);
+    ok &= check_hex("keccak256 empty", digest, 32, "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+    unsigned char abc[300];
+    for (int k = 0; k < 300; k++) {
+        abc[k] = "abc"[k % 3];
+    }
+    KECCAK_CTX ctx;
+    keccak_init(&ctx, 32);
+    keccak_update(&ctx, abc, 7);
+    keccak_update(&ctx, abc + 7, 293);
+    keccak_final(&ctx, digest, 32, SHA3_PAD);
+    ok &= check_hex("sha3-256", digest, 32, "26fb4fd7881f77c4c67694021204c5fcb0eb222e62aa6fe6e21e096ad58b6dc4");
+    keccak_init(&ctx, 64);
+    keccak_update(&ctx, abc, 300);
+    keccak_final(&ctx, digest, 64, SHA3_PAD);
+    ok &= check_hex("sha3-512", digest, 64,
+                    "c309069188c72d4d6a5af743b846de8af598da5cffb2442651d8dca4c35f2fae"
+                    "c3ed8f7ed0fd5678506fd6d7648b19f8add2fa26ff5bb39f82ae33e9ef152b4f");
+
+    struct uring ring;
+    struct uring *ringp = uring_init(&ring, 64) == 0 ? &ring : NULL;
+    unsigned char h0[32];
+    parse_hex("2cfe17dc69e953b28d77cdb7cdc86ce378dfe1e846f4be9cbe9dfb18efa5dfb5", h0, 32);
+    char path[] = "/tmp/storage_hashimoto_verify.XXXXXX";
+    int tmp = mkstemp(path);
+    close(tmp);
+
+    // hashimoto-tiny: kv i is the 64-byte big-endian i.
+    unsigned char tiny[16 * 64];
+    memset(tiny, 0, sizeof(tiny));
+    for (int i = 0; i < 16; i++) {
+        tiny[i * 64 + 63] = i;
+    }
+    int fd = write_file(path, tiny, sizeof(tiny));
+    StorageParams p = {HASHIMOTO_XOR, 6, 6, 2, 0, 0, 1, {}};
+    p.init();
+    ok &= check_scheduled("hashimoto-tiny r0", fd, ringp, p, NULL, h0, 1,
+                          "8c8285a007382a35628355faf9b037fd3523d6aa3d40b6187fcd9f7681023c23");
+    p.shard_len_bits = 2;
+    p.init();
+    ok &= check_scheduled("hashimoto-tiny r2", fd, ringp, p, NULL, h0, 1,
+                          "3ab8ce32981e789e67abf48d7753da99792bc7c66a82dd625462c064b673e588");
+    close(fd);
+
+    // hashimoto-large: 32 kvs of 4096 bytes, chunk j of kv i is keccak256(uint32(128 * i + j)).
+    unsigned char *large = (unsigned char *)malloc(32 * 4096);
+    for (uint32_t l = 0; l < 32 * 128; l++) {
+        unsigned char be[4] = {(unsigned char)(l >> 24), (unsigned char)(l >> 16), (unsigned char)(l >> 8),
+                               (unsigned char)l};
+        keccak256(be, 4, large + 32 * l);
+    }
+    fd = write_file(path, large, 32 * 4096);
+    p = {HASHIMOTO_XOR, 12, 12, 5, 0, 0, 16, {}};
+    p.init();
+    ok &= check_scheduled("hashimoto-large", fd, ringp, p, NULL, h0, 64,
+                          "dc5ed7906841c9936f16b4fcb44e4320516d32a2c94b0166197ea021a6150a05");
+
+    // Merkle chain against a direct loop over the same file.
+    p = {HASHIMOTO_MERKLE, 12, 10, 5, 0, 0, 16, {}};
+    p.init();
+    unsigned char h[32 + 1024];
+    memcpy(h, h0, 32);
+    for (unsigned i = 0; i < p.random_checks; i++) {
+        uint64_t parent = u256_from_be(h).w[0] & ((1ULL << 7) - 1);
+        memcpy(h + 32, large + parent * 1024, 1024);
+        keccak256(h, sizeof(h), h);
+    }
+    char expect[65];
+    for (int k = 0; k < 32; k++) {
+        sprintf(expect + 2 * k, "%02x", h[k]);
+    }
+    ok &= check_scheduled("hashimoto-merkle", fd, ringp, p, NULL, h0, 64, expect);
+    ok &= check_scheduled("hashimoto-merkle (pread)", fd, NULL, p, NULL, h0, 8, expect);
+    close(fd);
+
+    // Sparse shard: zero every third kv and everything past lastKvIdx 28, then
+    // compare against the same shard masked densely.
+    uint64_t cache_size = 1024;
+    unsigned char *cache = Dagger32Kernel::generate_cache(cache_size, (const unsigned char *)"123", 3);
+    for (uint64_t kv = 0; kv < 32; kv++) {
+        if (kv % 3 == 2 || kv >= 28) {
+            memset(large + kv * 4096, 0, 4096);
+        }
+    }
+    char raw_path[] = "/tmp/storage_hashimoto_raw.XXXXXX";
+    int raw_fd = mkstemp(raw_path);
+    if (write(raw_fd, large, 32 * 4096) != 32 * 4096) {
+        printf("cannot write %s\n", raw_path);
+    }
+    struct sparse_header sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.max_kv_size = 4096;
+    sh.entries = 32;
+    sh.cache_size = cache_size;
+    int64_t stored = sparse_shard_pack(raw_fd, path, &sh, 28, cache, dagger32_mask_blob);
+    close(raw_fd);
+    unlink(raw_path);
+    struct sparse_shard sparse;
+    if (stored != 19 || sparse_shard_open(&sparse, path, O_RDONLY) != 0) {
+        printf("sparse_shard_pack failed!\n");
+        ok = 0;
+    } else {
+        sparse.cache = cache;
+        sparse.mask = dagger32_mask_blob;
+        char dense_path[] = "/tmp/storage_hashimoto_dense.XXXXXX";
+        close(mkstemp(dense_path));
+        dagger32_mask_blob(cache, cache_size, 0, large, 32 * 4096);
+        int dense_fd = write_file(dense_path, large, 32 * 4096);
+        const StorageParams modes[2] = {{HASHIMOTO_XOR, 12, 12, 5, 0, 0, 16, {}}, {HASHIMOTO_MERKLE, 12, 10, 5, 0, 0, 16, {}}};
+        for (int m = 0; m < 2; m++) {
+            p = modes[m];
+            p.init();
+            Scheduler s(dense_fd, NULL, 1, p.max_kv_size(), NULL);
+            CandidateResult r;
+            bool spawned = false;
+            s.run(
+                1,
+                [&](unsigned, Candidate *c) {
+                    if (spawned) {
+                        return false;
+                    }
+                    spawned = true;
+                    *c = run_candidate(s, p, h0, &r);
+                    return true;
+                },
+                [](unsigned) {});
+            for (int k = 0; k < 32; k++) {
+                sprintf(expect + 2 * k, "%02x", r.hash[k]);
+            }
+            ok &= check_scheduled(m == 0 ? "hashimoto-sparse" : "hashimoto-merkle-sparse", sparse.fd, ringp, p,
+                                  &sparse, h0, 64, expect);
+        }
+        close(dense_fd);
+        unlink(dense_path);
+        sparse_shard_close(&sparse);
+    }
+    free(cache);
+    free(large);
+    unlink(path);
+    if (ringp != NULL) {
+        uring_exit(ringp);
+    }
+
+    if (ok) {
+        printf("self_verify() passed\n");
+    }
+    return;
+}
+
+struct MineConfig {
+    const char *data;
+    StorageParams params;
+    unsigned char init_hash[32];
+    unsigned char miner[20];
+    uint64_t mined_ts;
+    uint64_t nonce_start;
+    uint64_t nonces;
+    u256 diff;
+    int threads;
+    unsigned inflight;
+    unsigned window;
+    unsigned queue_depth;
+    int direct;
+    int use_uring;
+    const char *sparse_seed;
+};
+
+struct MineShared {
+    const MineConfig *cfg;
+    u256 target;
+    const struct sparse_shard *sparse;
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> synthesized{0};
+    std::mutex lock;
+    std::vector<CandidateResult> found;
+};
+
+static void mine_thread(MineShared *m, int t) {
+    const MineConfig &cfg = *m->cfg;
+    int fd = open(cfg.data, O_RDONLY | (cfg.direct ? O_DIRECT : 0));
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s\n", cfg.data, strerror(errno));
+        m->errors++;
+        return;
+    }
+    struct uring ring;
+    struct uring *ringp = NULL;
+    if (cfg.use_uring) {
+        int ret = uring_init(&ring, cfg.queue_depth);
+        if (ret == 0) {
+            ringp = &ring;
+        } else if (t == 0) {
+            fprintf(stderr, "io_uring unavailable (%s), using pread\n", strerror(-ret));
+        }
+    }
+
+    // per-slot state of the candidates in flight
+    std::vector<CandidateResult> results(cfg.inflight);
+    std::vector<unsigned char> hash0(32 * cfg.inflight);
+    std::vector<uint64_t> started(cfg.inflight);
+    timeline_thread_name("miner");
+
+    Scheduler s(fd, ringp, cfg.window, cfg.params.max_kv_size(), m->sparse);
+    uint64_t nonce = cfg.nonce_start + t;
+    uint64_t end = cfg.nonce_start + cfg.nonces;
+    s.run(
+        cfg.inflight,
+        [&](unsigned slot, Candidate *c) {
+            if (nonce >= end) {
+                return false;
+            }
+            results[slot].nonce = nonce;
+            started[slot] = metrics_now();
+            candidate_hash0(cfg.init_hash, cfg.miner, cfg.mined_ts, nonce, &hash0[32 * slot]);
+            *c = run_candidate(s, cfg.params, &hash0[32 * slot], &results[slot]);
+            nonce += cfg.threads;
+            return true;
+        },
+        [&](unsigned slot) {
+            CandidateResult &r = results[slot];
+            timeline_span("candidate", started[slot], metrics_observe_since(METRIC_HASH_LATENCY, started[slot]));
+            metrics_add(METRIC_HASHES, 1);
+            if (r.error) {
+                metrics_add(METRIC_ERRORS, 1);
+                m->errors++;
+            } else if (u256_cmp(u256_from_be(r.hash), m->target) <= 0) {
+                std::lock_guard<std::mutex> g(m->lock);
+                m->found.push_back(r);
+            }
+        });
+    m->reads += s.reads();
+    m->synthesized += s.synthesized();
+    if (ringp != NULL) {
+        uring_exit(ringp);
+    }
+    close(fd);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s verify\n"
+            "       %s mine --data PATH [options]\n"
+            "  --mode xor|merkle        _hashimoto or _hashimotoMerkleProof (default xor)\n"
+            "  --max-kv-size-bits N     (default 12)\n"
+            "  --chunk-size-bits N      merkle mode chunk size (default max-kv-size-bits)\n"
+            "  --shard-entry-bits N     (default 5)\n"
+            "  --shard-len-bits N       (default 0)\n"
+            "  --start-shard N          (default 0)\n"
+            "  --random-checks N        (default 16)\n"
+            "  --init-hash HEX32        hash0 from _calculateDiffAndInitHash (default 0)\n"
+            "  --miner HEX20            (default 0)\n"
+            "  --mined-ts N             (default 0)\n"
+            "  --nonce-start N          (default 0)\n"
+            "  --nonces N               candidates to try (default 1048576)\n"
+            "  --diff N                 difficulty, up to 256 bits (default 1)\n"
+            "  --threads N              (default: profile, else all cores)\n"
+            "  --inflight N             candidates in flight per thread (default 4096)\n"
+            "  --window N               reads sorted and submitted together (default 256)\n"
+            "  --queue-depth N          io_uring queue depth (default 256)\n"
+            "  --direct                 O_DIRECT reads (read size must be a multiple of %d)\n"
+            "  --no-uring               synchronous pread instead of io_uring\n"
+            "  --sparse SEED            data is a sparse shard masked with cache seed SEED\n"
+            "  --metrics TARGET         export metrics to file:PATH or unix:PATH (default $DAGGER_METRICS)\n",
+            prog, prog, BLOB_ALIGN);
+}
+
+int main(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"data", required_argument, 0, 'd'},
+        {"mode", required_argument, 0, 'M'},
+        {"max-kv-size-bits", required_argument, 0, 'K'},
+        {"chunk-size-bits", required_argument, 0, 'C'},
+        {"shard-entry-bits", required_argument, 0, 'E'},
+        {"shard-len-bits", required_argument, 0, 'L'},
+        {"start-shard", required_argument, 0, 'S'},
+        {"random-checks", required_argument, 0, 'r'},
+        {"init-hash", required_argument, 0, 'h'},
+        {"miner", required_argument, 0, 'a'},
+        {"mined-ts", required_argument, 0, 'T'},
+        {"nonce-start", required_argument, 0, 'n'},
+        {"nonces", required_argument, 0, 'N'},
+        {"diff", required_argument, 0, 'D'},
+        {"threads", required_argument, 0, 't'},
+        {"inflight", required_argument, 0, 'i'},
+        {"window", required_argument, 0, 'w'},
+        {"queue-depth", required_argument, 0, 'q'},
+        {"direct", no_argument, 0, 'O'},
+        {"no-uring", no_argument, 0, 'U'},
+        {"sparse", required_argument, 0, 'P'},
+        {"metrics", required_argument, 0, 'X'},
+        {0, 0, 0, 0},
+    };
+
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0) {
+        self_verify();
+        return (0);
+    }
+    if (argc < 2 || strcmp(argv[1], "mine") != 0) {
+        usage(argv[0]);
+        return (1);
+    }
+
+    MineConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.params = {HASHIMOTO_XOR, 12, 0, 5, 0, 0, 16, {}};
+    int chunk_bits = -1;
+    cfg.nonces = 1048576;
+    cfg.diff = u256_from_u64(1);
+    struct dagger_profile profile; // `dagger_32 calibrate` output for this host, if any
+    dagger_profile_load(&profile);
+    cfg.threads = profile.threads;
+    cfg.inflight = 4096;
+    cfg.window = 256;
+    cfg.queue_depth = 256;
+    cfg.use_uring = 1;
+    const char *metrics_target = getenv("DAGGER_METRICS");
+
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'd': cfg.data = optarg; break;
+        case 'M': cfg.params.mode = strcmp(optarg, "merkle") == 0 ? HASHIMOTO_MERKLE : HASHIMOTO_XOR; break;
+        case 'K': cfg.params.max_kv_size_bits = atoi(optarg); break;
+        case 'C': chunk_bits = atoi(optarg); break;
+        case 'E': cfg.params.shard_entry_bits = atoi(optarg); break;
+        case 'L': cfg.params.shard_len_bits = atoi(optarg); break;
+        case 'S': cfg.params.start_shard_id = strtoull(optarg, NULL, 0); break;
+        case 'r': cfg.params.random_checks = atoi(optarg); break;
+        case 'h':
+            if (!parse_hex(optarg, cfg.init_hash, 32)) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'a':
+            if (!parse_hex(optarg, cfg.miner, 20)) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 'T': cfg.mined_ts = strtoull(optarg, NULL, 0); break;
+        case 'n': cfg.nonce_start = strtoull(optarg, NULL, 0); break;
+        case 'N': cfg.nonces = strtoull(optarg, NULL, 0); break;
+        case 'D':
+            if (u256_from_string(optarg, &cfg.diff) != 0) {
+                usage(argv[0]);
+                return (1);
+            }
+            break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'i': cfg.inflight = atoi(optarg); break;
+        case 'w': cfg.window = atoi(optarg); break;
+        case 'q': cfg.queue_depth = atoi(optarg); break;
+        case 'O': cfg.direct = 1; break;
+        case 'U': cfg.use_uring = 0; break;
+        case 'P': cfg.sparse_seed = optarg; break;
+        case 'X': metrics_target = optarg; break;
+        default: usage(argv[0]); return (1);
+        }
+    }
+    cfg.params.chunk_size_bits = chunk_bits < 0 ? cfg.params.max_kv_size_bits : chunk_bits;
+    if (cfg.data == NULL || cfg.threads < 1 || cfg.inflight < 1 || cfg.window < 1 || u256_is_zero(cfg.diff) ||
+        cfg.params.chunk_size_bits > cfg.params.max_kv_size_bits || cfg.params.max_kv_size_bits < 6 ||
+        (cfg.direct && cfg.params.read_size() % BLOB_ALIGN != 0)) {
+        usage(argv[0]);
+        return (1);
+    }
+    cfg.params.init();
+    if (metrics_target != NULL && metrics_start(metrics_target, 1) != 0) {
+        return (1);
+    }
+    // DAGGER_TIMELINE=PATH records a Chrome trace of reads and candidates
+    timeline_start_env();
+
+    MineShared m;
+    m.cfg = &cfg;
+    m.sparse = NULL;
+    uint64_t entries = 1ULL << (cfg.params.shard_entry_bits + cfg.params.shard_len_bits);
+    struct sparse_shard sparse;
+    if (cfg.sparse_seed != NULL) {
+        if (sparse_shard_open(&sparse, cfg.data, O_RDONLY) != 0) {
+            return (1);
+        }
+        unsigned char seed_hash[64];
+        SHA512((void *)cfg.sparse_seed, strlen(cfg.sparse_seed), seed_hash);
+        if (sparse.h.max_kv_size != cfg.params.max_kv_size() || sparse.h.entries < entries ||
+            memcmp(seed_hash, sparse.h.seed_hash, sizeof(seed_hash)) != 0) {
+            fprintf(stderr, "%s does not match the shard parameters or seed\n", cfg.data);
+            return (1);
+        }
+        printf("Generating cache with size %llu\n", (unsigned long long)sparse.h.cache_size);
+        sparse.cache = Dagger32Kernel::generate_cache(sparse.h.cache_size, (const unsigned char *)cfg.sparse_seed,
+                                                      strlen(cfg.sparse_seed));
+        sparse.mask = dagger32_mask_blob;
+        metrics_set(METRIC_CACHE_BYTES, sparse.h.cache_size);
+        m.sparse = &sparse;
+    } else {
+        struct stat st;
+        uint64_t need = entries * cfg.params.max_kv_size();
+        if (stat(cfg.data, &st) != 0 || (uint64_t)st.st_size < need) {
+            fprintf(stderr, "%s must hold %llu bytes of masked blobs\n", cfg.data, (unsigned long long)need);
+            return (1);
+        }
+    }
+    u256 max = {{UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX}};
+    m.target = u256_div(max, cfg.diff, NULL);
+
+    printf("Mining %llu nonces (%s, %u checks, %d threads, %u in flight per thread, %s%s)\n",
+           (unsigned long long)cfg.nonces, cfg.params.mode == HASHIMOTO_XOR ? "xor" : "merkle",
+           cfg.params.random_checks, cfg.threads, cfg.inflight, cfg.use_uring ? "io_uring" : "pread",
+           m.sparse ? ", sparse" : "");
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < cfg.threads; t++) {
+        threads.emplace_back(mine_thread, &m, t);
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    timeline_stop();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double used_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    std::sort(m.found.begin(), m.found.end(),
+              [](const CandidateResult &a, const CandidateResult &b) { return a.nonce < b.nonce; });
+    for (const CandidateResult &r : m.found) {
+        printf("nonce %llu hash 0x", (unsigned long long)r.nonce);
+        for (int k = 0; k < 32; k++) {
+            printf("%02x", r.hash[k]);
+        }
+        printf("\n");
+    }
+    uint64_t reads = m.reads.load();
+    printf("Done! Took %0.2fs, %0.2f H/s, %0.2f reads/s (%0.2f MB/s), %llu synthesized, %llu found, %llu errors\n",
+           used_time, cfg.nonces / used_time, reads / used_time, reads * cfg.params.read_size() / used_time / 1e6,
+           (unsigned long long)m.synthesized.load(), (unsigned long long)m.found.size(),
+           (unsigned long long)m.errors.load());
+    metrics_stop();
+    if (m.sparse != NULL) {
+        free(sparse.cache);
+        sparse_shard_close(&sparse);
+    }
+    return (m.errors.load() == 0 ? 0 : 1);
+}
@@ -0,0 +1,285 @@
+/*
+ * Timeline of what every thread is doing, as a Chrome trace / Perfetto file.
+ *
+ * Where metrics.c says how long items, chunks and I/O take on average, the
+ * timeline shows when: which stage a thread was in while the writer stalled,
+ * whether generation and mining overlap, how long a chunk waited for its
+ * write.  Stages record spans:
+ *
+ *   uint64_t t0 = timeline_begin();
+ *   ...
+ *   timeline_end("dataset chunk", t0);
+ *
+ * Spans that overlap others of the same thread (reads in flight, chunks
+ * waiting for their write) go through timeline_span(name, start, end), which
+ * the viewers draw as async tracks, and timeline_counter() records values
+ * worth plotting (chunks done, slots busy).  Names must be string literals:
+ * only the pointer is stored.
+ *
+ * Each thread appends fixed-size events to its own ring without locks or
+ * syscalls beyond clock_gettime(); a writer thread drains every ring a few
+ * times a second into the file.  If a ring fills up faster than that, its
+ * events are dropped and counted.  The file is a JSON array written as it
+ * goes, which chrome://tracing and ui.perfetto.dev accept even if the
+ * process dies before timeline_stop() closes it.
+ *
+ * Recording is switched at runtime: timeline_start_env() starts it when
+ * DAGGER_TIMELINE=PATH is set, and SIGUSR2 pauses or resumes it, so a long run
+ * can be captured only around the interesting part
+ * (DAGGER_TIMELINE_PAUSED=1 starts paused).  While off, timeline_begin()
+ * costs one relaxed load and returns 0, and timeline_end() of a 0 start
+ * records nothing.
+ *
+ * Must be included after metrics.c (timestamps are metrics_now()).
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIMELINE_RING 65536 // events per thread between drains (2 MB), a power of two
+#define TIMELINE_DRAIN_MS 100
+
+enum timeline_phase {
+    TIMELINE_SPAN,    // "X": ts, dur
+    TIMELINE_ASYNC,   // "b" and "e": ts, dur, on a track of its own
+    TIMELINE_COUNTER, // "C": ts, value
+};
+
+struct timeline_event {
+    const char *name;
+    uint64_t ts;    // metrics_now()
+    uint64_t value; // duration in ns or counter value
+    uint64_t phase;
+};
+
+struct timeline_ring {
+    uint64_t head; // written by the owning thread
+    uint64_t tail; // written by the drainer
+    uint64_t dropped;
+    uint32_t tid;
+    int named;     // thread_name metadata written
+    char name[32];
+    struct timeline_ring *next;
+    struct timeline_event events[TIMELINE_RING];
+};
+
+static struct {
+    int recording;
+    int paused;
+    FILE *out;
+    uint64_t events;  // written to the file
+    uint32_t threads;
+    struct timeline_ring *rings;
+    pthread_t drainer;
+    int stop;
+    pthread_mutex_t lock; // rings list and the file
+} timeline = {0, 0, NULL, 0, 0, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+static __thread struct timeline_ring *timeline_tls;
+
+static inline int timeline_on() {
+    return (__atomic_load_n(&timeline.recording, __ATOMIC_RELAXED) &&
+            !__atomic_load_n(&timeline.paused, __ATOMIC_RELAXED));
+}
+
+static struct timeline_ring *timeline_ring_get() {
+    struct timeline_ring *r = timeline_tls;
+    if (__builtin_expect(r != NULL, 1)) {
+        return (r);
+    }
+    r = (struct timeline_ring *)calloc(1, sizeof(*r));
+    if (r == NULL) {
+        return (NULL);
+    }
+    pthread_mutex_lock(&timeline.lock);
+    r->tid = ++timeline.threads;
+    snprintf(r->name, sizeof(r->name), "thread %u", r->tid);
+    r->next = timeline.rings;
+    timeline.rings = r;
+    pthread_mutex_unlock(&timeline.lock);
+    timeline_tls = r;
+    return (r);
+}
+
+static inline void timeline_push(const char *name, uint64_t ts, uint64_t value, uint64_t phase) {
+    struct timeline_ring *r = timeline_ring_get();
+    if (r == NULL) {
+        return;
+    }
+    uint64_t head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= TIMELINE_RING) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    struct timeline_event *e = &r->events[head % TIMELINE_RING];
+    e->name = name;
+    e->ts = ts;
+    e->value = value;
+    e->phase = phase;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Start of a span, or 0 while the timeline is off.
+static inline uint64_t timeline_begin() {
+    return (timeline_on() ? metrics_now() : 0);
+}
+
+// A span from start (timeline_begin()) to now; returns now, or 0 if nothing was recorded.
+static inline uint64_t timeline_end(const char *name, uint64_t start) {
+    if (start == 0 || !timeline_on()) {
+        return (0);
+    }
+    uint64_t now = metrics_now();
+    timeline_push(name, start, now - start, TIMELINE_SPAN);
+    return (now);
+}
+
+// A span with both ends given, e.g. an I/O from its submission to its completion; may overlap others.
+static inline void timeline_span(const char *name, uint64_t start, uint64_t end) {
+    if (start != 0 && end >= start && timeline_on()) {
+        timeline_push(name, start, end - start, TIMELINE_ASYNC);
+    }
+}
+
+static inline void timeline_counter(const char *name, uint64_t value) {
+    if (timeline_on()) {
+        timeline_push(name, metrics_now(), value, TIMELINE_COUNTER);
+    }
+}
+
+// Label the calling thread's track ("generator", "writer", ...).
+void timeline_thread_name(const char *name) {
+    if (!__atomic_load_n(&timeline.recording, __ATOMIC_RELAXED)) {
+        return;
+    }
+    struct timeline_ring *r = timeline_ring_get();
+    if (r != NULL) {
+        pthread_mutex_lock(&timeline.lock);
+        snprintf(r->name, sizeof(r->name), "%s %u", name, r->tid);
+        r->named = 0;
+        pthread_mutex_unlock(&timeline.lock);
+    }
+}
+
+// Write out what every ring holds.  Called with timeline.lock held.
+static void timeline_drain_locked() {
+    FILE *f = timeline.out;
+    int pid = getpid();
+    for (struct timeline_ring *r = timeline.rings; f != NULL && r != NULL; r = r->next) {
+        uint64_t tail = r->tail, head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (!r->named && head != tail) {
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    pid, r->tid, r->name);
+            r->named = 1;
+        }
+        for (; tail != head; tail++) {
+            const struct timeline_event *e = &r->events[tail % TIMELINE_RING];
+            if (e->phase == TIMELINE_SPAN) {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", e->name,
+                        pid, r->tid, e->ts / 1e3, e->value / 1e3);
+            } else if (e->phase == TIMELINE_ASYNC) {
+                fprintf(f,
+                        ",\n{\"name\":\"%s\",\"cat\":\"async\",\"ph\":\"b\",\"id\":%llu,\"pid\":%d,\"tid\":%u,\"ts\":%.3f}"
+                        ",\n{\"name\":\"%s\",\"cat\":\"async\",\"ph\":\"e\",\"id\":%llu,\"pid\":%d,\"tid\":%u,\"ts\":%.3f}",
+                        e->name, (unsigned long long)timeline.events, pid, r->tid, e->ts / 1e3, e->name,
+                        (unsigned long long)timeline.events, pid, r->tid, (e->ts + e->value) / 1e3);
+            } else {
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+                        e->name, pid, r->tid, e->ts / 1e3, (unsigned long long)e->value);
+            }
+            timeline.events++;
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    if (f != NULL) {
+        fflush(f);
+    }
+}
+
+static void *timeline_drainer(void *arg) {
+    (void)arg;
+    struct timespec ts = {0, TIMELINE_DRAIN_MS * 1000000L};
+    while (!__atomic_load_n(&timeline.stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&ts, NULL);
+        pthread_mutex_lock(&timeline.lock);
+        timeline_drain_locked();
+        pthread_mutex_unlock(&timeline.lock);
+    }
+    return (NULL);
+}
+
+static void timeline_toggle(int sig) {
+    (void)sig;
+    __atomic_store_n(&timeline.paused, !__atomic_load_n(&timeline.paused, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+// Record to path (paused if asked) until timeline_stop().
+int timeline_start(const char *path, int paused) {
+    if (timeline.out != NULL) {
+        return (-1);
+    }
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write timeline %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    // the process entry first, so every event after it can start with a comma
+    fprintf(f, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"dagger\"}}", (int)getpid());
+    timeline.out = f;
+    timeline.events = 0;
+    timeline.stop = 0;
+    if (pthread_create(&timeline.drainer, NULL, timeline_drainer, NULL) != 0) {
+        fclose(f);
+        timeline.out = NULL;
+        return (-1);
+    }
+    __atomic_store_n(&timeline.paused, paused, __ATOMIC_RELAXED);
+    __atomic_store_n(&timeline.recording, 1, __ATOMIC_RELEASE);
+    return (0);
+}
+
+// DAGGER_TIMELINE=PATH [DAGGER_TIMELINE_PAUSED=1]; SIGUSR2 then pauses and resumes.
+int timeline_start_env() {
+    const char *path = getenv("DAGGER_TIMELINE");
+    const char *paused = getenv("DAGGER_TIMELINE_PAUSED");
+    if (path == NULL || path[0] == 0) {
+        return (-1);
+    }
+    if (timeline_start(path, paused != NULL && atoi(paused) != 0) != 0) {
+        return (-1);
+    }
+    signal(SIGUSR2, timeline_toggle);
+    fprintf(stderr, "Recording timeline to %s (kill -USR2 %d to pause or resume)\n", path, (int)getpid());
+    return (0);
+}
+
+// Drain what is left and close the file.  Spans still being recorded by other threads may be lost.
+void timeline_stop() {
+    if (timeline.out == NULL) {
+        return;
+    }
+    __atomic_store_n(&timeline.recording, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&timeline.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(timeline.drainer, NULL);
+    pthread_mutex_lock(&timeline.lock);
+    timeline_drain_locked();
+    uint64_t dropped = 0;
+    for (struct timeline_ring *r = timeline.rings; r != NULL; r = r->next) {
+        dropped += __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+    }
+    fprintf(timeline.out, "\n]\n");
+    fclose(timeline.out);
+    timeline.out = NULL;
+    pthread_mutex_unlock(&timeline.lock);
+    if (dropped > 0) {
+        fprintf(stderr, "timeline: %llu events written, %llu dropped (rings full)\n",
+                (unsigned long long)timeline.events, (unsigned long long)dropped);
+    }
+}
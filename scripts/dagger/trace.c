@@ -0,0 +1,199 @@
+/*
+ * Access-pattern tracer for the dagger kernels.
+ *
+ * Built with -DDAGGER_TRACE, the kernels call TRACE_MARK() at the start of
+ * every dataset item, mask item or hashimoto nonce and TRACE_ACCESS() for
+ * every cache or dataset row they read.  Without it both macros expand to
+ * nothing.  Tracing is off until trace_start() (or trace_start_env(), from
+ * DAGGER_TRACE_FILE) and then records one unit (item or nonce) in every
+ * `sample`.
+ *
+ * Each thread appends to its own buffer and hands full buffers to the file
+ * under a lock, so the log is a sequence of blocks from interleaved threads:
+ *
+ *   struct trace_header
+ *   { struct trace_block; varint events[] }*
+ *
+ * An event is the varint of (zigzag(row - previous row of the region) << 2 |
+ * region), or (kind << 2 | TRACE_MARKER) for a unit boundary.  Deltas restart
+ * at zero in every block, so blocks decode independently.  access_sim.c
+ * replays a log against cache and TLB models.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC 0x3145435254474144ULL // "DAGTRCE1"
+#define TRACE_BUFFER_BYTES 65536
+
+enum trace_region {
+    TRACE_CACHE,   // dagger cache, HASH_BYTES rows
+    TRACE_DATASET, // full dataset, MIX_BYTES rows
+    TRACE_SHARD,   // storage shard, one row per blob
+    TRACE_MARKER,
+};
+
+enum trace_unit {
+    TRACE_ITEM,
+    TRACE_MASK,
+    TRACE_HASH,
+    TRACE_UNITS,
+};
+
+struct trace_header {
+    uint64_t magic;
+    uint32_t sample;
+    uint32_t row_bytes[TRACE_MARKER];
+};
+
+struct trace_block {
+    uint32_t thread;
+    uint32_t bytes;
+    uint64_t events;
+};
+
+struct trace_buffer {
+    struct trace_block block;
+    int64_t last[TRACE_MARKER];
+    uint64_t units;
+    int active;
+    struct trace_buffer *next;
+    unsigned char data[TRACE_BUFFER_BYTES];
+};
+
+static struct {
+    int fd;
+    int enabled;
+    uint32_t sample;
+    uint32_t threads;
+    struct trace_buffer *buffers;
+    pthread_mutex_t lock;
+} tracer = {-1, 0, 1, 0, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+static __thread struct trace_buffer *trace_tls;
+
+static void trace_flush(struct trace_buffer *b) {
+    if (b->block.bytes == 0) {
+        return;
+    }
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.fd >= 0 && (write(tracer.fd, &b->block, sizeof(b->block)) != sizeof(b->block) ||
+                           write(tracer.fd, b->data, b->block.bytes) != (ssize_t)b->block.bytes)) {
+        fprintf(stderr, "trace write failed: %s\n", strerror(errno));
+        close(tracer.fd);
+        tracer.fd = -1;
+        tracer.enabled = 0;
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    b->block.bytes = 0;
+    b->block.events = 0;
+    memset(b->last, 0, sizeof(b->last));
+}
+
+// Callers flush a full buffer before computing v, since a flush restarts the deltas.
+static inline void trace_put(struct trace_buffer *b, uint64_t v) {
+    while (v >= 0x80) {
+        b->data[b->block.bytes++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    b->data[b->block.bytes++] = (unsigned char)v;
+    b->block.events++;
+}
+
+// Start of an item, mask item or nonce; decides whether it is sampled.
+void trace_mark(unsigned kind) {
+    if (!__atomic_load_n(&tracer.enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+    struct trace_buffer *b = trace_tls;
+    if (b == NULL) {
+        b = (struct trace_buffer *)calloc(1, sizeof(*b));
+        pthread_mutex_lock(&tracer.lock);
+        b->block.thread = tracer.threads++;
+        b->next = tracer.buffers;
+        tracer.buffers = b;
+        pthread_mutex_unlock(&tracer.lock);
+        trace_tls = b;
+    }
+    b->active = b->units++ % tracer.sample == 0;
+    if (b->active) {
+        if (b->block.bytes > TRACE_BUFFER_BYTES - 10) {
+            trace_flush(b);
+        }
+        trace_put(b, ((uint64_t)kind << 2) | TRACE_MARKER);
+    }
+}
+
+static inline void trace_access(unsigned region, uint64_t row) {
+    struct trace_buffer *b = trace_tls;
+    if (b == NULL || !b->active) {
+        return;
+    }
+    if (b->block.bytes > TRACE_BUFFER_BYTES - 10) {
+        trace_flush(b);
+    }
+    int64_t delta = (int64_t)row - b->last[region];
+    b->last[region] = row;
+    uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    trace_put(b, (zigzag << 2) | region);
+}
+
+#ifdef DAGGER_TRACE
+#define TRACE_MARK(kind) trace_mark(kind)
+#define TRACE_ACCESS(region, row) trace_access(region, row)
+#else
+#define TRACE_MARK(kind) ((void)0)
+#define TRACE_ACCESS(region, row) ((void)0)
+#endif
+
+// Record to path, one unit in every sample.  row_bytes gives the row size of
+// each region so the simulator can turn rows back into addresses.
+int trace_start(const char *path, uint32_t sample, const uint32_t row_bytes[TRACE_MARKER]) {
+    struct trace_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TRACE_MAGIC;
+    h.sample = sample > 0 ? sample : 1;
+    memcpy(h.row_bytes, row_bytes, sizeof(h.row_bytes));
+    tracer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tracer.fd < 0 || write(tracer.fd, &h, sizeof(h)) != sizeof(h)) {
+        fprintf(stderr, "cannot write trace %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+    tracer.sample = h.sample;
+    __atomic_store_n(&tracer.enabled, 1, __ATOMIC_RELEASE);
+    return (0);
+}
+
+// DAGGER_TRACE_FILE=PATH, DAGGER_TRACE_SAMPLE=N; a no-op in builds without DAGGER_TRACE.
+int trace_start_env(const uint32_t row_bytes[TRACE_MARKER]) {
+#ifdef DAGGER_TRACE
+    const char *path = getenv("DAGGER_TRACE_FILE");
+    const char *sample = getenv("DAGGER_TRACE_SAMPLE");
+    if (path != NULL) {
+        return (trace_start(path, sample ? atoi(sample) : 1, row_bytes));
+    }
+#endif
+    return (-1);
+}
+
+// Flush every thread's buffer and close the log.  Traced threads must be done.
+void trace_stop() {
+    if (!tracer.enabled) {
+        return;
+    }
+    tracer.enabled = 0;
+    for (struct trace_buffer *b = tracer.buffers; b != NULL; b = b->next) {
+        trace_flush(b);
+        b->active = 0;
+    }
+    if (tracer.fd >= 0) {
+        close(tracer.fd);
+        tracer.fd = -1;
+    }
+}
@@ -0,0 +1,246 @@
+/*
+ * Minimal 256-bit unsigned integers with EVM (mod 2^256) semantics.
+ *
+ * Limbs are little-endian 64-bit words: w[0] holds the least significant bits.
+ * Contract values (bytes32 / uint256) are big-endian on the wire; use
+ * u256_from_be() and u256_to_be() at the boundary.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t w[4];
+} u256;
+
+u256 u256_from_u64(uint64_t v) {
+    u256 r = {{v, 0, 0, 0}};
+    return (r);
+}
+
+u256 u256_from_be(const unsigned char *b) {
+    u256 r;
+    for (int k = 0; k < 4; k++) {
+        uint64_t v;
+        memcpy(&v, b + 8 * (3 - k), 8);
+        r.w[k] = __builtin_bswap64(v);
+    }
+    return (r);
+}
+
+void u256_to_be(u256 a, unsigned char *b) {
+    for (int k = 0; k < 4; k++) {
+        uint64_t v = __builtin_bswap64(a.w[k]);
+        memcpy(b + 8 * (3 - k), &v, 8);
+    }
+}
+
+int u256_is_zero(u256 a) {
+    return ((a.w[0] | a.w[1] | a.w[2] | a.w[3]) == 0);
+}
+
+int u256_cmp(u256 a, u256 b) {
+    for (int k = 3; k >= 0; k--) {
+        if (a.w[k] != b.w[k]) {
+            return (a.w[k] < b.w[k] ? -1 : 1);
+        }
+    }
+    return (0);
+}
+
+u256 u256_xor(u256 a, u256 b) {
+    for (int k = 0; k < 4; k++) {
+        a.w[k] ^= b.w[k];
+    }
+    return (a);
+}
+
+u256 u256_add(u256 a, u256 b) {
+    unsigned __int128 c = 0;
+    for (int k = 0; k < 4; k++) {
+        c += (unsigned __int128)a.w[k] + b.w[k];
+        a.w[k] = (uint64_t)c;
+        c >>= 64;
+    }
+    return (a);
+}
+
+u256 u256_sub(u256 a, u256 b) {
+    uint64_t borrow = 0;
+    for (int k = 0; k < 4; k++) {
+        uint64_t d = a.w[k] - b.w[k] - borrow;
+        borrow = (a.w[k] < b.w[k]) || (a.w[k] - b.w[k] < borrow);
+        a.w[k] = d;
+    }
+    return (a);
+}
+
+// Full schoolbook product, truncated to 256 bits (EVM mul).
+u256 u256_mul(u256 a, u256 b) {
+    u256 r = {{0, 0, 0, 0}};
+    for (int i = 0; i < 4; i++) {
+        unsigned __int128 c = 0;
+        for (int j = 0; i + j < 4; j++) {
+            c += (unsigned __int128)a.w[i] * b.w[j] + r.w[i + j];
+            r.w[i + j] = (uint64_t)c;
+            c >>= 64;
+        }
+    }
+    return (r);
+}
+
+// a * b like Solidity's checked mul: returns 1 (and the truncated product) on overflow.
+int u256_mul_checked(u256 a, u256 b, u256 *r) {
+    uint64_t p[8] = {0};
+    for (int i = 0; i < 4; i++) {
+        unsigned __int128 c = 0;
+        for (int j = 0; j < 4; j++) {
+            c += (unsigned __int128)a.w[i] * b.w[j] + p[i + j];
+            p[i + j] = (uint64_t)c;
+            c >>= 64;
+        }
+        p[i + 4] = (uint64_t)c;
+    }
+    memcpy(r->w, p, sizeof(r->w));
+    return ((p[4] | p[5] | p[6] | p[7]) != 0);
+}
+
+u256 u256_shr(u256 a, unsigned n) {
+    u256 r = {{0, 0, 0, 0}};
+    if (n >= 256) {
+        return (r);
+    }
+    unsigned limbs = n / 64;
+    unsigned bits = n % 64;
+    for (unsigned k = 0; k + limbs < 4; k++) {
+        r.w[k] = a.w[k + limbs] >> bits;
+        if (bits != 0 && k + limbs + 1 < 4) {
+            r.w[k] |= a.w[k + limbs + 1] << (64 - bits);
+        }
+    }
+    return (r);
+}
+
+u256 u256_shl(u256 a, unsigned n) {
+    u256 r = {{0, 0, 0, 0}};
+    if (n >= 256) {
+        return (r);
+    }
+    unsigned limbs = n / 64;
+    unsigned bits = n % 64;
+    for (unsigned k = limbs; k < 4; k++) {
+        r.w[k] = a.w[k - limbs] << bits;
+        if (bits != 0 && k > limbs) {
+            r.w[k] |= a.w[k - limbs - 1] >> (64 - bits);
+        }
+    }
+    return (r);
+}
+
+// a mod m for a non-zero 64-bit modulus.
+uint64_t u256_mod_u64(u256 a, uint64_t m) {
+    unsigned __int128 r = 0;
+    for (int k = 3; k >= 0; k--) {
+        r = ((r << 64) | a.w[k]) % m;
+    }
+    return ((uint64_t)r);
+}
+
+// a / d for a non-zero 64-bit divisor; the remainder goes to *rem if not NULL.
+u256 u256_div_u64(u256 a, uint64_t d, uint64_t *rem) {
+    u256 q;
+    unsigned __int128 r = 0;
+    for (int k = 3; k >= 0; k--) {
+        r = (r << 64) | a.w[k];
+        q.w[k] = (uint64_t)(r / d);
+        r %= d;
+    }
+    if (rem != NULL) {
+        *rem = (uint64_t)r;
+    }
+    return (q);
+}
+
+// a / b for a non-zero b (EVM div); the remainder goes to *rem if not NULL.
+u256 u256_div(u256 a, u256 b, u256 *rem) {
+    u256 q = {{0, 0, 0, 0}};
+    u256 r = {{0, 0, 0, 0}};
+    if (b.w[1] == 0 && b.w[2] == 0 && b.w[3] == 0) {
+        uint64_t r64;
+        q = u256_div_u64(a, b.w[0], &r64);
+        r.w[0] = r64;
+    } else {
+        // shift-subtract, one quotient bit at a time
+        for (int bit = 255; bit >= 0; bit--) {
+            uint64_t carry = r.w[3] >> 63; // r < b, but 2r may not fit when b > 2^255
+            r = u256_shl(r, 1);
+            r.w[0] |= (a.w[bit / 64] >> (bit % 64)) & 1;
+            if (carry || u256_cmp(r, b) >= 0) {
+                r = u256_sub(r, b);
+                q.w[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+    }
+    if (rem != NULL) {
+        *rem = r;
+    }
+    return (q);
+}
+
+// Nearest double, for ratios and reports only.
+double u256_to_double(u256 a) {
+    return ((((double)a.w[3] * 18446744073709551616.0 + (double)a.w[2]) * 18446744073709551616.0 + (double)a.w[1]) *
+                18446744073709551616.0 +
+            (double)a.w[0]);
+}
+
+// Parse a decimal or 0x-prefixed hex uint256; returns -1 on junk or overflow.
+int u256_from_string(const char *s, u256 *out) {
+    u256 r = {{0, 0, 0, 0}};
+    unsigned base = 10;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    if (*s == 0) {
+        return (-1);
+    }
+    for (; *s; s++) {
+        unsigned d;
+        if (*s >= '0' && *s <= '9') {
+            d = *s - '0';
+        } else if (base == 16 && *s >= 'a' && *s <= 'f') {
+            d = *s - 'a' + 10;
+        } else if (base == 16 && *s >= 'A' && *s <= 'F') {
+            d = *s - 'A' + 10;
+        } else {
+            return (-1);
+        }
+        if (u256_mul_checked(r, u256_from_u64(base), &r)) {
+            return (-1);
+        }
+        u256 sum = u256_add(r, u256_from_u64(d));
+        if (u256_cmp(sum, r) < 0) {
+            return (-1);
+        }
+        r = sum;
+    }
+    *out = r;
+    return (0);
+}
+
+// Decimal representation; buf needs 79 bytes.
+char *u256_to_dec(u256 a, char *buf) {
+    char tmp[80];
+    int n = 0;
+    do {
+        uint64_t d;
+        a = u256_div_u64(a, 10, &d);
+        tmp[n++] = '0' + d;
+    } while (!u256_is_zero(a));
+    for (int k = 0; k < n; k++) {
+        buf[k] = tmp[n - 1 - k];
+    }
+    buf[n] = 0;
+    return (buf);
+}
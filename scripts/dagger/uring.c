@@ -0,0 +1,150 @@
+/*
+ * Minimal io_uring wrapper on top of the raw syscalls (no liburing needed).
+ *
+ * Only what the dagger tools use: one ring, READ/WRITE submissions tagged
+ * with a 64-bit user_data, and blocking or non-blocking completion reaping.
+ * uring_init() returns a negative errno when io_uring is unavailable so the
+ * callers can fall back to pread/pwrite.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned to_submit;
+};
+
+int uring_init(struct uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        return (-errno);
+    }
+    r->entries = p.sq_entries;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+        int err = errno;
+        if (r->sqes != MAP_FAILED) {
+            munmap(r->sqes, r->sqes_len);
+        }
+        if (r->cq_ptr != MAP_FAILED) {
+            munmap(r->cq_ptr, r->cq_len);
+        }
+        if (r->sq_ptr != MAP_FAILED) {
+            munmap(r->sq_ptr, r->sq_len);
+        }
+        close(r->fd);
+        return (-err);
+    }
+
+    r->sq_head = (unsigned *)((char *)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    return (0);
+}
+
+void uring_exit(struct uring *r) {
+    munmap(r->sqes, r->sqes_len);
+    munmap(r->cq_ptr, r->cq_len);
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+// Queue a read or write (IORING_OP_READ / IORING_OP_WRITE).  Returns -1 if the
+// submission queue is full; call uring_submit() and retry.
+int uring_queue_rw(struct uring *r, int op, int fd, void *buf, unsigned len, uint64_t off, uint64_t user_data) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail;
+    if (tail - head >= r->entries) {
+        return (-1);
+    }
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return (0);
+}
+
+// Submit everything queued and wait until at least wait_nr completions are available.
+int uring_submit(struct uring *r, unsigned wait_nr) {
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait_nr, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return (-errno);
+    }
+    r->to_submit -= ret < (int)r->to_submit ? ret : r->to_submit;
+    return (ret);
+}
+
+// Take back the most recently queued entry that was not submitted yet.  Returns
+// 1 and fills user_data, or 0 when every queued entry went to the kernel.
+int uring_unqueue(struct uring *r, uint64_t *user_data) {
+    if (r->to_submit == 0) {
+        return (0);
+    }
+    unsigned tail = *r->sq_tail - 1;
+    *user_data = r->sqes[tail & *r->sq_mask].user_data;
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    r->to_submit--;
+    return (1);
+}
+
+// Pop one completion if there is any.  Returns 1 and fills res/user_data, or 0.
+int uring_reap(struct uring *r, int *res, uint64_t *user_data) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        return (0);
+    }
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    *res = cqe->res;
+    *user_data = cqe->user_data;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return (1);
+}